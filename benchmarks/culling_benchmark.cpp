@@ -0,0 +1,194 @@
+// Frustum culling benchmark, compares the original scalar per-entity loop against the packed SIMD path.
+//
+// usage: bench_culling [--entities N] [--iterations K] [--extent E] [--seed S]
+
+#include "camera.hpp"
+#include "common_components.hpp"
+#include "culling.hpp"
+#include "drawing.hpp"
+#include "systems.hpp"
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <entt.hpp>
+#include <optional>
+#include <print>
+#include <random>
+#include <raymath.h>
+#include <span>
+#include <string_view>
+#include <vector>
+
+namespace {
+
+struct BenchmarkConfig {
+    std::uint64_t entities = 100'000u;
+    std::uint64_t iterations = 200u;
+    std::uint64_t extent = 1'000u; // entities are scattered over [-extent, extent] on both axes
+    std::uint64_t seed = 1337u;
+};
+
+auto parse_value(std::string_view arg, std::uint64_t &out) -> bool {
+    const auto [ptr, ec] = std::from_chars(arg.data(), arg.data() + arg.size(), out);
+    return ec == std::errc{} && ptr == arg.data() + arg.size();
+}
+
+auto parse_args(std::span<char *> args) -> std::optional<BenchmarkConfig> {
+    auto config = BenchmarkConfig{};
+
+    for (auto i = 1u; i < args.size(); i++) {
+        const auto arg = std::string_view{args[i]};
+        if (i + 1 >= args.size()) {
+            std::println("Missing value for {}", arg);
+            return std::nullopt;
+        }
+
+        const auto value = std::string_view{args[++i]};
+        const auto ok = arg == "--entities"     ? parse_value(value, config.entities)
+                        : arg == "--iterations" ? parse_value(value, config.iterations)
+                        : arg == "--extent"     ? parse_value(value, config.extent)
+                        : arg == "--seed"       ? parse_value(value, config.seed)
+                                                : false;
+        if (!ok) {
+            std::println("Invalid argument: {} {}", arg, value);
+            return std::nullopt;
+        }
+    }
+
+    return config;
+}
+
+// NOTE: Copy of flag_culled_models before the culling spheres were packed, kept as the reference implementation
+void flag_culled_models_scalar(entt::registry &registry) {
+    const auto models_view =
+        registry.view<stratgame::ModelComponent, stratgame::Transform, stratgame::FrustumCullingComponent>();
+
+    const auto camera_entity = registry.view<stratgame::Camera>().front();
+    const auto &camera = registry.get<stratgame::Camera>(camera_entity);
+    const auto camera_pos = camera.get_source_position();
+    const auto camera_dir = camera.get_camera_dir();
+
+    const auto right_vec = camera.get_right_vec();
+    const auto up_vec = camera.get_up_vec();
+
+    const auto half_fovy = camera.get_fovy() / 2.f;
+    const auto half_fovx = camera.get_fovx() / 2.f;
+
+    const auto tan_half_fovy = std::tan(half_fovy);
+    const auto tan_half_fovx = std::tan(half_fovx);
+    const auto factor_x = 1.f / std::cos(half_fovx);
+    const auto factor_y = 1.f / std::cos(half_fovy);
+
+    for (auto model_entity : models_view) {
+        const auto &[model_component, transform, culling_component] = models_view.get(model_entity);
+
+        model_component.visible = true;
+
+        const auto culling_sphere_center = culling_component.get_sphere_center(transform.position);
+        const auto camera_to_sphere_vec = Vector3Subtract(culling_sphere_center, camera_pos);
+        const auto sz = Vector3DotProduct(camera_dir, camera_to_sphere_vec);
+
+        const auto sy = Vector3DotProduct(up_vec, camera_to_sphere_vec);
+        const auto y_dist = culling_component.radius * factor_y + sz * tan_half_fovy;
+        if (sy > y_dist || sy < -y_dist) {
+            model_component.visible = false;
+            continue;
+        }
+
+        const auto sx = Vector3DotProduct(right_vec, camera_to_sphere_vec);
+        const auto x_dist = culling_component.radius * factor_x + sz * tan_half_fovx;
+        if (sx > x_dist || sx < -x_dist) {
+            model_component.visible = false;
+        }
+    }
+}
+
+auto snapshot_visibility(entt::registry &registry, std::span<const entt::entity> entities) -> std::vector<bool> {
+    auto visible = std::vector<bool>(entities.size());
+    for (auto i = 0u; i < entities.size(); i++) {
+        visible[i] = registry.get<const stratgame::ModelComponent>(entities[i]).visible;
+    }
+    return visible;
+}
+
+template <typename Func> auto time_ms(const std::uint64_t iterations, Func &&func) -> double {
+    const auto start = std::chrono::steady_clock::now();
+    for (auto i = 0u; i < iterations; i++) {
+        func(i);
+    }
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+    return std::chrono::duration<double, std::milli>(elapsed).count() / static_cast<double>(iterations);
+}
+
+} // namespace
+
+auto main(int argc, char **argv) -> int {
+    const auto config = parse_args(std::span{argv, static_cast<std::size_t>(argc)});
+    if (!config) {
+        std::println("usage: {} [--entities N] [--iterations K] [--extent E] [--seed S]", argv[0]);
+        return 1;
+    }
+
+    auto registry = entt::registry{};
+    stratgame::setup_culling(registry);
+
+    auto rng = std::mt19937{static_cast<std::mt19937::result_type>(config->seed)};
+    const auto extent = static_cast<float>(config->extent);
+    auto coordinate = std::uniform_real_distribution<float>{-extent, extent};
+    auto radius = std::uniform_real_distribution<float>{0.5f, 4.f};
+
+    auto entities = std::vector<entt::entity>{};
+    entities.reserve(config->entities);
+    for (auto i = 0u; i < config->entities; i++) {
+        const auto entity = registry.create();
+        registry.emplace<stratgame::ModelComponent>(entity, Model{});
+        registry.emplace<stratgame::Transform>(entity, Vector3{coordinate(rng), 0.f, coordinate(rng)});
+        registry.emplace<stratgame::FrustumCullingComponent>(entity, radius(rng), Vector2{0.f, 0.f});
+        entities.push_back(entity);
+    }
+
+    const auto camera_entity = stratgame::create_camera(registry);
+    auto &camera = registry.get<stratgame::Camera>(camera_entity);
+    camera.zoom = camera.max_zoom;
+    stratgame::update_camera(registry);
+
+    // NOTE: The camera pans every iteration so the packed path has to flip visibility instead of only comparing bytes
+    const auto pan = [&](const std::uint64_t iteration) {
+        const auto angle = static_cast<float>(iteration) * 0.05f;
+        camera.target_position = Vector2{std::cos(angle) * extent * 0.5f, std::sin(angle) * extent * 0.5f};
+        camera.yaw = angle;
+    };
+
+    const auto scalar_ms = time_ms(config->iterations, [&](const std::uint64_t i) {
+        pan(i);
+        flag_culled_models_scalar(registry);
+    });
+    const auto scalar_visibility = snapshot_visibility(registry, entities);
+
+    const auto packed_ms = time_ms(config->iterations, [&](const std::uint64_t i) {
+        pan(i);
+        stratgame::flag_culled_models(registry);
+    });
+    const auto packed_visibility = snapshot_visibility(registry, entities);
+
+    const auto refresh_ms = time_ms(config->iterations, [&](std::uint64_t) {
+        stratgame::update_culling_spheres(registry);
+    });
+
+    auto mismatches = 0u;
+    for (auto i = 0u; i < entities.size(); i++) {
+        mismatches += scalar_visibility[i] != packed_visibility[i] ? 1u : 0u;
+    }
+
+    const auto &stats = registry.ctx().get<const stratgame::CullingSpheres>().stats;
+    std::println("entities: {}, iterations: {}, extent: {}", config->entities, config->iterations, config->extent);
+    std::println("  {:<24} {:>10.4f} ms/iteration", "scalar", scalar_ms);
+    std::println("  {:<24} {:>10.4f} ms/iteration ({:.1f}x)", "packed", packed_ms, scalar_ms / packed_ms);
+    std::println("  {:<24} {:>10.4f} ms/iteration", "update_culling_spheres", refresh_ms);
+    std::println("  visible: {}, culled: {}, regions {} inside / {} outside / {} tested", stats.visible, stats.culled,
+                 stats.regions_inside, stats.regions_outside, stats.regions_tested);
+    std::println("  mismatches against scalar: {}", mismatches);
+
+    return mismatches == 0u ? 0 : 1;
+}
@@ -0,0 +1,267 @@
+// Pathfinding benchmark, compares a plain A* over the whole navigation grid against the hierarchical pathfinder
+// on a map crossed by walls with a single gap each.
+//
+// usage: bench_pathfinding [--cells N] [--queries Q] [--iterations K] [--seed S]
+
+#include "flow_field.hpp"
+#include "height_field.hpp"
+#include "pathfinding.hpp"
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <numbers>
+#include <optional>
+#include <print>
+#include <queue>
+#include <random>
+#include <span>
+#include <string_view>
+#include <vector>
+
+namespace {
+
+constexpr auto chunk_size = 128u;
+constexpr auto chunk_subdivisions = 64u;
+constexpr auto infinity = std::numeric_limits<float>::infinity();
+constexpr auto border = 8.f;
+
+struct BenchmarkConfig {
+    std::uint64_t cells = 512u; // per side, rounded down to whole chunks
+    std::uint64_t queries = 64u;
+    std::uint64_t iterations = 20u;
+    std::uint64_t seed = 1337u;
+};
+
+auto parse_value(std::string_view arg, std::uint64_t &out) -> bool {
+    const auto [ptr, ec] = std::from_chars(arg.data(), arg.data() + arg.size(), out);
+    return ec == std::errc{} && ptr == arg.data() + arg.size();
+}
+
+auto parse_args(std::span<char *> args) -> std::optional<BenchmarkConfig> {
+    auto config = BenchmarkConfig{};
+
+    for (auto i = 1u; i < args.size(); i++) {
+        const auto arg = std::string_view{args[i]};
+        if (i + 1 >= args.size()) {
+            std::println("Missing value for {}", arg);
+            return std::nullopt;
+        }
+
+        const auto value = std::string_view{args[++i]};
+        const auto ok = arg == "--cells"        ? parse_value(value, config.cells)
+                        : arg == "--queries"    ? parse_value(value, config.queries)
+                        : arg == "--iterations" ? parse_value(value, config.iterations)
+                        : arg == "--seed"       ? parse_value(value, config.seed)
+                                                : false;
+        if (!ok) {
+            std::println("Invalid argument: {} {}", arg, value);
+            return std::nullopt;
+        }
+    }
+
+    return config;
+}
+
+// Rolling hills with a wall every quarter of the map, each wall has one gap at a different place.
+// NOTE: The map is walled in too, the pathfinder treats everything past the loaded terrain as open ground
+auto terrain_height(const float x, const float z, const float extent) -> float {
+    const auto hills = 2.f * std::sin(x * 0.05f) * std::cos(z * 0.04f);
+    if (x < border || z < border || x > extent - border || z > extent - border) {
+        return hills + 40.f;
+    }
+    for (auto wall = 1; wall < 4; wall++) {
+        const auto wall_x = extent * static_cast<float>(wall) / 4.f;
+        const auto gap_z = extent * (wall == 2 ? 0.85f : 0.15f);
+        if (std::abs(x - wall_x) < 4.f && std::abs(z - gap_z) > 10.f) {
+            return hills + 40.f;
+        }
+    }
+    return hills;
+}
+
+auto build_height_field(const std::int64_t chunks) -> stratgame::TerrainHeightField {
+    auto height_field = stratgame::TerrainHeightField{chunk_size, chunk_subdivisions};
+    const auto extent = static_cast<float>(chunks * chunk_size);
+    const auto spacing = height_field.get_sample_spacing();
+    const auto side = chunk_subdivisions + 1u;
+
+    for (auto y = std::int64_t{0}; y < chunks; y++) {
+        for (auto x = std::int64_t{0}; x < chunks; x++) {
+            auto samples = std::vector<float>(side * side);
+            for (auto row = 0u; row < side; row++) {
+                for (auto column = 0u; column < side; column++) {
+                    samples[row * side + column] =
+                        terrain_height(static_cast<float>(x * chunk_size) + static_cast<float>(column) * spacing,
+                                       static_cast<float>(y * chunk_size) + static_cast<float>(row) * spacing, extent);
+                }
+            }
+            height_field.set_chunk(x, y, std::move(samples));
+        }
+    }
+    return height_field;
+}
+
+// NOTE: Reference implementation, the same costs and moves as the pathfinder without the cluster graph
+auto grid_path_cost(const std::vector<float> &costs, const std::uint32_t side, const std::uint32_t start,
+                    const std::uint32_t goal) -> float {
+    using QueueEntry = std::pair<float, std::uint32_t>;
+    auto open = std::priority_queue<QueueEntry, std::vector<QueueEntry>, std::greater<>>{};
+    auto best = std::vector<float>(costs.size(), infinity);
+    auto closed = std::vector<bool>(costs.size(), false);
+    const auto heuristic = [&](const std::uint32_t cell) {
+        const auto dx = std::abs(static_cast<float>(cell % side) - static_cast<float>(goal % side));
+        const auto dz = std::abs(static_cast<float>(cell / side) - static_cast<float>(goal / side));
+        return std::max(dx, dz) + (std::numbers::sqrt2_v<float> - 1.f) * std::min(dx, dz);
+    };
+    const auto passable = [&](const std::int64_t column, const std::int64_t row) {
+        return column >= 0 && row >= 0 && column < side && row < side &&
+               costs[static_cast<std::size_t>(row * side + column)] != infinity;
+    };
+
+    best[start] = 0.f;
+    open.emplace(heuristic(start), start);
+    while (!open.empty()) {
+        const auto cell = open.top().second;
+        open.pop();
+        if (cell == goal) {
+            return best[goal];
+        }
+        if (closed[cell]) {
+            continue;
+        }
+        closed[cell] = true;
+
+        const auto column = static_cast<std::int64_t>(cell % side);
+        const auto row = static_cast<std::int64_t>(cell / side);
+        for (auto dz = -1; dz <= 1; dz++) {
+            for (auto dx = -1; dx <= 1; dx++) {
+                if ((dx == 0 && dz == 0) || !passable(column + dx, row + dz) ||
+                    (dx != 0 && dz != 0 && !(passable(column + dx, row) && passable(column, row + dz)))) {
+                    continue;
+                }
+                const auto next = static_cast<std::uint32_t>((row + dz) * side + column + dx);
+                const auto distance = dx != 0 && dz != 0 ? std::numbers::sqrt2_v<float> : 1.f;
+                const auto cost = best[cell] + distance * 0.5f * (costs[cell] + costs[next]);
+                if (cost < best[next]) {
+                    best[next] = cost;
+                    open.emplace(cost + heuristic(next), next);
+                }
+            }
+        }
+    }
+    return infinity;
+}
+
+// Counts path segments that cross an impassable cell, sampled a quarter cell apart
+auto count_blocked_segments(const std::vector<float> &costs, const std::uint32_t side, const float cell_size,
+                            const Vector2 start, const std::vector<Vector2> &waypoints) -> std::uint64_t {
+    auto blocked = std::uint64_t{0};
+    auto from = start;
+    for (const auto to : waypoints) {
+        const auto length = std::hypot(to.x - from.x, to.y - from.y);
+        const auto steps = static_cast<std::uint32_t>(length / (cell_size * 0.25f)) + 1u;
+        for (auto step = 0u; step <= steps; step++) {
+            const auto t = static_cast<float>(step) / static_cast<float>(steps);
+            const auto column = static_cast<std::uint32_t>((from.x + (to.x - from.x) * t) / cell_size);
+            const auto row = static_cast<std::uint32_t>((from.y + (to.y - from.y) * t) / cell_size);
+            if (column < side && row < side && costs[row * side + column] == infinity) {
+                blocked++;
+                break;
+            }
+        }
+        from = to;
+    }
+    return blocked;
+}
+
+template <typename Func> auto time_us(const std::uint64_t iterations, Func &&func) -> double {
+    const auto start = std::chrono::steady_clock::now();
+    for (auto i = 0u; i < iterations; i++) {
+        func(i);
+    }
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+    return std::chrono::duration<double, std::micro>(elapsed).count() / static_cast<double>(iterations);
+}
+
+} // namespace
+
+auto main(int argc, char **argv) -> int {
+    const auto config = parse_args(std::span{argv, static_cast<std::size_t>(argc)});
+    if (!config || config->queries == 0u) {
+        std::println("usage: {} [--cells N] [--queries Q] [--iterations K] [--seed S]", argv[0]);
+        return 1;
+    }
+
+    const auto settings = stratgame::PathfinderSettings{};
+    const auto cells_per_chunk = static_cast<std::uint64_t>(static_cast<float>(chunk_size) / settings.cell_size);
+    const auto chunks = static_cast<std::int64_t>(std::max<std::uint64_t>(config->cells / cells_per_chunk, 2u));
+    const auto side = static_cast<std::uint32_t>(static_cast<std::uint64_t>(chunks) * cells_per_chunk);
+    const auto extent = static_cast<float>(side) * settings.cell_size;
+    const auto height_field = build_height_field(chunks);
+    const auto costs = stratgame::compute_navigation_costs(&height_field, settings.cell_size, settings.max_slope,
+                                                           settings.slope_cost, Vector2{0.f, 0.f}, side, side);
+
+    // Queries cross the map from the left edge to the right edge
+    auto rng = std::mt19937{static_cast<std::mt19937::result_type>(config->seed)};
+    auto edge = std::uniform_real_distribution<float>{2.f * border, extent * 0.1f};
+    auto along = std::uniform_real_distribution<float>{2.f * border, extent - 2.f * border};
+    const auto random_passable = [&](const bool left) {
+        while (true) {
+            const auto position = Vector2{left ? edge(rng) : extent - edge(rng), along(rng)};
+            const auto cell = static_cast<std::uint32_t>(position.y / settings.cell_size) * side +
+                              static_cast<std::uint32_t>(position.x / settings.cell_size);
+            if (costs[cell] != infinity) {
+                return position;
+            }
+        }
+    };
+    auto starts = std::vector<Vector2>{};
+    auto goals = std::vector<Vector2>{};
+    for (auto i = 0u; i < config->queries; i++) {
+        starts.push_back(random_passable(true));
+        goals.push_back(random_passable(false));
+    }
+
+    const auto to_cell = [&](const Vector2 position) {
+        return static_cast<std::uint32_t>(position.y / settings.cell_size) * side +
+               static_cast<std::uint32_t>(position.x / settings.cell_size);
+    };
+    auto unreachable = std::uint64_t{0};
+    const auto grid_us = time_us(config->queries, [&](const std::uint64_t i) {
+        unreachable += grid_path_cost(costs, side, to_cell(starts[i]), to_cell(goals[i])) == infinity ? 1u : 0u;
+    });
+
+    auto pathfinder = stratgame::HierarchicalPathfinder{settings};
+    auto failed = std::uint64_t{0};
+    auto blocked = std::uint64_t{0};
+    const auto cold_us = time_us(config->queries, [&](const std::uint64_t i) {
+        const auto path = pathfinder.find_path(&height_field, starts[i], goals[i]);
+        failed += path ? 0u : 1u;
+        blocked += path ? count_blocked_segments(costs, side, settings.cell_size, starts[i], *path) : 0u;
+    });
+    const auto cold_stats = pathfinder.get_stats();
+
+    // NOTE: Every warm query repeats a cluster pair of the cold pass, only the legs inside the end clusters are new
+    auto jitter = std::uniform_real_distribution<float>{-8.f, 8.f};
+    const auto warm_us = time_us(config->queries * config->iterations, [&](const std::uint64_t i) {
+        const auto query = i % config->queries;
+        const auto y = std::clamp(starts[query].y + jitter(rng), 2.f * border, extent - 2.f * border);
+        const auto start = Vector2{starts[query].x, y};
+        const auto path = pathfinder.find_path(&height_field, start, goals[query]);
+        failed += path ? 0u : 1u;
+    });
+    const auto warm_stats = pathfinder.get_stats();
+
+    std::println("map: {}x{} cells, {} queries, {} warm iterations", side, side, config->queries, config->iterations);
+    std::println("grid A*:        {:.1f} us/query", grid_us);
+    std::println("hierarchical:   {:.1f} us/query cold ({} clusters built)", cold_us, cold_stats.rebuilt);
+    std::println("hierarchical:   {:.1f} us/query warm ({} cache hits, {} misses)", warm_us,
+                 warm_stats.cache_hits - cold_stats.cache_hits, warm_stats.cache_misses - cold_stats.cache_misses);
+    std::println("speedup (warm): {:.1f}x", grid_us / warm_us);
+    std::println("failed: {} (grid A* unreachable: {}), segments through impassable cells: {}", failed, unreachable,
+                 blocked);
+    return failed == 0u && blocked == 0u ? 0 : 1;
+}
@@ -0,0 +1,373 @@
+// Core systems benchmark, times the per frame systems over synthetic registries from 1k entities up to --max-entities
+// in steps of 10x. Reports the cost per entity and the heap allocations per iteration, --json writes the same results
+// as a JSON array so runs can be compared by scripts.
+//
+// usage: bench_systems [--max-entities N] [--iterations K] [--seed S] [--json FILE]
+
+#include "camera.hpp"
+#include "common_components.hpp"
+#include "culling.hpp"
+#include "height_field.hpp"
+#include "instancing.hpp"
+#include "minion.hpp"
+#include "simulation.hpp"
+#include "spatial_grid.hpp"
+#include "systems.hpp"
+#include "tasks.hpp"
+#include "terrain.hpp"
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <entt.hpp>
+#include <format>
+#include <fstream>
+#include <new>
+#include <optional>
+#include <print>
+#include <random>
+#include <raymath.h>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// ===================================
+// allocation counting
+// ===================================
+namespace {
+auto allocation_count = std::atomic<std::uint64_t>{0u};
+auto allocated_bytes = std::atomic<std::uint64_t>{0u};
+
+auto counted_alloc(const std::size_t size, const std::size_t alignment) -> void * {
+    allocation_count.fetch_add(1u, std::memory_order_relaxed);
+    allocated_bytes.fetch_add(size, std::memory_order_relaxed);
+    const auto rounded = std::max<std::size_t>((size + alignment - 1u) / alignment * alignment, alignment);
+#ifdef _MSC_VER
+    auto *memory = _aligned_malloc(rounded, alignment);
+#else
+    auto *memory = std::aligned_alloc(alignment, rounded);
+#endif
+    if (memory == nullptr) {
+        throw std::bad_alloc{};
+    }
+    return memory;
+}
+
+void counted_free(void *memory) {
+#ifdef _MSC_VER
+    _aligned_free(memory);
+#else
+    std::free(memory);
+#endif
+}
+} // namespace
+
+// NOTE: Only operator new is counted, raylib's MemAlloc goes straight to malloc
+auto operator new(std::size_t size) -> void * { return counted_alloc(size, __STDCPP_DEFAULT_NEW_ALIGNMENT__); }
+auto operator new(std::size_t size, std::align_val_t alignment) -> void * {
+    return counted_alloc(size, static_cast<std::size_t>(alignment));
+}
+void operator delete(void *memory) noexcept { counted_free(memory); }
+void operator delete(void *memory, std::size_t) noexcept { counted_free(memory); }
+void operator delete(void *memory, std::align_val_t) noexcept { counted_free(memory); }
+void operator delete(void *memory, std::size_t, std::align_val_t) noexcept { counted_free(memory); }
+
+namespace {
+
+constexpr auto min_entities = std::uint64_t{1'000u};
+constexpr auto chunk_size = 128u;
+constexpr auto chunk_subdivisions = 64u;
+constexpr auto vertices_per_chunk = std::uint64_t{(chunk_subdivisions + 1u) * (chunk_subdivisions + 1u)};
+constexpr auto rays_per_iteration = 256u;
+constexpr auto max_pick_distance = 1000.f;
+
+struct BenchmarkConfig {
+    std::uint64_t max_entities = 1'000'000u;
+    std::uint64_t iterations = 20u;
+    std::uint64_t seed = 1337u;
+    std::string json; // written when set
+};
+
+auto parse_value(std::string_view arg, std::uint64_t &out) -> bool {
+    const auto [ptr, ec] = std::from_chars(arg.data(), arg.data() + arg.size(), out);
+    return ec == std::errc{} && ptr == arg.data() + arg.size();
+}
+
+auto parse_args(std::span<char *> args) -> std::optional<BenchmarkConfig> {
+    auto config = BenchmarkConfig{};
+
+    for (auto i = 1u; i < args.size(); i++) {
+        const auto arg = std::string_view{args[i]};
+        if (i + 1 >= args.size()) {
+            std::println("Missing value for {}", arg);
+            return std::nullopt;
+        }
+
+        const auto value = std::string_view{args[++i]};
+        if (arg == "--json") {
+            config.json = value;
+            continue;
+        }
+        const auto ok = arg == "--max-entities" ? parse_value(value, config.max_entities)
+                        : arg == "--iterations" ? parse_value(value, config.iterations)
+                        : arg == "--seed"       ? parse_value(value, config.seed)
+                                                : false;
+        if (!ok) {
+            std::println("Invalid argument: {} {}", arg, value);
+            return std::nullopt;
+        }
+    }
+
+    return config;
+}
+
+struct Measurement {
+    double nanoseconds = 0.; // per iteration
+    double allocations = 0.; // per iteration
+    double bytes = 0.;       // allocated per iteration
+};
+
+struct BenchmarkResult {
+    std::string_view name;
+    std::uint64_t entities; // size of the synthetic registry
+    std::uint64_t items;    // what the time is divided by, see unit
+    std::string_view unit;
+    std::uint64_t iterations;
+    Measurement measurement;
+
+    [[nodiscard]] auto get_ns_per_item() const -> double {
+        return measurement.nanoseconds / static_cast<double>(std::max<std::uint64_t>(items, 1u));
+    }
+};
+
+// NOTE: One untimed iteration first, so scratch buffers growing to their steady size do not count as allocations
+template <typename Func> auto measure(const std::uint64_t iterations, Func &&func) -> Measurement {
+    func(0u);
+
+    const auto allocations_before = allocation_count.load(std::memory_order_relaxed);
+    const auto bytes_before = allocated_bytes.load(std::memory_order_relaxed);
+    const auto start = std::chrono::steady_clock::now();
+    for (auto i = 1u; i <= iterations; i++) {
+        func(i);
+    }
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+    const auto allocations = allocation_count.load(std::memory_order_relaxed) - allocations_before;
+    const auto bytes = allocated_bytes.load(std::memory_order_relaxed) - bytes_before;
+
+    const auto count = static_cast<double>(iterations);
+    return Measurement{.nanoseconds = std::chrono::duration<double, std::nano>(elapsed).count() / count,
+                       .allocations = static_cast<double>(allocations) / count,
+                       .bytes = static_cast<double>(bytes) / count};
+}
+
+// Ray from an RTS camera angle down to a point on the ground, like a mouse pick
+auto pick_ray(const float x, const float z) -> Ray {
+    const auto origin = Vector3{x - 60.f, 80.f, z - 60.f};
+    return Ray{origin, Vector3Normalize(Vector3Subtract(Vector3{x, 0.f, z}, origin))};
+}
+
+// Minions walking somewhere far away, every one with a culling sphere and an instance of one shared model
+void run_entity_benchmarks(const BenchmarkConfig &config, const std::uint64_t entities,
+                           std::vector<BenchmarkResult> &results) {
+    auto registry = entt::registry{};
+    stratgame::setup_simulation(registry);
+    stratgame::setup_instancing(registry);
+
+    const auto model_entity = registry.create();
+    registry.emplace<stratgame::InstanceableModel>(model_entity, 0, Model{});
+
+    // NOTE: The map grows with the registry so the density, and with it the grid and culling work, stays the same
+    const auto extent = 2.f * std::sqrt(static_cast<float>(entities));
+    auto rng = std::mt19937{static_cast<std::mt19937::result_type>(config.seed)};
+    auto coordinate = std::uniform_real_distribution<float>{-extent, extent};
+    for (auto i = 0u; i < entities; i++) {
+        const auto minion = stratgame::create_minion(registry, {coordinate(rng), coordinate(rng)}, 0);
+        registry.emplace<stratgame::FrustumCullingComponent>(minion, 1.f, Vector2{0.f, 0.f});
+        registry.emplace<stratgame::ModelInstance>(minion, model_entity);
+        stratgame::add_task(registry, minion,
+                            stratgame::WalkToTask{.target = {coordinate(rng), coordinate(rng)}, .speed = 5.f});
+    }
+
+    const auto camera_entity = stratgame::create_camera(registry);
+    auto &camera = registry.get<stratgame::Camera>(camera_entity);
+    camera.zoom = camera.max_zoom;
+    stratgame::update_camera(registry);
+
+    const auto add_result = [&](const std::string_view name, const std::uint64_t items, const std::string_view unit,
+                                const Measurement &measurement) {
+        results.push_back(BenchmarkResult{.name = name,
+                                          .entities = entities,
+                                          .items = items,
+                                          .unit = unit,
+                                          .iterations = config.iterations,
+                                          .measurement = measurement});
+    };
+
+    // NOTE: Positions never change between iterations, so every task keeps walking and does the same work each time
+    add_result("update_tasks", entities, "entity",
+               measure(config.iterations, [&](std::uint64_t) { stratgame::update_tasks(registry); }));
+    add_result("update_transform", entities, "entity",
+               measure(config.iterations, [&](std::uint64_t) { stratgame::update_transform(registry); }));
+
+    // The camera pans every iteration like in bench_culling, visibility flips instead of staying the same
+    const auto pan = [&](const std::uint64_t iteration) {
+        const auto angle = static_cast<float>(iteration) * 0.05f;
+        camera.target_position = Vector2{std::cos(angle) * extent * 0.5f, std::sin(angle) * extent * 0.5f};
+        camera.yaw = angle;
+    };
+    add_result("flag_culled_models", entities, "entity", measure(config.iterations, [&](const std::uint64_t i) {
+                   pan(i);
+                   stratgame::flag_culled_models(registry);
+               }));
+
+    // The CPU side of draw_models_instanced, what is left of the last culling pass is compacted every iteration
+    auto &model = registry.get<stratgame::InstanceableModel>(model_entity);
+    add_result("gather_instances", entities, "entity", measure(config.iterations, [&](std::uint64_t) {
+                   stratgame::update_model_instances(registry);
+                   static_cast<void>(stratgame::gather_visible_instances(model));
+               }));
+
+    auto rays = std::vector<Ray>{};
+    for (auto i = 0u; i < rays_per_iteration; i++) {
+        rays.push_back(pick_ray(coordinate(rng), coordinate(rng)));
+    }
+    const auto &grid = registry.ctx().get<const stratgame::SpatialGrid>();
+    add_result("raycast_spatial_grid", rays.size(), "ray", measure(config.iterations, [&](std::uint64_t) {
+                   for (const auto &ray : rays) {
+                       static_cast<void>(grid.raycast(ray, max_pick_distance));
+                   }
+               }));
+}
+
+// Terrain chunks with about as many vertices as the registries have entities
+void run_terrain_benchmarks(const BenchmarkConfig &config, const std::uint64_t entities,
+                            std::vector<BenchmarkResult> &results) {
+    const auto side = std::max<std::int64_t>(
+        static_cast<std::int64_t>(std::sqrt(static_cast<double>(entities) / vertices_per_chunk)), 1);
+    const auto chunks = static_cast<std::uint64_t>(side * side);
+    const auto vertices = chunks * vertices_per_chunk;
+    const auto generator =
+        stratgame::TerrainGenerator(stratgame::NoiseParameters{}, chunk_subdivisions, chunk_size, Shader{});
+
+    const auto add_result = [&](const std::string_view name, const std::uint64_t items, const std::string_view unit,
+                                const Measurement &measurement) {
+        results.push_back(BenchmarkResult{.name = name,
+                                          .entities = entities,
+                                          .items = items,
+                                          .unit = unit,
+                                          .iterations = config.iterations,
+                                          .measurement = measurement});
+    };
+
+    auto heights = std::vector<std::vector<float>>(chunks);
+    add_result("generate_chunk_heights", vertices, "vertex", measure(config.iterations, [&](std::uint64_t) {
+                   for (auto i = 0u; i < chunks; i++) {
+                       heights[i] = generator.generate_chunk_heights(static_cast<std::int64_t>(i) % side,
+                                                                     static_cast<std::int64_t>(i) / side);
+                   }
+               }));
+
+    auto height_field = stratgame::TerrainHeightField{chunk_size, chunk_subdivisions};
+    for (auto i = 0u; i < chunks; i++) {
+        height_field.set_chunk(static_cast<std::int64_t>(i) % side, static_cast<std::int64_t>(i) / side,
+                               std::move(heights[i]));
+    }
+
+    const auto world = static_cast<float>(side * chunk_size);
+    auto rng = std::mt19937{static_cast<std::mt19937::result_type>(config.seed)};
+    auto coordinate = std::uniform_real_distribution<float>{0.f, world};
+    auto rays = std::vector<Ray>{};
+    for (auto i = 0u; i < rays_per_iteration; i++) {
+        rays.push_back(pick_ray(coordinate(rng), coordinate(rng)));
+    }
+    add_result("raycast_height_field", rays.size(), "ray", measure(config.iterations, [&](std::uint64_t) {
+                   for (const auto &ray : rays) {
+                       static_cast<void>(height_field.raycast(ray, max_pick_distance));
+                   }
+               }));
+
+    // One ground lookup per entity, the batch update_transform snaps moving units with
+    auto xs = std::vector<float>(entities);
+    auto zs = std::vector<float>(entities);
+    for (auto i = 0u; i < entities; i++) {
+        xs[i] = coordinate(rng);
+        zs[i] = coordinate(rng);
+    }
+    auto ground = std::vector<float>(entities);
+    add_result("ground_heights", entities, "entity", measure(config.iterations, [&](std::uint64_t) {
+                   height_field.get_heights(xs, zs, ground);
+               }));
+
+    // Zoomed out over the middle of the map, the quadtree of every chunk is walked like draw_terrain does
+    auto camera_registry = entt::registry{};
+    auto &camera = camera_registry.get<stratgame::Camera>(stratgame::create_camera(camera_registry));
+    camera.target_position = Vector2{world * 0.5f, world * 0.5f};
+    camera.zoom = camera.max_zoom;
+    stratgame::update_camera(camera_registry);
+    const auto frustum = stratgame::make_culling_frustum(camera);
+    const auto camera_position = camera.get_source_position();
+    auto nodes = std::vector<stratgame::TerrainNode>{};
+    add_result("select_terrain_nodes", chunks, "chunk", measure(config.iterations, [&](std::uint64_t) {
+                   nodes.clear();
+                   for (auto i = 0u; i < chunks; i++) {
+                       generator.get_lod().select(generator.get_chunk_transform(static_cast<std::int64_t>(i) % side,
+                                                                                 static_cast<std::int64_t>(i) / side),
+                                                  camera_position, frustum, nodes);
+                   }
+               }));
+}
+
+auto write_json(const std::string &path, std::span<const BenchmarkResult> results) -> bool {
+    auto file = std::ofstream{path};
+    if (!file) {
+        return false;
+    }
+
+    file << "[\n";
+    for (auto i = 0u; i < results.size(); i++) {
+        const auto &result = results[i];
+        file << std::format(R"(  {{"name":"{}","entities":{},"items":{},"unit":"{}","iterations":{},)", result.name,
+                            result.entities, result.items, result.unit, result.iterations)
+             << std::format(R"("ns_per_iteration":{:.1f},"ns_per_item":{:.3f},)", result.measurement.nanoseconds,
+                            result.get_ns_per_item())
+             << std::format(R"("allocations_per_iteration":{:.2f},"bytes_per_iteration":{:.0f}}})",
+                            result.measurement.allocations, result.measurement.bytes)
+             << (i + 1u < results.size() ? ",\n" : "\n");
+    }
+    file << "]\n";
+    return static_cast<bool>(file);
+}
+
+} // namespace
+
+auto main(int argc, char **argv) -> int {
+    const auto config = parse_args(std::span{argv, static_cast<std::size_t>(argc)});
+    if (!config || config->iterations == 0u || config->max_entities < min_entities) {
+        std::println("usage: {} [--max-entities N] [--iterations K] [--seed S] [--json FILE]", argv[0]);
+        return 1;
+    }
+
+    auto results = std::vector<BenchmarkResult>{};
+    for (auto entities = min_entities; entities <= config->max_entities; entities *= 10u) {
+        run_entity_benchmarks(*config, entities, results);
+        run_terrain_benchmarks(*config, entities, results);
+    }
+
+    std::println("{:<24} {:>9} {:>9} {:>14} {:>14} {:>12} {:>14}", "benchmark", "entities", "items", "us/iteration",
+                 "ns/item", "allocs/iter", "bytes/iter");
+    for (const auto &result : results) {
+        std::println("{:<24} {:>9} {:>9} {:>14.1f} {:>8.3f} {:<5} {:>12.2f} {:>14.0f}", result.name, result.entities,
+                     result.items, result.measurement.nanoseconds * 1e-3, result.get_ns_per_item(), result.unit,
+                     result.measurement.allocations, result.measurement.bytes);
+    }
+
+    if (!config->json.empty() && !write_json(config->json, results)) {
+        std::println("Could not write {}", config->json);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,12 @@
+#version 330
+
+in vec3 fragNormal;
+in vec4 fragColor;
+
+out vec4 finalColor;
+
+void main() {
+    vec3 lightDir = normalize(vec3(0.3, 1.0, 0.2));
+    float brightness = 0.4 + 0.6 * max(dot(normalize(fragNormal), lightDir), 0.0);
+    finalColor = vec4(fragColor.rgb * brightness, 1.0);
+}
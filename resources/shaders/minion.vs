@@ -0,0 +1,25 @@
+#version 330
+
+// Input vertex attributes
+in vec3 vertexPosition;
+in vec3 vertexNormal;
+
+// Per instance attributes
+in mat4 instanceTransform;
+in vec4 instanceColor;
+
+// Input uniform values
+uniform mat4 mvp;
+
+// Output vertex attributes (to fragment shader)
+out vec3 fragNormal;
+out vec4 fragColor;
+
+void main()
+{
+    // NOTE: Instances are only translated, so the normal needs no normal matrix
+    fragNormal = vertexNormal;
+    fragColor = instanceColor;
+
+    gl_Position = mvp*instanceTransform*vec4(vertexPosition, 1.0);
+}
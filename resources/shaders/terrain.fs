@@ -6,6 +6,7 @@ out vec4 fragColor;
 
 uniform float yellow_threshold;
 uniform float white_threshold;
+uniform vec4 colDiffuse; // the draw tint, wireframes are drawn with the same shader
 
 void main()
 {
@@ -21,6 +22,6 @@ void main()
         color = vec3(1.0, 1.0, 1.0); // White for higher heights
     }
 
-    fragColor = vec4(color, 1.0);
+    fragColor = vec4(color, 1.0)*colDiffuse;
 }
 
@@ -11,13 +11,39 @@ uniform mat4 mvp;
 uniform mat4 matModel;
 uniform mat4 matNormal;
 
+// Chunk heights, one texel per vertex of the full resolution chunk grid
+uniform sampler2D texture0;
+
+// The node being drawn. The grid is shared by every node and flat, vertexPosition.xz is the vertex in node grid
+// coordinates and matModel moves the chunk into place.
+uniform vec2 node_origin;     // texel of the node grid origin
+uniform float node_stride;    // texels per node grid quad
+uniform vec2 morph_range;     // camera distances at which the node starts and finishes morphing into its parent level
+uniform vec3 camera_position;
+uniform float vertex_spacing; // world units between texels
+
 out float fragHeight;
 
-// NOTE: Add here your custom variables
+float height_at(vec2 grid)
+{
+    return texelFetch(texture0, ivec2(node_origin + grid*node_stride), 0).r;
+}
 
 void main()
 {
-    fragHeight = vertexPosition.y;
+    vec2 grid = vertexPosition.xz;
+    vec2 texel = node_origin + grid*node_stride;
+    float height = height_at(grid);
+    vec3 world = (matModel*vec4(texel.x*vertex_spacing, height, texel.y*vertex_spacing, 1.0)).xyz;
+
+    // Odd vertices do not exist in the parent level, its surface runs straight between the even neighbours on either
+    // side of them, diagonally for vertices odd in both directions as the triangles are split that way
+    vec2 odd = mod(grid, 2.0);
+    float parent_height = 0.5*(height_at(grid - odd) + height_at(grid + odd));
+    float morph = clamp((distance(world, camera_position) - morph_range.x)/(morph_range.y - morph_range.x), 0.0, 1.0);
+    height = mix(height, parent_height, morph);
+
+    fragHeight = height;
     // Calculate final vertex position
-    gl_Position = mvp*vec4(vertexPosition, 1.0);
+    gl_Position = mvp*vec4(texel.x*vertex_spacing, height, texel.y*vertex_spacing, 1.0);
 }
@@ -0,0 +1,225 @@
+#include "asset_manager.hpp"
+#include "assets_loader.hpp"
+#include "log.hpp"
+#include "thread_pool.hpp"
+#include <rlgl.h>
+
+namespace stratgame {
+
+static void unload_asset(const Texture2D &texture) { UnloadTexture(texture); }
+static void unload_asset(const Shader &shader) { UnloadShader(shader); }
+static void unload_asset(const Model &model) { UnloadModel(model); }
+
+// ===================================
+// AssetStore
+// ===================================
+template <typename T> auto AssetStore::allocate(const std::string &key) -> std::uint32_t {
+    auto &storage = get_storage<T>();
+    auto slot = static_cast<std::uint32_t>(storage.slots.size());
+    if (storage.free_slots.empty()) {
+        storage.slots.emplace_back();
+    } else {
+        slot = storage.free_slots.back();
+        storage.free_slots.pop_back();
+    }
+
+    storage.slots[slot].key = key;
+    storage.lookup.emplace(key, slot);
+    in_flight++;
+    return slot;
+}
+
+template <typename T> void AssetStore::free_slot(const std::uint32_t slot) {
+    auto &storage = get_storage<T>();
+    auto &asset_slot = storage.slots[slot];
+    if (asset_slot.state == AssetState::Ready && !unloaded) {
+        unload_asset(asset_slot.asset);
+    }
+
+    storage.lookup.erase(asset_slot.key);
+    asset_slot = Slot<T>{};
+    storage.free_slots.push_back(slot);
+}
+
+template <typename T> void AssetStore::release(const std::uint32_t slot) {
+    auto &asset_slot = get_storage<T>().slots[slot];
+    asset_slot.references--;
+    // NOTE: A load still in flight frees its slot once it finishes
+    if (asset_slot.references == 0u && asset_slot.state != AssetState::Loading) {
+        free_slot<T>(slot);
+    }
+}
+
+template <typename T> void AssetStore::finish(const std::uint32_t slot, Expected<T> result) {
+    auto &asset_slot = get_storage<T>().slots[slot];
+    in_flight--;
+
+    if (result) {
+        asset_slot.asset = *result;
+        asset_slot.state = AssetState::Ready;
+    } else {
+        log_error("Failed to load {}: {}", asset_slot.key, result.error());
+        asset_slot.error = std::move(result.error());
+        asset_slot.state = AssetState::Failed;
+    }
+
+    if (asset_slot.references == 0u) {
+        free_slot<T>(slot);
+    }
+}
+
+void AssetStore::complete(std::function<void()> upload) {
+    {
+        const auto lock = std::scoped_lock{completions_mutex};
+        completions.push_back(std::move(upload));
+    }
+    completed.notify_one();
+}
+
+auto AssetStore::run_completions() -> std::size_t {
+    auto uploads = std::vector<std::function<void()>>{};
+    {
+        const auto lock = std::scoped_lock{completions_mutex};
+        uploads.swap(completions);
+    }
+
+    for (const auto &upload : uploads) {
+        upload();
+    }
+    return uploads.size();
+}
+
+void AssetStore::make_progress() {
+    if (run_completions() > 0u || pool.run_pending_task()) {
+        return;
+    }
+
+    // NOTE: Every queue is empty, so the loads still in flight are running on workers right now
+    auto lock = std::unique_lock{completions_mutex};
+    completed.wait(lock, [&] { return !completions.empty(); });
+}
+
+void AssetStore::wait_idle() {
+    while (in_flight > 0u) {
+        make_progress();
+    }
+}
+
+void AssetStore::unload_all() {
+    wait_idle();
+
+    const auto unload_storage = [](auto &storage) {
+        for (const auto &asset_slot : storage.slots) {
+            if (asset_slot.state == AssetState::Ready) {
+                unload_asset(asset_slot.asset);
+            }
+        }
+    };
+    unload_storage(textures);
+    unload_storage(shaders);
+    unload_storage(models);
+    unloaded = true;
+}
+
+template void AssetStore::release<Texture2D>(std::uint32_t slot);
+template void AssetStore::release<Shader>(std::uint32_t slot);
+template void AssetStore::release<Model>(std::uint32_t slot);
+
+// ===================================
+// AssetManager
+// ===================================
+template <typename T, typename Decode, typename Upload>
+auto AssetManager::load(const std::string &key, Decode decode, Upload upload) -> AssetHandle<T> {
+    auto &storage = store->get_storage<T>();
+    if (const auto found = storage.lookup.find(key); found != storage.lookup.end()) {
+        return AssetHandle<T>{store, found->second};
+    }
+
+    const auto slot = store->allocate<T>(key);
+    auto handle = AssetHandle<T>{store, slot};
+    pool.execute([store = store, slot, decode = std::move(decode), upload = std::move(upload)] {
+        auto decoded = decode();
+        // NOTE: The upload is run by the store itself, a raw pointer avoids the store owning itself until then
+        store->complete([store = store.get(), slot, decoded = std::move(decoded), upload] {
+            store->finish<T>(slot, decoded ? upload(*decoded) : std::unexpected(decoded.error()));
+        });
+    });
+    return handle;
+}
+
+auto AssetManager::load_texture(const std::filesystem::path &path) -> AssetHandle<Texture2D> {
+    const auto decode = [path]() -> Expected<Image> {
+        const auto full_path = get_asset_path(path);
+        if (!full_path) {
+            return std::unexpected(full_path.error());
+        }
+        const auto image = LoadImage(full_path->string().c_str());
+        if (image.data == nullptr) {
+            return std::unexpected(std::string{"Could not decode image: "} + full_path->string());
+        }
+        return image;
+    };
+    const auto upload = [](const Image &image) -> Expected<Texture2D> {
+        const auto texture = LoadTextureFromImage(image);
+        UnloadImage(image);
+        if (texture.id == 0u) {
+            return std::unexpected(std::string{"Could not upload texture"});
+        }
+        return texture;
+    };
+    return load<Texture2D>(path.lexically_normal().string(), decode, upload);
+}
+
+[[nodiscard]] static auto read_text(const std::filesystem::path &path) -> Expected<std::string> {
+    const auto full_path = get_asset_path(path);
+    if (!full_path) {
+        return std::unexpected(full_path.error());
+    }
+    auto *text = LoadFileText(full_path->string().c_str());
+    if (text == nullptr) {
+        return std::unexpected(std::string{"Could not read file: "} + full_path->string());
+    }
+    auto result = std::string{text};
+    UnloadFileText(text);
+    return result;
+}
+
+auto AssetManager::load_shader(const std::filesystem::path &vertex_path, const std::filesystem::path &fragment_path)
+    -> AssetHandle<Shader> {
+    using Sources = std::pair<std::string, std::string>;
+    const auto decode = [vertex_path, fragment_path]() -> Expected<Sources> {
+        auto vertex = read_text(vertex_path);
+        if (!vertex) {
+            return std::unexpected(vertex.error());
+        }
+        auto fragment = read_text(fragment_path);
+        if (!fragment) {
+            return std::unexpected(fragment.error());
+        }
+        return Sources{std::move(*vertex), std::move(*fragment)};
+    };
+    const auto upload = [](const Sources &sources) -> Expected<Shader> {
+        const auto shader = LoadShaderFromMemory(sources.first.c_str(), sources.second.c_str());
+        // NOTE: raylib falls back to its default shader when compiling or linking fails
+        if (shader.id == rlGetShaderIdDefault()) {
+            return std::unexpected(std::string{"Could not compile shader"});
+        }
+        return shader;
+    };
+    return load<Shader>(vertex_path.lexically_normal().string() + '|' + fragment_path.lexically_normal().string(),
+                        decode, upload);
+}
+
+auto AssetManager::load_model(const std::filesystem::path &path) -> AssetHandle<Model> {
+    const auto decode = [path] { return get_asset_path(path); };
+    const auto upload = [](const std::filesystem::path &full_path) -> Expected<Model> {
+        const auto model = LoadModel(full_path.string().c_str());
+        if (model.meshCount == 0) {
+            return std::unexpected(std::string{"Could not load model: "} + full_path.string());
+        }
+        return model;
+    };
+    return load<Model>(path.lexically_normal().string(), decode, upload);
+}
+
+} // namespace stratgame
@@ -0,0 +1,168 @@
+#pragma once
+#include "error.hpp"
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <raylib.h>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace stratgame {
+class ThreadPool;
+
+enum class AssetState : std::uint8_t { Loading, Ready, Failed };
+
+// Every asset of an AssetManager with its reference count. Shared with the handles, so a handle outliving the manager
+// only drops its reference. Everything but the completion queue belongs to the main thread.
+class AssetStore {
+  public:
+    template <typename T> struct Slot {
+        std::string key;
+        T asset{};
+        AssetState state = AssetState::Loading;
+        Error error;
+        std::uint32_t references = 0u;
+    };
+
+    template <typename T> struct Storage {
+        std::vector<Slot<T>> slots;
+        std::vector<std::uint32_t> free_slots;
+        std::unordered_map<std::string, std::uint32_t> lookup; // key to slot, kept until the slot is freed
+    };
+
+    explicit AssetStore(ThreadPool &pool) : pool{pool} {}
+
+    template <typename T> [[nodiscard]] auto get_storage() -> Storage<T> & {
+        if constexpr (std::is_same_v<T, Texture2D>) {
+            return textures;
+        } else if constexpr (std::is_same_v<T, Shader>) {
+            return shaders;
+        } else {
+            static_assert(std::is_same_v<T, Model>, "No storage for this asset type");
+            return models;
+        }
+    }
+    template <typename T> [[nodiscard]] auto allocate(const std::string &key) -> std::uint32_t;
+    template <typename T> void release(std::uint32_t slot);
+    // Stores the result of a load, frees the slot right away when every handle was dropped in the meantime
+    template <typename T> void finish(std::uint32_t slot, Expected<T> result);
+
+    // Called by the workers, the upload step is run on the main thread by run_completions
+    void complete(std::function<void()> upload);
+    auto run_completions() -> std::size_t;
+    // Runs uploads and helps the pool until no load is in flight any more
+    void wait_idle();
+    // Runs uploads and helps the pool, blocks when there is nothing to do but wait for a worker
+    void make_progress();
+
+    // Unloads everything, handles dropped afterwards only release their slot
+    void unload_all();
+
+  private:
+    template <typename T> void free_slot(std::uint32_t slot);
+
+    ThreadPool &pool;
+    Storage<Texture2D> textures;
+    Storage<Shader> shaders;
+    Storage<Model> models;
+    std::size_t in_flight = 0u; // loads whose result has not been stored yet
+    bool unloaded = false;
+
+    std::mutex completions_mutex;
+    std::condition_variable completed;
+    std::vector<std::function<void()>> completions;
+};
+
+// Refcounted reference to an asset of an AssetManager, the asset is unloaded once its last handle is dropped.
+// Handles are copied, waited on and dropped on the main thread only.
+template <typename T> class AssetHandle {
+  public:
+    AssetHandle() = default;
+    AssetHandle(std::shared_ptr<AssetStore> store, const std::uint32_t slot) : store{std::move(store)}, slot{slot} {
+        this->store->get_storage<T>().slots[slot].references++;
+    }
+    AssetHandle(const AssetHandle &other) : store{other.store}, slot{other.slot} {
+        if (store) {
+            store->get_storage<T>().slots[slot].references++;
+        }
+    }
+    AssetHandle(AssetHandle &&other) noexcept : store{std::move(other.store)}, slot{other.slot} {}
+    auto operator=(AssetHandle other) noexcept -> AssetHandle & {
+        std::swap(store, other.store);
+        std::swap(slot, other.slot);
+        return *this;
+    }
+    ~AssetHandle() {
+        if (store) {
+            store->release<T>(slot);
+        }
+    }
+
+    [[nodiscard]] explicit operator bool() const { return store != nullptr; }
+    [[nodiscard]] auto get_state() const -> AssetState { return get_slot().state; }
+
+    // nullptr until the asset is uploaded and when it failed to load
+    [[nodiscard]] auto get() const -> const T * {
+        const auto &asset_slot = get_slot();
+        return asset_slot.state == AssetState::Ready ? &asset_slot.asset : nullptr;
+    }
+
+    // Blocks until the asset is uploaded, uploading whatever else finished in the meantime
+    [[nodiscard]] auto wait() const -> Expected<T> {
+        while (get_slot().state == AssetState::Loading) {
+            store->make_progress();
+        }
+        const auto &asset_slot = get_slot();
+        if (asset_slot.state == AssetState::Failed) {
+            return std::unexpected(asset_slot.error);
+        }
+        return asset_slot.asset;
+    }
+
+  private:
+    [[nodiscard]] auto get_slot() const -> const AssetStore::Slot<T> & { return store->get_storage<T>().slots[slot]; }
+
+    std::shared_ptr<AssetStore> store;
+    std::uint32_t slot = 0u;
+};
+
+// Loads every asset once per path and loader, files are read and decoded on the thread pool and uploaded to the GPU on
+// the main thread. Lives in registry.ctx() of the game.
+class AssetManager {
+  public:
+    explicit AssetManager(ThreadPool &pool) : pool{pool}, store{std::make_shared<AssetStore>(pool)} {}
+    ~AssetManager() { store->wait_idle(); }
+
+    AssetManager(const AssetManager &) = delete;
+    AssetManager(AssetManager &&) = delete;
+    auto operator=(const AssetManager &) -> AssetManager & = delete;
+    auto operator=(AssetManager &&) -> AssetManager & = delete;
+
+    // Paths are relative to the resources directory like get_asset_path
+    [[nodiscard]] auto load_texture(const std::filesystem::path &path) -> AssetHandle<Texture2D>;
+    [[nodiscard]] auto load_shader(const std::filesystem::path &vertex_path, const std::filesystem::path &fragment_path)
+        -> AssetHandle<Shader>;
+    // NOTE: raylib uploads the meshes while parsing, so models are parsed on the main thread once uploads run
+    [[nodiscard]] auto load_model(const std::filesystem::path &path) -> AssetHandle<Model>;
+
+    // Uploads what the workers finished decoding, called once per frame on the main thread
+    void upload_pending() { store->run_completions(); }
+    // Waits for every load in flight and unloads everything, called before the window closes
+    void unload_all() { store->unload_all(); }
+
+  private:
+    template <typename T, typename Decode, typename Upload>
+    [[nodiscard]] auto load(const std::string &key, Decode decode, Upload upload) -> AssetHandle<T>;
+
+    ThreadPool &pool;
+    std::shared_ptr<AssetStore> store;
+};
+
+} // namespace stratgame
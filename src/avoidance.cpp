@@ -0,0 +1,441 @@
+#include "avoidance.hpp"
+#include "commands.hpp"
+#include "common_components.hpp"
+#include "height_field.hpp"
+#include "simulation.hpp"
+#include "spatial_grid.hpp"
+#include "thread_pool.hpp"
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define STRATGAME_AVOIDANCE_SSE2
+#endif
+
+namespace stratgame {
+constexpr static auto avoidance_chunk_size = std::size_t{2048};
+// Sideways share of a predicted push, two units walking straight at each other both step to their right
+constexpr static auto side_step = 0.5f;
+
+auto AvoidanceGrid::bucket_of(const std::int32_t cell_x, const std::int32_t cell_z) const -> std::uint32_t {
+    const auto row = static_cast<std::uint32_t>(cell_z) & row_mask;
+    return row << column_bits | (static_cast<std::uint32_t>(cell_x) & column_mask);
+}
+
+// Component at a position of the storage's packed array, the same position as its entity in storage.data()
+template <typename T> [[nodiscard]] static auto get_packed(entt::storage<T> &storage, const std::size_t index) -> T & {
+    constexpr auto page_size = entt::component_traits<T>::page_size;
+    return storage.raw()[index / page_size][index % page_size];
+}
+
+void AvoidanceGrid::build(entt::registry &registry, const float delta_time) {
+    auto &movements = registry.storage<Movement>();
+    const auto &transforms = registry.storage<Transform>();
+    const auto &indexed = registry.storage<GridIndexed>();
+    const auto &unit_ids = registry.storage<UnitId>();
+
+    // NOTE: Walks the Movement storage in its own order, the pushes go back by index without looking entities up
+    gathered.clear();
+    auto max_radius = 0.f;
+    auto max_step = 0.f;
+    const auto *movement_entities = movements.data();
+    for (auto k = std::size_t{0}; k < movements.size(); k++) {
+        const auto entity = movement_entities[k];
+        if (!transforms.contains(entity) || !indexed.contains(entity)) {
+            continue;
+        }
+
+        const auto &velocity = get_packed(movements, k).velocity;
+        const auto &position = transforms.get(entity).position;
+        const auto unit_radius = indexed.get(entity).radius;
+        // NOTE: UnitIds survive a save game where entities do not, a loaded game has to push the same way
+        const auto seed = unit_ids.contains(entity) ? unit_ids.get(entity).value
+                                                    : static_cast<std::uint32_t>(entt::to_entity(entity));
+        gathered.push_back(Unit{.seed = seed,
+                                .movement_index = static_cast<std::uint32_t>(k),
+                                .x = position.x,
+                                .z = position.z,
+                                .velocity_x = velocity.x,
+                                .velocity_z = velocity.z,
+                                .radius = unit_radius,
+                                .bucket = 0u});
+        max_radius = std::max(max_radius, unit_radius);
+        max_step = std::max(max_step, velocity.x * velocity.x + velocity.z * velocity.z);
+    }
+
+    // NOTE: Two units closing in on each other at full speed still meet within the neighbouring cells
+    const auto ahead = settings.prediction / delta_time;
+    cell_size = std::max(2.f * max_radius + 2.f * std::sqrt(max_step) * ahead, 0.01f);
+    const auto inv_cell_size = 1.f / cell_size;
+
+    // NOTE: Twice as many buckets as units keeps cells sharing a bucket rare, those are a whole tile apart. At least
+    // 4x4 so the 3x3 cells around any cell never share one.
+    const auto bucket_count = std::bit_ceil(std::max<std::size_t>(2u * gathered.size(), 16u));
+    const auto bucket_bits = static_cast<std::uint32_t>(std::countr_zero(bucket_count));
+    column_bits = (bucket_bits + 1u) / 2u;
+    column_mask = (1u << column_bits) - 1u;
+    row_mask = (1u << (bucket_bits - column_bits)) - 1u;
+    bucket_starts.assign(bucket_count + 1u, 0u);
+    for (auto &unit : gathered) {
+        unit.bucket = bucket_of(static_cast<std::int32_t>(std::floor(unit.x * inv_cell_size)),
+                                static_cast<std::int32_t>(std::floor(unit.z * inv_cell_size)));
+        bucket_starts[unit.bucket + 1u]++;
+    }
+    for (auto i = 1u; i <= bucket_count; i++) {
+        bucket_starts[i] += bucket_starts[i - 1u];
+    }
+
+    // NOTE: Counting sort, units keep their storage order inside a bucket so the result is the same on every run
+    const auto count = gathered.size();
+    movement_indices.resize(count);
+    neighbours.resize(count);
+    for (const auto &unit : gathered) {
+        const auto slot = bucket_starts[unit.bucket]++;
+
+        // NOTE: Multiplying by an odd constant is a bijection, no two units get the same direction
+        const auto hash = unit.seed * 0x9e3779b9u;
+        movement_indices[slot] = unit.movement_index;
+        neighbours[slot] = Neighbour{.x = unit.x,
+                                     .z = unit.z,
+                                     .velocity_x = unit.velocity_x,
+                                     .velocity_z = unit.velocity_z,
+                                     .radius = unit.radius,
+                                     .jitter_x = static_cast<float>(hash & 0xffffu) / 32767.5f - 1.f,
+                                     .jitter_z = static_cast<float>(hash >> 16u) / 32767.5f - 1.f};
+    }
+
+    // NOTE: Scattered once as whole records, the lanes are copied out of them in order afterwards
+    for (auto *values : {&x, &z, &velocity_x, &velocity_z, &radius, &jitter_x, &jitter_z}) {
+        values->resize(count + padding);
+        std::fill(values->begin() + static_cast<std::ptrdiff_t>(count), values->end(), 0.f);
+    }
+    cell_x.resize(count);
+    cell_z.resize(count);
+    for (auto i = std::size_t{0}; i < count; i++) {
+        const auto &unit = neighbours[i];
+        x[i] = unit.x;
+        z[i] = unit.z;
+        velocity_x[i] = unit.velocity_x;
+        velocity_z[i] = unit.velocity_z;
+        radius[i] = unit.radius;
+        jitter_x[i] = unit.jitter_x;
+        jitter_z[i] = unit.jitter_z;
+        cell_x[i] = static_cast<std::int32_t>(std::floor(unit.x * inv_cell_size));
+        cell_z[i] = static_cast<std::int32_t>(std::floor(unit.z * inv_cell_size));
+    }
+    for (auto i = bucket_count; i > 0u; i--) {
+        bucket_starts[i] = bucket_starts[i - 1u];
+    }
+    bucket_starts[0] = 0u;
+}
+
+// Units of the 3x3 cells around a cell as ranges, one per row unless the row wraps around the tile
+struct Neighbourhood {
+    struct Range {
+        std::uint32_t begin;
+        std::uint32_t end;
+    };
+    std::array<Range, 9> ranges;
+    std::uint32_t count = 0u;
+};
+
+[[nodiscard]] static auto get_neighbourhood(const AvoidanceGrid &grid, const std::int32_t cell_x,
+                                            const std::int32_t cell_z) -> Neighbourhood {
+    auto neighbourhood = Neighbourhood{};
+    for (auto dz = -1; dz <= 1; dz++) {
+        const auto first = grid.bucket_of(cell_x - 1, cell_z + dz);
+        if ((first & grid.column_mask) + 2u <= grid.column_mask) {
+            neighbourhood.ranges[neighbourhood.count++] =
+                Neighbourhood::Range{.begin = grid.bucket_starts[first], .end = grid.bucket_starts[first + 3u]};
+            continue;
+        }
+        for (auto dx = -1; dx <= 1; dx++) {
+            const auto bucket = grid.bucket_of(cell_x + dx, cell_z + dz);
+            neighbourhood.ranges[neighbourhood.count++] =
+                Neighbourhood::Range{.begin = grid.bucket_starts[bucket], .end = grid.bucket_starts[bucket + 1u]};
+        }
+    }
+    return neighbourhood;
+}
+
+// Summed push of unit i away from every unit it overlaps now or will overlap within ahead ticks.
+// NOTE: Itself adds nothing, its offset and jitter difference are both zero
+[[nodiscard]] static auto separate_one(const AvoidanceGrid &grid, const Neighbourhood &neighbourhood,
+                                       const std::size_t i, const float ahead) -> Vector2 {
+    const auto weight = grid.settings.prediction_weight;
+    auto push = Vector2{0.f, 0.f};
+    for (auto r = 0u; r < neighbourhood.count; r++) {
+        for (auto j = neighbourhood.ranges[r].begin; j < neighbourhood.ranges[r].end; j++) {
+            const auto &other = grid.neighbours[j];
+            const auto dx = grid.x[i] - other.x;
+            const auto dz = grid.z[i] - other.z;
+            const auto ahead_x = dx + (grid.velocity_x[i] - other.velocity_x) * ahead;
+            const auto ahead_z = dz + (grid.velocity_z[i] - other.velocity_z) * ahead;
+            const auto combined = grid.radius[i] + other.radius;
+            const auto distance_squared = dx * dx + dz * dz;
+            const auto ahead_squared = ahead_x * ahead_x + ahead_z * ahead_z;
+
+            if (distance_squared < combined * combined) {
+                const auto distance = std::sqrt(distance_squared);
+                if (distance > 0.f) {
+                    push.x += dx * (combined / distance - 1.f);
+                    push.y += dz * (combined / distance - 1.f);
+                } else {
+                    push.x += (grid.jitter_x[i] - other.jitter_x) * combined;
+                    push.y += (grid.jitter_z[i] - other.jitter_z) * combined;
+                }
+            }
+            if (ahead_squared < combined * combined && ahead_squared > 0.f) {
+                const auto scale = (combined / std::sqrt(ahead_squared) - 1.f) * weight;
+                push.x += (ahead_x - side_step * ahead_z) * scale;
+                push.y += (ahead_z + side_step * ahead_x) * scale;
+            }
+        }
+    }
+    return push;
+}
+
+#if defined(__AVX__)
+// 1 / sqrt(value), one Newton step on top of the hardware estimate
+[[nodiscard]] static auto inverse_sqrt(const __m256 value) -> __m256 {
+    const auto estimate = _mm256_rsqrt_ps(value);
+    const auto half = _mm256_mul_ps(value, _mm256_set1_ps(0.5f));
+    return _mm256_mul_ps(estimate,
+                         _mm256_sub_ps(_mm256_set1_ps(1.5f), _mm256_mul_ps(half, _mm256_mul_ps(estimate, estimate))));
+}
+#elif defined(STRATGAME_AVOIDANCE_SSE2)
+// 1 / sqrt(value), one Newton step on top of the hardware estimate
+[[nodiscard]] static auto inverse_sqrt(const __m128 value) -> __m128 {
+    const auto estimate = _mm_rsqrt_ps(value);
+    const auto half = _mm_mul_ps(value, _mm_set1_ps(0.5f));
+    return _mm_mul_ps(estimate, _mm_sub_ps(_mm_set1_ps(1.5f), _mm_mul_ps(half, _mm_mul_ps(estimate, estimate))));
+}
+#endif
+
+// Pushes of the units [first, last), which all stand in the same cell, lanes run side by side
+static void separate_cell(const AvoidanceGrid &grid, const std::size_t first, const std::size_t last,
+                          const float ahead, float *push_x, float *push_z) {
+    const auto neighbourhood = get_neighbourhood(grid, grid.cell_x[first], grid.cell_z[first]);
+    auto i = first;
+
+#if defined(__AVX__)
+    const auto zero = _mm256_setzero_ps();
+    const auto one = _mm256_set1_ps(1.f);
+    const auto weight = _mm256_set1_ps(grid.settings.prediction_weight);
+    const auto ahead8 = _mm256_set1_ps(ahead);
+    const auto side = _mm256_set1_ps(side_step);
+    // NOTE: Lanes past last read the padding or the next cell's units, their results are never stored
+    for (; i + 1u < last; i += 8u) {
+        const auto xi = _mm256_loadu_ps(grid.x.data() + i);
+        const auto zi = _mm256_loadu_ps(grid.z.data() + i);
+        const auto vxi = _mm256_loadu_ps(grid.velocity_x.data() + i);
+        const auto vzi = _mm256_loadu_ps(grid.velocity_z.data() + i);
+        const auto ri = _mm256_loadu_ps(grid.radius.data() + i);
+        const auto jxi = _mm256_loadu_ps(grid.jitter_x.data() + i);
+        const auto jzi = _mm256_loadu_ps(grid.jitter_z.data() + i);
+        auto px = zero;
+        auto pz = zero;
+
+        for (auto r = 0u; r < neighbourhood.count; r++) {
+            for (auto j = neighbourhood.ranges[r].begin; j < neighbourhood.ranges[r].end; j++) {
+                const auto &other = grid.neighbours[j];
+                const auto dx = _mm256_sub_ps(xi, _mm256_set1_ps(other.x));
+                const auto dz = _mm256_sub_ps(zi, _mm256_set1_ps(other.z));
+                const auto ax = _mm256_add_ps(
+                    dx, _mm256_mul_ps(_mm256_sub_ps(vxi, _mm256_set1_ps(other.velocity_x)), ahead8));
+                const auto az = _mm256_add_ps(
+                    dz, _mm256_mul_ps(_mm256_sub_ps(vzi, _mm256_set1_ps(other.velocity_z)), ahead8));
+                const auto combined = _mm256_add_ps(ri, _mm256_set1_ps(other.radius));
+                const auto combined_squared = _mm256_mul_ps(combined, combined);
+                const auto distance_squared = _mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dz, dz));
+                const auto ahead_squared = _mm256_add_ps(_mm256_mul_ps(ax, ax), _mm256_mul_ps(az, az));
+                const auto near = _mm256_cmp_ps(distance_squared, combined_squared, _CMP_LT_OQ);
+                const auto ahead_near = _mm256_cmp_ps(ahead_squared, combined_squared, _CMP_LT_OQ);
+                if (_mm256_movemask_ps(_mm256_or_ps(near, ahead_near)) == 0) {
+                    continue;
+                }
+
+                // NOTE: overlap / distance is combined / distance - 1. Lanes at a zero distance are masked out of
+                // it and pushed along the jitter instead.
+                const auto apart = _mm256_cmp_ps(distance_squared, zero, _CMP_GT_OQ);
+                const auto scale =
+                    _mm256_and_ps(_mm256_and_ps(near, apart),
+                                  _mm256_sub_ps(_mm256_mul_ps(combined, inverse_sqrt(distance_squared)), one));
+                const auto stacked = _mm256_andnot_ps(apart, combined);
+                const auto jx = _mm256_sub_ps(jxi, _mm256_set1_ps(other.jitter_x));
+                const auto jz = _mm256_sub_ps(jzi, _mm256_set1_ps(other.jitter_z));
+                px = _mm256_add_ps(px, _mm256_add_ps(_mm256_mul_ps(dx, scale), _mm256_mul_ps(jx, stacked)));
+                pz = _mm256_add_ps(pz, _mm256_add_ps(_mm256_mul_ps(dz, scale), _mm256_mul_ps(jz, stacked)));
+
+                const auto ahead_apart = _mm256_cmp_ps(ahead_squared, zero, _CMP_GT_OQ);
+                const auto ahead_scale = _mm256_and_ps(
+                    _mm256_and_ps(ahead_near, ahead_apart),
+                    _mm256_mul_ps(_mm256_sub_ps(_mm256_mul_ps(combined, inverse_sqrt(ahead_squared)), one), weight));
+                px = _mm256_add_ps(px, _mm256_mul_ps(_mm256_sub_ps(ax, _mm256_mul_ps(side, az)), ahead_scale));
+                pz = _mm256_add_ps(pz, _mm256_mul_ps(_mm256_add_ps(az, _mm256_mul_ps(side, ax)), ahead_scale));
+            }
+        }
+
+        alignas(32) auto lanes_x = std::array<float, 8>{};
+        alignas(32) auto lanes_z = std::array<float, 8>{};
+        _mm256_store_ps(lanes_x.data(), px);
+        _mm256_store_ps(lanes_z.data(), pz);
+        const auto lanes = std::min<std::size_t>(8u, last - i);
+        std::copy_n(lanes_x.begin(), lanes, push_x + (i - first));
+        std::copy_n(lanes_z.begin(), lanes, push_z + (i - first));
+    }
+#elif defined(STRATGAME_AVOIDANCE_SSE2)
+    const auto zero = _mm_setzero_ps();
+    const auto one = _mm_set1_ps(1.f);
+    const auto weight = _mm_set1_ps(grid.settings.prediction_weight);
+    const auto ahead4 = _mm_set1_ps(ahead);
+    const auto side = _mm_set1_ps(side_step);
+    // NOTE: Lanes past last read the padding or the next cell's units, their results are never stored
+    for (; i + 1u < last; i += 4u) {
+        const auto xi = _mm_loadu_ps(grid.x.data() + i);
+        const auto zi = _mm_loadu_ps(grid.z.data() + i);
+        const auto vxi = _mm_loadu_ps(grid.velocity_x.data() + i);
+        const auto vzi = _mm_loadu_ps(grid.velocity_z.data() + i);
+        const auto ri = _mm_loadu_ps(grid.radius.data() + i);
+        const auto jxi = _mm_loadu_ps(grid.jitter_x.data() + i);
+        const auto jzi = _mm_loadu_ps(grid.jitter_z.data() + i);
+        auto px = zero;
+        auto pz = zero;
+
+        for (auto r = 0u; r < neighbourhood.count; r++) {
+            for (auto j = neighbourhood.ranges[r].begin; j < neighbourhood.ranges[r].end; j++) {
+                const auto &other = grid.neighbours[j];
+                const auto dx = _mm_sub_ps(xi, _mm_set1_ps(other.x));
+                const auto dz = _mm_sub_ps(zi, _mm_set1_ps(other.z));
+                const auto ax = _mm_add_ps(dx, _mm_mul_ps(_mm_sub_ps(vxi, _mm_set1_ps(other.velocity_x)), ahead4));
+                const auto az = _mm_add_ps(dz, _mm_mul_ps(_mm_sub_ps(vzi, _mm_set1_ps(other.velocity_z)), ahead4));
+                const auto combined = _mm_add_ps(ri, _mm_set1_ps(other.radius));
+                const auto combined_squared = _mm_mul_ps(combined, combined);
+                const auto distance_squared = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dz, dz));
+                const auto ahead_squared = _mm_add_ps(_mm_mul_ps(ax, ax), _mm_mul_ps(az, az));
+                const auto near = _mm_cmplt_ps(distance_squared, combined_squared);
+                const auto ahead_near = _mm_cmplt_ps(ahead_squared, combined_squared);
+                if (_mm_movemask_ps(_mm_or_ps(near, ahead_near)) == 0) {
+                    continue;
+                }
+
+                // NOTE: overlap / distance is combined / distance - 1. Lanes at a zero distance are masked out of
+                // it and pushed along the jitter instead.
+                const auto apart = _mm_cmpgt_ps(distance_squared, zero);
+                const auto scale = _mm_and_ps(_mm_and_ps(near, apart),
+                                              _mm_sub_ps(_mm_mul_ps(combined, inverse_sqrt(distance_squared)), one));
+                const auto stacked = _mm_andnot_ps(apart, combined);
+                const auto jx = _mm_sub_ps(jxi, _mm_set1_ps(other.jitter_x));
+                const auto jz = _mm_sub_ps(jzi, _mm_set1_ps(other.jitter_z));
+                px = _mm_add_ps(px, _mm_add_ps(_mm_mul_ps(dx, scale), _mm_mul_ps(jx, stacked)));
+                pz = _mm_add_ps(pz, _mm_add_ps(_mm_mul_ps(dz, scale), _mm_mul_ps(jz, stacked)));
+
+                const auto ahead_apart = _mm_cmpgt_ps(ahead_squared, zero);
+                const auto ahead_scale =
+                    _mm_and_ps(_mm_and_ps(ahead_near, ahead_apart),
+                               _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(combined, inverse_sqrt(ahead_squared)), one), weight));
+                px = _mm_add_ps(px, _mm_mul_ps(_mm_sub_ps(ax, _mm_mul_ps(side, az)), ahead_scale));
+                pz = _mm_add_ps(pz, _mm_mul_ps(_mm_add_ps(az, _mm_mul_ps(side, ax)), ahead_scale));
+            }
+        }
+
+        alignas(16) auto lanes_x = std::array<float, 4>{};
+        alignas(16) auto lanes_z = std::array<float, 4>{};
+        _mm_store_ps(lanes_x.data(), px);
+        _mm_store_ps(lanes_z.data(), pz);
+        const auto lanes = std::min<std::size_t>(4u, last - i);
+        std::copy_n(lanes_x.begin(), lanes, push_x + (i - first));
+        std::copy_n(lanes_z.begin(), lanes, push_z + (i - first));
+    }
+#endif
+
+    // NOTE: A unit alone in its cell is not worth a vector batch
+    for (; i < last; i++) {
+        const auto push = separate_one(grid, neighbourhood, i, ahead);
+        push_x[i - first] = push.x;
+        push_z[i - first] = push.y;
+    }
+}
+
+// NOTE: Pushes must not shove units into terrain navigation routes around, like onto the side of a cliff. A unit
+// standing on such a cell already may still be pushed off it.
+[[nodiscard]] static auto is_walkable(const TerrainHeightField &height_field, const Vector2 from, const Vector2 to,
+                                      const float max_slope) -> bool {
+    const auto slope = height_field.get_slope(to);
+    if (!slope || *slope <= max_slope) {
+        return true;
+    }
+    const auto from_slope = height_field.get_slope(from);
+    return from_slope && *from_slope > max_slope;
+}
+
+// Runs the cells inside [begin, end) and stores the pushes of their units in grid.pushes
+// NOTE: Only writes the pushes of its own units, chunks run on several threads at once
+static void update_avoidance_chunk(AvoidanceGrid &grid, const TerrainHeightField *height_field,
+                                   const std::size_t begin, const std::size_t end, const float delta_time) {
+    const auto ahead = grid.settings.prediction / delta_time;
+    const auto strength = grid.settings.strength * delta_time;
+    const auto max_push = grid.settings.max_speed * delta_time;
+
+    auto push_x = std::vector<float>{};
+    auto push_z = std::vector<float>{};
+    for (auto first = begin; first < end;) {
+        auto last = first + 1u;
+        while (last < end && grid.cell_x[last] == grid.cell_x[first] && grid.cell_z[last] == grid.cell_z[first]) {
+            last++;
+        }
+
+        push_x.resize(last - first);
+        push_z.resize(last - first);
+        separate_cell(grid, first, last, ahead, push_x.data(), push_z.data());
+
+        for (auto i = first; i < last; i++) {
+            auto push = Vector2{push_x[i - first] * strength, push_z[i - first] * strength};
+            const auto length = std::sqrt(push.x * push.x + push.y * push.y);
+            if (length == 0.f) {
+                continue;
+            }
+            if (length > max_push) {
+                push.x *= max_push / length;
+                push.y *= max_push / length;
+            }
+
+            const auto from = Vector2{grid.x[i] + grid.velocity_x[i], grid.z[i] + grid.velocity_z[i]};
+            if (height_field != nullptr &&
+                !is_walkable(*height_field, from, Vector2{from.x + push.x, from.y + push.y}, grid.settings.max_slope)) {
+                continue;
+            }
+            grid.pushes[grid.movement_indices[i]] = push;
+        }
+        first = last;
+    }
+}
+
+void setup_avoidance(entt::registry &registry) { registry.ctx().emplace<AvoidanceGrid>(); }
+
+void update_avoidance(entt::registry &registry) {
+    auto &grid = registry.ctx().get<AvoidanceGrid>();
+    const auto delta_time = registry.ctx().get<const SimulationTime>().delta_time;
+    grid.build(registry, delta_time);
+
+    auto &movements = registry.storage<Movement>();
+    grid.pushes.assign(movements.size(), Vector2{0.f, 0.f});
+    const auto *height_field = registry.ctx().find<const TerrainHeightField>();
+    registry.ctx().get<ThreadPool>().parallel_for_chunks(
+        grid.size(), avoidance_chunk_size, [&](const std::size_t begin, const std::size_t end) {
+            update_avoidance_chunk(grid, height_field, begin, end, delta_time);
+        });
+
+    for (auto k = std::size_t{0}; k < movements.size(); k++) {
+        auto &velocity = get_packed(movements, k).velocity;
+        velocity.x += grid.pushes[k].x;
+        velocity.z += grid.pushes[k].y;
+    }
+}
+
+} // namespace stratgame
@@ -0,0 +1,76 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <entt.hpp>
+#include <raylib.h>
+#include <vector>
+
+namespace stratgame {
+
+struct AvoidanceSettings {
+    float strength = 8.f;           // share of an overlap resolved per second
+    float prediction = 0.25f;       // seconds ahead units look for others on a collision course
+    float prediction_weight = 0.5f; // of an overlap that is only predicted compared to an actual one
+    float max_speed = 4.f;          // units per second that avoidance alone may move a unit
+    float max_slope = 1.f;          // rise over run like the navigation settings, steeper pushes are dropped
+};
+
+// Every unit with Movement, Transform and GridIndexed sorted by the cell it stands in, rebuilt every tick. Cells wrap
+// around a power of two sized tile of buckets, so neighbouring cells stay close in memory. Lives in registry.ctx().
+// NOTE: Separate from the SpatialGrid, which answers the odd query. Avoidance visits the neighbours of every unit each
+// tick, so the units are packed in cell order and each cell is run against its neighbourhood as one vector batch.
+struct AvoidanceGrid {
+    constexpr static std::size_t padding = 8u; // lanes past the last unit, vector loads never leave the arrays
+
+    // Everything a unit is compared by, packed so looking at a neighbour reads a single cache line
+    struct alignas(32) Neighbour {
+        float x, z, velocity_x, velocity_z, radius, jitter_x, jitter_z;
+    };
+
+    AvoidanceSettings settings{};
+
+    // per unit, in bucket order. The units of one cell are loaded into vector lanes from the arrays, the units they
+    // are compared with are read from neighbours.
+    std::vector<std::uint32_t> movement_indices; // into the Movement storage
+    std::vector<Neighbour> neighbours;
+    std::vector<float> x;
+    std::vector<float> z;
+    std::vector<float> velocity_x; // distance per tick like Movement::velocity
+    std::vector<float> velocity_z;
+    std::vector<float> radius;
+    std::vector<float> jitter_x; // fixed per unit, pushes apart units standing on the exact same spot
+    std::vector<float> jitter_z;
+    std::vector<std::int32_t> cell_x;
+    std::vector<std::int32_t> cell_z;
+
+    std::vector<std::uint32_t> bucket_starts; // offsets of each bucket's units, one past the last bucket at the end
+    std::uint32_t column_bits = 0u; // the tile is 1 << column_bits buckets wide
+    std::uint32_t column_mask = 0u;
+    std::uint32_t row_mask = 0u;
+    float cell_size = 1.f;
+
+    // Added to Movement::velocity, indexed like the Movement storage
+    std::vector<Vector2> pushes;
+
+    [[nodiscard]] auto size() const -> std::size_t { return movement_indices.size(); }
+    [[nodiscard]] auto bucket_of(std::int32_t cell_x, std::int32_t cell_z) const -> std::uint32_t;
+
+    // Sorts the units into the grid, cells are large enough that everything a unit can collide with within
+    // settings.prediction is in the 3x3 cells around it
+    void build(entt::registry &registry, float delta_time);
+
+  private:
+    struct Unit {
+        std::uint32_t seed; // of the jitter
+        std::uint32_t movement_index;
+        float x, z, velocity_x, velocity_z, radius;
+        std::uint32_t bucket;
+    };
+    std::vector<Unit> gathered;
+};
+
+void setup_avoidance(entt::registry &registry);
+// Adds the separation from nearby units to Movement::velocity, runs between update_tasks and update_transform
+void update_avoidance(entt::registry &registry);
+
+} // namespace stratgame
@@ -25,6 +25,7 @@ struct Camera {
     float speed = 30.0f;
     float rotation_speed = 5.f;
     float zoom_speed = 1000.f;
+    float aspect_ratio = 16.f / 9.f; // kept in sync with the window by update_context
 
     float zoom = 20.0f;                            // distance from target
     float yaw = 0.f;                               // rotation around y axis
@@ -55,7 +56,7 @@ struct Camera {
     }
     [[nodiscard]] auto is_within_zoom_bounds() const -> bool { return zoom <= max_zoom && zoom >= min_zoom; }
     [[nodiscard]] auto get_fovx() const -> degrees {
-        return 2 * std::atan(std::tan(DEG2RAD * camera3d.fovy / 2.f) * get_aspect_ratio());
+        return 2 * std::atan(std::tan(DEG2RAD * camera3d.fovy / 2.f) * aspect_ratio);
     }
     [[nodiscard]] auto get_fovy() const -> degrees {
         return camera3d.fovy * DEG2RAD;
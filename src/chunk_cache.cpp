@@ -0,0 +1,151 @@
+#include "chunk_cache.hpp"
+#include <cstring>
+#include <format>
+#include <fstream>
+#include <functional>
+#include <thread>
+#include <type_traits>
+
+namespace stratgame {
+
+namespace {
+
+constexpr auto cache_magic = std::uint32_t{0x43544753u}; // "SGTC"
+
+struct ChunkFileHeader {
+    std::uint32_t magic;
+    std::uint32_t version;
+
+    // everything the chunk data depends on
+    float frequency;
+    float amplitude;
+    float lacunarity;
+    float persistence;
+    std::uint32_t octaves;
+    float height_scale;
+    std::uint32_t chunk_size;
+    std::uint32_t chunk_subdivisions;
+    std::int64_t x;
+    std::int64_t y;
+
+    // element count of the heights that follow the header
+    std::uint32_t height_count;
+    std::uint32_t reserved;
+};
+static_assert(std::is_trivially_copyable_v<ChunkFileHeader>);
+static_assert(sizeof(ChunkFileHeader) == 64u, "the header is written as raw bytes and must not contain padding");
+
+auto make_header(const NoiseParameters &noise, const std::uint32_t chunk_size, const std::uint32_t chunk_subdivisions,
+                 const float height_scale, const std::int64_t x, const std::int64_t y) -> ChunkFileHeader {
+    return ChunkFileHeader{.magic = cache_magic,
+                           .version = ChunkCache::version,
+                           .frequency = noise.frequency,
+                           .amplitude = noise.amplitude,
+                           .lacunarity = noise.lacunarity,
+                           .persistence = noise.persistence,
+                           .octaves = noise.octaves,
+                           .height_scale = height_scale,
+                           .chunk_size = chunk_size,
+                           .chunk_subdivisions = chunk_subdivisions,
+                           .x = x,
+                           .y = y,
+                           .height_count = 0u,
+                           .reserved = 0u};
+}
+
+// FNV-1a, only used to name the cache directory, the header check is what guards against collisions
+auto hash_bytes(const void *data, const std::size_t size) -> std::uint64_t {
+    auto hash = std::uint64_t{0xcbf29ce484222325u};
+    const auto *bytes = static_cast<const unsigned char *>(data);
+    for (auto i = 0u; i < size; i++) {
+        hash = (hash ^ bytes[i]) * std::uint64_t{0x100000001b3u};
+    }
+    return hash;
+}
+
+template <typename T> auto view_array(std::span<const std::byte> bytes, std::size_t &offset, std::uint32_t count) {
+    const auto *first = reinterpret_cast<const T *>(bytes.data() + offset);
+    offset += count * sizeof(T);
+    return std::span<const T>{first, count};
+}
+
+} // namespace
+
+ChunkCache::ChunkCache(const std::filesystem::path &root, const NoiseParameters &noise, const std::uint32_t chunk_size,
+                       const std::uint32_t chunk_subdivisions, const float height_scale)
+    : noise(noise), chunk_size(chunk_size), chunk_subdivisions(chunk_subdivisions), height_scale(height_scale) {
+    const auto key = make_header(noise, chunk_size, chunk_subdivisions, height_scale, 0, 0);
+    directory = root / std::format("v{}-{:016x}", version, hash_bytes(&key, sizeof(key)));
+
+    // NOTE: A directory that cannot be created only means every load misses and every store fails
+    auto error = std::error_code{};
+    std::filesystem::create_directories(directory, error);
+}
+
+auto ChunkCache::chunk_path(const std::int64_t x, const std::int64_t y) const -> std::filesystem::path {
+    return directory / std::format("{}_{}.chunk", x, y);
+}
+
+auto ChunkCache::load(const std::int64_t x, const std::int64_t y) const -> Expected<CachedChunk> {
+    auto mapped = MappedFile::open(chunk_path(x, y));
+    if (!mapped) {
+        return std::unexpected(mapped.error());
+    }
+
+    const auto file = std::make_shared<const MappedFile>(std::move(*mapped));
+    const auto bytes = file->get_bytes();
+    if (bytes.size() < sizeof(ChunkFileHeader)) {
+        return std::unexpected(std::format("Truncated chunk cache file for ({}, {})", x, y));
+    }
+
+    auto header = ChunkFileHeader{};
+    std::memcpy(&header, bytes.data(), sizeof(header));
+
+    auto expected = make_header(noise, chunk_size, chunk_subdivisions, height_scale, x, y);
+    expected.height_count = header.height_count;
+    if (std::memcmp(&header, &expected, sizeof(header)) != 0) {
+        return std::unexpected(std::format("Stale chunk cache file for ({}, {})", x, y));
+    }
+
+    const auto payload = sizeof(float) * std::size_t{header.height_count};
+    if (bytes.size() != sizeof(ChunkFileHeader) + payload) {
+        return std::unexpected(std::format("Truncated chunk cache file for ({}, {})", x, y));
+    }
+
+    // NOTE: mmap returns page aligned memory and the header keeps the heights aligned
+    auto offset = sizeof(ChunkFileHeader);
+    const auto heights = view_array<float>(bytes, offset, header.height_count);
+    return CachedChunk{.file = file, .heights = heights};
+}
+
+auto ChunkCache::store(const std::int64_t x, const std::int64_t y, std::span<const float> heights) const
+    -> Expected<void> {
+    auto header = make_header(noise, chunk_size, chunk_subdivisions, height_scale, x, y);
+    header.height_count = static_cast<std::uint32_t>(heights.size());
+
+    const auto path = chunk_path(x, y);
+    auto temporary = path;
+    temporary += std::format(".{:x}.tmp", std::hash<std::thread::id>{}(std::this_thread::get_id()));
+
+    auto written = false;
+    {
+        auto out = std::ofstream{temporary, std::ios::binary | std::ios::trunc};
+        out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char *>(heights.data()),
+                  static_cast<std::streamsize>(heights.size_bytes()));
+        out.close();
+        written = static_cast<bool>(out);
+    }
+
+    auto error = std::error_code{};
+    if (written) {
+        std::filesystem::rename(temporary, path, error);
+    }
+    if (!written || error) {
+        std::filesystem::remove(temporary, error);
+        return std::unexpected(std::format("Could not write {}", path.string()));
+    }
+    return {};
+}
+
+} // namespace stratgame
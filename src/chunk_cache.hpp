@@ -0,0 +1,45 @@
+#pragma once
+#include "error.hpp"
+#include "mapped_file.hpp"
+#include "noise.hpp"
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <span>
+
+namespace stratgame {
+
+// Views into a mapped cache file, valid as long as file is alive
+struct CachedChunk {
+    std::shared_ptr<const MappedFile> file;
+    std::span<const float> heights;
+};
+
+// On-disk cache of generated chunk data, one file per chunk in a directory named after everything the data depends
+// on. Files are in native byte order and start with a header that is checked field by field on load, so a stale or
+// foreign file is treated as a miss and overwritten.
+// Loads and stores of different chunks can run on different threads at the same time.
+class ChunkCache {
+  public:
+    constexpr static std::uint32_t version = 2u;
+
+    ChunkCache(const std::filesystem::path &root, const NoiseParameters &noise, std::uint32_t chunk_size,
+               std::uint32_t chunk_subdivisions, float height_scale);
+
+    [[nodiscard]] auto load(std::int64_t x, std::int64_t y) const -> Expected<CachedChunk>;
+    // Best effort, written to a temporary file first so readers never see a partial chunk
+    [[nodiscard]] auto store(std::int64_t x, std::int64_t y, std::span<const float> heights) const -> Expected<void>;
+
+    [[nodiscard]] auto get_directory() const -> const std::filesystem::path & { return directory; }
+
+  private:
+    NoiseParameters noise;
+    std::uint32_t chunk_size;
+    std::uint32_t chunk_subdivisions;
+    float height_scale;
+    std::filesystem::path directory;
+
+    [[nodiscard]] auto chunk_path(std::int64_t x, std::int64_t y) const -> std::filesystem::path;
+};
+
+} // namespace stratgame
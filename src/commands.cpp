@@ -0,0 +1,89 @@
+#include "commands.hpp"
+#include "common_components.hpp"
+#include "minion.hpp"
+#include "selection.hpp"
+#include "tasks.hpp"
+#include <type_traits>
+#include <vector>
+
+namespace stratgame {
+
+auto CommandQueue::begin_tick() -> const std::vector<Command> & {
+    applied.clear();
+    std::swap(applied, pending);
+    return applied;
+}
+
+auto CommandQueue::add_unit(const entt::entity entity) -> std::uint32_t {
+    units.push_back(entity);
+    return static_cast<std::uint32_t>(units.size() - 1u);
+}
+
+void CommandQueue::remove_unit(const std::uint32_t id) {
+    if (id < units.size()) {
+        units[id] = entt::null;
+    }
+}
+
+auto CommandQueue::find_unit(const std::uint32_t id) const -> entt::entity {
+    return id < units.size() ? units[id] : entt::entity{entt::null};
+}
+
+void CommandQueue::reset_units(const std::uint32_t count) { units.assign(count, entt::entity{entt::null}); }
+
+void CommandQueue::restore_unit(const std::uint32_t id, const entt::entity entity) {
+    if (id >= units.size()) {
+        units.resize(id + 1u, entt::entity{entt::null});
+    }
+    units[id] = entity;
+}
+
+void setup_commands(entt::registry &registry) {
+    registry.ctx().emplace<CommandQueue>();
+
+    // NOTE: Ids are handed out in creation order, which commands decide, so a replay ends up with the same ones.
+    // Units restored from a save game keep the id they were saved with.
+    registry.on_construct<Minion>().connect<[](entt::registry &registry, entt::entity entity) {
+        auto &queue = registry.ctx().get<CommandQueue>();
+        if (const auto *unit = registry.try_get<const UnitId>(entity)) {
+            queue.restore_unit(unit->value, entity);
+        } else {
+            registry.emplace<UnitId>(entity, queue.add_unit(entity));
+        }
+    }>();
+
+    registry.on_destroy<UnitId>().connect<[](entt::registry &registry, entt::entity entity) {
+        registry.ctx().get<CommandQueue>().remove_unit(registry.get<const UnitId>(entity).value);
+    }>();
+}
+
+static void apply(entt::registry &registry, const CommandQueue &queue, const Command &command) {
+    std::visit(
+        [&](const auto &command) {
+            using command_type = std::decay_t<decltype(command)>;
+            if constexpr (std::is_same_v<command_type, SpawnMinionCommand>) {
+                create_minion(registry, command.position, command.team_id);
+            } else if constexpr (std::is_same_v<command_type, SelectCommand>) {
+                auto entities = std::vector<entt::entity>{};
+                entities.reserve(command.units.size());
+                for (const auto id : command.units) {
+                    if (const auto entity = queue.find_unit(id); entity != entt::null) {
+                        entities.push_back(entity);
+                    }
+                }
+                apply_selection(registry, entities, command.add);
+            } else if constexpr (std::is_same_v<command_type, MoveCommand>) {
+                order_walk_to(registry, command.target);
+            }
+        },
+        command);
+}
+
+void apply_commands(entt::registry &registry) {
+    auto &queue = registry.ctx().get<CommandQueue>();
+    for (const auto &command : queue.begin_tick()) {
+        apply(registry, queue, command);
+    }
+}
+
+} // namespace stratgame
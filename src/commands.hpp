@@ -0,0 +1,67 @@
+#pragma once
+#include <cstdint>
+#include <entt.hpp>
+#include <raylib.h>
+#include <variant>
+#include <vector>
+
+namespace stratgame {
+
+// Stable handle of a unit that commands refer to, the same in a recording and its replay unlike entt::entity.
+// Every Minion gets the next one when it is created.
+struct UnitId {
+    std::uint32_t value;
+};
+
+struct SpawnMinionCommand {
+    Vector2 position;
+    int team_id;
+};
+
+// Replaces the selection, or adds to it when add is set
+struct SelectCommand {
+    std::vector<std::uint32_t> units; // UnitId values
+    bool add = false;
+};
+
+// Orders the selected minions to walk to target
+struct MoveCommand {
+    Vector2 target;
+};
+
+using Command = std::variant<SpawnMinionCommand, SelectCommand, MoveCommand>;
+
+// Player commands waiting for the next tick, lives in registry.ctx(). Input code only pushes commands and never
+// changes the simulation itself, so the applied commands are everything a replay needs besides the terrain.
+class CommandQueue {
+  public:
+    void push(Command command) { pending.push_back(std::move(command)); }
+
+    // Moves the pending commands over to the applied ones and returns them
+    auto begin_tick() -> const std::vector<Command> &;
+    // Commands applied at the start of the last tick, in order
+    [[nodiscard]] auto get_applied() const -> const std::vector<Command> & { return applied; }
+
+    [[nodiscard]] auto add_unit(entt::entity entity) -> std::uint32_t;
+    void remove_unit(std::uint32_t id);
+    // entt::null when there is no such unit
+    [[nodiscard]] auto find_unit(std::uint32_t id) const -> entt::entity;
+    // Ids handed out so far
+    [[nodiscard]] auto get_unit_count() const -> std::uint32_t { return static_cast<std::uint32_t>(units.size()); }
+
+    // For restoring a save game: forgets every unit and continues handing out ids from count, the saved units are put
+    // back with restore_unit
+    void reset_units(std::uint32_t count);
+    void restore_unit(std::uint32_t id, entt::entity entity);
+
+  private:
+    std::vector<Command> pending;
+    std::vector<Command> applied;
+    std::vector<entt::entity> units; // indexed by UnitId
+};
+
+void setup_commands(entt::registry &registry);
+// Applies the queued commands, tick_simulation runs it before the systems
+void apply_commands(entt::registry &registry);
+
+} // namespace stratgame
@@ -12,6 +12,9 @@ struct Movement {
     float speed;
 };
 
+// Height of a unit's position above the ground, units are spheres of radius 1 for now
+constexpr auto unit_ground_offset = 1.f;
+
 struct Transform {
     Vector3 position;
 };
@@ -0,0 +1,511 @@
+#include "culling.hpp"
+#include "camera.hpp"
+#include "common_components.hpp"
+#include "drawing.hpp"
+#include "height_field.hpp"
+#include "occlusion.hpp"
+#include "terrain.hpp"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <raymath.h>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define STRATGAME_CULLING_SSE2
+#endif
+
+namespace stratgame {
+
+auto make_culling_frustum(const Camera &camera) -> CullingFrustum {
+    const auto half_fovy = camera.get_fovy() / 2.f;
+    const auto half_fovx = camera.get_fovx() / 2.f;
+
+    return CullingFrustum{.position = camera.get_source_position(),
+                          .dir = camera.get_camera_dir(),
+                          .right = camera.get_right_vec(),
+                          .up = camera.get_up_vec(),
+                          .tan_x = std::tan(half_fovx),
+                          .tan_y = std::tan(half_fovy),
+                          .factor_x = 1.f / std::cos(half_fovx),
+                          .factor_y = 1.f / std::cos(half_fovy)};
+}
+
+auto test_sphere(const CullingFrustum &frustum, const Vector3 &center, const float radius) -> CullingResult {
+    const auto camera_to_sphere_vec = Vector3Subtract(center, frustum.position);
+    const auto sz = Vector3DotProduct(frustum.dir, camera_to_sphere_vec);
+    const auto sy = std::abs(Vector3DotProduct(frustum.up, camera_to_sphere_vec));
+    const auto sx = std::abs(Vector3DotProduct(frustum.right, camera_to_sphere_vec));
+
+    const auto y_limit = sz * frustum.tan_y;
+    const auto x_limit = sz * frustum.tan_x;
+    const auto y_margin = radius * frustum.factor_y;
+    const auto x_margin = radius * frustum.factor_x;
+
+    if (sy > y_limit + y_margin || sx > x_limit + x_margin) {
+        return CullingResult::Outside;
+    }
+    if (sy <= y_limit - y_margin && sx <= x_limit - x_margin) {
+        return CullingResult::Inside;
+    }
+    return CullingResult::Intersecting;
+}
+
+static void test_spheres_scalar(const CullingFrustum &frustum, const float *x, const float *y, const float *z,
+                                const float *radius, const std::size_t count, std::uint8_t *visible) {
+    for (auto i = 0u; i < count; i++) {
+        const auto vx = x[i] - frustum.position.x;
+        const auto vy = y[i] - frustum.position.y;
+        const auto vz = z[i] - frustum.position.z;
+
+        const auto sz = frustum.dir.x * vx + frustum.dir.y * vy + frustum.dir.z * vz;
+        const auto sy = frustum.up.x * vx + frustum.up.y * vy + frustum.up.z * vz;
+        const auto sx = frustum.right.x * vx + frustum.right.y * vy + frustum.right.z * vz;
+
+        const auto y_dist = radius[i] * frustum.factor_y + sz * frustum.tan_y;
+        const auto x_dist = radius[i] * frustum.factor_x + sz * frustum.tan_x;
+        visible[i] = static_cast<std::uint8_t>(std::abs(sy) <= y_dist && std::abs(sx) <= x_dist);
+    }
+}
+
+void test_spheres(const CullingFrustum &frustum, const float *x, const float *y, const float *z, const float *radius,
+                  const std::size_t count, std::uint8_t *visible) {
+    auto i = std::size_t{0};
+
+#if defined(__AVX__)
+    const auto sign_mask = _mm256_set1_ps(-0.f);
+    const auto px = _mm256_set1_ps(frustum.position.x);
+    const auto py = _mm256_set1_ps(frustum.position.y);
+    const auto pz = _mm256_set1_ps(frustum.position.z);
+    const auto dx = _mm256_set1_ps(frustum.dir.x);
+    const auto dy = _mm256_set1_ps(frustum.dir.y);
+    const auto dz = _mm256_set1_ps(frustum.dir.z);
+    const auto ux = _mm256_set1_ps(frustum.up.x);
+    const auto uy = _mm256_set1_ps(frustum.up.y);
+    const auto uz = _mm256_set1_ps(frustum.up.z);
+    const auto rx = _mm256_set1_ps(frustum.right.x);
+    const auto ry = _mm256_set1_ps(frustum.right.y);
+    const auto rz = _mm256_set1_ps(frustum.right.z);
+    const auto tan_x = _mm256_set1_ps(frustum.tan_x);
+    const auto tan_y = _mm256_set1_ps(frustum.tan_y);
+    const auto factor_x = _mm256_set1_ps(frustum.factor_x);
+    const auto factor_y = _mm256_set1_ps(frustum.factor_y);
+
+    for (; i + 8u <= count; i += 8u) {
+        const auto vx = _mm256_sub_ps(_mm256_loadu_ps(x + i), px);
+        const auto vy = _mm256_sub_ps(_mm256_loadu_ps(y + i), py);
+        const auto vz = _mm256_sub_ps(_mm256_loadu_ps(z + i), pz);
+        const auto r = _mm256_loadu_ps(radius + i);
+
+        const auto sz =
+            _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, vx), _mm256_mul_ps(dy, vy)), _mm256_mul_ps(dz, vz));
+        const auto sy =
+            _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ux, vx), _mm256_mul_ps(uy, vy)), _mm256_mul_ps(uz, vz));
+        const auto sx =
+            _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(rx, vx), _mm256_mul_ps(ry, vy)), _mm256_mul_ps(rz, vz));
+
+        const auto y_dist = _mm256_add_ps(_mm256_mul_ps(r, factor_y), _mm256_mul_ps(sz, tan_y));
+        const auto x_dist = _mm256_add_ps(_mm256_mul_ps(r, factor_x), _mm256_mul_ps(sz, tan_x));
+
+        const auto inside_y = _mm256_cmp_ps(_mm256_andnot_ps(sign_mask, sy), y_dist, _CMP_LE_OQ);
+        const auto inside_x = _mm256_cmp_ps(_mm256_andnot_ps(sign_mask, sx), x_dist, _CMP_LE_OQ);
+        const auto mask = static_cast<unsigned>(_mm256_movemask_ps(_mm256_and_ps(inside_x, inside_y)));
+
+        for (auto lane = 0u; lane < 8u; lane++) {
+            visible[i + lane] = static_cast<std::uint8_t>((mask >> lane) & 1u);
+        }
+    }
+#elif defined(STRATGAME_CULLING_SSE2)
+    const auto sign_mask = _mm_set1_ps(-0.f);
+    const auto px = _mm_set1_ps(frustum.position.x);
+    const auto py = _mm_set1_ps(frustum.position.y);
+    const auto pz = _mm_set1_ps(frustum.position.z);
+    const auto dx = _mm_set1_ps(frustum.dir.x);
+    const auto dy = _mm_set1_ps(frustum.dir.y);
+    const auto dz = _mm_set1_ps(frustum.dir.z);
+    const auto ux = _mm_set1_ps(frustum.up.x);
+    const auto uy = _mm_set1_ps(frustum.up.y);
+    const auto uz = _mm_set1_ps(frustum.up.z);
+    const auto rx = _mm_set1_ps(frustum.right.x);
+    const auto ry = _mm_set1_ps(frustum.right.y);
+    const auto rz = _mm_set1_ps(frustum.right.z);
+    const auto tan_x = _mm_set1_ps(frustum.tan_x);
+    const auto tan_y = _mm_set1_ps(frustum.tan_y);
+    const auto factor_x = _mm_set1_ps(frustum.factor_x);
+    const auto factor_y = _mm_set1_ps(frustum.factor_y);
+
+    for (; i + 4u <= count; i += 4u) {
+        const auto vx = _mm_sub_ps(_mm_loadu_ps(x + i), px);
+        const auto vy = _mm_sub_ps(_mm_loadu_ps(y + i), py);
+        const auto vz = _mm_sub_ps(_mm_loadu_ps(z + i), pz);
+        const auto r = _mm_loadu_ps(radius + i);
+
+        const auto sz = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, vx), _mm_mul_ps(dy, vy)), _mm_mul_ps(dz, vz));
+        const auto sy = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ux, vx), _mm_mul_ps(uy, vy)), _mm_mul_ps(uz, vz));
+        const auto sx = _mm_add_ps(_mm_add_ps(_mm_mul_ps(rx, vx), _mm_mul_ps(ry, vy)), _mm_mul_ps(rz, vz));
+
+        const auto y_dist = _mm_add_ps(_mm_mul_ps(r, factor_y), _mm_mul_ps(sz, tan_y));
+        const auto x_dist = _mm_add_ps(_mm_mul_ps(r, factor_x), _mm_mul_ps(sz, tan_x));
+
+        const auto inside_y = _mm_cmple_ps(_mm_andnot_ps(sign_mask, sy), y_dist);
+        const auto inside_x = _mm_cmple_ps(_mm_andnot_ps(sign_mask, sx), x_dist);
+        const auto mask = static_cast<unsigned>(_mm_movemask_ps(_mm_and_ps(inside_x, inside_y)));
+
+        for (auto lane = 0u; lane < 4u; lane++) {
+            visible[i + lane] = static_cast<std::uint8_t>((mask >> lane) & 1u);
+        }
+    }
+#endif
+
+    test_spheres_scalar(frustum, x + i, y + i, z + i, radius + i, count - i, visible + i);
+}
+
+// ===================================
+// CullingSpheres
+// ===================================
+auto CullingSpheres::contains(const entt::entity entity) const -> bool {
+    const auto index = static_cast<std::size_t>(entt::to_entity(entity));
+    return index < locations.size() && locations[index].slot != invalid_slot;
+}
+
+auto CullingSpheres::region_coord(const float v) const -> std::int32_t {
+    return static_cast<std::int32_t>(std::floor(v / region_size));
+}
+
+auto CullingSpheres::region_for(const Vector3 &center) -> std::uint32_t {
+    const auto rx = region_coord(center.x);
+    const auto rz = region_coord(center.z);
+    const auto key =
+        (static_cast<std::uint64_t>(static_cast<std::uint32_t>(rx)) << 32u) | static_cast<std::uint32_t>(rz);
+
+    const auto [it, inserted] = region_lookup.try_emplace(key, static_cast<std::uint32_t>(regions.size()));
+    if (inserted) {
+        auto &region = regions.emplace_back();
+        region.region_x = rx;
+        region.region_z = rz;
+    }
+    return it->second;
+}
+
+void CullingSpheres::expand_bounds(CullingRegion &region, const Vector3 &center, const float radius) {
+    region.bounds_min = Vector3{std::min(region.bounds_min.x, center.x - radius),
+                                std::min(region.bounds_min.y, center.y - radius),
+                                std::min(region.bounds_min.z, center.z - radius)};
+    region.bounds_max = Vector3{std::max(region.bounds_max.x, center.x + radius),
+                                std::max(region.bounds_max.y, center.y + radius),
+                                std::max(region.bounds_max.z, center.z + radius)};
+}
+
+void CullingSpheres::insert(const entt::entity entity, const Vector3 &position,
+                            const FrustumCullingComponent &culling) {
+    if (contains(entity)) {
+        remove(entity);
+    }
+
+    const auto index = static_cast<std::size_t>(entt::to_entity(entity));
+    if (index >= locations.size()) {
+        locations.resize(index + 1u, Location{.region = 0u, .slot = invalid_slot});
+    }
+
+    const auto center = culling.get_sphere_center(position);
+    const auto region_index = region_for(center);
+    auto &region = regions[region_index];
+
+    if (region.entities.empty()) {
+        region.bounds_min = center;
+        region.bounds_max = center;
+    }
+    expand_bounds(region, center, culling.radius);
+
+    region.x.push_back(center.x);
+    region.y.push_back(center.y);
+    region.z.push_back(center.z);
+    region.radius.push_back(culling.radius);
+    region.offsets.push_back(culling.offset);
+    region.entities.push_back(entity);
+    region.visible.push_back(1u); // matches the ModelComponent::visible default
+
+    locations[index] =
+        Location{.region = region_index, .slot = static_cast<std::uint32_t>(region.entities.size() - 1u)};
+}
+
+void CullingSpheres::update(const entt::entity entity, const Vector3 &position) {
+    if (!contains(entity)) {
+        return;
+    }
+
+    const auto location = locations[static_cast<std::size_t>(entt::to_entity(entity))];
+    auto &region = regions[location.region];
+    const auto slot = location.slot;
+    const auto offset = region.offsets[slot];
+    const auto center = Vector3{position.x + offset.x, position.y, position.z + offset.y};
+
+    // NOTE: Only re-bucket when the sphere leaves its region, otherwise update in place
+    if (region_coord(center.x) != region.region_x || region_coord(center.z) != region.region_z) {
+        const auto culling = FrustumCullingComponent{.radius = region.radius[slot], .offset = offset};
+        const auto was_visible = region.visible[slot];
+        remove(entity);
+        insert(entity, position, culling);
+        const auto moved_to = locations[static_cast<std::size_t>(entt::to_entity(entity))];
+        regions[moved_to.region].visible[moved_to.slot] = was_visible;
+        return;
+    }
+
+    expand_bounds(region, center, region.radius[slot]);
+    region.x[slot] = center.x;
+    region.y[slot] = center.y;
+    region.z[slot] = center.z;
+}
+
+// swap-and-pop inside the region, the moved sphere gets its slot patched
+void CullingSpheres::remove(const entt::entity entity) {
+    if (!contains(entity)) {
+        return;
+    }
+
+    auto &location = locations[static_cast<std::size_t>(entt::to_entity(entity))];
+    auto &region = regions[location.region];
+    const auto slot = location.slot;
+    const auto last = region.entities.size() - 1u;
+
+    if (slot != last) {
+        region.x[slot] = region.x[last];
+        region.y[slot] = region.y[last];
+        region.z[slot] = region.z[last];
+        region.radius[slot] = region.radius[last];
+        region.offsets[slot] = region.offsets[last];
+        region.entities[slot] = region.entities[last];
+        region.visible[slot] = region.visible[last];
+        locations[static_cast<std::size_t>(entt::to_entity(region.entities[slot]))].slot = slot;
+    }
+
+    region.x.pop_back();
+    region.y.pop_back();
+    region.z.pop_back();
+    region.radius.pop_back();
+    region.offsets.pop_back();
+    region.entities.pop_back();
+    region.visible.pop_back();
+
+    location.slot = invalid_slot;
+}
+
+void CullingSpheres::refresh(const entt::storage<Transform> &transforms) {
+    moved.clear();
+
+    for (auto &region : regions) {
+        const auto min_x = static_cast<float>(region.region_x) * region_size;
+        const auto min_z = static_cast<float>(region.region_z) * region_size;
+        const auto max_x = min_x + region_size;
+        const auto max_z = min_z + region_size;
+
+        // NOTE: Bounds are rebuilt from scratch here, so they tighten again once spheres have moved away
+        constexpr auto infinity = std::numeric_limits<float>::infinity();
+        auto bounds_min = Vector3{infinity, infinity, infinity};
+        auto bounds_max = Vector3{-infinity, -infinity, -infinity};
+
+        const auto count = region.entities.size();
+        const auto *entities = region.entities.data();
+        const auto *offsets = region.offsets.data();
+        const auto *radius = region.radius.data();
+        auto *xs = region.x.data();
+        auto *ys = region.y.data();
+        auto *zs = region.z.data();
+
+        for (auto i = std::size_t{0}; i < count; i++) {
+            const auto &position = transforms.get(entities[i]).position;
+            const auto x = position.x + offsets[i].x;
+            const auto y = position.y;
+            const auto z = position.z + offsets[i].y;
+
+            if (x < min_x || x >= max_x || z < min_z || z >= max_z) {
+                moved.push_back(entities[i]);
+                continue;
+            }
+
+            xs[i] = x;
+            ys[i] = y;
+            zs[i] = z;
+
+            const auto r = radius[i];
+            bounds_min =
+                Vector3{std::min(bounds_min.x, x - r), std::min(bounds_min.y, y - r), std::min(bounds_min.z, z - r)};
+            bounds_max =
+                Vector3{std::max(bounds_max.x, x + r), std::max(bounds_max.y, y + r), std::max(bounds_max.z, z + r)};
+        }
+
+        region.bounds_min = bounds_min;
+        region.bounds_max = bounds_max;
+    }
+
+    // NOTE: Re-bucketed after the walk, moving spheres between regions reorders the arrays being walked
+    for (const auto entity : moved) {
+        update(entity, transforms.get(entity).position);
+    }
+}
+
+// ===================================
+// systems
+// ===================================
+void setup_culling(entt::registry &registry, const float region_size) {
+    registry.ctx().emplace<CullingSpheres>(region_size);
+    registry.ctx().emplace<OcclusionBuffer>();
+
+    // NOTE: FrustumCullingComponent requires Transform to already be present
+    registry.on_construct<FrustumCullingComponent>().connect<[](entt::registry &registry, entt::entity entity) {
+        const auto &[culling, transform] = registry.get<const FrustumCullingComponent, const Transform>(entity);
+        registry.ctx().get<CullingSpheres>().insert(entity, transform.position, culling);
+    }>();
+
+    registry.on_destroy<FrustumCullingComponent>().connect<[](entt::registry &registry, entt::entity entity) {
+        registry.ctx().get<CullingSpheres>().remove(entity);
+    }>();
+
+    registry.on_update<Transform>().connect<[](entt::registry &registry, entt::entity entity) {
+        registry.ctx().get<CullingSpheres>().update(entity, registry.get<const Transform>(entity).position);
+    }>();
+}
+
+void update_culling_spheres(entt::registry &registry) {
+    registry.ctx().get<CullingSpheres>().refresh(registry.storage<Transform>());
+}
+
+// Rasterizes every loaded chunk the frustum keeps, the order does not matter since only the closest depth is kept.
+// Left as it is while neither the camera nor the terrain changed, units moving do not affect the occluders.
+static void draw_terrain_occluders(entt::registry &registry, const CullingFrustum &frustum,
+                                   const TerrainHeightField &height_field, OcclusionBuffer &occlusion) {
+    if (occlusion.is_drawn(frustum, height_field.get_revision())) {
+        return;
+    }
+    occlusion.begin(frustum, height_field.get_revision());
+    const auto chunks = registry.view<const TerrainChunk>();
+    for (const auto &[entity, chunk] : chunks.each()) {
+        const auto *heights = height_field.find_chunk(chunk.x, chunk.y);
+        if (heights == nullptr) {
+            continue;
+        }
+        const auto origin = Vector2{static_cast<float>(chunk.x) * chunk.size, static_cast<float>(chunk.y) * chunk.size};
+        const auto min = Vector3{origin.x, heights->min_height, origin.y};
+        const auto max = Vector3{origin.x + chunk.size, heights->max_height, origin.y + chunk.size};
+        const auto center = Vector3Scale(Vector3Add(min, max), 0.5f);
+        if (test_sphere(frustum, center, Vector3Distance(min, max) * 0.5f) != CullingResult::Outside) {
+            add_chunk_occluders(occlusion, height_field, *heights, origin);
+        }
+    }
+    occlusion.end();
+}
+
+// Whole regions are classified first, only regions straddling a frustum plane run the per-sphere SIMD test. What the
+// frustum keeps is then tested against the terrain, a region at a time before sphere by sphere.
+// ModelComponent::visible and the visibility of model instances are only touched for entities whose visibility
+// actually changed.
+void flag_culled_models(entt::registry &registry) {
+    const auto camera_entity = registry.view<stratgame::Camera>().front();
+    const auto &camera = registry.get<stratgame::Camera>(camera_entity);
+    const auto frustum = make_culling_frustum(camera);
+
+    auto &spheres = registry.ctx().get<CullingSpheres>();
+    auto &models = registry.storage<ModelComponent>();
+    auto &instances = registry.storage<ModelInstance>();
+    const auto &chunks = registry.storage<TerrainChunk>();
+
+    auto *occlusion = registry.ctx().find<OcclusionBuffer>();
+    const auto *height_field = registry.ctx().find<const TerrainHeightField>();
+    if (occlusion != nullptr && (!occlusion->enabled || height_field == nullptr)) {
+        occlusion = nullptr;
+    }
+    if (occlusion != nullptr) {
+        draw_terrain_occluders(registry, frustum, *height_field, *occlusion);
+    }
+
+    auto stats = CullingStats{};
+    auto results = std::vector<std::uint8_t>{};
+
+    const auto apply = [&](CullingRegion &region, const std::uint8_t *visible) {
+        for (auto i = 0u; i < region.entities.size(); i++) {
+            if (region.visible[i] != visible[i]) {
+                region.visible[i] = visible[i];
+                if (models.contains(region.entities[i])) {
+                    models.get(region.entities[i]).visible = visible[i] != 0u;
+                } else if (instances.contains(region.entities[i])) {
+                    const auto &instance = instances.get(region.entities[i]);
+                    auto &model = registry.get<InstanceableModel>(instance.model_entity);
+                    model.visible_count = model.visible_count - model.visible[instance.slot] + visible[i];
+                    model.visible[instance.slot] = visible[i];
+                }
+            }
+            stats.visible += visible[i];
+        }
+        stats.culled += static_cast<std::uint32_t>(region.entities.size());
+    };
+
+    // NOTE: Terrain chunks are tested again with their height bounds, their culling sphere reaches far above and below
+    // the ground
+    const auto flag_occluded = [&](CullingRegion &region, std::uint8_t *visible) {
+        const auto count = region.entities.size();
+        const auto before = std::reduce(visible, visible + count, std::uint32_t{0u});
+        occlusion->test_spheres(region.x.data(), region.y.data(), region.z.data(), region.radius.data(), count,
+                                visible);
+        for (auto i = std::size_t{0}; i < count; i++) {
+            if (visible[i] == 0u || !chunks.contains(region.entities[i])) {
+                continue;
+            }
+            const auto &chunk = chunks.get(region.entities[i]);
+            if (const auto *heights = height_field->find_chunk(chunk.x, chunk.y)) {
+                const auto origin_x = static_cast<float>(chunk.x) * chunk.size;
+                const auto origin_z = static_cast<float>(chunk.y) * chunk.size;
+                const auto occluded = occlusion->is_box_occluded(
+                    Vector3{origin_x, heights->min_height, origin_z},
+                    Vector3{origin_x + chunk.size, heights->max_height, origin_z + chunk.size});
+                visible[i] = static_cast<std::uint8_t>(!occluded);
+            }
+        }
+        stats.occluded += before - std::reduce(visible, visible + count, std::uint32_t{0u});
+    };
+
+    for (auto &region : spheres.get_regions()) {
+        if (region.entities.empty()) {
+            continue;
+        }
+
+        const auto center = Vector3Scale(Vector3Add(region.bounds_min, region.bounds_max), 0.5f);
+        const auto radius = Vector3Distance(region.bounds_min, region.bounds_max) * 0.5f;
+        const auto coarse = test_sphere(frustum, center, radius);
+
+        if (coarse == CullingResult::Outside) {
+            results.assign(region.entities.size(), 0u);
+            apply(region, results.data());
+            stats.regions_outside++;
+            continue;
+        }
+        if (occlusion != nullptr && occlusion->is_box_occluded(region.bounds_min, region.bounds_max)) {
+            results.assign(region.entities.size(), 0u);
+            apply(region, results.data());
+            stats.occluded += static_cast<std::uint32_t>(region.entities.size());
+            stats.regions_occluded++;
+            continue;
+        }
+
+        if (coarse == CullingResult::Intersecting) {
+            results.resize(region.entities.size());
+            test_spheres(frustum, region.x.data(), region.y.data(), region.z.data(), region.radius.data(),
+                         region.entities.size(), results.data());
+            stats.regions_tested++;
+        } else {
+            results.assign(region.entities.size(), 1u);
+            stats.regions_inside++;
+        }
+
+        if (occlusion != nullptr) {
+            flag_occluded(region, results.data());
+        }
+        apply(region, results.data());
+    }
+
+    stats.culled -= stats.visible;
+    spheres.stats = stats;
+}
+}; // namespace stratgame
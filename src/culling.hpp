@@ -0,0 +1,123 @@
+#pragma once
+
+#include <cstdint>
+#include <entt.hpp>
+#include <raylib.h>
+#include <raymath.h>
+#include <unordered_map>
+#include <vector>
+#include "common.hpp"
+#include "common_components.hpp"
+
+namespace stratgame {
+struct Camera;
+
+struct FrustumCullingComponent {
+    float radius;
+    Vector2 offset; // offset from the Transform component used in the frustum culling check
+
+    [[nodiscard]] auto get_sphere_center(const Vector3 &position) const -> Vector3 {
+        const auto culled_center_1 = Vector2(position.x, position.z);
+        return to_vec3(Vector2Add(culled_center_1, offset), position.y);
+    }
+
+    [[nodiscard]] auto get_sphere_center(const Vector2 &position) const -> Vector2 {
+        const auto culled_center_1 = position;
+        return Vector2Add(culled_center_1, offset);
+    }
+};
+
+// Side planes of the camera frustum in the form used by the sphere test:
+// a sphere is outside when |dot(v, up)| > r * factor_y + dot(v, dir) * tan_y (same for x), v = center - position
+struct CullingFrustum {
+    Vector3 position;
+    Vector3 dir;
+    Vector3 right;
+    Vector3 up;
+    float tan_x;
+    float tan_y;
+    float factor_x;
+    float factor_y;
+};
+
+[[nodiscard]] auto make_culling_frustum(const Camera &camera) -> CullingFrustum;
+
+enum class CullingResult : std::uint8_t { Outside, Intersecting, Inside };
+
+[[nodiscard]] auto test_sphere(const CullingFrustum &frustum, const Vector3 &center, float radius) -> CullingResult;
+
+// Writes 1 (visible) or 0 (culled) per sphere, 8 or 4 spheres at a time depending on the instruction set
+void test_spheres(const CullingFrustum &frustum, const float *x, const float *y, const float *z, const float *radius,
+                  std::size_t count, std::uint8_t *visible);
+
+// Culling spheres that fall into the same square of the xz plane, stored as structure of arrays
+struct CullingRegion {
+    std::vector<float> x;
+    std::vector<float> y;
+    std::vector<float> z;
+    std::vector<float> radius;
+    std::vector<Vector2> offsets; // FrustumCullingComponent::offset, needed to refresh the centers from Transform
+    std::vector<entt::entity> entities;
+    std::vector<std::uint8_t> visible; // last result, ModelComponent::visible is only written when this flips
+
+    std::int32_t region_x;
+    std::int32_t region_z;
+
+    // conservative bounds of every sphere ever stored, reset when the region empties
+    Vector3 bounds_min;
+    Vector3 bounds_max;
+};
+
+struct CullingStats {
+    std::uint32_t visible = 0u;
+    std::uint32_t culled = 0u;
+    std::uint32_t occluded = 0u; // of culled, the ones inside the frustum but hidden behind terrain
+    std::uint32_t regions_inside = 0u;
+    std::uint32_t regions_outside = 0u;
+    std::uint32_t regions_tested = 0u;
+    std::uint32_t regions_occluded = 0u;
+};
+
+// Packed mirror of every FrustumCullingComponent, lives in registry.ctx() and is kept up to date by hooks
+struct CullingSpheres {
+    explicit CullingSpheres(float region_size = 128.f) : region_size(region_size) {}
+
+    void insert(entt::entity entity, const Vector3 &position, const FrustumCullingComponent &culling);
+    void update(entt::entity entity, const Vector3 &position);
+    void remove(entt::entity entity);
+
+    // Re-reads every sphere center from the Transform storage, walking the packed arrays in order
+    void refresh(const entt::storage<Transform> &transforms);
+
+    [[nodiscard]] auto contains(entt::entity entity) const -> bool;
+    [[nodiscard]] auto get_regions() -> std::vector<CullingRegion> & { return regions; }
+
+    CullingStats stats; // filled by flag_culled_models
+
+  private:
+    struct Location {
+        std::uint32_t region;
+        std::uint32_t slot;
+    };
+    constexpr static auto invalid_slot = ~std::uint32_t{0};
+
+    float region_size;
+    std::vector<CullingRegion> regions;
+    std::unordered_map<std::uint64_t, std::uint32_t> region_lookup;
+    std::vector<Location> locations; // indexed by entt::to_entity
+
+    std::vector<entt::entity> moved; // scratch for refresh
+
+    [[nodiscard]] auto region_coord(float v) const -> std::int32_t;
+    [[nodiscard]] auto region_for(const Vector3 &center) -> std::uint32_t;
+    static void expand_bounds(CullingRegion &region, const Vector3 &center, float radius);
+};
+
+// Also puts an OcclusionBuffer in registry.ctx()
+void setup_culling(entt::registry &registry, float region_size = 128.f);
+// Picks up Transforms written in place by update_transform, which does not go through registry.patch
+void update_culling_spheres(entt::registry &registry);
+// Frustum culling for the first Camera, followed by occlusion culling against the terrain when there is a
+// TerrainHeightField and the OcclusionBuffer is enabled
+void flag_culled_models(entt::registry &registry);
+}; // namespace stratgame
@@ -1,12 +1,16 @@
-#include <print>
 #include "drawing.hpp"
 #include "camera.hpp"
 #include "common_components.hpp"
+#include "culling.hpp"
+#include "terrain.hpp"
+#include <bit>
 #include <raymath.h>
+#include <rlgl.h>
 
 namespace stratgame {
-void draw_models(const entt::registry &registry) {
-    const auto view = registry.view<ModelComponent, stratgame::Transform>();
+auto draw_models(const entt::registry &registry) -> DrawStats {
+    auto stats = DrawStats{};
+    const auto view = registry.view<ModelComponent, stratgame::Transform>(entt::exclude<TerrainChunk>);
     for (auto entity : view) {
         const auto &model_component = view.get<ModelComponent>(entity);
 
@@ -22,105 +26,144 @@ void draw_models(const entt::registry &registry) {
             model_component.model.materials[0].shader = shader_component.shader;
             DrawModel(model_component.model, transform.position, 1.0f, WHITE);
             model_component.model.materials[0].shader = shader_backup;
+            stats.draw_calls += static_cast<std::uint32_t>(model_component.model.meshCount);
             continue;
         }
         DrawModel(model_component.model, transform.position, model_component.scale, WHITE);
+        stats.draw_calls += static_cast<std::uint32_t>(model_component.model.meshCount);
     }
+    return stats;
 }
 
-void flag_culled_models(entt::registry &registry) {
-    const auto models_view = registry.view<ModelComponent, stratgame::Transform, FrustumCullingComponent>();
-
-    const auto camera_entity = registry.view<stratgame::Camera>().front();
-    const auto &camera = registry.get<stratgame::Camera>(camera_entity);
-    const auto camera_pos = camera.get_source_position();
-    const auto camera_dir = camera.get_camera_dir();
-
-    const auto right_vec = camera.get_right_vec();
-    const auto up_vec = camera.get_up_vec();
-
-    const auto half_fovy = camera.get_fovy() / 2.f;
-    const auto half_fovx = camera.get_fovx() / 2.f;
-
-    const auto tan_half_fovy = std::tan(half_fovy);
-    const auto tan_half_fovx = std::tan(half_fovx);
-    const auto factor_x = 1.f / std::cos(half_fovx);
-    const auto factor_y = 1.f / std::cos(half_fovy);
-
-    for (auto model_entity : models_view) {
-        const auto &[model_component, transform, culling_component] = models_view.get(model_entity);
+// The buffer only grows, the vertex arrays keep the attribute pointing at it between frames
+static void upload_instance_colors(InstanceableModel &model, const std::span<const Color> colors) {
+    const auto size = static_cast<int>(colors.size() * sizeof(Color));
+    if (colors.size() <= model.color_buffer_capacity) {
+        rlUpdateVertexBuffer(model.color_buffer, colors.data(), size, 0);
+        return;
+    }
 
-        model_component.visible = true;
+    if (model.color_buffer != 0u) {
+        rlUnloadVertexBuffer(model.color_buffer);
+    }
+    model.color_buffer_capacity = std::bit_ceil(colors.size());
+    model.color_buffer =
+        rlLoadVertexBuffer(nullptr, static_cast<int>(model.color_buffer_capacity * sizeof(Color)), true);
+    rlUpdateVertexBuffer(model.color_buffer, colors.data(), size, 0);
+
+    const auto location = static_cast<unsigned int>(model.color_location);
+    for (auto i = 0; i < model.model.meshCount; i++) {
+        rlEnableVertexArray(model.model.meshes[i].vaoId);
+        rlEnableVertexBuffer(model.color_buffer);
+        rlEnableVertexAttribute(location);
+        rlSetVertexAttribute(location, 4, RL_UNSIGNED_BYTE, true, 0, nullptr);
+        rlSetVertexAttributeDivisor(location, 1);
+        rlDisableVertexBuffer();
+        rlDisableVertexArray();
+    }
+}
 
-        const auto culling_sphere_center = culling_component.get_sphere_center(transform.position);
-        const auto camera_to_sphere_vec = Vector3Subtract(culling_sphere_center, camera_pos);
-        const auto sz = Vector3DotProduct(camera_dir, camera_to_sphere_vec);
+// One instanced draw per mesh, culled instances are compacted out first unless every instance is visible
+auto draw_models_instanced(entt::registry &registry) -> DrawStats {
+    auto stats = DrawStats{};
+    auto models = registry.view<InstanceableModel>();
 
-        const auto sy = Vector3DotProduct(up_vec, camera_to_sphere_vec);
-        const auto y_dist = culling_component.radius * factor_y + sz * tan_half_fovy;
-        if (sy > y_dist || sy < -y_dist) {
-            model_component.visible = false;
+    for (auto &&[model_entity, instanceable_model] : models.each()) {
+        if (instanceable_model.visible_count == 0u) {
             continue;
         }
 
-        const auto sx = Vector3DotProduct(right_vec, camera_to_sphere_vec);
-        const auto x_dist = culling_component.radius * factor_x + sz * tan_half_fovx;
-        if (sx > x_dist || sx < -x_dist) {
-            model_component.visible = false;
+        const auto instances = gather_visible_instances(instanceable_model);
+        if (instanceable_model.color_location >= 0) {
+            upload_instance_colors(instanceable_model, instances.colors);
+        }
+        for (auto i = 0; i < instanceable_model.model.meshCount; i++) {
+            DrawMeshInstanced(instanceable_model.model.meshes[i], instanceable_model.model.materials[0],
+                              instances.transforms.data(), static_cast<int>(instances.transforms.size()));
         }
+        stats.draw_calls += static_cast<std::uint32_t>(instanceable_model.model.meshCount);
+        stats.instances += static_cast<std::uint32_t>(instances.transforms.size());
     }
+    return stats;
 }
 
-auto register_instanceable_model(entt::registry &registry, const Model &model) -> entt::entity {
-    static int model_id = 0;
-
-    std::println("Registering model with id: {}", model_id);
-
-    const auto entity = registry.create();
-    registry.emplace<InstanceableModel>(entity, model_id, model, std::vector<Matrix>{});
+// Nodes reuse the chunk material, only the uniforms describing the node change between draws
+static auto draw_terrain_nodes(const entt::registry &registry, const TerrainLod &lod, const Color tint) -> DrawStats {
+    auto stats = DrawStats{};
+    const auto cameras = registry.view<const Camera>();
+    if (cameras.empty()) {
+        return stats;
+    }
+    const auto &camera = cameras.get<const Camera>(cameras.front());
+    const auto camera_position = camera.get_source_position();
+    const auto frustum = make_culling_frustum(camera);
+
+    // NOTE: Reused between frames, drawing only ever happens on the main thread
+    static auto nodes = std::vector<TerrainNode>{};
+    const auto vertex_spacing = lod.get_vertex_spacing();
+
+    const auto view = registry.view<const ModelComponent, const stratgame::Transform, const TerrainChunk>();
+    for (const auto &[entity, model_component, transform, chunk] : view.each()) {
+        const auto &model = model_component.model;
+        if (!model_component.visible || model.meshCount == 0) {
+            continue;
+        }
 
-    model_id++;
-    return entity;
+        nodes.clear();
+        lod.select(transform.position, camera_position, frustum, nodes);
+
+        auto &material = model.materials[0];
+        const auto &shader = material.shader;
+        const auto node_origin_location = GetShaderLocation(shader, "node_origin");
+        const auto node_stride_location = GetShaderLocation(shader, "node_stride");
+        const auto morph_range_location = GetShaderLocation(shader, "morph_range");
+        SetShaderValue(shader, GetShaderLocation(shader, "camera_position"), &camera_position, SHADER_UNIFORM_VEC3);
+        SetShaderValue(shader, GetShaderLocation(shader, "vertex_spacing"), &vertex_spacing, SHADER_UNIFORM_FLOAT);
+
+        const auto color_backup = material.maps[MATERIAL_MAP_DIFFUSE].color;
+        material.maps[MATERIAL_MAP_DIFFUSE].color = tint;
+        const auto matrix = MatrixTranslate(transform.position.x, transform.position.y, transform.position.z);
+        // NOTE: Partial nodes only exist with more than one level, the node grid is even then and every quadrant has
+        // the same number of patches
+        const auto patches = model.meshCount / 4;
+
+        for (const auto &node : nodes) {
+            const auto origin = Vector2{static_cast<float>(node.x), static_cast<float>(node.y)};
+            const auto stride = static_cast<float>(1u << node.level);
+            const auto morph_range = lod.get_morph_range(node.level);
+            SetShaderValue(shader, node_origin_location, &origin, SHADER_UNIFORM_VEC2);
+            SetShaderValue(shader, node_stride_location, &stride, SHADER_UNIFORM_FLOAT);
+            SetShaderValue(shader, morph_range_location, &morph_range, SHADER_UNIFORM_VEC2);
+
+            for (auto i = 0; i < model.meshCount; i++) {
+                const auto quadrant = patches > 0 ? i / patches : 0;
+                if (node.quadrants != 0b1111u && (node.quadrants & (1u << quadrant)) == 0u) {
+                    continue;
+                }
+                DrawMesh(model.meshes[i], material, matrix);
+                stats.draw_calls++;
+                stats.terrain_triangles += static_cast<std::uint32_t>(model.meshes[i].triangleCount);
+            }
+        }
+        material.maps[MATERIAL_MAP_DIFFUSE].color = color_backup;
+    }
+    return stats;
 }
 
-void create_model_instance(entt::registry &registry, entt::entity model_entity, Vector3 transform,
-                           entt::entity object_entity) {
-    registry.emplace<stratgame::Transform>(object_entity, transform);
-
-    auto &instanceable_model = registry.get<InstanceableModel>(model_entity);
-    auto &transforms = instanceable_model.transforms;
-
-    transforms.push_back(MatrixIdentity());
-    registry.emplace<ModelInstance>(object_entity, instanceable_model.model_id, static_cast<int>(transforms.size()));
+auto draw_terrain(const entt::registry &registry, const TerrainLod &lod) -> DrawStats {
+    return draw_terrain_nodes(registry, lod, WHITE);
 }
 
-void draw_models_instanced(entt::registry &registry) {
-    const auto models = registry.view<InstanceableModel>();
-    const auto instanced_entities = registry.view<ModelInstance, stratgame::Transform>();
-
-    for (auto model_entity : models) {
-        auto &instanceable_model = models.get<InstanceableModel>(model_entity);
-        auto &transforms = instanceable_model.transforms;
-
-        for (auto instanced_entity : instanced_entities) {
-            const auto &model_instance = instanced_entities.get<ModelInstance>(instanced_entity);
-            if (model_instance.model_id != instanceable_model.model_id) {
-                continue;
-            }
-
-            auto &transform = instanced_entities.get<stratgame::Transform>(instanced_entity);
-            transforms[static_cast<std::size_t>(model_instance.instance_id - 1)] =
-                MatrixTranslate(transform.position.x, transform.position.y, transform.position.z);
-        }
-
-        for (auto i = 0; i < instanceable_model.model.meshCount; i++) {
-            DrawMeshInstanced(instanceable_model.model.meshes[i], instanceable_model.model.materials[0],
-                              transforms.data(), static_cast<int>(transforms.size()));
-        }
-    }
+auto draw_terrain_wireframes(const entt::registry &registry, const TerrainLod &lod) -> DrawStats {
+    rlEnableWireMode();
+    auto stats = draw_terrain_nodes(registry, lod, Fade(LIGHTGRAY, 0.6f));
+    rlDisableWireMode();
+    stats.terrain_triangles = 0u; // the same triangles draw_terrain counted
+    return stats;
 }
 
-void draw_model_wireframes(const entt::registry &registry) {
+auto draw_model_wireframes(const entt::registry &registry) -> DrawStats {
+    auto stats = DrawStats{};
     const auto view = registry.view<ModelComponent, stratgame::Transform, DrawModelWireframeComponent>();
     for (auto entity : view) {
         const auto &model_component = view.get<ModelComponent>(entity);
@@ -131,6 +174,8 @@ void draw_model_wireframes(const entt::registry &registry) {
         }
 
         DrawModelWires(model_component.model, transform.position, 1.0f, Fade(LIGHTGRAY, 0.6f));
+        stats.draw_calls += static_cast<std::uint32_t>(model_component.model.meshCount);
     }
+    return stats;
 }
 }; // namespace stratgame
@@ -3,7 +3,11 @@
 #include <entt.hpp>
 #include <raylib.h>
 #include <raymath.h>
+#include <cstdint>
+#include <vector>
 #include "common.hpp"
+#include "instancing.hpp"
+#include "terrain_lod.hpp"
 
 namespace stratgame {
 struct ModelComponent {
@@ -18,41 +22,28 @@ struct ShaderComponent {
     Shader shader;
 };
 
-struct FrustumCullingComponent {
-    float radius;
-    Vector2 offset; // offset from the Transform component used in the frustum culling check
-
-    [[nodiscard]] auto get_sphere_center(const Vector3 &position) const -> Vector3 {
-        const auto culled_center_1 = Vector2(position.x, position.z);
-        return to_vec3(Vector2Add(culled_center_1, offset), position.y);
-    }
-
-    [[nodiscard]] auto get_sphere_center(const Vector2 &position) const -> Vector2 {
-        const auto culled_center_1 = position;
-        return Vector2Add(culled_center_1, offset);
-    }
-};
-void flag_culled_models(entt::registry &registry);
-
 // requires ModelComponent
 struct DrawModelWireframeComponent {};
 
-void draw_models(const entt::registry &registry);
-void draw_model_wireframes(const entt::registry &registry);
-void draw_models_instanced(entt::registry &registry);
-
-struct InstanceableModel {
-    int model_id;
-    Model model;
-    std::vector<Matrix> transforms;
+// What a draw system submitted, for the profiler counters
+struct DrawStats {
+    std::uint32_t draw_calls = 0u;
+    std::uint32_t instances = 0u; // drawn through instanced calls
+    std::uint32_t terrain_triangles = 0u;
+
+    auto operator+=(const DrawStats &other) -> DrawStats & {
+        draw_calls += other.draw_calls;
+        instances += other.instances;
+        terrain_triangles += other.terrain_triangles;
+        return *this;
+    }
 };
 
-struct ModelInstance {
-    int model_id;
-    int instance_id;
-};
+auto draw_models(const entt::registry &registry) -> DrawStats;
+auto draw_model_wireframes(const entt::registry &registry) -> DrawStats;
+auto draw_models_instanced(entt::registry &registry) -> DrawStats;
 
-auto register_instanceable_model(entt::registry &registry, const Model &model) -> entt::entity;
-void create_model_instance(entt::registry &registry, entt::entity model_entity, Vector3 transform,
-                           entt::entity object_entity);
+// Terrain chunks are drawn node by node as picked by lod for the first Camera, draw_models leaves them out
+auto draw_terrain(const entt::registry &registry, const TerrainLod &lod) -> DrawStats;
+auto draw_terrain_wireframes(const entt::registry &registry, const TerrainLod &lod) -> DrawStats;
 }; // namespace stratgame
@@ -0,0 +1,325 @@
+#include "flow_field.hpp"
+#include "height_field.hpp"
+#include "simulation.hpp"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <numbers>
+#include <queue>
+#include <raymath.h>
+#include <utility>
+
+namespace stratgame {
+
+constexpr static auto infinity = std::numeric_limits<float>::infinity();
+
+struct NeighbourOffset {
+    int dx;
+    int dz;
+    float distance;
+};
+
+// NOTE: Orthogonal neighbours first, diagonals are only taken when both orthogonal cells next to them are passable
+constexpr static auto neighbour_offsets = std::array{
+    NeighbourOffset{1, 0, 1.f},
+    NeighbourOffset{-1, 0, 1.f},
+    NeighbourOffset{0, 1, 1.f},
+    NeighbourOffset{0, -1, 1.f},
+    NeighbourOffset{1, 1, std::numbers::sqrt2_v<float>},
+    NeighbourOffset{1, -1, std::numbers::sqrt2_v<float>},
+    NeighbourOffset{-1, 1, std::numbers::sqrt2_v<float>},
+    NeighbourOffset{-1, -1, std::numbers::sqrt2_v<float>},
+};
+
+[[nodiscard]] static auto to_cell(const float v, const float cell_size) -> std::int64_t {
+    return static_cast<std::int64_t>(std::floor(v / cell_size));
+}
+
+auto compute_navigation_costs(const TerrainHeightField *height_field, const float cell_size, const float max_slope,
+                              const float slope_cost, const Vector2 origin, const std::uint32_t columns,
+                              const std::uint32_t rows) -> std::vector<float> {
+    auto costs = std::vector<float>(static_cast<std::size_t>(columns) * rows, 1.f);
+    if (height_field == nullptr) {
+        return costs;
+    }
+
+    const auto corner_columns = static_cast<std::size_t>(columns) + 1u;
+    auto corners = std::vector<float>(corner_columns * (rows + 1u));
+    for (auto row = 0u; row <= rows; row++) {
+        for (auto column = 0u; column <= columns; column++) {
+            const auto position = Vector2{origin.x + static_cast<float>(column) * cell_size,
+                                          origin.y + static_cast<float>(row) * cell_size};
+            corners[row * corner_columns + column] = height_field->get_height(position).value_or(std::nanf(""));
+        }
+    }
+
+    // NOTE: The steepest edge of the cell decides, NaN compares false so cells touching unloaded terrain cost 1
+    for (auto row = 0u; row < rows; row++) {
+        for (auto column = 0u; column < columns; column++) {
+            const auto corner = row * corner_columns + column;
+            const auto h00 = corners[corner];
+            const auto h10 = corners[corner + 1u];
+            const auto h01 = corners[corner + corner_columns];
+            const auto h11 = corners[corner + corner_columns + 1u];
+
+            const auto rise = std::max({std::abs(h10 - h00), std::abs(h01 - h00), std::abs(h11 - h10),
+                                        std::abs(h11 - h01)});
+            const auto slope = std::isnan(rise) ? 0.f : rise / cell_size;
+            costs[row * columns + column] = slope > max_slope ? infinity : 1.f + slope * slope_cost;
+        }
+    }
+    return costs;
+}
+
+auto build_flow_field(const TerrainHeightField *height_field, const FlowFieldSettings &settings, const Vector2 target,
+                      const Vector2 window_min, const Vector2 window_max) -> FlowField {
+    const auto cell_size = settings.cell_size;
+    const auto target_x = to_cell(target.x, cell_size);
+    const auto target_z = to_cell(target.y, cell_size);
+
+    // NOTE: Windows are snapped to the global navigation grid and always contain the target
+    const auto clip = [&](const float low, const float high, const std::int64_t target_cell) {
+        auto first = std::min(to_cell(low, cell_size), target_cell);
+        auto last = std::max(to_cell(high, cell_size), target_cell);
+        const auto max_cells = static_cast<std::int64_t>(settings.max_cells);
+        if (last - first + 1 > max_cells) {
+            first = std::clamp(target_cell - max_cells / 2, first, last - max_cells + 1);
+            last = first + max_cells - 1;
+        }
+        return std::pair{first, static_cast<std::uint32_t>(last - first + 1)};
+    };
+    const auto [first_x, columns] = clip(window_min.x, window_max.x, target_x);
+    const auto [first_z, rows] = clip(window_min.y, window_max.y, target_z);
+
+    auto field = FlowField{
+        .origin = Vector2{static_cast<float>(first_x) * cell_size, static_cast<float>(first_z) * cell_size},
+        .cell_size = cell_size,
+        .columns = columns,
+        .rows = rows,
+        .target = target,
+        .target_x = target_x,
+        .target_z = target_z,
+        .integration = std::vector<float>(static_cast<std::size_t>(columns) * rows, infinity),
+        .directions = std::vector<Vector2>(static_cast<std::size_t>(columns) * rows, Vector2{0.f, 0.f}),
+    };
+
+    auto costs = compute_navigation_costs(height_field, cell_size, settings.max_slope, settings.slope_cost,
+                                          field.origin, columns, rows);
+    const auto target_cell = static_cast<std::uint32_t>((target_z - first_z) * columns + (target_x - first_x));
+    costs[target_cell] = 1.f;
+
+    const auto passable = [&](const std::int64_t column, const std::int64_t row) {
+        return column >= 0 && row >= 0 && column < columns && row < rows &&
+               costs[static_cast<std::size_t>(row * columns + column)] != infinity;
+    };
+    // Calls func(neighbour_index, offset) for every neighbour that can be reached from the cell
+    const auto for_each_neighbour = [&](const std::uint32_t cell, auto &&func) {
+        const auto column = static_cast<std::int64_t>(cell % columns);
+        const auto row = static_cast<std::int64_t>(cell / columns);
+        for (const auto &offset : neighbour_offsets) {
+            if (!passable(column + offset.dx, row + offset.dz)) {
+                continue;
+            }
+            if (offset.dx != 0 && offset.dz != 0 &&
+                !(passable(column + offset.dx, row) && passable(column, row + offset.dz))) {
+                continue;
+            }
+            func(static_cast<std::uint32_t>((row + offset.dz) * columns + column + offset.dx), offset);
+        }
+    };
+
+    // Dijkstra outwards from the target, edges cost the distance times the mean cost of the two cells
+    using QueueEntry = std::pair<float, std::uint32_t>;
+    auto open = std::priority_queue<QueueEntry, std::vector<QueueEntry>, std::greater<>>{};
+    field.integration[target_cell] = 0.f;
+    open.emplace(0.f, target_cell);
+    while (!open.empty()) {
+        const auto [cost, cell] = open.top();
+        open.pop();
+        if (cost > field.integration[cell]) {
+            continue;
+        }
+
+        for_each_neighbour(cell, [&](const std::uint32_t neighbour, const NeighbourOffset &offset) {
+            const auto next = cost + offset.distance * 0.5f * (costs[cell] + costs[neighbour]);
+            if (next < field.integration[neighbour]) {
+                field.integration[neighbour] = next;
+                open.emplace(next, neighbour);
+            }
+        });
+    }
+
+    for (auto cell = 0u; cell < field.integration.size(); cell++) {
+        if (cell == target_cell || field.integration[cell] == infinity) {
+            continue;
+        }
+
+        auto best = field.integration[cell];
+        for_each_neighbour(cell, [&](const std::uint32_t neighbour, const NeighbourOffset &offset) {
+            if (field.integration[neighbour] < best) {
+                best = field.integration[neighbour];
+                const auto step = Vector2{static_cast<float>(offset.dx), static_cast<float>(offset.dz)};
+                field.directions[cell] = Vector2Scale(step, 1.f / offset.distance);
+            }
+        });
+    }
+
+    return field;
+}
+
+auto FlowField::contains(const Vector2 position) const -> bool {
+    const auto column = std::floor((position.x - origin.x) / cell_size);
+    const auto row = std::floor((position.y - origin.y) / cell_size);
+    return column >= 0.f && row >= 0.f && column < static_cast<float>(columns) && row < static_cast<float>(rows);
+}
+
+auto FlowField::reachable(const Vector2 position) const -> bool {
+    if (!contains(position)) {
+        return false;
+    }
+
+    const auto column = static_cast<std::size_t>((position.x - origin.x) / cell_size);
+    const auto row = static_cast<std::size_t>((position.y - origin.y) / cell_size);
+    return integration[row * columns + column] != infinity;
+}
+
+auto FlowField::sample(const Vector2 position) const -> Vector2 {
+    if (!contains(position)) {
+        return Vector2{0.f, 0.f};
+    }
+
+    const auto column = static_cast<std::size_t>((position.x - origin.x) / cell_size);
+    const auto row = static_cast<std::size_t>((position.y - origin.y) / cell_size);
+    return directions[row * columns + column];
+}
+
+auto FlowFieldCache::request(const TerrainHeightField *height_field, const Vector2 target,
+                             std::span<const Vector2> positions, const std::uint64_t tick) -> FlowFieldId {
+    const auto target_x = to_cell(target.x, settings.cell_size);
+    const auto target_z = to_cell(target.y, settings.cell_size);
+
+    for (auto slot = 0u; slot < entries.size(); slot++) {
+        auto &entry = entries[slot];
+        if (!entry.field || entry.field->target_x != target_x || entry.field->target_z != target_z) {
+            continue;
+        }
+        if (std::ranges::all_of(positions, [&](const Vector2 &position) { return entry.field->contains(position); })) {
+            entry.last_used = tick;
+            return FlowFieldId{.slot = slot, .generation = entry.generation};
+        }
+    }
+
+    auto window_min = target;
+    auto window_max = target;
+    for (const auto &position : positions) {
+        window_min = Vector2Min(window_min, position);
+        window_max = Vector2Max(window_max, position);
+    }
+    // NOTE: Detours can leave the window, it grows until every unit can reach the target or it hits max_cells
+    auto padding = settings.padding;
+    auto field = FlowField{};
+    while (true) {
+        const auto margin = Vector2{padding, padding};
+        field = build_flow_field(height_field, settings, target, Vector2Subtract(window_min, margin),
+                                 Vector2Add(window_max, margin));
+
+        const auto all_reachable = std::ranges::all_of(positions, [&](const Vector2 &position) {
+            return field.reachable(position);
+        });
+        const auto clipped = field.columns == settings.max_cells || field.rows == settings.max_cells;
+        if (all_reachable || clipped) {
+            break;
+        }
+        padding *= 2.f;
+    }
+
+    auto slot = static_cast<std::uint32_t>(entries.size());
+    if (!free_slots.empty()) {
+        slot = free_slots.back();
+        free_slots.pop_back();
+    } else {
+        entries.emplace_back();
+    }
+
+    auto &entry = entries[slot];
+    entry.field = std::move(field);
+    entry.last_used = tick;
+    return FlowFieldId{.slot = slot, .generation = entry.generation};
+}
+
+auto FlowFieldCache::use(const FlowFieldId id, const std::uint64_t tick) -> const FlowField * {
+    if (id.slot >= entries.size()) {
+        return nullptr;
+    }
+
+    auto &entry = entries[id.slot];
+    if (!entry.field || entry.generation != id.generation) {
+        return nullptr;
+    }
+
+    // NOTE: Task chunks call this in parallel, they all store the same tick
+    std::atomic_ref{entry.last_used}.store(tick, std::memory_order_relaxed);
+    return &*entry.field;
+}
+
+void FlowFieldCache::drop_unused(const std::uint64_t tick) {
+    for (auto slot = 0u; slot < entries.size(); slot++) {
+        auto &entry = entries[slot];
+        if (entry.field && tick - entry.last_used > settings.unused_ticks) {
+            // NOTE: Bumping the generation invalidates every FlowFieldId still pointing at this slot
+            entry.field.reset();
+            entry.generation++;
+            free_slots.push_back(slot);
+        }
+    }
+}
+
+auto FlowFieldCache::get_state() const -> FlowFieldCacheState {
+    auto state = FlowFieldCacheState{.slots = {}, .free_slots = free_slots};
+    state.slots.reserve(entries.size());
+    for (const auto &entry : entries) {
+        auto &slot = state.slots.emplace_back(std::nullopt, entry.generation, entry.last_used);
+        if (entry.field) {
+            slot.window = FlowFieldWindow{.target = entry.field->target,
+                                          .origin = entry.field->origin,
+                                          .columns = entry.field->columns,
+                                          .rows = entry.field->rows};
+        }
+    }
+    return state;
+}
+
+void FlowFieldCache::restore_state(const TerrainHeightField *height_field, const FlowFieldCacheState &state) {
+    entries.clear();
+    entries.resize(state.slots.size());
+    free_slots = state.free_slots;
+
+    // NOTE: The window is passed in cell centres, build_flow_field snaps it back to exactly the same cells
+    const auto half_cell = Vector2{settings.cell_size * 0.5f, settings.cell_size * 0.5f};
+    for (auto slot = 0u; slot < entries.size(); slot++) {
+        const auto &saved = state.slots[slot];
+        auto &entry = entries[slot];
+        entry.generation = saved.generation;
+        entry.last_used = saved.last_used;
+        if (!saved.window) {
+            continue;
+        }
+
+        const auto &window = *saved.window;
+        const auto size = Vector2{static_cast<float>(window.columns) * settings.cell_size,
+                                  static_cast<float>(window.rows) * settings.cell_size};
+        entry.field = build_flow_field(height_field, settings, window.target, Vector2Add(window.origin, half_cell),
+                                       Vector2Subtract(Vector2Add(window.origin, size), half_cell));
+    }
+}
+
+void update_flow_fields(entt::registry &registry) {
+    if (auto *cache = registry.ctx().find<FlowFieldCache>()) {
+        cache->drop_unused(registry.ctx().get<const SimulationTime>().tick);
+    }
+}
+
+} // namespace stratgame
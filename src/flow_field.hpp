@@ -0,0 +1,116 @@
+#pragma once
+#include <cstdint>
+#include <entt.hpp>
+#include <optional>
+#include <raylib.h>
+#include <span>
+#include <vector>
+
+namespace stratgame {
+struct TerrainHeightField;
+
+struct FlowFieldSettings {
+    float cell_size = 2.f;              // world units per navigation cell
+    float max_slope = 1.f;              // rise over run, steeper cells are impassable
+    float slope_cost = 4.f;             // extra cost per unit of slope on top of the base cost of 1
+    float padding = 32.f;               // world units added around the ordered units and the target
+    std::uint32_t max_cells = 512u;     // per side, orders spanning more are clipped around the target
+    std::uint64_t unused_ticks = 120u;  // fields nobody sampled for this long are dropped
+};
+
+// Integration and direction field of one move order over a window of the navigation grid.
+// Cell (column, row) covers [origin + (column, row) * cell_size, origin + (column + 1, row + 1) * cell_size).
+struct FlowField {
+    Vector2 origin;
+    float cell_size;
+    std::uint32_t columns;
+    std::uint32_t rows;
+
+    Vector2 target;
+    std::int64_t target_x; // global navigation cell of the target
+    std::int64_t target_z;
+
+    std::vector<float> integration;  // cost to reach the target, infinity where it cannot be reached
+    std::vector<Vector2> directions; // normalized, zero in the target cell and where the target cannot be reached
+
+    [[nodiscard]] auto contains(Vector2 position) const -> bool;
+    [[nodiscard]] auto reachable(Vector2 position) const -> bool;
+    // Direction of the cell containing position, zero outside the field
+    [[nodiscard]] auto sample(Vector2 position) const -> Vector2;
+};
+
+// Row major traversal cost of columns x rows navigation cells starting at origin, 1 plus slope_cost per unit of slope.
+// Cells steeper than max_slope are infinity, cells over unloaded terrain (or without a height field) cost 1.
+[[nodiscard]] auto compute_navigation_costs(const TerrainHeightField *height_field, float cell_size, float max_slope,
+                                            float slope_cost, Vector2 origin, std::uint32_t columns,
+                                            std::uint32_t rows) -> std::vector<float>;
+
+[[nodiscard]] auto build_flow_field(const TerrainHeightField *height_field, const FlowFieldSettings &settings,
+                                    Vector2 target, Vector2 window_min, Vector2 window_max) -> FlowField;
+
+// Handle to a field in the FlowFieldCache, stays safe to use after the field was dropped
+struct FlowFieldId {
+    constexpr static auto invalid_slot = ~std::uint32_t{0};
+
+    std::uint32_t slot = invalid_slot;
+    std::uint32_t generation = 0u;
+
+    [[nodiscard]] auto is_valid() const -> bool { return slot != invalid_slot; }
+};
+
+// Where a field lies on the navigation grid, build_flow_field gives the same field again for it on the same terrain
+struct FlowFieldWindow {
+    Vector2 target;
+    Vector2 origin;
+    std::uint32_t columns;
+    std::uint32_t rows;
+};
+
+// Slots of a FlowFieldCache without the fields themselves, see FlowFieldCache::get_state
+struct FlowFieldCacheState {
+    struct Slot {
+        std::optional<FlowFieldWindow> window; // empty for a free slot
+        std::uint32_t generation = 0u;
+        std::uint64_t last_used = 0u;
+    };
+
+    std::vector<Slot> slots;
+    std::vector<std::uint32_t> free_slots;
+};
+
+// Flow fields shared by every unit walking to the same navigation cell, lives in registry.ctx()
+class FlowFieldCache {
+  public:
+    explicit FlowFieldCache(FlowFieldSettings settings = {}) : settings(settings) {}
+
+    // Reuses a field with the same target cell if it already covers every position, builds one otherwise
+    [[nodiscard]] auto request(const TerrainHeightField *height_field, Vector2 target,
+                               std::span<const Vector2> positions, std::uint64_t tick) -> FlowFieldId;
+    // Marks the field as in use, nullptr once it was dropped. Safe to call from several threads at once.
+    [[nodiscard]] auto use(FlowFieldId id, std::uint64_t tick) -> const FlowField *;
+    void drop_unused(std::uint64_t tick);
+
+    // NOTE: Fields are large but cheap to build again, save games keep their windows and restore_state rebuilds them.
+    // Every FlowFieldId handed out before get_state is valid again after restore_state and points to the same field.
+    [[nodiscard]] auto get_state() const -> FlowFieldCacheState;
+    void restore_state(const TerrainHeightField *height_field, const FlowFieldCacheState &state);
+
+    [[nodiscard]] auto size() const -> std::size_t { return entries.size() - free_slots.size(); }
+    [[nodiscard]] auto get_settings() const -> const FlowFieldSettings & { return settings; }
+
+  private:
+    struct Entry {
+        std::optional<FlowField> field;
+        std::uint32_t generation = 0u;
+        std::uint64_t last_used = 0u;
+    };
+
+    FlowFieldSettings settings;
+    std::vector<Entry> entries;
+    std::vector<std::uint32_t> free_slots;
+};
+
+// Drops fields that no WalkToTask sampled recently
+void update_flow_fields(entt::registry &registry);
+
+} // namespace stratgame
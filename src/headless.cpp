@@ -0,0 +1,385 @@
+// Headless simulation runner, spawns a synthetic world and ticks it as fast as possible without opening a window.
+//
+// usage: stratgame_headless [--minions N] [--chunks M] [--ticks K] [--seed S] [--threads T] [--stream F] [--cache DIR]
+//                           [--replay FILE] [--trace FILE] [--save FILE] [--load FILE] [--occlusion 0|1]
+
+#include "camera.hpp"
+#include "common_components.hpp"
+#include "culling.hpp"
+#include "drawing.hpp"
+#include "minion.hpp"
+#include "occlusion.hpp"
+#include "profiler.hpp"
+#include "replay.hpp"
+#include "save_game.hpp"
+#include "simulation.hpp"
+#include "tasks.hpp"
+#include "terrain.hpp"
+#include "terrain_streamer.hpp"
+#include "thread_pool.hpp"
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <entt.hpp>
+#include <filesystem>
+#include <optional>
+#include <print>
+#include <random>
+#include <span>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace {
+
+struct HeadlessConfig {
+    std::uint64_t minions = 10'000u;
+    std::uint64_t chunks = 64u;
+    std::uint64_t ticks = 600u;
+    std::uint64_t seed = 1337u;
+    std::uint64_t threads = 0u; // worker threads, 0 picks one less than the hardware has
+    std::uint64_t stream = 0u; // frames of camera panning over streamed terrain, 0 skips it
+    std::uint64_t occlusion = 1u; // 0 leaves terrain occlusion culling out of flag_culled_models
+    std::string cache;         // chunk cache directory, empty disables the cache
+    std::string replay;        // recording to play back instead of the synthetic world
+    std::string trace;         // Chrome trace of every tick, empty runs without the profiler
+    std::string save;          // save game written after the run
+    std::string load;          // save game to start from instead of spawning minions
+};
+
+constexpr auto chunk_size = 32u;
+constexpr auto chunk_subdivisions = 32u;
+
+auto parse_value(std::string_view arg, std::uint64_t &out) -> bool {
+    const auto [ptr, ec] = std::from_chars(arg.data(), arg.data() + arg.size(), out);
+    return ec == std::errc{} && ptr == arg.data() + arg.size();
+}
+
+auto parse_args(std::span<char *> args) -> std::optional<HeadlessConfig> {
+    auto config = HeadlessConfig{};
+
+    for (auto i = 1u; i < args.size(); i++) {
+        const auto arg = std::string_view{args[i]};
+        if (i + 1 >= args.size()) {
+            std::println("Missing value for {}", arg);
+            return std::nullopt;
+        }
+
+        const auto value = std::string_view{args[++i]};
+        const auto ok = arg == "--minions"     ? parse_value(value, config.minions)
+                        : arg == "--chunks"    ? parse_value(value, config.chunks)
+                        : arg == "--ticks"     ? parse_value(value, config.ticks)
+                        : arg == "--seed"      ? parse_value(value, config.seed)
+                        : arg == "--threads"   ? parse_value(value, config.threads)
+                        : arg == "--stream"    ? parse_value(value, config.stream)
+                        : arg == "--occlusion" ? parse_value(value, config.occlusion)
+                        : arg == "--cache"     ? (config.cache = value, true)
+                        : arg == "--replay"    ? (config.replay = value, true)
+                        : arg == "--trace"     ? (config.trace = value, true)
+                        : arg == "--save"      ? (config.save = value, true)
+                        : arg == "--load"      ? (config.load = value, true)
+                                               : false;
+        if (!ok) {
+            std::println("Invalid argument: {} {}", arg, value);
+            return std::nullopt;
+        }
+    }
+
+    return config;
+}
+
+// Registers M chunks laid out in a square around the origin, returns the half extent of the map in world units
+auto spawn_chunks(entt::registry &registry, const stratgame::TerrainGenerator &generator, const std::uint64_t count)
+    -> float {
+    const auto side = static_cast<std::int64_t>(std::ceil(std::sqrt(static_cast<double>(count))));
+    const auto half_side = side / 2;
+
+    auto coordinates = std::vector<stratgame::ChunkCoordinate>{};
+    for (auto y = -half_side; y < side - half_side && coordinates.size() < count; y++) {
+        for (auto x = -half_side; x < side - half_side && coordinates.size() < count; x++) {
+            coordinates.push_back(stratgame::ChunkCoordinate{.x = x, .y = y});
+        }
+    }
+
+    auto chunks = generator.generate_chunks(registry.ctx().get<stratgame::ThreadPool>(), coordinates);
+    // NOTE: No GL context, chunks are registered without uploading a heightmap
+    for (const auto &chunk : chunks) {
+        generator.register_chunk(registry, chunk);
+    }
+
+    return static_cast<float>(half_side * chunk_size);
+}
+
+void spawn_minions(entt::registry &registry, const HeadlessConfig &config, const float half_extent) {
+    auto rng = std::mt19937{static_cast<std::mt19937::result_type>(config.seed)};
+    auto coordinate = std::uniform_real_distribution<float>{-half_extent, half_extent};
+    auto team = std::uniform_int_distribution<int>{0, 1};
+
+    for (auto i = 0u; i < config.minions; i++) {
+        const auto minion = stratgame::create_minion(registry, {coordinate(rng), coordinate(rng)}, team(rng));
+        registry.emplace<stratgame::FrustumCullingComponent>(minion, 1.f, Vector2{0.f, 0.f});
+        stratgame::add_task(registry, minion,
+                            stratgame::WalkToTask{.target = {coordinate(rng), coordinate(rng)}, .speed = 5.f});
+    }
+}
+
+auto to_ms(std::chrono::nanoseconds duration) -> double {
+    return std::chrono::duration<double, std::milli>(duration).count();
+}
+
+auto load_minions(entt::registry &registry, const std::string &path, const stratgame::ReplayHeader &world) -> bool {
+    const auto start = std::chrono::steady_clock::now();
+    const auto snapshot = stratgame::read_world_snapshot(path);
+    if (!snapshot) {
+        std::println("Error: {}", snapshot.error());
+        return false;
+    }
+    const auto read_time = std::chrono::steady_clock::now() - start;
+    if (const auto restored = stratgame::restore_world_snapshot(registry, *snapshot, world); !restored) {
+        std::println("Error: {}", restored.error());
+        return false;
+    }
+    const auto restore_time = std::chrono::steady_clock::now() - start - read_time;
+
+    const auto minions = registry.view<const stratgame::Minion>();
+    for (const auto minion : minions) {
+        registry.emplace<stratgame::FrustumCullingComponent>(minion, 1.f, Vector2{0.f, 0.f});
+    }
+    std::println("loaded {}: {} units at tick {}, read {:.2f} ms, restore {:.2f} ms", path, minions.size(),
+                 snapshot->tick, to_ms(read_time), to_ms(restore_time));
+    return true;
+}
+
+void save_minions(const entt::registry &registry, const std::string &path, const stratgame::ReplayHeader &world) {
+    const auto start = std::chrono::steady_clock::now();
+    const auto snapshot = stratgame::take_world_snapshot(registry, world);
+    const auto snapshot_time = std::chrono::steady_clock::now() - start;
+    if (const auto saved = stratgame::write_world_snapshot(snapshot, path, stratgame::SaveCompression::Lz4); !saved) {
+        std::println("Error: {}", saved.error());
+        return;
+    }
+    const auto write_time = std::chrono::steady_clock::now() - start - snapshot_time;
+
+    auto error = std::error_code{};
+    const auto size = std::filesystem::file_size(path, error);
+    std::println("saved {}: {} bytes, snapshot {:.2f} ms, write {:.2f} ms", path, error ? 0u : size,
+                 to_ms(snapshot_time), to_ms(write_time));
+}
+
+void setup_registry(entt::registry &registry, const HeadlessConfig &config, const float tick_rate) {
+    stratgame::setup_simulation(registry, tick_rate);
+    if (config.threads > 0u) {
+        registry.ctx().erase<stratgame::ThreadPool>();
+        registry.ctx().emplace<stratgame::ThreadPool>(config.threads);
+    }
+}
+
+void print_system_timings(const stratgame::SystemTimings &timings, const double ticks) {
+    const auto systems = stratgame::simulation_systems();
+    for (auto i = 0u; i < systems.size(); i++) {
+        std::println("  {:<24} {:>10.3f} ms total {:>10.4f} ms/tick", systems[i].name, to_ms(timings.elapsed[i]),
+                     to_ms(timings.elapsed[i]) / ticks);
+    }
+}
+
+// Plays a recording back as fast as possible and checks the state hash of every tick against it
+auto run_replay(const HeadlessConfig &config) -> int {
+    auto reader = stratgame::ReplayReader::open(config.replay);
+    if (!reader) {
+        std::println("Error: {}", reader.error());
+        return 1;
+    }
+
+    const auto &header = reader->get_header();
+    auto registry = entt::registry{};
+    setup_registry(registry, config, header.tick_rate);
+
+    auto generator = stratgame::TerrainGenerator(header.noise, header.chunk_subdivisions, header.chunk_size, Shader{},
+                                                 header.height_scale);
+    if (!config.cache.empty()) {
+        generator.enable_cache(config.cache);
+    }
+
+    auto timings = stratgame::SystemTimings{};
+    const auto start = std::chrono::steady_clock::now();
+    const auto stats = stratgame::play_replay(registry, *reader, generator, &timings);
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+    if (!stats) {
+        std::println("Error: {}", stats.error());
+        return 1;
+    }
+
+    const auto ticks = static_cast<double>(std::max<std::uint64_t>(stats->ticks, 1u));
+    const auto seconds = std::chrono::duration<double>(elapsed).count();
+    std::println("replay: {} ticks, {} commands, {} units", stats->ticks, stats->commands,
+                 registry.storage<stratgame::UnitId>().size());
+    std::println("ticks/sec: {:.1f} ({:.3f} ms/tick, {:.1f}x real time)", ticks / seconds, to_ms(elapsed) / ticks,
+                 ticks / header.tick_rate / seconds);
+    print_system_timings(timings, ticks);
+
+    if (stats->first_mismatch) {
+        std::println("diverged at tick {}, {} ticks with a different state hash", *stats->first_mismatch,
+                     stats->mismatches);
+        return 1;
+    }
+    std::println("state hashes match the recording");
+    return 0;
+}
+
+// Pans the camera in a straight line over fresh terrain, streaming chunks in and out every frame
+void run_streaming(const HeadlessConfig &config) {
+    const auto frames = config.stream;
+    auto registry = entt::registry{};
+    stratgame::setup_simulation(registry);
+
+    auto generator = stratgame::TerrainGenerator(stratgame::NoiseParameters{}, 64u, 128u, Shader{});
+    if (!config.cache.empty()) {
+        generator.enable_cache(config.cache);
+    }
+
+    const auto camera_entity = stratgame::create_camera(registry);
+    auto &streamer = registry.ctx().emplace<stratgame::TerrainStreamer>(
+        generator, stratgame::TerrainStreamingSettings{.upload_chunks = false});
+    streamer.load_blocking(registry, registry.get<stratgame::Camera>(camera_entity).target_position);
+
+    auto total = std::chrono::nanoseconds{0};
+    auto worst = std::chrono::nanoseconds{0};
+    auto max_resident = std::size_t{0};
+    // NOTE: Paced like a 60 fps game loop, otherwise the generation tasks never get the chance to finish in between
+    auto next_frame = std::chrono::steady_clock::now();
+    for (auto frame = 0u; frame < frames; frame++) {
+        next_frame += std::chrono::microseconds{16'667};
+        std::this_thread::sleep_until(next_frame);
+
+        registry.get<stratgame::Camera>(camera_entity).target_position.x += 8.f;
+
+        const auto start = std::chrono::steady_clock::now();
+        stratgame::update_terrain_streaming(registry);
+        const auto elapsed = std::chrono::steady_clock::now() - start;
+
+        total += elapsed;
+        worst = std::max(worst, std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed));
+        max_resident = std::max(max_resident, streamer.get_stats().resident);
+    }
+
+    const auto stats = streamer.get_stats();
+    std::println("streaming: {} frames, {:.4f} ms/frame, worst {:.3f} ms", frames,
+                 to_ms(total) / static_cast<double>(frames), to_ms(worst));
+    std::println("  chunks: {} loaded, {} evicted, {} resident (max {}, capacity {})", stats.loaded, stats.evicted,
+                 stats.resident, max_resident, streamer.get_settings().max_resident_chunks);
+
+    streamer.unload_all(registry);
+}
+
+} // namespace
+
+auto main(int argc, char **argv) -> int {
+    const auto config = parse_args(std::span{argv, static_cast<std::size_t>(argc)});
+    if (!config) {
+        std::println("usage: {} [--minions N] [--chunks M] [--ticks K] [--seed S] [--threads T] [--stream F] "
+                     "[--cache DIR] [--replay FILE] [--trace FILE] [--save FILE] [--load FILE]",
+                     argv[0]);
+        return 1;
+    }
+    if (!config->replay.empty()) {
+        return run_replay(*config);
+    }
+
+    auto registry = entt::registry{};
+    setup_registry(registry, *config, stratgame::default_tick_rate);
+
+    const auto generation_start = std::chrono::steady_clock::now();
+    auto generator =
+        stratgame::TerrainGenerator(stratgame::NoiseParameters{}, chunk_subdivisions, chunk_size, Shader{});
+    if (!config->cache.empty()) {
+        generator.enable_cache(config->cache);
+    }
+    const auto half_extent = spawn_chunks(registry, generator, config->chunks);
+    const auto world = stratgame::make_replay_header(generator, stratgame::default_tick_rate);
+    if (config->load.empty()) {
+        spawn_minions(registry, *config, std::max(half_extent, static_cast<float>(chunk_size)));
+    } else if (!load_minions(registry, config->load, world)) {
+        return 1;
+    }
+    const auto generation_time = std::chrono::steady_clock::now() - generation_start;
+
+    // NOTE: Fully zoomed out so culling has a realistic amount of visible chunks to deal with
+    const auto camera_entity = stratgame::create_camera(registry);
+    auto &camera = registry.get<stratgame::Camera>(camera_entity);
+    camera.zoom = camera.max_zoom;
+    stratgame::update_camera(registry);
+    registry.ctx().get<stratgame::OcclusionBuffer>().enabled = config->occlusion != 0u;
+
+    auto timings = stratgame::SystemTimings{};
+    auto sync_time = std::chrono::nanoseconds{0};
+    auto culling_time = std::chrono::nanoseconds{0};
+
+    // NOTE: Every tick is a profiler frame, the systems find the profiler in the context
+    auto *profiler = config->trace.empty() ? nullptr : &registry.ctx().emplace<stratgame::Profiler>();
+    if (profiler != nullptr) {
+        profiler->capture(config->ticks, config->trace);
+    }
+
+    const auto run_start = std::chrono::steady_clock::now();
+    for (auto tick = 0u; tick < config->ticks; tick++) {
+        if (profiler != nullptr) {
+            profiler->begin_frame();
+        }
+
+        const auto sync_start = std::chrono::steady_clock::now();
+        stratgame::profile(profiler, "update_culling_spheres", [&] { stratgame::update_culling_spheres(registry); });
+        const auto culling_start = std::chrono::steady_clock::now();
+        stratgame::profile(profiler, "flag_culled_models", [&] { stratgame::flag_culled_models(registry); });
+        culling_time += std::chrono::steady_clock::now() - culling_start;
+        sync_time += culling_start - sync_start;
+
+        stratgame::profile(profiler, "tick_simulation", [&] { stratgame::tick_simulation(registry, &timings); });
+
+        if (profiler != nullptr) {
+            const auto &culling = registry.ctx().get<const stratgame::CullingSpheres>().stats;
+            profiler->set_counter("visible spheres", culling.visible);
+            profiler->set_counter("culled spheres", culling.culled);
+            profiler->set_counter("occluded spheres", culling.occluded);
+            profiler->end_frame();
+        }
+    }
+    const auto run_time = std::chrono::steady_clock::now() - run_start;
+
+    const auto ticks = static_cast<double>(config->ticks);
+    const auto seconds = std::chrono::duration<double>(run_time).count();
+
+    std::println("minions: {}, chunks: {}, ticks: {}, entities: {}", config->minions, config->chunks, config->ticks,
+                 registry.storage<entt::entity>().free_list());
+    std::println("world generation: {:.2f} ms ({} worker threads)", to_ms(generation_time),
+                 registry.ctx().get<const stratgame::ThreadPool>().get_thread_count());
+    std::println("ticks/sec: {:.1f} ({:.3f} ms/tick)", ticks / seconds, to_ms(run_time) / ticks);
+
+    print_system_timings(timings, ticks);
+    std::println("  {:<24} {:>10.3f} ms total {:>10.4f} ms/tick", "update_culling_spheres", to_ms(sync_time),
+                 to_ms(sync_time) / ticks);
+    std::println("  {:<24} {:>10.3f} ms total {:>10.4f} ms/tick", "flag_culled_models", to_ms(culling_time),
+                 to_ms(culling_time) / ticks);
+
+    const auto &culling = registry.ctx().get<const stratgame::CullingSpheres>().stats;
+    std::println("  culling: {} visible, {} culled, {} of them occluded", culling.visible, culling.culled,
+                 culling.occluded);
+    std::println("  regions: {} inside, {} outside, {} tested, {} occluded", culling.regions_inside,
+                 culling.regions_outside, culling.regions_tested, culling.regions_occluded);
+
+    if (profiler != nullptr) {
+        std::println("{}", profiler->get_capture_status());
+    }
+
+    if (!config->save.empty()) {
+        save_minions(registry, config->save, world);
+    }
+
+    if (config->stream > 0u) {
+        run_streaming(*config);
+    }
+
+    return 0;
+}
@@ -0,0 +1,467 @@
+#include "height_field.hpp"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+#include <raymath.h>
+
+namespace stratgame {
+
+constexpr static auto infinity = std::numeric_limits<float>::infinity();
+constexpr static auto slab_padding = 1e-3f; // keeps perfectly flat chunks from producing an empty t range
+constexpr static auto query_block_size = std::size_t{256};
+constexpr static auto max_table_holes = std::int64_t{64}; // a chunk table may cover 4x the chunks plus this many
+
+// Corner samples of the cells under a block of positions, filled by fetch_cells
+struct TerrainHeightField::CellBlock {
+    std::array<std::int32_t, query_block_size> chunk_x;
+    std::array<std::int32_t, query_block_size> chunk_z;
+    std::array<std::int32_t, query_block_size> offset; // of the near left sample in the chunk
+    std::array<float, query_block_size> fx;
+    std::array<float, query_block_size> fz;
+    std::array<float, query_block_size> h00;
+    std::array<float, query_block_size> h10;
+    std::array<float, query_block_size> h01;
+    std::array<float, query_block_size> h11;
+    std::array<std::uint8_t, query_block_size> loaded;
+};
+
+[[nodiscard]] static auto mix(const float a, const float b, const float t) -> float { return a + (b - a) * t; }
+
+[[nodiscard]] static auto bilinear(const float h00, const float h10, const float h01, const float h11, const float fx,
+                                   const float fz) -> float {
+    return mix(mix(h00, h10, fx), mix(h01, h11, fx), fz);
+}
+
+// Normal from the partial derivatives of the bilinear patch
+[[nodiscard]] static auto bilinear_normal(const float h00, const float h10, const float h01, const float h11,
+                                          const float fx, const float fz, const float spacing) -> Vector3 {
+    const auto dx = mix(h10 - h00, h11 - h01, fz) / spacing;
+    const auto dz = mix(h01 - h00, h11 - h10, fx) / spacing;
+    const auto inverse_length = 1.f / std::sqrt(dx * dx + 1.f + dz * dz);
+    return Vector3{-dx * inverse_length, inverse_length, -dz * inverse_length};
+}
+
+auto TerrainHeightField::make_key(const std::int64_t x, const std::int64_t y) -> std::uint64_t {
+    return (static_cast<std::uint64_t>(static_cast<std::uint32_t>(x)) << 32u) | static_cast<std::uint32_t>(y);
+}
+
+void TerrainHeightField::set_chunk(const std::int64_t x, const std::int64_t y, std::vector<float> samples) {
+    const auto [min_it, max_it] = std::minmax_element(samples.begin(), samples.end());
+    const auto chunk_min = samples.empty() ? 0.f : *min_it;
+    const auto chunk_max = samples.empty() ? 0.f : *max_it;
+
+    if (chunks.empty()) {
+        min_height = chunk_min;
+        max_height = chunk_max;
+    } else {
+        min_height = std::min(min_height, chunk_min);
+        max_height = std::max(max_height, chunk_max);
+    }
+
+    // NOTE: Neighbouring blocks share their edge samples, the bilinear surface between samples never dips below them
+    const auto blocks = samples.empty() ? 0u : get_occluder_blocks();
+    const auto row_size = chunk_subdivisions + 1u;
+    auto block_min_heights = std::vector<float>(blocks * blocks, infinity);
+    for (auto block_z = 0u; block_z < blocks; block_z++) {
+        for (auto block_x = 0u; block_x < blocks; block_x++) {
+            auto &block_min = block_min_heights[block_z * blocks + block_x];
+            for (auto z = get_block_start(block_z); z <= get_block_start(block_z + 1u); z++) {
+                for (auto x = get_block_start(block_x); x <= get_block_start(block_x + 1u); x++) {
+                    block_min = std::min(block_min, samples[z * row_size + x]);
+                }
+            }
+        }
+    }
+
+    auto chunk = ChunkHeights{.samples = std::move(samples),
+                              .min_height = chunk_min,
+                              .max_height = chunk_max,
+                              .block_min_heights = std::move(block_min_heights)};
+    chunks.insert_or_assign(make_key(x, y), std::move(chunk));
+    rebuild_chunk_table();
+    revision++;
+}
+
+void TerrainHeightField::remove_chunk(const std::int64_t x, const std::int64_t y) {
+    if (chunks.erase(make_key(x, y)) != 0u) {
+        recompute_bounds();
+        rebuild_chunk_table();
+        revision++;
+    }
+}
+
+// NOTE: Chunks come and go a few per frame at most, rebuilding from scratch is cheaper than any lookup it saves
+void TerrainHeightField::rebuild_chunk_table() {
+    chunk_table.clear();
+    if (chunks.empty()) {
+        return;
+    }
+
+    const auto decode = [](const std::uint64_t key) {
+        return std::pair{static_cast<std::int64_t>(static_cast<std::int32_t>(key >> 32u)),
+                         static_cast<std::int64_t>(static_cast<std::int32_t>(key & 0xffffffffu))};
+    };
+    auto min_x = std::numeric_limits<std::int64_t>::max();
+    auto min_y = std::numeric_limits<std::int64_t>::max();
+    auto max_x = std::numeric_limits<std::int64_t>::min();
+    auto max_y = std::numeric_limits<std::int64_t>::min();
+    for (const auto &[key, chunk] : chunks) {
+        const auto [x, y] = decode(key);
+        min_x = std::min(min_x, x);
+        min_y = std::min(min_y, y);
+        max_x = std::max(max_x, x);
+        max_y = std::max(max_y, y);
+    }
+
+    table_x = min_x;
+    table_y = min_y;
+    table_width = max_x - min_x + 1;
+    table_height = max_y - min_y + 1;
+    if (table_width * table_height > 4 * static_cast<std::int64_t>(chunks.size()) + max_table_holes) {
+        return;
+    }
+
+    chunk_table.assign(static_cast<std::size_t>(table_width * table_height), nullptr);
+    for (const auto &[key, chunk] : chunks) {
+        const auto [x, y] = decode(key);
+        chunk_table[static_cast<std::size_t>((y - table_y) * table_width + (x - table_x))] = &chunk;
+    }
+}
+
+void TerrainHeightField::recompute_bounds() {
+    min_height = chunks.empty() ? 0.f : infinity;
+    max_height = chunks.empty() ? 0.f : -infinity;
+    for (const auto &[key, chunk] : chunks) {
+        min_height = std::min(min_height, chunk.min_height);
+        max_height = std::max(max_height, chunk.max_height);
+    }
+}
+
+auto TerrainHeightField::find_chunk(const std::int64_t x, const std::int64_t y) const -> const ChunkHeights * {
+    if (!chunk_table.empty()) {
+        const auto column = x - table_x;
+        const auto row = y - table_y;
+        if (column < 0 || row < 0 || column >= table_width || row >= table_height) {
+            return nullptr;
+        }
+        return chunk_table[static_cast<std::size_t>(row * table_width + column)];
+    }
+
+    const auto it = chunks.find(make_key(x, y));
+    return it != chunks.end() ? &it->second : nullptr;
+}
+
+// The cell under position and where in it, clamped so that positions on the far edge of a chunk use its last cell
+struct CellPosition {
+    const float *corner; // near left sample, the far row starts stride samples later
+    std::size_t stride;
+    float fx;
+    float fz;
+};
+
+[[nodiscard]] static auto find_cell(const TerrainHeightField &field, const Vector2 position)
+    -> std::optional<CellPosition> {
+    const auto chunk_size = field.get_chunk_size();
+    const auto chunk_x = static_cast<std::int64_t>(std::floor(position.x / chunk_size));
+    const auto chunk_z = static_cast<std::int64_t>(std::floor(position.y / chunk_size));
+    const auto *chunk = field.find_chunk(chunk_x, chunk_z);
+    if (chunk == nullptr) {
+        return std::nullopt;
+    }
+
+    const auto spacing = field.get_sample_spacing();
+    const auto last_cell = static_cast<float>(field.get_chunk_subdivisions() - 1u);
+    const auto local_x = (position.x - static_cast<float>(chunk_x) * chunk_size) / spacing;
+    const auto local_z = (position.y - static_cast<float>(chunk_z) * chunk_size) / spacing;
+    const auto cell_x = std::clamp(std::floor(local_x), 0.f, last_cell);
+    const auto cell_z = std::clamp(std::floor(local_z), 0.f, last_cell);
+
+    const auto stride = static_cast<std::size_t>(field.get_chunk_subdivisions() + 1u);
+    const auto index = static_cast<std::size_t>(cell_z) * stride + static_cast<std::size_t>(cell_x);
+    return CellPosition{.corner = chunk->samples.data() + index,
+                        .stride = stride,
+                        .fx = std::clamp(local_x - cell_x, 0.f, 1.f),
+                        .fz = std::clamp(local_z - cell_z, 0.f, 1.f)};
+}
+
+auto TerrainHeightField::get_height(const Vector2 position) const -> std::optional<float> {
+    const auto cell = find_cell(*this, position);
+    if (!cell) {
+        return std::nullopt;
+    }
+    const auto *corner = cell->corner;
+    return bilinear(corner[0], corner[1], corner[cell->stride], corner[cell->stride + 1u], cell->fx, cell->fz);
+}
+
+auto TerrainHeightField::get_normal(const Vector2 position) const -> std::optional<Vector3> {
+    const auto cell = find_cell(*this, position);
+    if (!cell) {
+        return std::nullopt;
+    }
+    const auto *corner = cell->corner;
+    return bilinear_normal(corner[0], corner[1], corner[cell->stride], corner[cell->stride + 1u], cell->fx, cell->fz,
+                           sample_spacing);
+}
+
+void TerrainHeightField::fetch_cells(const float *xs, const float *zs, const std::size_t count,
+                                     CellBlock &block) const {
+    const auto last_cell = static_cast<float>(chunk_subdivisions - 1u);
+    const auto stride = static_cast<std::int32_t>(chunk_subdivisions + 1u);
+
+    // NOTE: The arithmetic of find_cell without the lookup, branchless so it vectorizes
+    for (auto i = 0u; i < count; i++) {
+        const auto chunk_x = std::floor(xs[i] / chunk_size);
+        const auto chunk_z = std::floor(zs[i] / chunk_size);
+        const auto local_x = (xs[i] - chunk_x * chunk_size) / sample_spacing;
+        const auto local_z = (zs[i] - chunk_z * chunk_size) / sample_spacing;
+        const auto cell_x = std::clamp(std::floor(local_x), 0.f, last_cell);
+        const auto cell_z = std::clamp(std::floor(local_z), 0.f, last_cell);
+        block.chunk_x[i] = static_cast<std::int32_t>(chunk_x);
+        block.chunk_z[i] = static_cast<std::int32_t>(chunk_z);
+        block.offset[i] = static_cast<std::int32_t>(cell_z) * stride + static_cast<std::int32_t>(cell_x);
+        block.fx[i] = std::clamp(local_x - cell_x, 0.f, 1.f);
+        block.fz[i] = std::clamp(local_z - cell_z, 0.f, 1.f);
+    }
+
+    // NOTE: Units close to each other are usually close in the storage too, so the last chunk is remembered
+    const ChunkHeights *chunk = nullptr;
+    auto has_chunk = false;
+    auto last_x = std::int32_t{0};
+    auto last_z = std::int32_t{0};
+    for (auto i = 0u; i < count; i++) {
+        if (!has_chunk || block.chunk_x[i] != last_x || block.chunk_z[i] != last_z) {
+            chunk = find_chunk(block.chunk_x[i], block.chunk_z[i]);
+            has_chunk = true;
+            last_x = block.chunk_x[i];
+            last_z = block.chunk_z[i];
+        }
+        if (chunk == nullptr) {
+            block.h00[i] = block.h10[i] = block.h01[i] = block.h11[i] = 0.f;
+            block.loaded[i] = 0u;
+            continue;
+        }
+        const auto *corner = chunk->samples.data() + block.offset[i];
+        block.h00[i] = corner[0];
+        block.h10[i] = corner[1];
+        block.h01[i] = corner[stride];
+        block.h11[i] = corner[stride + 1];
+        block.loaded[i] = 1u;
+    }
+}
+
+void TerrainHeightField::get_heights(const std::span<const float> xs, const std::span<const float> zs,
+                                     const std::span<float> heights) const {
+    CellBlock block; // NOTE: Left uninitialized, fetch_cells writes every entry that is read afterwards
+    for (auto first = std::size_t{0}; first < xs.size(); first += query_block_size) {
+        const auto count = std::min(query_block_size, xs.size() - first);
+        fetch_cells(xs.data() + first, zs.data() + first, count, block);
+
+        auto *out = heights.data() + first;
+        for (auto i = 0u; i < count; i++) {
+            const auto height =
+                bilinear(block.h00[i], block.h10[i], block.h01[i], block.h11[i], block.fx[i], block.fz[i]);
+            out[i] = block.loaded[i] != 0u ? height : out[i];
+        }
+    }
+}
+
+void TerrainHeightField::get_normals(const std::span<const float> xs, const std::span<const float> zs,
+                                     const std::span<Vector3> normals) const {
+    CellBlock block; // NOTE: Left uninitialized, fetch_cells writes every entry that is read afterwards
+    for (auto first = std::size_t{0}; first < xs.size(); first += query_block_size) {
+        const auto count = std::min(query_block_size, xs.size() - first);
+        fetch_cells(xs.data() + first, zs.data() + first, count, block);
+
+        auto *out = normals.data() + first;
+        for (auto i = 0u; i < count; i++) {
+            const auto normal = bilinear_normal(block.h00[i], block.h10[i], block.h01[i], block.h11[i], block.fx[i],
+                                                block.fz[i], sample_spacing);
+            out[i] = block.loaded[i] != 0u ? normal : out[i];
+        }
+    }
+}
+
+auto TerrainHeightField::get_slope(const Vector2 position) const -> std::optional<float> {
+    const auto chunk_x = static_cast<std::int64_t>(std::floor(position.x / chunk_size));
+    const auto chunk_z = static_cast<std::int64_t>(std::floor(position.y / chunk_size));
+    const auto *chunk = find_chunk(chunk_x, chunk_z);
+    if (chunk == nullptr) {
+        return std::nullopt;
+    }
+
+    const auto last_cell = static_cast<float>(chunk_subdivisions - 1u);
+    const auto cell_x = std::clamp(std::floor((position.x - static_cast<float>(chunk_x) * chunk_size) / sample_spacing),
+                                   0.f, last_cell);
+    const auto cell_z = std::clamp(std::floor((position.y - static_cast<float>(chunk_z) * chunk_size) / sample_spacing),
+                                   0.f, last_cell);
+
+    const auto stride = static_cast<std::size_t>(chunk_subdivisions + 1u);
+    const auto index = static_cast<std::size_t>(cell_z) * stride + static_cast<std::size_t>(cell_x);
+    const auto &samples = chunk->samples;
+    const auto h00 = samples[index];
+    const auto h10 = samples[index + 1u];
+    const auto h01 = samples[index + stride];
+    const auto h11 = samples[index + stride + 1u];
+    const auto rise =
+        std::max({std::abs(h10 - h00), std::abs(h01 - h00), std::abs(h11 - h10), std::abs(h11 - h01)});
+    return rise / sample_spacing;
+}
+
+// Range of t for which the ray's height stays within [low, high]
+[[nodiscard]] static auto clip_to_slab(const Ray &ray, const float low, const float high, float t_start, float t_end)
+    -> std::pair<float, float> {
+    if (ray.direction.y == 0.f) {
+        const auto inside = ray.position.y >= low - slab_padding && ray.position.y <= high + slab_padding;
+        return inside ? std::pair{t_start, t_end} : std::pair{1.f, 0.f};
+    }
+
+    const auto t_low = (low - slab_padding - ray.position.y) / ray.direction.y;
+    const auto t_high = (high + slab_padding - ray.position.y) / ray.direction.y;
+    return {std::max(t_start, std::min(t_low, t_high)), std::min(t_end, std::max(t_low, t_high))};
+}
+
+// 2D DDA over the xz projection of the ray, calls visit(cell_x, cell_z, t_enter, t_exit) until it returns true
+template <typename Func>
+static void walk_grid(const Ray &ray, const float cell_size, const float t_start, const float t_end, Func &&visit) {
+    const auto start = Vector3Add(ray.position, Vector3Scale(ray.direction, t_start));
+    auto x = static_cast<std::int64_t>(std::floor(start.x / cell_size));
+    auto z = static_cast<std::int64_t>(std::floor(start.z / cell_size));
+
+    const auto step_x = ray.direction.x >= 0.f ? 1 : -1;
+    const auto step_z = ray.direction.z >= 0.f ? 1 : -1;
+    const auto t_delta_x = ray.direction.x != 0.f ? cell_size / std::abs(ray.direction.x) : infinity;
+    const auto t_delta_z = ray.direction.z != 0.f ? cell_size / std::abs(ray.direction.z) : infinity;
+
+    const auto boundary = [&](const std::int64_t cell, const int step, const float origin, const float dir) {
+        if (dir == 0.f) {
+            return infinity;
+        }
+        const auto edge = static_cast<float>(step > 0 ? cell + 1 : cell) * cell_size;
+        return (edge - origin) / dir;
+    };
+    auto t_max_x = boundary(x, step_x, ray.position.x, ray.direction.x);
+    auto t_max_z = boundary(z, step_z, ray.position.z, ray.direction.z);
+
+    auto t = t_start;
+    while (t < t_end) {
+        const auto t_next = std::min({t_max_x, t_max_z, t_end});
+        if (visit(x, z, t, t_next)) {
+            return;
+        }
+
+        if (t_max_x < t_max_z) {
+            t_max_x += t_delta_x;
+            x += step_x;
+        } else {
+            t_max_z += t_delta_z;
+            z += step_z;
+        }
+        t = t_next;
+    }
+}
+
+// Möller-Trumbore, returns the distance along the ray
+[[nodiscard]] static auto intersect_triangle(const Ray &ray, const Vector3 &a, const Vector3 &b, const Vector3 &c)
+    -> std::optional<float> {
+    constexpr auto epsilon = 1e-7f;
+
+    const auto edge1 = Vector3Subtract(b, a);
+    const auto edge2 = Vector3Subtract(c, a);
+    const auto p = Vector3CrossProduct(ray.direction, edge2);
+    const auto det = Vector3DotProduct(edge1, p);
+    if (std::abs(det) < epsilon) {
+        return std::nullopt;
+    }
+
+    const auto inv_det = 1.f / det;
+    const auto to_origin = Vector3Subtract(ray.position, a);
+    const auto u = Vector3DotProduct(to_origin, p) * inv_det;
+    if (u < 0.f || u > 1.f) {
+        return std::nullopt;
+    }
+
+    const auto q = Vector3CrossProduct(to_origin, edge1);
+    const auto v = Vector3DotProduct(ray.direction, q) * inv_det;
+    if (v < 0.f || u + v > 1.f) {
+        return std::nullopt;
+    }
+
+    const auto t = Vector3DotProduct(edge2, q) * inv_det;
+    return t >= 0.f ? std::optional{t} : std::nullopt;
+}
+
+auto TerrainHeightField::raycast_chunk(const Ray &ray, const std::int64_t x, const std::int64_t y,
+                                       const ChunkHeights &chunk, const float t_start, const float t_end) const
+    -> std::optional<float> {
+    const auto subdivisions = static_cast<std::int64_t>(chunk_subdivisions);
+    const auto vertices_per_side = static_cast<std::size_t>(chunk_subdivisions + 1u);
+    const auto origin_x = static_cast<float>(x) * chunk_size;
+    const auto origin_z = static_cast<float>(y) * chunk_size;
+
+    auto hit = std::optional<float>{};
+    walk_grid(ray, sample_spacing, t_start, t_end,
+              [&](const std::int64_t cell_x, const std::int64_t cell_z, float, float) {
+                  // NOTE: Clamped because the walk can start a hair outside the chunk due to float rounding
+                  const auto j = std::clamp(cell_x - x * subdivisions, std::int64_t{0}, subdivisions - 1);
+                  const auto i = std::clamp(cell_z - y * subdivisions, std::int64_t{0}, subdivisions - 1);
+
+                  const auto vertex = [&](const std::int64_t row, const std::int64_t column) {
+                      const auto index =
+                          static_cast<std::size_t>(row) * vertices_per_side + static_cast<std::size_t>(column);
+                      return Vector3{origin_x + static_cast<float>(column) * sample_spacing, chunk.samples[index],
+                                     origin_z + static_cast<float>(row) * sample_spacing};
+                  };
+
+                  // NOTE: Same triangulation as the terrain grid patches
+                  const auto v00 = vertex(i, j);
+                  const auto v10 = vertex(i + 1, j);
+                  const auto v11 = vertex(i + 1, j + 1);
+                  const auto v01 = vertex(i, j + 1);
+
+                  const auto first = intersect_triangle(ray, v00, v10, v11);
+                  const auto second = intersect_triangle(ray, v00, v11, v01);
+                  if (first || second) {
+                      hit = std::min(first.value_or(infinity), second.value_or(infinity));
+                      return true;
+                  }
+                  return false;
+              });
+
+    return hit;
+}
+
+auto TerrainHeightField::raycast(const Ray &ray, const float max_distance) const -> std::optional<Vector3> {
+    if (chunks.empty()) {
+        return std::nullopt;
+    }
+
+    const auto [t_start, t_end] = clip_to_slab(ray, min_height, max_height, 0.f, max_distance);
+    if (t_start > t_end) {
+        return std::nullopt;
+    }
+
+    auto hit = std::optional<float>{};
+    walk_grid(ray, chunk_size, t_start, t_end,
+              [&](const std::int64_t x, const std::int64_t y, const float t_enter, const float t_exit) {
+                  const auto *chunk = find_chunk(x, y);
+                  if (chunk == nullptr) {
+                      return false;
+                  }
+
+                  const auto [t_low, t_high] = clip_to_slab(ray, chunk->min_height, chunk->max_height, t_enter, t_exit);
+                  if (t_low > t_high) {
+                      return false;
+                  }
+
+                  hit = raycast_chunk(ray, x, y, *chunk, t_low, t_high);
+                  return hit.has_value();
+              });
+
+    if (!hit) {
+        return std::nullopt;
+    }
+    return Vector3Add(ray.position, Vector3Scale(ray.direction, *hit));
+}
+
+} // namespace stratgame
@@ -0,0 +1,105 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <optional>
+#include <raylib.h>
+#include <span>
+#include <unordered_map>
+#include <vector>
+
+namespace stratgame {
+
+struct ChunkHeights {
+    std::vector<float> samples; // (subdivisions + 1)^2 heights, row major with rows along z
+    float min_height;
+    float max_height;
+    // Lowest sample of each of the occluder_blocks^2 blocks the chunk is split into, row major with rows along z.
+    // The terrain never dips below it inside the block at any level of detail, so it bounds solid ground.
+    std::vector<float> block_min_heights;
+};
+
+// CPU copy of the terrain heights, filled by TerrainGenerator::register_chunk and stored in registry.ctx()
+struct TerrainHeightField {
+    constexpr static std::uint32_t max_occluder_blocks = 8u;
+
+    TerrainHeightField(std::uint32_t chunk_size, std::uint32_t chunk_subdivisions)
+        : chunk_size(static_cast<float>(chunk_size)), chunk_subdivisions(chunk_subdivisions),
+          sample_spacing(static_cast<float>(chunk_size) / static_cast<float>(chunk_subdivisions)) {}
+    // NOTE: Not copyable, the chunk table points into the chunk map
+    TerrainHeightField(const TerrainHeightField &) = delete;
+    TerrainHeightField(TerrainHeightField &&) = default;
+    auto operator=(const TerrainHeightField &) -> TerrainHeightField & = delete;
+    auto operator=(TerrainHeightField &&) -> TerrainHeightField & = default;
+
+    void set_chunk(std::int64_t x, std::int64_t y, std::vector<float> samples);
+    void remove_chunk(std::int64_t x, std::int64_t y);
+
+    [[nodiscard]] auto find_chunk(std::int64_t x, std::int64_t y) const -> const ChunkHeights *;
+    [[nodiscard]] auto chunk_count() const -> std::size_t { return chunks.size(); }
+
+    // Bilinear interpolation of the four samples around position, nullopt over chunks that are not loaded
+    [[nodiscard]] auto get_height(Vector2 position) const -> std::optional<float>;
+
+    // Normal of the bilinear surface get_height samples, nullopt over chunks that are not loaded
+    [[nodiscard]] auto get_normal(Vector2 position) const -> std::optional<Vector3>;
+
+    // get_height and get_normal for positions given as separate x and z arrays, the same size as the output. Entries
+    // over chunks that are not loaded keep whatever the output already holds. Positions are processed in blocks whose
+    // arithmetic vectorizes, only fetching the corner samples is done one position at a time.
+    void get_heights(std::span<const float> xs, std::span<const float> zs, std::span<float> heights) const;
+    void get_normals(std::span<const float> xs, std::span<const float> zs, std::span<Vector3> normals) const;
+
+    // Steepest edge of the height cell around position as rise over run, like the navigation cost of that cell.
+    // nullopt over chunks that are not loaded.
+    [[nodiscard]] auto get_slope(Vector2 position) const -> std::optional<float>;
+
+    // Walks the chunk grid along the ray and only marches the height cells of chunks whose height range it crosses
+    [[nodiscard]] auto raycast(const Ray &ray, float max_distance) const -> std::optional<Vector3>;
+
+    [[nodiscard]] auto get_chunk_size() const -> float { return chunk_size; }
+    [[nodiscard]] auto get_chunk_subdivisions() const -> std::uint32_t { return chunk_subdivisions; }
+    [[nodiscard]] auto get_sample_spacing() const -> float { return sample_spacing; }
+    // Blocks per side of ChunkHeights::block_min_heights, block i spans the samples from get_block_start(i) to
+    // get_block_start(i + 1)
+    [[nodiscard]] auto get_occluder_blocks() const -> std::uint32_t {
+        return std::min(max_occluder_blocks, chunk_subdivisions);
+    }
+    [[nodiscard]] auto get_block_start(const std::uint32_t block) const -> std::uint32_t {
+        return block * chunk_subdivisions / get_occluder_blocks();
+    }
+    // Over every loaded chunk
+    [[nodiscard]] auto get_min_height() const -> float { return min_height; }
+    [[nodiscard]] auto get_max_height() const -> float { return max_height; }
+    // Changes whenever a chunk is set or removed
+    [[nodiscard]] auto get_revision() const -> std::uint64_t { return revision; }
+
+  private:
+    float chunk_size;
+    std::uint32_t chunk_subdivisions;
+    float sample_spacing;
+
+    float min_height = 0.f;
+    float max_height = 0.f;
+    std::uint64_t revision = 0u;
+
+    std::unordered_map<std::uint64_t, ChunkHeights> chunks;
+
+    // Dense lookup over the rectangle around every loaded chunk, row major. Left empty when the loaded chunks are so
+    // spread out that it would be mostly holes, find_chunk falls back to the map then.
+    std::vector<const ChunkHeights *> chunk_table;
+    std::int64_t table_x = 0;
+    std::int64_t table_y = 0;
+    std::int64_t table_width = 0;
+    std::int64_t table_height = 0;
+
+    struct CellBlock;
+
+    [[nodiscard]] static auto make_key(std::int64_t x, std::int64_t y) -> std::uint64_t;
+    void fetch_cells(const float *xs, const float *zs, std::size_t count, CellBlock &block) const;
+    void rebuild_chunk_table();
+    [[nodiscard]] auto raycast_chunk(const Ray &ray, std::int64_t x, std::int64_t y, const ChunkHeights &chunk,
+                                     float t_start, float t_end) const -> std::optional<float>;
+    void recompute_bounds();
+};
+
+} // namespace stratgame
@@ -1,9 +1,15 @@
 #include "homeless_functions.hpp"
-#include "assets_loader.hpp"
+#include "asset_manager.hpp"
 #include "common_components.hpp"
+#include "culling.hpp"
 #include "drawing.hpp"
+#include "height_field.hpp"
 #include "minion.hpp"
+#include "selection.hpp"
+#include "simulation.hpp"
+#include "thread_pool.hpp"
 #include <raylib.h>
+#include <rlgl.h>
 
 namespace stratgame {
 void setup_raylib() {
@@ -18,78 +24,108 @@ void setup_raylib() {
     InitWindow(screen_width, screen_height, "RTS game");
 }
 
-auto setup_entt() -> entt::registry {
-    entt::registry registry;
-
-    // NOTE: Movement depends on Transform
-    // NOTE: Resets Transform when Movement is added
-    registry.on_construct<stratgame::Movement>().connect<&entt::registry::emplace_or_replace<stratgame::Transform>>();
+[[nodiscard]] static auto get_team_color(const entt::registry &registry, const int team_id) -> Color {
+    const auto team_color_map_entity = registry.view<const stratgame::team_color_map>().front();
+    return registry.get<const stratgame::team_color_map>(team_color_map_entity).at(team_id);
+}
 
-    // NOTE: Minions must have Transform, BaseStats and ModelComponent
-    registry.on_construct<stratgame::Minion>().connect<[](entt::registry &registry, entt::entity entity) {
-        registry.emplace<stratgame::Transform>(entity);
-        registry.emplace<stratgame::Movement>(entity);
-        registry.emplace<stratgame::BaseStats>(entity);
-        registry.emplace<stratgame::Selectable>(entity);
+// NOTE: Every minion is an instance of this one sphere, team and selection colors are per instance attributes
+static void setup_minion_model(entt::registry &registry) {
+    auto shader_asset = registry.ctx().get<AssetManager>().load_shader("shaders/minion.vs", "shaders/minion.fs");
+    auto model = LoadModelFromMesh(GenMeshSphere(1.f, 16, 16));
 
-        const auto &minion = registry.get<stratgame::Minion>(entity);
-        auto model = LoadModelFromMesh(GenMeshSphere(1.f, 16, 16));
+    const auto shader = unwrap(shader_asset.wait());
+    shader.locs[SHADER_LOC_MATRIX_MVP] = GetShaderLocation(shader, "mvp");
+    shader.locs[SHADER_LOC_MATRIX_MODEL] = GetShaderLocationAttrib(shader, "instanceTransform");
+    model.materials[0].shader = shader;
 
-        const auto team_color_map_entity = registry.view<stratgame::team_color_map>().begin()[0];
-        const auto &team_colors = registry.get<stratgame::team_color_map>(team_color_map_entity);
-        const auto color = team_colors.at(minion.team_id);
+    registry.ctx().emplace<MinionModel>(stratgame::register_instanceable_model(registry, model),
+                                        std::move(shader_asset));
+}
 
-        model.materials[0].maps[MATERIAL_MAP_DIFFUSE].color = color;
-        registry.emplace<stratgame::ModelComponent>(entity, model);
-    }>();
+auto setup_entt() -> entt::registry {
+    entt::registry registry;
 
-    registry.on_construct<Selected>().connect<[](entt::registry &registry, entt::entity entity) {
-        if (registry.all_of<Minion, ModelComponent>(entity)) {
-            auto model = registry.get<ModelComponent>(entity);
-            model.model.materials[0].maps[MATERIAL_MAP_DIFFUSE].color = GREEN;
-        };
-    }>();
+    stratgame::setup_simulation(registry);
+    registry.ctx().emplace<AssetManager>(registry.ctx().get<ThreadPool>());
+    stratgame::setup_instancing(registry);
+    setup_minion_model(registry);
 
-    registry.on_destroy<Selected>().connect<[](entt::registry &registry, entt::entity entity) {
-        if (registry.all_of<Minion, ModelComponent>(entity)) {
-            auto minion = registry.get<Minion>(entity);
-            auto model = registry.get<ModelComponent>(entity);
-            const auto team_color_map_entity = registry.view<stratgame::team_color_map>().begin()[0];
-            const auto &team_colors = registry.get<stratgame::team_color_map>(team_color_map_entity);
-            const auto color = team_colors.at(minion.team_id);
-            model.model.materials[0].maps[MATERIAL_MAP_DIFFUSE].color = color;
-        };
+    // NOTE: Minions must have ModelInstance and FrustumCullingComponent, the simulation hooks add the rest
+    registry.on_construct<stratgame::Minion>().connect<[](entt::registry &registry, entt::entity entity) {
+        const auto &minion = registry.get<const stratgame::Minion>(entity);
+        registry.emplace<stratgame::ModelInstance>(entity, registry.ctx().get<const MinionModel>().model_entity);
+        stratgame::set_instance_color(registry, entity, get_team_color(registry, minion.team_id));
+        registry.emplace<stratgame::FrustumCullingComponent>(entity, 1.f, Vector2{0.f, 0.f});
     }>();
 
     return registry;
 }
 
-void setup_tree(entt::registry & /*registry*/) {
-    const auto tree_model = stratgame::load_asset(LoadModel, "tree/tree.gltf");
-    const auto tree_instancing_shader =
-        stratgame::load_asset(LoadShader, "shaders/instancing.vs", "shaders/instancing.fs");
+void update_selection_colors(entt::registry &registry) {
+    const auto &state = registry.ctx().get<const SelectionState>();
+    if (state.changed.empty()) {
+        return;
+    }
+
+    const auto team_color_map_entity = registry.view<const stratgame::team_color_map>().front();
+    const auto &team_colors = registry.get<const stratgame::team_color_map>(team_color_map_entity);
+    for (const auto entity : state.changed) {
+        if (!registry.valid(entity) || !registry.all_of<Minion, ModelInstance>(entity)) {
+            continue;
+        }
+        const auto &minion = registry.get<const Minion>(entity);
+        const auto color = registry.all_of<Selected>(entity) ? GREEN : team_colors.at(minion.team_id);
+        stratgame::set_instance_color(registry, entity, color);
+    }
+    clear_selection_changes(registry);
+}
+
+// Keeps the tree assets loaded for as long as the trees are drawn
+struct TreeAssets {
+    AssetHandle<Model> model;
+    AssetHandle<Shader> shader;
+    AssetHandle<Texture2D> texture;
+};
+
+void setup_tree(entt::registry &registry) {
+    // NOTE: Requested together, the texture and shader are read and decoded on workers while the model is parsed
+    auto &assets = registry.ctx().get<AssetManager>();
+    auto &tree_assets = registry.ctx().emplace<TreeAssets>(
+        assets.load_model("tree/tree.gltf"), assets.load_shader("shaders/instancing.vs", "shaders/instancing.fs"),
+        assets.load_texture("tree/treeDiffuse.png"));
+
+    const auto tree_model = unwrap(tree_assets.model.wait());
+    const auto tree_instancing_shader = unwrap(tree_assets.shader.wait());
+    const auto tree_texture = unwrap(tree_assets.texture.wait());
     tree_instancing_shader.locs[SHADER_LOC_MATRIX_MVP] = GetShaderLocation(tree_instancing_shader, "mvp");
     tree_instancing_shader.locs[SHADER_LOC_VECTOR_VIEW] = GetShaderLocation(tree_instancing_shader, "viewPos");
     tree_instancing_shader.locs[SHADER_LOC_MATRIX_MODEL] =
         GetShaderLocationAttrib(tree_instancing_shader, "instanceTransform");
 
     for (auto i = 0; i < tree_model.materialCount; i++) {
+        auto &albedo = tree_model.materials[i].maps[MATERIAL_MAP_ALBEDO].texture;
+        // NOTE: The glTF loader uploads its own copy of the texture for every material, only the shared one is kept
+        if (albedo.id != rlGetTextureIdDefault() && albedo.id != tree_texture.id) {
+            UnloadTexture(albedo);
+        }
+        albedo = tree_texture;
         tree_model.materials[i].shader = tree_instancing_shader;
-        tree_model.materials[i].maps[MATERIAL_MAP_ALBEDO].texture =
-            stratgame::load_asset(LoadTexture, "tree/treeDiffuse.png");
     }
-    // auto tree_model_entity = stratgame::register_instanceable_model(registry, tree_model);
-    //
-    // for (int i = 0; i < 50; i++) {
-    //     for (int j = 0; j < 50; j++) {
-    //         const auto height = heights[4 * i + 4 * j * 200];
-    //         const auto x_offset = ((float)rand() / RAND_MAX) * 2 - 1;
-    //         const auto z_offset = ((float)rand() / RAND_MAX) * 2 - 1;
-    //         const auto tree_entity = registry.create();
-    //         stratgame::create_model_instance(registry, tree_model_entity,
-    //                                          Vector3{4 * (float)i + x_offset, height, 4 * (float)j + z_offset},
-    //                                          tree_entity);
-    //     }
-    // }
+    const auto tree_model_entity = stratgame::register_instanceable_model(registry, tree_model);
+    const auto &height_field = registry.ctx().get<const TerrainHeightField>();
+
+    // NOTE: Trees are static, after this their instance matrices are never touched again
+    for (auto i = 0; i < 50; i++) {
+        for (auto j = 0; j < 50; j++) {
+            const auto x = 4.f * static_cast<float>(i) + static_cast<float>(GetRandomValue(-100, 100)) / 100.f;
+            const auto z = 4.f * static_cast<float>(j) + static_cast<float>(GetRandomValue(-100, 100)) / 100.f;
+
+            const auto ground = height_field.raycast(Ray{Vector3{x, 1000.f, z}, Vector3{0.f, -1.f, 0.f}}, 2000.f);
+            const auto tree_entity = registry.create();
+            stratgame::create_model_instance(registry, tree_model_entity,
+                                             Vector3{x, ground ? ground->y : 0.f, z}, tree_entity);
+        }
+    }
 }
 } // namespace stratgame
@@ -6,5 +6,7 @@ void setup_raylib();
 [[nodiscard]] auto setup_entt() -> entt::registry;
 
 void setup_tree(entt::registry &registry);
+// Selected minions are green, recolours the ones whose selection changed since the last call
+void update_selection_colors(entt::registry &registry);
 
 }; // namespace stratgame
@@ -0,0 +1,102 @@
+#include "instancing.hpp"
+#include "common_components.hpp"
+#include "log.hpp"
+#include <raymath.h>
+
+namespace stratgame {
+auto register_instanceable_model(entt::registry &registry, const Model &model) -> entt::entity {
+    static int model_id = 0;
+
+    log_debug("Registering model with id: {}", model_id);
+
+    const auto entity = registry.create();
+    auto &instanceable_model = registry.emplace<InstanceableModel>(entity, model_id, model);
+    instanceable_model.color_location = GetShaderLocationAttrib(model.materials[0].shader, "instanceColor");
+
+    model_id++;
+    return entity;
+}
+
+void create_model_instance(entt::registry &registry, entt::entity model_entity, Vector3 transform,
+                           entt::entity object_entity) {
+    registry.emplace<stratgame::Transform>(object_entity, transform);
+    registry.emplace<ModelInstance>(object_entity, model_entity);
+}
+
+void set_instance_color(entt::registry &registry, entt::entity object_entity, Color color) {
+    const auto &instance = registry.get<const ModelInstance>(object_entity);
+    registry.get<InstanceableModel>(instance.model_entity).colors[instance.slot] = color;
+}
+
+[[nodiscard]] static auto instance_matrix(const Vector3 &position) -> Matrix {
+    return MatrixTranslate(position.x, position.y, position.z);
+}
+
+void setup_instancing(entt::registry &registry) {
+    // NOTE: ModelInstance requires Transform to already be present
+    registry.on_construct<ModelInstance>().connect<[](entt::registry &registry, entt::entity entity) {
+        auto &instance = registry.get<ModelInstance>(entity);
+        auto &model = registry.get<InstanceableModel>(instance.model_entity);
+
+        instance.slot = static_cast<std::uint32_t>(model.instances.size());
+        model.instances.push_back(entity);
+        model.transforms.push_back(instance_matrix(registry.get<const stratgame::Transform>(entity).position));
+        model.colors.push_back(WHITE);
+        model.visible.push_back(1u);
+        model.visible_count++;
+    }>();
+
+    // swap-and-pop, the instance moved into the hole gets its slot patched
+    registry.on_destroy<ModelInstance>().connect<[](entt::registry &registry, entt::entity entity) {
+        const auto &instance = registry.get<const ModelInstance>(entity);
+        auto &model = registry.get<InstanceableModel>(instance.model_entity);
+
+        const auto last = model.instances.size() - 1u;
+        model.visible_count -= model.visible[instance.slot];
+        if (instance.slot != last) {
+            model.instances[instance.slot] = model.instances[last];
+            model.transforms[instance.slot] = model.transforms[last];
+            model.colors[instance.slot] = model.colors[last];
+            model.visible[instance.slot] = model.visible[last];
+            registry.get<ModelInstance>(model.instances[instance.slot]).slot = instance.slot;
+        }
+        model.instances.pop_back();
+        model.transforms.pop_back();
+        model.colors.pop_back();
+        model.visible.pop_back();
+    }>();
+
+    registry.on_update<stratgame::Transform>().connect<[](entt::registry &registry, entt::entity entity) {
+        if (const auto *instance = registry.try_get<const ModelInstance>(entity)) {
+            const auto &transform = registry.get<const stratgame::Transform>(entity);
+            registry.get<InstanceableModel>(instance->model_entity).transforms[instance->slot] =
+                instance_matrix(transform.position);
+        }
+    }>();
+}
+
+// NOTE: update_transform writes positions in place, so only instances that can move are refreshed every frame
+void update_model_instances(entt::registry &registry) {
+    const auto view = registry.view<const Movement, const stratgame::Transform, const ModelInstance>();
+    for (auto &&[entity, movement, transform, instance] : view.each()) {
+        auto &model = registry.get<InstanceableModel>(instance.model_entity);
+        model.transforms[instance.slot] = instance_matrix(transform.position);
+    }
+}
+
+auto gather_visible_instances(InstanceableModel &model) -> VisibleInstances {
+    if (model.visible_count == model.instances.size()) {
+        return VisibleInstances{.transforms = model.transforms, .colors = model.colors};
+    }
+
+    model.draw_transforms.clear();
+    model.draw_colors.clear();
+    for (auto i = 0u; i < model.instances.size(); i++) {
+        if (model.visible[i] != 0u) {
+            model.draw_transforms.push_back(model.transforms[i]);
+            model.draw_colors.push_back(model.colors[i]);
+        }
+    }
+    return VisibleInstances{.transforms = model.draw_transforms, .colors = model.draw_colors};
+}
+}; // namespace stratgame
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstdint>
+#include <entt.hpp>
+#include <raylib.h>
+#include <span>
+#include <vector>
+
+namespace stratgame {
+// Dense per-model instance buffer, transforms[i], colors[i] and visible[i] belong to instances[i]
+struct InstanceableModel {
+    int model_id;
+    Model model;
+    std::vector<Matrix> transforms;
+    std::vector<entt::entity> instances;
+    std::vector<Color> colors;         // per instance vertex attribute, only drawn when the shader has one
+    std::vector<std::uint8_t> visible; // written by flag_culled_models, instances without culling stay visible
+    std::uint32_t visible_count = 0u;
+
+    int color_location = -1;        // of the "instanceColor" attribute in the shader of the first material
+    unsigned int color_buffer = 0u; // per instance VBO attached to the vertex array of every mesh
+    std::size_t color_buffer_capacity = 0u;
+
+    // culled instances are left out of these before drawing, reused between frames
+    std::vector<Matrix> draw_transforms;
+    std::vector<Color> draw_colors;
+};
+
+// requires Transform, kept in its model's buffer by the hooks from setup_instancing
+struct ModelInstance {
+    entt::entity model_entity;
+    std::uint32_t slot = 0u;
+};
+
+// What draw_models_instanced hands to the GPU for one model
+struct VisibleInstances {
+    std::span<const Matrix> transforms;
+    std::span<const Color> colors;
+};
+
+auto register_instanceable_model(entt::registry &registry, const Model &model) -> entt::entity;
+void create_model_instance(entt::registry &registry, entt::entity model_entity, Vector3 transform,
+                           entt::entity object_entity);
+void set_instance_color(entt::registry &registry, entt::entity object_entity, Color color);
+
+// Instance matrices are only rewritten when a Transform is patched or the instance moves through Movement
+void setup_instancing(entt::registry &registry);
+void update_model_instances(entt::registry &registry);
+
+// The instances left after culling, compacted into draw_transforms and draw_colors unless every instance is visible
+[[nodiscard]] auto gather_visible_instances(InstanceableModel &model) -> VisibleInstances;
+}; // namespace stratgame
@@ -0,0 +1,185 @@
+#include "log.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace stratgame {
+
+namespace {
+
+constexpr auto queue_capacity = std::uint64_t{1024u}; // records per thread, 256 KiB
+
+// Ring of records with a single producer, the thread owning it, and a single consumer, the log thread
+struct LogQueue {
+    std::array<LogRecord, queue_capacity> records;
+    alignas(64) std::atomic<std::uint64_t> head = 0u; // next record to write out, advanced by the log thread
+    alignas(64) std::atomic<std::uint64_t> tail = 0u; // next free record, advanced by the owner
+    std::atomic<std::uint64_t> dropped = 0u;
+    std::atomic<bool> closed = false; // the owner exited, dropped once it is empty
+};
+
+[[nodiscard]] auto now() -> std::int64_t {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+[[nodiscard]] auto get_level_name(const LogLevel level) -> std::string_view {
+    switch (level) {
+    case LogLevel::Debug:
+        return "debug";
+    case LogLevel::Info:
+        return "info";
+    case LogLevel::Warning:
+        return "warning";
+    case LogLevel::Error:
+        return "error";
+    }
+    return "?";
+}
+
+// Formats and writes the records of every thread's queue on its own thread
+class Logger {
+  public:
+    Logger() : start(now()), thread([this](const std::stop_token &stop) { run(stop); }) {}
+
+    Logger(const Logger &) = delete;
+    Logger(Logger &&) = delete;
+    auto operator=(const Logger &) -> Logger & = delete;
+    auto operator=(Logger &&) -> Logger & = delete;
+    // NOTE: The jthread stops and joins here, run writes out what is left before it returns
+    ~Logger() = default;
+
+    auto add_queue() -> std::shared_ptr<LogQueue> {
+        auto queue = std::make_shared<LogQueue>();
+        const auto lock = std::scoped_lock{mutex};
+        queues.push_back(queue);
+        return queue;
+    }
+
+    void flush() {
+        auto targets = std::vector<std::pair<std::shared_ptr<LogQueue>, std::uint64_t>>{};
+        {
+            const auto lock = std::scoped_lock{mutex};
+            for (const auto &queue : queues) {
+                targets.emplace_back(queue, queue->tail.load(std::memory_order_acquire));
+            }
+        }
+        for (const auto &[queue, tail] : targets) {
+            while (queue->head.load(std::memory_order_acquire) < tail) {
+                std::this_thread::sleep_for(std::chrono::microseconds{100});
+            }
+        }
+    }
+
+  private:
+    std::int64_t start;
+    std::mutex mutex;
+    std::vector<std::shared_ptr<LogQueue>> queues; // guarded by mutex
+    std::string buffer;
+    std::jthread thread; // last, it uses everything above
+
+    void run(const std::stop_token &stop) {
+        while (!stop.stop_requested()) {
+            if (!write_pending()) {
+                std::this_thread::sleep_for(std::chrono::milliseconds{1});
+            }
+        }
+        while (write_pending()) {
+        }
+    }
+
+    // Writes out every queued record in one go, false when there was none
+    auto write_pending() -> bool {
+        buffer.clear();
+        {
+            const auto lock = std::scoped_lock{mutex};
+            for (auto &queue : queues) {
+                // NOTE: Read before the tail, a queue seen closed has nothing left to add past that tail
+                const auto closed = queue->closed.load(std::memory_order_acquire);
+                const auto tail = queue->tail.load(std::memory_order_acquire);
+                for (auto head = queue->head.load(std::memory_order_relaxed); head < tail; head++) {
+                    const auto &record = queue->records[head % queue_capacity];
+                    const auto seconds = static_cast<double>(record.time - start) * 1e-9;
+                    buffer += std::format("[{:10.3f}] {}: ", seconds, get_level_name(record.level));
+                    record.format(record, buffer);
+                    buffer += '\n';
+                    queue->head.store(head + 1u, std::memory_order_release);
+                }
+                if (const auto dropped = queue->dropped.exchange(0u, std::memory_order_relaxed); dropped > 0u) {
+                    buffer += std::format("[{:10.3f}] warning: {} messages dropped, the queue was full\n",
+                                          static_cast<double>(now() - start) * 1e-9, dropped);
+                }
+                if (closed) {
+                    queue.reset();
+                }
+            }
+            std::erase(queues, nullptr);
+        }
+
+        if (buffer.empty()) {
+            return false;
+        }
+        std::fwrite(buffer.data(), 1u, buffer.size(), stdout);
+        std::fflush(stdout);
+        return true;
+    }
+};
+
+auto get_logger() -> Logger & {
+    static auto logger = Logger{};
+    return logger;
+}
+
+// NOTE: Registered on the first message of a thread, closed when the thread exits
+struct ThreadQueue {
+    std::shared_ptr<LogQueue> queue;
+
+    ThreadQueue() = default;
+    ThreadQueue(const ThreadQueue &) = delete;
+    ThreadQueue(ThreadQueue &&) = delete;
+    auto operator=(const ThreadQueue &) -> ThreadQueue & = delete;
+    auto operator=(ThreadQueue &&) -> ThreadQueue & = delete;
+    ~ThreadQueue() {
+        if (queue) {
+            queue->closed.store(true, std::memory_order_release);
+        }
+    }
+};
+
+thread_local auto thread_queue = ThreadQueue{};
+
+} // namespace
+
+namespace detail {
+
+auto begin_log_record() -> LogRecord * {
+    if (!thread_queue.queue) {
+        thread_queue.queue = get_logger().add_queue();
+    }
+
+    auto &queue = *thread_queue.queue;
+    const auto tail = queue.tail.load(std::memory_order_relaxed);
+    if (tail - queue.head.load(std::memory_order_acquire) == queue_capacity) {
+        queue.dropped.fetch_add(1u, std::memory_order_relaxed);
+        return nullptr;
+    }
+
+    auto &record = queue.records[tail % queue_capacity];
+    record.time = now();
+    return &record;
+}
+
+void commit_log_record() {
+    auto &queue = *thread_queue.queue;
+    queue.tail.store(queue.tail.load(std::memory_order_relaxed) + 1u, std::memory_order_release);
+}
+
+} // namespace detail
+
+void flush_log() { get_logger().flush(); }
+
+} // namespace stratgame
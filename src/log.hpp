@@ -0,0 +1,170 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <format>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+// Lowest level compiled in, 0 debug, 1 info, 2 warning, 3 error. Calls below it compile to nothing.
+#ifndef STRATGAME_MIN_LOG_LEVEL
+#ifdef NDEBUG
+#define STRATGAME_MIN_LOG_LEVEL 1
+#else
+#define STRATGAME_MIN_LOG_LEVEL 0
+#endif
+#endif
+
+namespace stratgame {
+
+enum class LogLevel : std::uint8_t { Debug = 0u, Info = 1u, Warning = 2u, Error = 3u };
+
+constexpr auto min_log_level = static_cast<LogLevel>(STRATGAME_MIN_LOG_LEVEL);
+
+// One log call as the calling thread left it: the arguments packed as bytes, formatted later by the log thread
+struct LogRecord {
+    constexpr static std::size_t size = 256u;
+    using Formatter = void (*)(const LogRecord &record, std::string &out);
+
+    Formatter format;
+    std::string_view pattern; // the format string, always a literal
+    std::int64_t time;        // steady clock nanoseconds
+    LogLevel level;
+    std::array<std::byte, size - sizeof(Formatter) - sizeof(std::string_view) - sizeof(std::int64_t) - sizeof(LogLevel)>
+        payload;
+};
+static_assert(sizeof(LogRecord) == LogRecord::size);
+
+namespace detail {
+
+// Strings are copied into the record, everything else has to be trivially copyable and is copied as it is
+template <typename T>
+concept LogString = std::is_convertible_v<const T &, std::string_view>;
+
+template <typename T>
+concept LogValue = LogString<T> || std::is_trivially_copyable_v<T>;
+
+template <typename T> using log_decoded_t = std::conditional_t<LogString<T>, std::string_view, T>;
+
+// Bytes a value takes no matter what it holds, strings only count their length prefix
+template <typename T> constexpr auto log_fixed_size() -> std::size_t {
+    return LogString<T> ? sizeof(std::uint16_t) : sizeof(T);
+}
+
+class LogEncoder {
+  public:
+    LogEncoder(std::byte *out, const std::size_t string_budget) : out(out), string_budget(string_budget) {}
+
+    template <typename T> void write(const T &value) {
+        if constexpr (LogString<T>) {
+            // NOTE: Cut short rather than dropped, the strings share what the other arguments leave free
+            const auto string = std::string_view{value};
+            const auto length = static_cast<std::uint16_t>(std::min(string.size(), string_budget));
+            string_budget -= length;
+            raw(length);
+            std::memcpy(out, string.data(), length);
+            out += length;
+        } else {
+            raw(value);
+        }
+    }
+
+  private:
+    std::byte *out;
+    std::size_t string_budget;
+
+    template <typename T> void raw(const T &value) {
+        std::memcpy(out, &value, sizeof(T));
+        out += sizeof(T);
+    }
+};
+
+class LogDecoder {
+  public:
+    explicit LogDecoder(const std::byte *in) : in(in) {}
+
+    template <typename T> auto read() -> log_decoded_t<T> {
+        if constexpr (LogString<T>) {
+            const auto length = raw<std::uint16_t>();
+            const auto string = std::string_view{reinterpret_cast<const char *>(in), length};
+            in += length;
+            return string;
+        } else {
+            return raw<T>();
+        }
+    }
+
+  private:
+    const std::byte *in;
+
+    template <typename T> auto raw() -> T {
+        auto value = T{};
+        std::memcpy(&value, in, sizeof(T));
+        in += sizeof(T);
+        return value;
+    }
+};
+
+template <typename... Args> void format_log_record(const LogRecord &record, std::string &out) {
+    [[maybe_unused]] auto decoder = LogDecoder{record.payload.data()};
+    // NOTE: Braced initialization reads the arguments in order
+    auto values = std::tuple<log_decoded_t<Args>...>{decoder.read<Args>()...};
+    std::apply([&](auto &...value) { out += std::vformat(record.pattern, std::make_format_args(value...)); },
+               values);
+}
+
+// Free slot in the calling thread's queue, nullptr when the queue is full and the record has to be dropped
+[[nodiscard]] auto begin_log_record() -> LogRecord *;
+void commit_log_record();
+
+} // namespace detail
+
+// Queues a message for the log thread. Never blocks or allocates, messages are dropped while the calling thread's
+// queue is full. Arguments are formatted on the log thread, strings are copied and cut short when they do not fit.
+template <LogLevel Level, typename... Args>
+    requires(detail::LogValue<std::remove_cvref_t<Args>> && ...)
+void write_log(const std::format_string<Args...> format, Args &&...args) {
+    if constexpr (Level >= min_log_level) {
+        using payload_type = decltype(LogRecord::payload);
+        constexpr auto fixed_size = (std::size_t{0u} + ... + detail::log_fixed_size<std::remove_cvref_t<Args>>());
+        static_assert(fixed_size <= std::tuple_size_v<payload_type>, "too many arguments for one log record");
+
+        auto *record = detail::begin_log_record();
+        if (record == nullptr) {
+            return;
+        }
+        record->format = &detail::format_log_record<std::remove_cvref_t<Args>...>;
+        record->pattern = format.get();
+        record->level = Level;
+        constexpr auto string_budget = std::tuple_size_v<payload_type> - fixed_size;
+        [[maybe_unused]] auto encoder = detail::LogEncoder{record->payload.data(), string_budget};
+        (encoder.write(args), ...);
+        detail::commit_log_record();
+    }
+}
+
+template <typename... Args> void log_debug(const std::format_string<Args...> format, Args &&...args) {
+    write_log<LogLevel::Debug>(format, std::forward<Args>(args)...);
+}
+
+template <typename... Args> void log_info(const std::format_string<Args...> format, Args &&...args) {
+    write_log<LogLevel::Info>(format, std::forward<Args>(args)...);
+}
+
+template <typename... Args> void log_warning(const std::format_string<Args...> format, Args &&...args) {
+    write_log<LogLevel::Warning>(format, std::forward<Args>(args)...);
+}
+
+template <typename... Args> void log_error(const std::format_string<Args...> format, Args &&...args) {
+    write_log<LogLevel::Error>(format, std::forward<Args>(args)...);
+}
+
+// Blocks until every message queued before the call is written
+void flush_log();
+
+} // namespace stratgame
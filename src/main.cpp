@@ -1,46 +1,107 @@
-#include "assets_loader.hpp"
+#include "asset_manager.hpp"
 #include "camera.hpp"
+#include "commands.hpp"
+#include "culling.hpp"
 #include "drawing.hpp"
 #include "homeless_functions.hpp"
 #include "imgui.h"
+#include "log.hpp"
 #include "minion.hpp"
+#include "profiler.hpp"
+#include "profiler_overlay.hpp"
 #include "raylib.h"
+#include "replay.hpp"
 #include "rlImGui.h"
+#include "save_game.hpp"
+#include "selection.hpp"
+#include "simulation.hpp"
 #include "systems.hpp"
 #include "tasks.hpp"
 #include <entt.hpp>
-#include <print>
+#include <filesystem>
+#include <random>
 
 #include "common_components.hpp"
 #include "terrain.hpp"
+#include "terrain_streamer.hpp"
 
 #define RAYGUI_IMPLEMENTATION
 #include "raygui.h"
 
+constexpr auto autosave_path = "saves/autosave.save";
+constexpr auto quicksave_path = "saves/quicksave.save";
+
 auto main() -> int {
     stratgame::setup_raylib();
 
     auto registry = stratgame::setup_entt();
     const auto world_entity = registry.create();
 
-    auto terrain_shader = stratgame::generate_terrain_shader(
-        stratgame::load_asset(LoadShader, "shaders/terrain.vs", "shaders/terrain.fs"), 5.0f);
-    auto noise = SimplexNoise();
-    const auto terrain_generator = stratgame::generate_terrain(registry, 32 * 16, 2, noise, terrain_shader);
+    auto &assets = registry.ctx().get<stratgame::AssetManager>();
+    constexpr auto height_scale = 5.0f;
+    const auto terrain_shader_asset = assets.load_shader("shaders/terrain.vs", "shaders/terrain.fs");
+    auto terrain_shader =
+        stratgame::generate_terrain_shader(stratgame::unwrap(terrain_shader_asset.wait()), height_scale);
+    const auto noise = stratgame::NoiseParameters{};
+    const auto camera_entity = stratgame::create_camera(registry);
+
+    // NOTE: Only the chunks around the camera are resident, the rest is generated on demand while panning
+    auto terrain_generator = stratgame::TerrainGenerator(noise, 64, 128, terrain_shader, height_scale);
+    terrain_generator.enable_cache("cache/terrain");
+    terrain_generator.upload_grid();
+    // NOTE: Started before any chunk is registered, replays need every chunk that was ever resident
+    const auto replay_header = stratgame::make_replay_header(terrain_generator, stratgame::default_tick_rate);
+    // NOTE: Replays start from an empty world, a game resumed from the autosave is not recorded
+    auto autosave = stratgame::Expected<stratgame::WorldSnapshot>{std::unexpected(std::string{"No autosave"})};
+    if (std::filesystem::exists(autosave_path)) {
+        autosave = stratgame::read_world_snapshot(autosave_path);
+        if (!autosave) {
+            stratgame::log_warning("Not resuming the autosave: {}", autosave.error());
+        }
+    }
+    if (!autosave) {
+        if (const auto recording = stratgame::start_recording(registry, "replays/last.replay", replay_header);
+            !recording) {
+            stratgame::log_warning("Not recording a replay: {}", recording.error());
+        }
+    }
+    auto &terrain_streamer = registry.ctx().emplace<stratgame::TerrainStreamer>(terrain_generator,
+                                                                                 stratgame::TerrainStreamingSettings{});
+    terrain_streamer.load_blocking(registry, registry.get<stratgame::Camera>(camera_entity).target_position);
+    stratgame::setup_tree(registry);
 
     registry.emplace<stratgame::TerrainClick>(world_entity);
 
     auto selected_entity = registry.create();
     registry.emplace<stratgame::SelectedState>(selected_entity);
 
-    const auto camera_entity = stratgame::create_camera(registry);
+    // NOTE: Restored once the terrain is resident, the tasks request their flow fields from it
+    auto resumed = false;
+    if (autosave) {
+        if (const auto restored = stratgame::restore_world_snapshot(registry, *autosave, replay_header); !restored) {
+            stratgame::log_warning("Not resuming the autosave: {}", restored.error());
+        } else {
+            resumed = true;
+        }
+    }
 
-    stratgame::register_team(registry, RED);
-    stratgame::register_team(registry, BLUE);
+    if (!resumed) {
+        stratgame::register_team(registry, RED);
+        stratgame::register_team(registry, BLUE);
 
-    for (auto i = 0; i < 10; i++) {
-        stratgame::create_minion(registry, {static_cast<float>(i * 2), static_cast<float>(i * 2)}, rand() % 2);
+        // NOTE: Spawned through commands on the first tick so the recording contains them
+        auto rng = std::mt19937{1337u};
+        auto team = std::uniform_int_distribution<int>{0, 1};
+        for (auto i = 0; i < 10; i++) {
+            registry.ctx().get<stratgame::CommandQueue>().push(stratgame::SpawnMinionCommand{
+                .position = {static_cast<float>(i * 2), static_cast<float>(i * 2)}, .team_id = team(rng)});
+        }
     }
+    auto &save_games = registry.ctx().emplace<stratgame::SaveGameWriter>(replay_header, autosave_path);
+
+    auto timestep = stratgame::FixedTimestep{};
+    auto &profiler = registry.ctx().emplace<stratgame::Profiler>();
+    auto profiler_overlay = stratgame::ProfilerOverlay{};
 
     bool toggle_wireframe = false;
     GuiLoadStyleDefault();
@@ -48,18 +109,43 @@ auto main() -> int {
     rlImGuiSetup(true);
 
     while (!WindowShouldClose()) {
+        profiler.begin_frame();
         stratgame::update_context(registry);
+        stratgame::profile(&profiler, "upload_assets", [&] { assets.upload_pending(); });
 
         auto &camera = registry.get<stratgame::Camera>(camera_entity);
         // ======================================
         // UPDATE SYSTEMS
         // ======================================
-        stratgame::flag_culled_models(registry);
-        stratgame::handle_input(registry);
-        stratgame::update_transform(registry);
-        stratgame::update_camera(registry);
-        // stratgame::update_minion_heights(registry);
-        stratgame::update_tasks(registry);
+        stratgame::profile(&profiler, "update_culling_spheres", [&] { stratgame::update_culling_spheres(registry); });
+        stratgame::profile(&profiler, "flag_culled_models", [&] { stratgame::flag_culled_models(registry); });
+        stratgame::profile(&profiler, "update_model_instances", [&] { stratgame::update_model_instances(registry); });
+        stratgame::profile(&profiler, "handle_input", [&] { stratgame::handle_input(registry); });
+        if (IsKeyPressed(KEY_F5) && !save_games.save(registry, quicksave_path)) {
+            stratgame::log_warning("Not saving, the previous save is still being written");
+        }
+        if (IsKeyPressed(KEY_F9)) {
+            if (const auto quicksave = stratgame::read_world_snapshot(quicksave_path); !quicksave) {
+                stratgame::log_error("{}", quicksave.error());
+            } else if (const auto loaded = stratgame::restore_world_snapshot(registry, *quicksave, replay_header);
+                       !loaded) {
+                stratgame::log_error("{}", loaded.error());
+            } else {
+                // NOTE: The recording can not continue from a loaded game
+                registry.ctx().erase<stratgame::ReplayRecorder>();
+                stratgame::log_info("Loaded {}", quicksave_path);
+            }
+        }
+        stratgame::profile(&profiler, "update_camera", [&] { stratgame::update_camera(registry); });
+        stratgame::profile(&profiler, "update_terrain_streaming",
+                           [&] { stratgame::update_terrain_streaming(registry); });
+
+        const auto ticks = timestep.consume(GetFrameTime());
+        for (auto tick = 0; tick < ticks; tick++) {
+            stratgame::profile(&profiler, "tick_simulation", [&] { stratgame::tick_simulation(registry); });
+        }
+        stratgame::profile(&profiler, "update_save_games", [&] { stratgame::update_save_games(registry); });
+        stratgame::profile(&profiler, "update_selection_colors", [&] { stratgame::update_selection_colors(registry); });
 
         // ======================================
 
@@ -72,11 +158,18 @@ auto main() -> int {
         // ======================================
         // DRAW SYSTEMS
         // ======================================
-        stratgame::draw_models(registry);
+        const auto &terrain_lod = terrain_streamer.get_generator().get_lod();
+        auto draw_stats = stratgame::profile(&profiler, "draw_terrain",
+                                             [&] { return stratgame::draw_terrain(registry, terrain_lod); });
+        draw_stats += stratgame::profile(&profiler, "draw_models", [&] { return stratgame::draw_models(registry); });
         if (toggle_wireframe) {
-            stratgame::draw_model_wireframes(registry);
+            draw_stats += stratgame::profile(&profiler, "draw_terrain_wireframes",
+                                             [&] { return stratgame::draw_terrain_wireframes(registry, terrain_lod); });
+            draw_stats += stratgame::profile(&profiler, "draw_model_wireframes",
+                                             [&] { return stratgame::draw_model_wireframes(registry); });
         }
-        stratgame::draw_models_instanced(registry);
+        draw_stats += stratgame::profile(&profiler, "draw_models_instanced",
+                                         [&] { return stratgame::draw_models_instanced(registry); });
         // ======================================
 
         DrawLine3D({-1000, 0, 0}, {1000, 0, 0}, RED);
@@ -87,13 +180,34 @@ auto main() -> int {
         // ======================================
         // DRAW GUI
         // ======================================
-        GuiCheckBox(Rectangle{50, 50, 30, 30}, "Toggle wireframe", &toggle_wireframe);
-        GuiSliderBar(Rectangle{50, 100, 100, 20}, nullptr, "Camera speed", &camera.speed, 0.f, 500.f);
-
-        DrawFPS(10, 10);
-
-        EndDrawing();
+        stratgame::profile(&profiler, "draw_gui", [&] {
+            GuiCheckBox(Rectangle{50, 50, 30, 30}, "Toggle wireframe", &toggle_wireframe);
+            GuiSliderBar(Rectangle{50, 100, 100, 20}, nullptr, "Camera speed", &camera.speed, 0.f, 500.f);
+
+            rlImGuiBegin();
+            profiler_overlay.draw(profiler);
+            rlImGuiEnd();
+
+            if (const auto drag = stratgame::get_drag_rectangle(registry)) {
+                DrawRectangleRec(*drag, Fade(GREEN, 0.15f));
+                DrawRectangleLinesEx(*drag, 1.f, GREEN);
+            }
+
+            DrawFPS(10, 10);
+        });
+
+        stratgame::set_frame_counters(registry, profiler, draw_stats);
+        // NOTE: Includes waiting for the buffer swap
+        stratgame::profile(&profiler, "end_drawing", [] { EndDrawing(); });
+        profiler.end_frame();
     }
+    // NOTE: The next start resumes from here
+    save_games.wait();
+    static_cast<void>(save_games.save(registry, autosave_path));
+    save_games.wait();
+    terrain_streamer.unload_all(registry);
+    terrain_generator.unload_grid();
+    assets.unload_all();
     rlImGuiShutdown();
     CloseWindow();
 
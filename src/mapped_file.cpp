@@ -0,0 +1,98 @@
+#include "mapped_file.hpp"
+#include <utility>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace stratgame {
+
+auto MappedFile::open(const std::filesystem::path &path) -> Expected<MappedFile> {
+#ifdef _WIN32
+    const auto file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                                  FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        return std::unexpected(std::string{"Could not open "} + path.string());
+    }
+
+    auto size = LARGE_INTEGER{};
+    if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+        CloseHandle(file);
+        return std::unexpected(std::string{"Could not map empty file "} + path.string());
+    }
+
+    const auto mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    CloseHandle(file);
+    if (mapping == nullptr) {
+        return std::unexpected(std::string{"Could not map "} + path.string());
+    }
+
+    // NOTE: The view keeps the mapping alive, both handles can be closed right away
+    const auto *data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping);
+    if (data == nullptr) {
+        return std::unexpected(std::string{"Could not map "} + path.string());
+    }
+
+    return MappedFile{static_cast<const std::byte *>(data), static_cast<std::size_t>(size.QuadPart)};
+#else
+    const auto file = ::open(path.c_str(), O_RDONLY);
+    if (file < 0) {
+        return std::unexpected(std::string{"Could not open "} + path.string());
+    }
+
+    struct stat status {};
+    if (fstat(file, &status) != 0 || status.st_size == 0) {
+        close(file);
+        return std::unexpected(std::string{"Could not map empty file "} + path.string());
+    }
+
+    const auto size = static_cast<std::size_t>(status.st_size);
+    auto *data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, file, 0);
+    close(file);
+    if (data == MAP_FAILED) {
+        return std::unexpected(std::string{"Could not map "} + path.string());
+    }
+
+    return MappedFile{static_cast<const std::byte *>(data), size};
+#endif
+}
+
+MappedFile::MappedFile(MappedFile &&other) noexcept
+    : data(std::exchange(other.data, nullptr)), size(std::exchange(other.size, 0u)) {}
+
+auto MappedFile::operator=(MappedFile &&other) noexcept -> MappedFile & {
+    if (this != &other) {
+        unmap();
+        data = std::exchange(other.data, nullptr);
+        size = std::exchange(other.size, 0u);
+    }
+    return *this;
+}
+
+MappedFile::~MappedFile() {
+    unmap();
+}
+
+void MappedFile::unmap() {
+    if (data == nullptr) {
+        return;
+    }
+
+#ifdef _WIN32
+    UnmapViewOfFile(data);
+#else
+    munmap(const_cast<std::byte *>(data), size);
+#endif
+    data = nullptr;
+    size = 0u;
+}
+
+} // namespace stratgame
@@ -0,0 +1,31 @@
+#pragma once
+#include "error.hpp"
+#include <cstddef>
+#include <filesystem>
+#include <span>
+
+namespace stratgame {
+
+// Read-only memory mapping of a whole file, unmapped when destroyed
+class MappedFile {
+  public:
+    [[nodiscard]] static auto open(const std::filesystem::path &path) -> Expected<MappedFile>;
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile(MappedFile &&other) noexcept;
+    auto operator=(const MappedFile &) -> MappedFile & = delete;
+    auto operator=(MappedFile &&other) noexcept -> MappedFile &;
+    ~MappedFile();
+
+    [[nodiscard]] auto get_bytes() const -> std::span<const std::byte> { return {data, size}; }
+
+  private:
+    MappedFile(const std::byte *data, std::size_t size) : data(data), size(size) {}
+
+    const std::byte *data = nullptr;
+    std::size_t size = 0u;
+
+    void unmap();
+};
+
+} // namespace stratgame
@@ -1,6 +1,6 @@
 #include "minion.hpp"
 #include "common_components.hpp"
-#include "terrain.hpp"
+#include "height_field.hpp"
 
 namespace stratgame {
 
@@ -8,29 +8,17 @@ auto create_minion(entt::registry &registry, Vector2 position, int team_id) -> e
     const auto entity = registry.create();
     registry.emplace<stratgame::Minion>(entity, team_id);
 
-    auto &transform = registry.get<stratgame::Transform>(entity);
-    transform.position.x = position.x;
-    transform.position.z = position.y;
+    // NOTE: Placed on the ground right away, update_transform only snaps units once they move
+    const auto *height_field = registry.ctx().find<const TerrainHeightField>();
+    const auto ground = height_field != nullptr ? height_field->get_height(position).value_or(0.f) : 0.f;
+    registry.patch<stratgame::Transform>(entity, [&](stratgame::Transform &transform) {
+        transform.position.x = position.x;
+        transform.position.y = ground + unit_ground_offset;
+        transform.position.z = position.y;
+    });
     return entity;
 }
 
-void update_minion_heights(entt::registry &registry) {
-    // const auto height_entity = registry.view<const stratgame::GeneratedTerrain::Heights>();
-    // const auto &heights = registry.get<stratgame::GeneratedTerrain::Heights>(*height_entity.begin());
-    //
-    // auto minions = registry.view<stratgame::Minion>();
-    //
-    // for (auto minion : minions) {
-    //     auto &transform = registry.get<stratgame::Transform>(minion);
-    //
-    //     const auto x = static_cast<int>(transform.position.x);
-    //     const auto z = static_cast<int>(transform.position.z);
-    //
-    //     // NOTE: The +1 is because minions are temporarily spheres of radius 1
-    //     transform.position.y = heights[z * 200 + x] + 1.f;
-    // }
-}
-
 void register_team(entt::registry &registry, const Color &color) {
     static int team_id = 0;
 
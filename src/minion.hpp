@@ -1,4 +1,5 @@
 #pragma once
+#include "asset_manager.hpp"
 #include "raylib.h"
 #include <entt.hpp>
 
@@ -17,12 +18,17 @@ struct Minion {
     int team_id;
 };
 
+// The instanced model every minion is drawn with, lives in registry.ctx() of the game
+struct MinionModel {
+    entt::entity model_entity;
+    AssetHandle<Shader> shader;
+};
+
 struct BaseStats {
     int health{100};
     int attack{10};
 };
 
 auto create_minion(entt::registry &registry, Vector2 position, int team_id) -> entt::entity;
-void update_minion_heights(entt::registry &registry);
 
 } // namespace stratgame
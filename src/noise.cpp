@@ -0,0 +1,135 @@
+#include "noise.hpp"
+#include <algorithm>
+#include <array>
+#include <vector>
+
+namespace stratgame {
+
+// NOTE: Same permutation as SimplexNoise, widened to 32 bits so the lookups can be gathered
+constexpr static auto perm = std::array<std::int32_t, 256>{
+    151, 160, 137, 91, 90, 15, 131, 13, 201, 95, 96, 53, 194, 233, 7, 225,
+    140, 36, 103, 30, 69, 142, 8, 99, 37, 240, 21, 10, 23, 190, 6, 148,
+    247, 120, 234, 75, 0, 26, 197, 62, 94, 252, 219, 203, 117, 35, 11, 32,
+    57, 177, 33, 88, 237, 149, 56, 87, 174, 20, 125, 136, 171, 168, 68, 175,
+    74, 165, 71, 134, 139, 48, 27, 166, 77, 146, 158, 231, 83, 111, 229, 122,
+    60, 211, 133, 230, 220, 105, 92, 41, 55, 46, 245, 40, 244, 102, 143, 54,
+    65, 25, 63, 161, 1, 216, 80, 73, 209, 76, 132, 187, 208, 89, 18, 169,
+    200, 196, 135, 130, 116, 188, 159, 86, 164, 100, 109, 198, 173, 186, 3, 64,
+    52, 217, 226, 250, 124, 123, 5, 202, 38, 147, 118, 126, 255, 82, 85, 212,
+    207, 206, 59, 227, 47, 16, 58, 17, 182, 189, 28, 42, 223, 183, 170, 213,
+    119, 248, 152, 2, 44, 154, 163, 70, 221, 153, 101, 155, 167, 43, 172, 9,
+    129, 22, 39, 253, 19, 98, 108, 110, 79, 113, 224, 232, 178, 185, 112, 104,
+    218, 246, 97, 228, 251, 34, 242, 193, 238, 210, 144, 12, 191, 179, 162, 241,
+    81, 51, 145, 235, 249, 14, 239, 107, 49, 192, 214, 31, 181, 199, 106, 157,
+    184, 84, 204, 176, 115, 121, 50, 45, 127, 4, 150, 254, 138, 236, 205, 93,
+    222, 114, 67, 29, 24, 72, 243, 141, 128, 195, 78, 66, 215, 61, 156, 180,
+};
+
+constexpr static auto F2 = 0.366025403f; // (sqrt(3) - 1) / 2
+constexpr static auto G2 = 0.211324865f; // (3 - sqrt(3)) / 6
+
+[[nodiscard]] static inline auto hash(const std::int32_t i) -> std::int32_t {
+    return perm[static_cast<std::size_t>(i & 0xFF)];
+}
+
+[[nodiscard]] static inline auto fast_floor(const float v) -> std::int32_t {
+    const auto i = static_cast<std::int32_t>(v);
+    return i - static_cast<std::int32_t>(v < static_cast<float>(i));
+}
+
+[[nodiscard]] static inline auto grad(const std::int32_t hash, const float x, const float y) -> float {
+    const auto h = hash & 0x3F;
+    const auto swap = static_cast<float>(h < 4);
+    const auto u = swap * x + (1.f - swap) * y;
+    const auto v = swap * y + (1.f - swap) * x;
+    return (1.f - static_cast<float>(h & 1) * 2.f) * u + (2.f - static_cast<float>(h & 2) * 2.f) * v;
+}
+
+[[nodiscard]] static inline auto corner(const float x, const float y, const std::int32_t gradient) -> float {
+    const auto t = std::max(0.5f - x * x - y * y, 0.f);
+    const auto t2 = t * t;
+    return t2 * t2 * grad(gradient, x, y);
+}
+
+// Written without early outs, every sample runs the same instructions
+[[nodiscard]] static inline auto simplex(const float x, const float y) -> float {
+    const auto s = (x + y) * F2;
+    const auto i = fast_floor(x + s);
+    const auto j = fast_floor(y + s);
+
+    const auto t = static_cast<float>(i + j) * G2;
+    const auto x0 = x - (static_cast<float>(i) - t);
+    const auto y0 = y - (static_cast<float>(j) - t);
+
+    const auto i1 = x0 > y0 ? 1 : 0;
+    const auto j1 = 1 - i1;
+
+    const auto x1 = x0 - static_cast<float>(i1) + G2;
+    const auto y1 = y0 - static_cast<float>(j1) + G2;
+    const auto x2 = x0 - 1.f + 2.f * G2;
+    const auto y2 = y0 - 1.f + 2.f * G2;
+
+    const auto gi0 = hash(i + hash(j));
+    const auto gi1 = hash(i + i1 + hash(j + j1));
+    const auto gi2 = hash(i + 1 + hash(j + 1));
+
+    return 45.23065f * (corner(x0, y0, gi0) + corner(x1, y1, gi1) + corner(x2, y2, gi2));
+}
+
+auto fractal(const NoiseParameters &parameters, const float x, const float y) -> float {
+    auto output = 0.f;
+    auto denom = 0.f;
+    auto frequency = parameters.frequency;
+    auto amplitude = parameters.amplitude;
+
+    for (auto octave = 0u; octave < parameters.octaves; octave++) {
+        output += amplitude * simplex(x * frequency, y * frequency);
+        denom += amplitude;
+
+        frequency *= parameters.lacunarity;
+        amplitude *= parameters.persistence;
+    }
+
+    return output / denom;
+}
+
+void fractal_grid(const NoiseParameters &parameters, const Vector2 origin, const float spacing,
+                  const std::size_t columns, const std::size_t rows, std::span<float> out) {
+    auto xs = std::vector<float>(columns);
+    for (auto column = std::size_t{0}; column < columns; column++) {
+        xs[column] = origin.x + static_cast<float>(column) * spacing;
+    }
+
+    auto denom = 0.f;
+    auto amplitude = parameters.amplitude;
+    for (auto octave = 0u; octave < parameters.octaves; octave++) {
+        denom += amplitude;
+        amplitude *= parameters.persistence;
+    }
+
+    for (auto row = std::size_t{0}; row < rows; row++) {
+        const auto y = origin.y + static_cast<float>(row) * spacing;
+        auto *samples = out.data() + row * columns;
+        for (auto column = std::size_t{0}; column < columns; column++) {
+            samples[column] = 0.f;
+        }
+
+        auto frequency = parameters.frequency;
+        amplitude = parameters.amplitude;
+        for (auto octave = 0u; octave < parameters.octaves; octave++) {
+            const auto fy = y * frequency;
+            for (auto column = std::size_t{0}; column < columns; column++) {
+                samples[column] += amplitude * simplex(xs[column] * frequency, fy);
+            }
+
+            frequency *= parameters.lacunarity;
+            amplitude *= parameters.persistence;
+        }
+
+        for (auto column = std::size_t{0}; column < columns; column++) {
+            samples[column] /= denom;
+        }
+    }
+}
+
+} // namespace stratgame
@@ -0,0 +1,26 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <raylib.h>
+#include <span>
+
+namespace stratgame {
+
+// Fractional Brownian motion over 2D simplex noise, same parameters as SimplexNoise::fractal
+struct NoiseParameters {
+    float frequency = 0.01f; // of the first octave, per world unit
+    float amplitude = 1.f;   // of the first octave, the sum is normalized so this only weighs the octaves
+    float lacunarity = 2.f;  // frequency multiplier between octaves
+    float persistence = 0.5f; // amplitude multiplier between octaves
+    std::uint32_t octaves = 6u;
+};
+
+// Returns the same values as SimplexNoise::fractal(octaves, x, y), in [-1, 1]
+[[nodiscard]] auto fractal(const NoiseParameters &parameters, float x, float y) -> float;
+
+// Fills a row major grid of rows x columns samples taken at origin + (column, row) * spacing.
+// Rows are evaluated one octave at a time with branchless per-sample code so the inner loop vectorizes.
+void fractal_grid(const NoiseParameters &parameters, Vector2 origin, float spacing, std::size_t columns,
+                  std::size_t rows, std::span<float> out);
+
+} // namespace stratgame
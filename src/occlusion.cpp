@@ -0,0 +1,353 @@
+#include "occlusion.hpp"
+#include "height_field.hpp"
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <limits>
+
+namespace stratgame {
+
+OcclusionBuffer::OcclusionBuffer(const std::uint32_t width, const std::uint32_t height) : width(width), height(height) {
+    auto level_width = width;
+    auto level_height = height;
+    levels.emplace_back(static_cast<std::size_t>(level_width) * level_height, 0.f);
+    while (level_width > 1u || level_height > 1u) {
+        level_width = (level_width + 1u) / 2u;
+        level_height = (level_height + 1u) / 2u;
+        levels.emplace_back(static_cast<std::size_t>(level_width) * level_height, 0.f);
+    }
+}
+
+auto OcclusionBuffer::to_view(const Vector3 &point) const -> Vector3 {
+    const auto v = Vector3Subtract(point, frustum.position);
+    return Vector3{Vector3DotProduct(frustum.right, v), Vector3DotProduct(frustum.up, v),
+                   Vector3DotProduct(frustum.dir, v)};
+}
+
+auto OcclusionBuffer::to_screen(const Vector3 &view_point) const -> ScreenPoint {
+    const auto inverse_depth = 1.f / view_point.z;
+    return ScreenPoint{.x = 0.5f * static_cast<float>(width) + view_point.x * inverse_depth * pixels_x,
+                       .y = 0.5f * static_cast<float>(height) - view_point.y * inverse_depth * pixels_y,
+                       .inverse_depth = inverse_depth};
+}
+
+[[nodiscard]] static auto is_same_vector(const Vector3 &a, const Vector3 &b) -> bool {
+    return a.x == b.x && a.y == b.y && a.z == b.z;
+}
+
+auto OcclusionBuffer::is_drawn(const CullingFrustum &view, const std::uint64_t terrain_revision) const -> bool {
+    return revision == terrain_revision && is_same_vector(frustum.position, view.position) &&
+           is_same_vector(frustum.dir, view.dir) && is_same_vector(frustum.right, view.right) &&
+           is_same_vector(frustum.up, view.up) && frustum.tan_x == view.tan_x && frustum.tan_y == view.tan_y;
+}
+
+void OcclusionBuffer::begin(const CullingFrustum &view, const std::uint64_t terrain_revision) {
+    frustum = view;
+    revision = terrain_revision;
+    pixels_x = 0.5f * static_cast<float>(width) / view.tan_x;
+    pixels_y = 0.5f * static_cast<float>(height) / view.tan_y;
+    std::ranges::fill(levels.front(), 0.f);
+}
+
+// Corner i of a box has the max x when bit 0 is set, the max y for bit 1 and the max z for bit 2
+void OcclusionBuffer::add_box(const Vector3 &min, const Vector3 &max, const std::uint8_t faces) {
+    auto corners = std::array<ScreenPoint, 8>{};
+    for (auto i = 0u; i < 8u; i++) {
+        const auto corner = Vector3{(i & 1u) != 0u ? max.x : min.x, (i & 2u) != 0u ? max.y : min.y,
+                                    (i & 4u) != 0u ? max.z : min.z};
+        const auto view_point = to_view(corner);
+        if (view_point.z < near_distance) {
+            return;
+        }
+        corners[i] = to_screen(view_point);
+    }
+
+    // NOTE: Faces seen from behind are covered by the ones in front, the camera can only see a face from outside the
+    // slab of the box along its axis
+    const auto &camera = frustum.position;
+    if (camera.x < min.x && (faces & face_min_x) != 0u) {
+        draw_quad(corners, 0u, 2u, 6u, 4u);
+    } else if (camera.x > max.x && (faces & face_max_x) != 0u) {
+        draw_quad(corners, 1u, 3u, 7u, 5u);
+    }
+    if (camera.y < min.y && (faces & face_min_y) != 0u) {
+        draw_quad(corners, 0u, 1u, 5u, 4u);
+    } else if (camera.y > max.y && (faces & face_max_y) != 0u) {
+        draw_quad(corners, 2u, 3u, 7u, 6u);
+    }
+    if (camera.z < min.z && (faces & face_min_z) != 0u) {
+        draw_quad(corners, 0u, 1u, 3u, 2u);
+    } else if (camera.z > max.z && (faces & face_max_z) != 0u) {
+        draw_quad(corners, 4u, 5u, 7u, 6u);
+    }
+}
+
+void OcclusionBuffer::draw_quad(const std::array<ScreenPoint, 8> &corners, const std::uint32_t a, const std::uint32_t b,
+                                const std::uint32_t c, const std::uint32_t d) {
+    draw_triangle(corners[a], corners[b], corners[c]);
+    draw_triangle(corners[a], corners[c], corners[d]);
+}
+
+// Pixels whose center is inside the triangle keep the closer of their depth and the triangle's. The edge functions
+// give the weights of the corners, the inverse depth is interpolated with them and is linear along a row.
+void OcclusionBuffer::draw_triangle(const ScreenPoint &a, const ScreenPoint &b_in, const ScreenPoint &c_in) {
+    const auto edge = [](const ScreenPoint &from, const ScreenPoint &to, const float x, const float y) {
+        return (to.x - from.x) * (y - from.y) - (to.y - from.y) * (x - from.x);
+    };
+
+    auto area = edge(a, b_in, c_in.x, c_in.y);
+    if (area == 0.f) {
+        return;
+    }
+    // NOTE: Either winding is drawn, flipping two corners makes every edge function positive inside
+    const auto &b = area > 0.f ? b_in : c_in;
+    const auto &c = area > 0.f ? c_in : b_in;
+    area = std::abs(area);
+
+    const auto min_x = std::max(0.f, std::floor(std::min({a.x, b.x, c.x})));
+    const auto min_y = std::max(0.f, std::floor(std::min({a.y, b.y, c.y})));
+    const auto max_x = std::min(static_cast<float>(width) - 1.f, std::ceil(std::max({a.x, b.x, c.x})));
+    const auto max_y = std::min(static_cast<float>(height) - 1.f, std::ceil(std::max({a.y, b.y, c.y})));
+    if (min_x > max_x || min_y > max_y) {
+        return;
+    }
+
+    const auto start_x = min_x + 0.5f;
+    const auto start_y = min_y + 0.5f;
+    // NOTE: Weight of each corner is the edge function of the opposite edge
+    auto row_a = edge(b, c, start_x, start_y);
+    auto row_b = edge(c, a, start_x, start_y);
+    auto row_c = edge(a, b, start_x, start_y);
+    const auto step_x_a = -(c.y - b.y);
+    const auto step_x_b = -(a.y - c.y);
+    const auto step_x_c = -(b.y - a.y);
+    const auto step_y_a = c.x - b.x;
+    const auto step_y_b = a.x - c.x;
+    const auto step_y_c = b.x - a.x;
+    const auto depth_a = a.inverse_depth / area;
+    const auto depth_b = b.inverse_depth / area;
+    const auto depth_c = c.inverse_depth / area;
+
+    // NOTE: Each row only visits the span where every weight is positive, solved from the weight of its first pixel
+    const auto narrow = [](const float weight, const float step, const float inverse_step, float &begin, float &end) {
+        if (step > 0.f) {
+            begin = std::max(begin, std::ceil(-weight * inverse_step));
+        } else if (step < 0.f) {
+            end = std::min(end, std::floor(-weight * inverse_step));
+        } else if (weight < 0.f) {
+            end = -1.f;
+        }
+    };
+    const auto inverse = [](const float step) { return step != 0.f ? 1.f / step : 0.f; };
+    const auto inverse_step_a = inverse(step_x_a);
+    const auto inverse_step_b = inverse(step_x_b);
+    const auto inverse_step_c = inverse(step_x_c);
+
+    auto &depths = levels.front();
+    const auto columns = max_x - min_x;
+    for (auto y = static_cast<std::uint32_t>(min_y); y <= static_cast<std::uint32_t>(max_y); y++) {
+        auto begin = 0.f;
+        auto end = columns;
+        narrow(row_a, step_x_a, inverse_step_a, begin, end);
+        narrow(row_b, step_x_b, inverse_step_b, begin, end);
+        narrow(row_c, step_x_c, inverse_step_c, begin, end);
+
+        if (begin <= end) {
+            auto *row = depths.data() + static_cast<std::size_t>(y) * width + static_cast<std::size_t>(min_x);
+            const auto row_depth = row_a * depth_a + row_b * depth_b + row_c * depth_c;
+            const auto step_depth = step_x_a * depth_a + step_x_b * depth_b + step_x_c * depth_c;
+            const auto last = static_cast<std::uint32_t>(end) + 1u;
+            for (auto x = static_cast<std::uint32_t>(begin); x < last; x++) {
+                row[x] = std::max(row[x], row_depth + static_cast<float>(x) * step_depth);
+            }
+        }
+        row_a += step_y_a;
+        row_b += step_y_b;
+        row_c += step_y_c;
+    }
+}
+
+void OcclusionBuffer::end() {
+    auto level_width = width;
+    auto level_height = height;
+    for (auto level = 1u; level < levels.size(); level++) {
+        const auto &source = levels[level - 1u];
+        auto &target = levels[level];
+        const auto source_width = level_width;
+        const auto source_height = level_height;
+        level_width = (level_width + 1u) / 2u;
+        level_height = (level_height + 1u) / 2u;
+
+        for (auto y = 0u; y < level_height; y++) {
+            const auto y0 = 2u * y;
+            const auto y1 = std::min(y0 + 1u, source_height - 1u);
+            for (auto x = 0u; x < level_width; x++) {
+                const auto x0 = 2u * x;
+                const auto x1 = std::min(x0 + 1u, source_width - 1u);
+                target[y * level_width + x] =
+                    std::min({source[y0 * source_width + x0], source[y0 * source_width + x1],
+                              source[y1 * source_width + x0], source[y1 * source_width + x1]});
+            }
+        }
+    }
+}
+
+// The pixel rectangle is tested at a level where it spans at most 2x2 texels
+auto OcclusionBuffer::is_rect_occluded(const float min_x, const float min_y, const float max_x, const float max_y,
+                                       const float inverse_depth) const -> bool {
+    if (max_x < 0.f || max_y < 0.f || min_x >= static_cast<float>(width) || min_y >= static_cast<float>(height)) {
+        return false; // off screen, the frustum test decides
+    }
+    const auto x0 = static_cast<std::uint32_t>(std::max(0.f, min_x));
+    const auto y0 = static_cast<std::uint32_t>(std::max(0.f, min_y));
+    const auto x1 = static_cast<std::uint32_t>(std::min(max_x, static_cast<float>(width) - 1.f));
+    const auto y1 = static_cast<std::uint32_t>(std::min(max_y, static_cast<float>(height) - 1.f));
+
+    // NOTE: A range narrower than a texel of the level overlaps at most two of them
+    const auto level = std::min(static_cast<std::uint32_t>(std::bit_width(std::max(x1 - x0, y1 - y0))),
+                                static_cast<std::uint32_t>(levels.size() - 1u));
+
+    // NOTE: Always the same 4 reads, the first ones again when the rectangle only spans one texel
+    const auto level_width = ((width - 1u) >> level) + 1u;
+    const auto &depths = levels[level];
+    const auto *row_0 = depths.data() + (y0 >> level) * level_width;
+    const auto *row_1 = depths.data() + (y1 >> level) * level_width;
+    const auto farthest = std::min(std::min(row_0[x0 >> level], row_0[x1 >> level]),
+                                   std::min(row_1[x0 >> level], row_1[x1 >> level]));
+    return farthest > inverse_depth;
+}
+
+auto OcclusionBuffer::is_box_occluded(const Vector3 &min, const Vector3 &max) const -> bool {
+    auto min_x = std::numeric_limits<float>::infinity();
+    auto min_y = std::numeric_limits<float>::infinity();
+    auto max_x = -std::numeric_limits<float>::infinity();
+    auto max_y = -std::numeric_limits<float>::infinity();
+    auto closest = 0.f;
+
+    for (auto i = 0u; i < 8u; i++) {
+        const auto corner = Vector3{(i & 1u) != 0u ? max.x : min.x, (i & 2u) != 0u ? max.y : min.y,
+                                    (i & 4u) != 0u ? max.z : min.z};
+        const auto view_point = to_view(corner);
+        if (view_point.z < near_distance) {
+            return false;
+        }
+        const auto point = to_screen(view_point);
+        min_x = std::min(min_x, point.x);
+        min_y = std::min(min_y, point.y);
+        max_x = std::max(max_x, point.x);
+        max_y = std::max(max_y, point.y);
+        closest = std::max(closest, point.inverse_depth);
+    }
+    return is_rect_occluded(min_x, min_y, max_x, max_y, closest);
+}
+
+// Spheres are tested as the view space box around them. Each side of the box is furthest out on screen at the near face
+// when it is off center that way and at the far face otherwise.
+void OcclusionBuffer::test_spheres(const float *x, const float *y, const float *z, const float *radius,
+                                   const std::size_t count, std::uint8_t *visible) {
+    rects.resize(count);
+    const auto center_x = 0.5f * static_cast<float>(width);
+    const auto center_y = 0.5f * static_cast<float>(height);
+    for (auto i = std::size_t{0}; i < count; i++) {
+        const auto vx = x[i] - frustum.position.x;
+        const auto vy = y[i] - frustum.position.y;
+        const auto vz = z[i] - frustum.position.z;
+        const auto view_x = frustum.right.x * vx + frustum.right.y * vy + frustum.right.z * vz;
+        const auto view_y = frustum.up.x * vx + frustum.up.y * vy + frustum.up.z * vz;
+        const auto view_z = frustum.dir.x * vx + frustum.dir.y * vy + frustum.dir.z * vz;
+
+        // NOTE: Clamped so spheres reaching past the near distance still project, an infinite depth lets them through
+        const auto inverse_near = 1.f / std::max(view_z - radius[i], near_distance);
+        const auto inverse_far = 1.f / std::max(view_z + radius[i], near_distance);
+        const auto left = view_x - radius[i];
+        const auto right = view_x + radius[i];
+        const auto bottom = view_y - radius[i];
+        const auto top = view_y + radius[i];
+
+        // NOTE: Screen y grows downwards, the top of the box ends up in the smaller y
+        auto &rect = rects[i];
+        rect.min_x = center_x + std::min(left * inverse_near, left * inverse_far) * pixels_x;
+        rect.max_x = center_x + std::max(right * inverse_near, right * inverse_far) * pixels_x;
+        rect.min_y = center_y - std::max(top * inverse_near, top * inverse_far) * pixels_y;
+        rect.max_y = center_y - std::min(bottom * inverse_near, bottom * inverse_far) * pixels_y;
+        rect.inverse_depth = view_z - radius[i] < near_distance ? std::numeric_limits<float>::infinity() : inverse_near;
+    }
+
+    for (auto i = std::size_t{0}; i < count; i++) {
+        const auto &rect = rects[i];
+        if (visible[i] != 0u && is_rect_occluded(rect.min_x, rect.min_y, rect.max_x, rect.max_y, rect.inverse_depth)) {
+            visible[i] = 0u;
+        }
+    }
+}
+
+void add_chunk_occluders(OcclusionBuffer &buffer, const TerrainHeightField &height_field, const ChunkHeights &chunk,
+                         const Vector2 chunk_origin) {
+    const auto blocks = height_field.get_occluder_blocks();
+    if (chunk.block_min_heights.size() != static_cast<std::size_t>(blocks) * blocks) {
+        return;
+    }
+
+    // NOTE: Far away chunks merge blocks into boxes with the lowest height among them, projecting the corners of a box
+    // costs more than drawing it once it covers a few pixels
+    const auto chunk_size = height_field.get_chunk_size();
+    const auto camera = buffer.get_camera_position();
+    const auto chunk_min = Vector3{chunk_origin.x, chunk.min_height, chunk_origin.y};
+    const auto chunk_max = Vector3{chunk_origin.x + chunk_size, chunk.max_height, chunk_origin.y + chunk_size};
+    const auto distance = Vector3Distance(Vector3Clamp(camera, chunk_min, chunk_max), camera);
+    const auto block_pixels = chunk_size / static_cast<float>(blocks) * buffer.get_pixels_per_unit(distance);
+    auto stride = 1u;
+    while (stride < blocks && static_cast<float>(stride) * block_pixels < OcclusionBuffer::min_box_pixels) {
+        stride *= 2u;
+    }
+
+    // NOTE: Every box of a chunk stands on the same floor, so a wall is buried in the box next to it when that one
+    // is at least as high
+    const auto cells = (blocks + stride - 1u) / stride;
+    constexpr auto max_blocks = TerrainHeightField::max_occluder_blocks;
+    auto heights = std::array<float, max_blocks * max_blocks>{};
+    for (auto cell_z = 0u; cell_z < cells; cell_z++) {
+        for (auto cell_x = 0u; cell_x < cells; cell_x++) {
+            auto &height = heights[cell_z * cells + cell_x];
+            height = std::numeric_limits<float>::infinity();
+            for (auto z = cell_z * stride; z < std::min((cell_z + 1u) * stride, blocks); z++) {
+                for (auto x = cell_x * stride; x < std::min((cell_x + 1u) * stride, blocks); x++) {
+                    height = std::min(height, chunk.block_min_heights[z * blocks + x]);
+                }
+            }
+        }
+    }
+
+    const auto spacing = height_field.get_sample_spacing();
+    const auto to_world = [&](const std::uint32_t cell) {
+        return static_cast<float>(height_field.get_block_start(std::min(cell * stride, blocks))) * spacing;
+    };
+    const auto is_buried = [&](const std::uint32_t cell_x, const std::uint32_t cell_z, const std::int32_t dx,
+                               const std::int32_t dz) {
+        const auto x = static_cast<std::int32_t>(cell_x) + dx;
+        const auto z = static_cast<std::int32_t>(cell_z) + dz;
+        const auto size = static_cast<std::int32_t>(cells);
+        return x >= 0 && z >= 0 && x < size && z < size &&
+               heights[static_cast<std::uint32_t>(z) * cells + static_cast<std::uint32_t>(x)] >=
+                   heights[cell_z * cells + cell_x];
+    };
+
+    for (auto cell_z = 0u; cell_z < cells; cell_z++) {
+        for (auto cell_x = 0u; cell_x < cells; cell_x++) {
+            const auto faces = static_cast<std::uint8_t>(
+                OcclusionBuffer::face_min_y | OcclusionBuffer::face_max_y |
+                (is_buried(cell_x, cell_z, -1, 0) ? 0u : OcclusionBuffer::face_min_x) |
+                (is_buried(cell_x, cell_z, 1, 0) ? 0u : OcclusionBuffer::face_max_x) |
+                (is_buried(cell_x, cell_z, 0, -1) ? 0u : OcclusionBuffer::face_min_z) |
+                (is_buried(cell_x, cell_z, 0, 1) ? 0u : OcclusionBuffer::face_max_z));
+            const auto min_x = chunk_origin.x + to_world(cell_x);
+            const auto min_z = chunk_origin.y + to_world(cell_z);
+            const auto min = Vector3{min_x, chunk.min_height, min_z};
+            const auto max = Vector3{chunk_origin.x + to_world(cell_x + 1u), heights[cell_z * cells + cell_x],
+                                     chunk_origin.y + to_world(cell_z + 1u)};
+            buffer.add_box(min, max, faces);
+        }
+    }
+}
+
+} // namespace stratgame
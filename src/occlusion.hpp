@@ -0,0 +1,102 @@
+#pragma once
+#include "culling.hpp"
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <raylib.h>
+#include <vector>
+
+namespace stratgame {
+struct ChunkHeights;
+struct TerrainHeightField;
+
+// Depth buffer the terrain is rasterized into on the CPU, with a pyramid of the farthest depth of every 2x2 texels on
+// top so a bounding box is tested against at most 4 texels. Lives in registry.ctx(), flag_culled_models fills it from
+// the first Camera before testing anything the frustum test kept.
+// Depths are stored as 1 / distance along the view direction, which is linear across the screen, so 0 is empty and a
+// larger value is closer.
+class OcclusionBuffer {
+  public:
+    constexpr static std::uint32_t default_width = 256u;
+    constexpr static std::uint32_t default_height = 128u;
+    constexpr static float near_distance = 0.5f; // anything reaching closer than this is never occluder nor occluded
+    constexpr static float min_box_pixels = 8.f;  // add_chunk_occluders merges blocks smaller than this on screen
+
+    explicit OcclusionBuffer(std::uint32_t width = default_width, std::uint32_t height = default_height);
+
+    // True when the buffer was last drawn from view with the terrain at revision, it can be tested as it is then
+    [[nodiscard]] auto is_drawn(const CullingFrustum &view, std::uint64_t terrain_revision) const -> bool;
+    // Clears the buffer for a new view of the terrain at terrain_revision
+    void begin(const CullingFrustum &view, std::uint64_t terrain_revision);
+    // Bits of the faces add_box draws, a face can be left out when another occluder covers it
+    constexpr static std::uint8_t face_min_x = 1u << 0u;
+    constexpr static std::uint8_t face_max_x = 1u << 1u;
+    constexpr static std::uint8_t face_min_y = 1u << 2u;
+    constexpr static std::uint8_t face_max_y = 1u << 3u;
+    constexpr static std::uint8_t face_min_z = 1u << 4u;
+    constexpr static std::uint8_t face_max_z = 1u << 5u;
+    constexpr static std::uint8_t all_faces = 0b111111u;
+
+    // Solid box, only the faces towards the camera are drawn. Skipped when it reaches closer than near_distance.
+    void add_box(const Vector3 &min, const Vector3 &max, std::uint8_t faces = all_faces);
+    // Builds the pyramid, call once after the last occluder and before the first test
+    void end();
+
+    // True when an occluder is in front of the closest point of the box everywhere on screen the box covers
+    [[nodiscard]] auto is_box_occluded(const Vector3 &min, const Vector3 &max) const -> bool;
+    // Clears visible for the spheres that are occluded, like is_box_occluded on the box around each sphere. Every
+    // sphere is projected first in a loop that vectorizes, only the texel lookups run one sphere at a time.
+    void test_spheres(const float *x, const float *y, const float *z, const float *radius, std::size_t count,
+                      std::uint8_t *visible);
+
+    [[nodiscard]] auto get_camera_position() const -> Vector3 { return frustum.position; }
+    // Width in pixels of a world unit at distance from the camera
+    [[nodiscard]] auto get_pixels_per_unit(const float distance) const -> float {
+        return static_cast<float>(width) / (2.f * frustum.tan_x * std::max(distance, near_distance));
+    }
+
+    bool enabled = true;
+
+  private:
+    // Position in pixels and inverse depth of a projected point
+    struct ScreenPoint {
+        float x;
+        float y;
+        float inverse_depth;
+    };
+
+    // Screen bounds in pixels and inverse depth of the closest point of something tested
+    struct ScreenRect {
+        float min_x;
+        float min_y;
+        float max_x;
+        float max_y;
+        float inverse_depth;
+    };
+
+    std::uint32_t width;
+    std::uint32_t height;
+    CullingFrustum frustum{};
+    float pixels_x = 0.f; // pixels from the center of the screen per unit of view x over view depth
+    float pixels_y = 0.f;
+    std::optional<std::uint64_t> revision; // of the terrain drawn, none before the first begin
+    std::vector<std::vector<float>> levels; // levels[0] is width x height, every next one halves both sides
+    std::vector<ScreenRect> rects;          // scratch for test_spheres
+
+    [[nodiscard]] auto to_view(const Vector3 &point) const -> Vector3;
+    [[nodiscard]] auto to_screen(const Vector3 &view_point) const -> ScreenPoint;
+    void draw_quad(const std::array<ScreenPoint, 8> &corners, std::uint32_t a, std::uint32_t b, std::uint32_t c,
+                   std::uint32_t d);
+    void draw_triangle(const ScreenPoint &a, const ScreenPoint &b, const ScreenPoint &c);
+    [[nodiscard]] auto is_rect_occluded(float min_x, float min_y, float max_x, float max_y, float inverse_depth) const
+        -> bool;
+};
+
+// Draws the terrain under chunk as one box per ChunkHeights::block_min_heights entry, from the lowest sample of the
+// chunk up to the lowest sample of the block. The boxes are solid ground at every level of detail, so nothing they
+// hide can be seen, and they stay inside the chunk's own bounds so a chunk never hides itself.
+void add_chunk_occluders(OcclusionBuffer &buffer, const TerrainHeightField &height_field, const ChunkHeights &chunk,
+                         Vector2 chunk_origin);
+
+} // namespace stratgame
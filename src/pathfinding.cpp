@@ -0,0 +1,807 @@
+#include "pathfinding.hpp"
+#include "flow_field.hpp"
+#include "height_field.hpp"
+#include "terrain.hpp"
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <numbers>
+#include <raymath.h>
+#include <unordered_set>
+
+namespace stratgame {
+
+constexpr static auto infinity = std::numeric_limits<float>::infinity();
+
+// Border order used by Cluster::portals
+constexpr static auto side_dx = std::array<std::int64_t, 4>{1, -1, 0, 0};
+constexpr static auto side_dz = std::array<std::int64_t, 4>{0, 0, 1, -1};
+constexpr static auto opposite_side = std::array<std::uint32_t, 4>{1u, 0u, 3u, 2u};
+
+// Open runs along a border longer than this get a portal at each end instead of one in the middle
+constexpr static auto long_run = 6u;
+
+[[nodiscard]] static auto floor_div(const std::int64_t a, const std::int64_t b) -> std::int64_t {
+    const auto quotient = a / b;
+    return (a % b != 0 && a < 0) ? quotient - 1 : quotient;
+}
+
+[[nodiscard]] static auto octile(const std::int64_t dx, const std::int64_t dz) -> float {
+    const auto a = static_cast<float>(std::abs(dx));
+    const auto b = static_cast<float>(std::abs(dz));
+    return std::max(a, b) + (std::numbers::sqrt2_v<float> - 1.f) * std::min(a, b);
+}
+
+// Calls func(neighbour, distance) for the passable 8-neighbours of a cell inside a cluster, without cutting corners
+template <typename Func>
+static void for_each_cluster_neighbour(const std::vector<float> &costs, const std::uint32_t side_cells,
+                                       const std::uint32_t cell, Func &&func) {
+    const auto n = static_cast<std::int64_t>(side_cells);
+    const auto column = static_cast<std::int64_t>(cell % side_cells);
+    const auto row = static_cast<std::int64_t>(cell / side_cells);
+    const auto passable = [&](const std::int64_t c, const std::int64_t r) {
+        return c >= 0 && r >= 0 && c < n && r < n && costs[static_cast<std::size_t>(r * n + c)] != infinity;
+    };
+
+    for (auto dz = -1; dz <= 1; dz++) {
+        for (auto dx = -1; dx <= 1; dx++) {
+            if ((dx == 0 && dz == 0) || !passable(column + dx, row + dz)) {
+                continue;
+            }
+            if (dx != 0 && dz != 0 && !(passable(column + dx, row) && passable(column, row + dz))) {
+                continue;
+            }
+            const auto distance = dx != 0 && dz != 0 ? std::numbers::sqrt2_v<float> : 1.f;
+            func(static_cast<std::uint32_t>((row + dz) * n + column + dx), distance);
+        }
+    }
+}
+
+HierarchicalPathfinder::HierarchicalPathfinder(const PathfinderSettings settings) : settings(settings) {
+    const auto cells = static_cast<std::size_t>(settings.cluster_cells) * settings.cluster_cells;
+    local_costs.resize(cells);
+    local_parents.resize(cells);
+    local_closed.resize(cells);
+}
+
+auto HierarchicalPathfinder::make_key(const std::int64_t x, const std::int64_t z) -> cluster_key {
+    return (static_cast<std::uint64_t>(static_cast<std::uint32_t>(x)) << 32u) | static_cast<std::uint32_t>(z);
+}
+
+auto HierarchicalPathfinder::cluster_of(const Cell &cell) const -> cluster_key {
+    const auto n = static_cast<std::int64_t>(settings.cluster_cells);
+    return make_key(floor_div(cell.x, n), floor_div(cell.z, n));
+}
+
+auto HierarchicalPathfinder::to_cell(const Vector2 position) const -> Cell {
+    return Cell{.x = static_cast<std::int64_t>(std::floor(position.x / settings.cell_size)),
+                .z = static_cast<std::int64_t>(std::floor(position.y / settings.cell_size))};
+}
+
+auto HierarchicalPathfinder::to_world(const Cell &cell) const -> Vector2 {
+    return Vector2{(static_cast<float>(cell.x) + 0.5f) * settings.cell_size,
+                   (static_cast<float>(cell.z) + 0.5f) * settings.cell_size};
+}
+
+auto HierarchicalPathfinder::local_index(const Cluster &cluster, const Cell &cell) const -> std::uint32_t {
+    const auto n = static_cast<std::int64_t>(settings.cluster_cells);
+    return static_cast<std::uint32_t>((cell.z - cluster.z * n) * n + (cell.x - cluster.x * n));
+}
+
+auto HierarchicalPathfinder::global_cell(const Cluster &cluster, const std::uint32_t local) const -> Cell {
+    const auto n = settings.cluster_cells;
+    return Cell{.x = cluster.x * n + local % n, .z = cluster.z * n + local / n};
+}
+
+auto HierarchicalPathfinder::portal_cell(const Cluster &cluster, const std::uint32_t node) const -> std::uint32_t {
+    const auto n = settings.cluster_cells;
+    auto side = 0u;
+    while (node >= cluster.portal_offsets[side + 1u]) {
+        side++;
+    }
+
+    const auto position = cluster.portals[side][node - cluster.portal_offsets[side]];
+    switch (side) {
+    case 0u:
+        return position * n + (n - 1u);
+    case 1u:
+        return position * n;
+    case 2u:
+        return (n - 1u) * n + position;
+    default:
+        return position;
+    }
+}
+
+auto HierarchicalPathfinder::cell_cost(const Cell &cell) -> float {
+    const auto n = static_cast<std::int64_t>(settings.cluster_cells);
+    const auto &cluster = ensure_costs(floor_div(cell.x, n), floor_div(cell.z, n));
+    return cluster.costs[local_index(cluster, cell)];
+}
+
+// Whether any loaded terrain chunk touches the square, including its far edges which are sampled as corners
+[[nodiscard]] static auto overlaps_terrain(const TerrainHeightField &height_field, const Vector2 origin,
+                                           const float size) -> bool {
+    const auto chunk_size = height_field.get_chunk_size();
+    const auto first_x = static_cast<std::int64_t>(std::floor(origin.x / chunk_size));
+    const auto first_z = static_cast<std::int64_t>(std::floor(origin.y / chunk_size));
+    const auto last_x = static_cast<std::int64_t>(std::floor((origin.x + size) / chunk_size));
+    const auto last_z = static_cast<std::int64_t>(std::floor((origin.y + size) / chunk_size));
+    for (auto z = first_z; z <= last_z; z++) {
+        for (auto x = first_x; x <= last_x; x++) {
+            if (height_field.find_chunk(x, z) != nullptr) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+auto HierarchicalPathfinder::ensure_costs(const std::int64_t x, const std::int64_t z) -> Cluster & {
+    const auto [it, inserted] = clusters.try_emplace(make_key(x, z));
+    auto &cluster = it->second;
+    if (!inserted) {
+        return cluster;
+    }
+
+    const auto n = settings.cluster_cells;
+    const auto size = static_cast<float>(n) * settings.cell_size;
+    const auto origin = Vector2{static_cast<float>(x) * size, static_cast<float>(z) * size};
+
+    cluster.x = x;
+    cluster.z = z;
+    // NOTE: Clusters away from loaded terrain are flat, there is nothing to sample for them
+    if (height_field != nullptr && overlaps_terrain(*height_field, origin, size)) {
+        cluster.costs = compute_navigation_costs(height_field, settings.cell_size, settings.max_slope,
+                                                 settings.slope_cost, origin, n, n);
+    } else {
+        cluster.costs.assign(static_cast<std::size_t>(n) * n, 1.f);
+    }
+    cluster.uniform = std::ranges::all_of(cluster.costs, [](const float cost) { return cost == 1.f; });
+    rebuilt++;
+    return cluster;
+}
+
+// Portal positions along the border between two clusters, low is the one with the smaller coordinate on the axis
+[[nodiscard]] static auto find_portals(const std::vector<float> &low, const std::vector<float> &high,
+                                       const std::uint32_t n, const bool along_x) -> std::vector<std::uint32_t> {
+    auto portals = std::vector<std::uint32_t>{};
+    auto run_start = 0u;
+    for (auto i = 0u; i <= n; i++) {
+        auto open = false;
+        if (i < n) {
+            const auto low_cell = along_x ? i * n + (n - 1u) : (n - 1u) * n + i;
+            const auto high_cell = along_x ? i * n : i;
+            open = low[low_cell] != infinity && high[high_cell] != infinity;
+        }
+
+        if (open) {
+            continue;
+        }
+        if (i > run_start) {
+            const auto length = i - run_start;
+            if (length < long_run) {
+                portals.push_back(run_start + length / 2u);
+            } else {
+                portals.push_back(run_start);
+                portals.push_back(i - 1u);
+            }
+        }
+        run_start = i + 1u;
+    }
+    return portals;
+}
+
+auto HierarchicalPathfinder::ensure_portals(const std::int64_t x, const std::int64_t z) -> Cluster & {
+    auto &cluster = ensure_costs(x, z);
+    if (cluster.has_portals) {
+        return cluster;
+    }
+
+    const auto n = settings.cluster_cells;
+    for (auto side = 0u; side < 4u; side++) {
+        // NOTE: Both clusters compute the shared border from the same two cost arrays, so their lists match
+        const auto &neighbour = ensure_costs(x + side_dx[side], z + side_dz[side]);
+        const auto is_low = side == 0u || side == 2u;
+        const auto &low = is_low ? cluster.costs : neighbour.costs;
+        const auto &high = is_low ? neighbour.costs : cluster.costs;
+        cluster.portals[side] = find_portals(low, high, n, side < 2u);
+        cluster.portal_offsets[side + 1u] =
+            cluster.portal_offsets[side] + static_cast<std::uint32_t>(cluster.portals[side].size());
+    }
+
+    cluster.has_portals = true;
+    return cluster;
+}
+
+auto HierarchicalPathfinder::ensure_edges(const std::int64_t x, const std::int64_t z) -> Cluster & {
+    auto &cluster = ensure_portals(x, z);
+    if (cluster.has_edges) {
+        return cluster;
+    }
+
+    const auto cells = static_cast<std::size_t>(settings.cluster_cells) * settings.cluster_cells;
+    const auto count = cluster.portal_offsets[4];
+    cluster.distances.assign(static_cast<std::size_t>(count) * count, infinity);
+
+    // NOTE: The fields are kept so legs and refinement can walk down them instead of searching again
+    cluster.fields.clear();
+    if (!cluster.uniform) {
+        cluster.fields.resize(count * cells);
+        for (auto node = 0u; node < count; node++) {
+            search_cluster(cluster, portal_cell(cluster, node), std::span{cluster.fields}.subspan(node * cells, cells));
+        }
+    }
+
+    for (auto from = 0u; from < count; from++) {
+        for (auto to = 0u; to < count; to++) {
+            cluster.distances[from * count + to] = portal_cost(cluster, to, portal_cell(cluster, from));
+        }
+    }
+
+    cluster.has_edges = true;
+    return cluster;
+}
+
+auto HierarchicalPathfinder::find_portal(const Cluster &cluster, const Cell &cell) const
+    -> std::optional<std::uint32_t> {
+    const auto local = local_index(cluster, cell);
+    for (auto node = 0u; node < cluster.portal_offsets[4]; node++) {
+        if (portal_cell(cluster, node) == local) {
+            return node;
+        }
+    }
+    return std::nullopt;
+}
+
+auto HierarchicalPathfinder::portal_cost(const Cluster &cluster, const std::uint32_t node,
+                                         const std::uint32_t local) const -> float {
+    const auto n = settings.cluster_cells;
+    if (!cluster.uniform) {
+        return cluster.fields[static_cast<std::size_t>(node) * n * n + local];
+    }
+
+    const auto portal = portal_cell(cluster, node);
+    return octile(static_cast<std::int64_t>(portal % n) - local % n, static_cast<std::int64_t>(portal / n) - local / n);
+}
+
+void HierarchicalPathfinder::search_cluster(const Cluster &cluster, const std::uint32_t source,
+                                            const std::span<float> out) {
+    using QueueEntry = std::pair<float, std::uint32_t>;
+    auto open = std::priority_queue<QueueEntry, std::vector<QueueEntry>, std::greater<>>{};
+
+    std::ranges::fill(out, infinity);
+    out[source] = 0.f;
+    open.emplace(0.f, source);
+    while (!open.empty()) {
+        const auto [cost, cell] = open.top();
+        open.pop();
+        if (cost > out[cell]) {
+            continue;
+        }
+
+        for_each_cluster_neighbour(cluster.costs, settings.cluster_cells, cell,
+                                   [&](const std::uint32_t neighbour, const float distance) {
+                                       const auto next =
+                                           cost + distance * 0.5f * (cluster.costs[cell] + cluster.costs[neighbour]);
+                                       if (next < out[neighbour]) {
+                                           out[neighbour] = next;
+                                           open.emplace(next, neighbour);
+                                       }
+                                   });
+    }
+}
+
+auto HierarchicalPathfinder::path_in_cluster(const Cluster &cluster, const std::uint32_t from, const std::uint32_t to)
+    -> std::vector<Cell> {
+    // NOTE: Every cell of a uniform cluster is passable, the straight line between any two of them is clear
+    if (cluster.uniform || from == to) {
+        return from == to ? std::vector{global_cell(cluster, from)}
+                          : std::vector{global_cell(cluster, from), global_cell(cluster, to)};
+    }
+
+    const auto n = settings.cluster_cells;
+    const auto heuristic = [&](const std::uint32_t cell) {
+        return octile(static_cast<std::int64_t>(to % n) - cell % n, static_cast<std::int64_t>(to / n) - cell / n);
+    };
+
+    using QueueEntry = std::pair<float, std::uint32_t>;
+    auto open = std::priority_queue<QueueEntry, std::vector<QueueEntry>, std::greater<>>{};
+    std::ranges::fill(local_costs, infinity);
+    std::ranges::fill(local_closed, std::uint8_t{0});
+
+    local_costs[from] = 0.f;
+    open.emplace(heuristic(from), from);
+    while (!open.empty()) {
+        const auto cell = open.top().second;
+        open.pop();
+        if (local_closed[cell] != 0u) {
+            continue;
+        }
+        local_closed[cell] = 1u;
+        if (cell == to) {
+            break;
+        }
+
+        const auto cost = local_costs[cell];
+        for_each_cluster_neighbour(cluster.costs, n, cell, [&](const std::uint32_t neighbour, const float distance) {
+            const auto next = cost + distance * 0.5f * (cluster.costs[cell] + cluster.costs[neighbour]);
+            if (next < local_costs[neighbour]) {
+                local_costs[neighbour] = next;
+                local_parents[neighbour] = cell;
+                open.emplace(next + heuristic(neighbour), neighbour);
+            }
+        });
+    }
+
+    if (local_closed[to] == 0u) {
+        return {};
+    }
+
+    auto cells = std::vector<Cell>{};
+    for (auto cell = to; cell != from; cell = local_parents[cell]) {
+        cells.push_back(global_cell(cluster, cell));
+    }
+    cells.push_back(global_cell(cluster, from));
+    std::ranges::reverse(cells);
+    return cells;
+}
+
+auto HierarchicalPathfinder::path_to_portal(const Cluster &cluster, const std::uint32_t from,
+                                            const std::uint32_t node) const -> std::vector<Cell> {
+    const auto to = portal_cell(cluster, node);
+    if (cluster.uniform || from == to) {
+        return from == to ? std::vector{global_cell(cluster, from)}
+                          : std::vector{global_cell(cluster, from), global_cell(cluster, to)};
+    }
+
+    const auto n = settings.cluster_cells;
+    const auto field = std::span{cluster.fields}.subspan(static_cast<std::size_t>(node) * n * n, n * n);
+    if (field[from] == infinity) {
+        return {};
+    }
+
+    // NOTE: Costs only grow away from the portal, so stepping to the neighbour the cost came from always ends there
+    auto cells = std::vector<Cell>{global_cell(cluster, from)};
+    for (auto cell = from; cell != to;) {
+        auto best = cell;
+        auto best_cost = infinity;
+        for_each_cluster_neighbour(cluster.costs, n, cell, [&](const std::uint32_t neighbour, const float distance) {
+            const auto cost = field[neighbour] + distance * 0.5f * (cluster.costs[cell] + cluster.costs[neighbour]);
+            if (cost < best_cost) {
+                best = neighbour;
+                best_cost = cost;
+            }
+        });
+        if (best == cell || field[best] >= field[cell]) {
+            return {};
+        }
+        cell = best;
+        cells.push_back(global_cell(cluster, cell));
+    }
+    return cells;
+}
+
+auto HierarchicalPathfinder::abstract_path(const Cell &start, const Cell &goal) -> std::optional<std::vector<Node>> {
+    const auto n = static_cast<std::int64_t>(settings.cluster_cells);
+    const auto start_key = cluster_of(start);
+    const auto goal_key = cluster_of(goal);
+    auto &start_cluster = ensure_edges(floor_div(start.x, n), floor_div(start.z, n));
+    auto &goal_cluster = ensure_edges(floor_div(goal.x, n), floor_div(goal.z, n));
+
+    // Costs between the start (goal) cell and the portals of its cluster
+    const auto portal_costs = [&](const Cluster &cluster, const Cell &cell) {
+        auto costs = std::vector<float>(cluster.portal_offsets[4]);
+        for (auto node = 0u; node < costs.size(); node++) {
+            costs[node] = portal_cost(cluster, node, local_index(cluster, cell));
+        }
+        return costs;
+    };
+    const auto start_costs = portal_costs(start_cluster, start);
+    const auto goal_costs = portal_costs(goal_cluster, goal);
+
+    const auto heuristic = [&](const Cluster &cluster, const std::uint32_t node) {
+        const auto cell = global_cell(cluster, portal_cell(cluster, node));
+        return octile(goal.x - cell.x, goal.z - cell.z);
+    };
+
+    struct OpenEntry {
+        float estimate;
+        float cost;
+        Node node;
+
+        auto operator>(const OpenEntry &other) const -> bool { return estimate > other.estimate; }
+    };
+    auto open = std::priority_queue<OpenEntry, std::vector<OpenEntry>, std::greater<>>{};
+    constexpr auto no_parent = Node{.cluster = ~cluster_key{0}, .index = ~std::uint32_t{0}};
+
+    abstract_records.clear();
+    const auto relax = [&](const Cluster &cluster, const Node &node, const float cost, const Node &parent) {
+        const auto [it, inserted] =
+            abstract_records.try_emplace(node, NodeRecord{.cost = infinity, .parent = no_parent, .closed = false});
+        auto &record = it->second;
+        if (record.closed || cost >= record.cost) {
+            return;
+        }
+        record.cost = cost;
+        record.parent = parent;
+        open.push(OpenEntry{.estimate = cost + heuristic(cluster, node.index), .cost = cost, .node = node});
+    };
+
+    for (auto node = 0u; node < start_costs.size(); node++) {
+        if (start_costs[node] != infinity) {
+            relax(start_cluster, Node{.cluster = start_key, .index = node}, start_costs[node], no_parent);
+        }
+    }
+
+    auto best_goal = infinity;
+    auto goal_parent = no_parent;
+    auto expanded = 0u;
+    while (!open.empty()) {
+        const auto entry = open.top();
+        open.pop();
+        if (entry.estimate >= best_goal) {
+            break;
+        }
+
+        auto &record = abstract_records.at(entry.node);
+        if (record.closed || entry.cost > record.cost) {
+            continue;
+        }
+        record.closed = true;
+        if (++expanded > settings.max_expanded) {
+            return std::nullopt;
+        }
+
+        auto &cluster = clusters.at(entry.node.cluster);
+        const auto index = entry.node.index;
+        if (entry.node.cluster == goal_key && entry.cost + goal_costs[index] < best_goal) {
+            best_goal = entry.cost + goal_costs[index];
+            goal_parent = entry.node;
+        }
+
+        // Edges inside the cluster
+        const auto count = cluster.portal_offsets[4];
+        for (auto other = 0u; other < count; other++) {
+            const auto distance = cluster.distances[index * count + other];
+            if (other != index && distance != infinity) {
+                relax(cluster, Node{.cluster = entry.node.cluster, .index = other}, entry.cost + distance,
+                      entry.node);
+            }
+        }
+
+        // The edge across the border to the same portal on the neighbour's side
+        auto side = 0u;
+        while (index >= cluster.portal_offsets[side + 1u]) {
+            side++;
+        }
+        const auto opposite = opposite_side[side];
+        auto &neighbour = ensure_edges(cluster.x + side_dx[side], cluster.z + side_dz[side]);
+        const auto neighbour_index = neighbour.portal_offsets[opposite] + (index - cluster.portal_offsets[side]);
+        const auto crossing = 0.5f * (cluster.costs[portal_cell(cluster, index)] +
+                                      neighbour.costs[portal_cell(neighbour, neighbour_index)]);
+        relax(neighbour, Node{.cluster = make_key(neighbour.x, neighbour.z), .index = neighbour_index},
+              entry.cost + crossing, entry.node);
+    }
+
+    if (best_goal == infinity) {
+        return std::nullopt;
+    }
+
+    auto nodes = std::vector<Node>{};
+    for (auto node = goal_parent; node != no_parent; node = abstract_records.at(node).parent) {
+        nodes.push_back(node);
+    }
+    std::ranges::reverse(nodes);
+    return nodes;
+}
+
+auto HierarchicalPathfinder::refine(const std::vector<Node> &nodes) -> std::vector<Cell> {
+    auto cells = std::vector<Cell>{};
+    const auto &first = clusters.at(nodes.front().cluster);
+    cells.push_back(global_cell(first, portal_cell(first, nodes.front().index)));
+
+    for (auto i = 1u; i < nodes.size(); i++) {
+        const auto &cluster = clusters.at(nodes[i].cluster);
+        const auto to = portal_cell(cluster, nodes[i].index);
+        if (nodes[i - 1u].cluster != nodes[i].cluster) {
+            cells.push_back(global_cell(cluster, to));
+            continue;
+        }
+
+        const auto segment = path_to_portal(cluster, portal_cell(cluster, nodes[i - 1u].index), nodes[i].index);
+        cells.insert(cells.end(), std::next(segment.begin()), segment.end());
+    }
+    return cells;
+}
+
+// Walks every cell the segment between the two cell centers touches, both cells next to an exact corner crossing
+auto HierarchicalPathfinder::line_of_sight(const Cell &from, const Cell &to) -> bool {
+    const auto dx = to.x - from.x;
+    const auto dz = to.z - from.z;
+    const auto step_x = dx > 0 ? 1 : -1;
+    const auto step_z = dz > 0 ? 1 : -1;
+    const auto steps_x = std::abs(dx);
+    const auto steps_z = std::abs(dz);
+    // NOTE: Consecutive cells are nearly always in the same cluster, only a cluster change needs a lookup
+    const auto n = static_cast<std::int64_t>(settings.cluster_cells);
+    const Cluster *cluster = nullptr;
+    const auto passable = [&](const std::int64_t x, const std::int64_t z) {
+        const auto cell = Cell{.x = x, .z = z};
+        if (cluster == nullptr || floor_div(x, n) != cluster->x || floor_div(z, n) != cluster->z) {
+            cluster = &ensure_costs(floor_div(x, n), floor_div(z, n));
+        }
+        return cluster->costs[local_index(*cluster, cell)] != infinity;
+    };
+
+    auto x = from.x;
+    auto z = from.z;
+    auto taken_x = std::int64_t{0};
+    auto taken_z = std::int64_t{0};
+    while (taken_x < steps_x || taken_z < steps_z) {
+        // NOTE: Compares where the segment crosses the next vertical and horizontal cell boundary
+        const auto decision = (1 + 2 * taken_x) * steps_z - (1 + 2 * taken_z) * steps_x;
+        if (decision == 0) {
+            if (!passable(x + step_x, z) || !passable(x, z + step_z)) {
+                return false;
+            }
+            x += step_x;
+            z += step_z;
+            taken_x++;
+            taken_z++;
+        } else if (decision < 0) {
+            x += step_x;
+            taken_x++;
+        } else {
+            z += step_z;
+            taken_z++;
+        }
+
+        if (!passable(x, z)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void HierarchicalPathfinder::smooth(std::vector<Cell> &cells) {
+    if (cells.size() <= 2u) {
+        return;
+    }
+
+    // NOTE: Only the cells where the path turns are candidates, straight runs are clear by construction
+    auto turns = std::vector<Cell>{cells.front()};
+    for (auto i = 1u; i + 1u < cells.size(); i++) {
+        const auto in = Cell{.x = cells[i].x - cells[i - 1u].x, .z = cells[i].z - cells[i - 1u].z};
+        const auto out = Cell{.x = cells[i + 1u].x - cells[i].x, .z = cells[i + 1u].z - cells[i].z};
+        if (in != out) {
+            turns.push_back(cells[i]);
+        }
+    }
+    turns.push_back(cells.back());
+
+    cells.clear();
+    cells.push_back(turns.front());
+    auto anchor = turns.front();
+    for (auto i = 1u; i + 1u < turns.size(); i++) {
+        if (!line_of_sight(anchor, turns[i + 1u])) {
+            cells.push_back(turns[i]);
+            anchor = turns[i];
+        }
+    }
+    cells.push_back(turns.back());
+}
+
+auto HierarchicalPathfinder::find_cached(const cluster_key start, const cluster_key goal) -> const CachedPath * {
+    const auto key = path_key{start, goal};
+    const auto it = cache.find(key);
+    if (it == cache.end()) {
+        cache_misses++;
+        return nullptr;
+    }
+
+    cache_hits++;
+    lru.splice(lru.begin(), lru, it->second.lru_position);
+    return &it->second;
+}
+
+void HierarchicalPathfinder::store_cached(const cluster_key start, const cluster_key goal, std::vector<Cell> waypoints,
+                                          std::vector<cluster_key> touched) {
+    const auto key = path_key{start, goal};
+
+    if (const auto it = cache.find(key); it != cache.end()) {
+        lru.erase(it->second.lru_position);
+        cache.erase(it);
+    }
+    while (!lru.empty() && cache.size() >= settings.cache_capacity) {
+        cache.erase(lru.back());
+        lru.pop_back();
+    }
+
+    lru.push_front(key);
+    cache.emplace(key, CachedPath{.waypoints = std::move(waypoints),
+                                  .clusters = std::move(touched),
+                                  .lru_position = lru.begin()});
+}
+
+auto HierarchicalPathfinder::find_path(const TerrainHeightField *height_field, const Vector2 start, const Vector2 goal)
+    -> std::optional<std::vector<Vector2>> {
+    this->height_field = height_field;
+
+    const auto n = static_cast<std::int64_t>(settings.cluster_cells);
+    const auto start_cell = to_cell(start);
+    const auto goal_cell = to_cell(goal);
+    if (cell_cost(goal_cell) == infinity) {
+        return std::nullopt;
+    }
+
+    const auto start_key = cluster_of(start_cell);
+    const auto goal_key = cluster_of(goal_cell);
+    auto &start_cluster = ensure_edges(floor_div(start_cell.x, n), floor_div(start_cell.z, n));
+    auto &goal_cluster = ensure_edges(floor_div(goal_cell.x, n), floor_div(goal_cell.z, n));
+
+    auto cells = std::vector<Cell>{};
+    if (start_key == goal_key) {
+        cells = path_in_cluster(start_cluster, local_index(start_cluster, start_cell),
+                                local_index(start_cluster, goal_cell));
+        smooth(cells);
+    }
+
+    // The cached middle part joined with legs inside the start and goal clusters
+    const auto assemble = [&](const std::vector<Cell> &middle) {
+        const auto first = find_portal(start_cluster, middle.front());
+        const auto last = find_portal(goal_cluster, middle.back());
+        if (!first || !last) {
+            return std::vector<Cell>{};
+        }
+
+        auto head = path_to_portal(start_cluster, local_index(start_cluster, start_cell), *first);
+        auto tail = path_to_portal(goal_cluster, local_index(goal_cluster, goal_cell), *last);
+        if (head.empty() || tail.empty()) {
+            return std::vector<Cell>{};
+        }
+
+        smooth(head);
+        smooth(tail);
+        head.insert(head.end(), std::next(middle.begin()), middle.end());
+        head.insert(head.end(), std::next(tail.rbegin()), tail.rend());
+
+        // NOTE: Each part is already smooth, this pulls the string over the corners where they meet
+        smooth(head);
+        return head;
+    };
+
+    if (cells.empty()) {
+        if (const auto *cached = find_cached(start_key, goal_key)) {
+            cells = assemble(cached->waypoints);
+        }
+    }
+
+    // NOTE: A miss, or a start that cannot reach the cached portals, gets a full search whose middle is cached
+    if (cells.empty()) {
+        const auto nodes = abstract_path(start_cell, goal_cell);
+        if (!nodes) {
+            return std::nullopt;
+        }
+
+        auto middle = refine(*nodes);
+
+        // NOTE: Taken before smoothing, the straight segments afterwards skip over the clusters in between
+        auto touched = std::vector<cluster_key>{};
+        for (const auto &cell : middle) {
+            touched.push_back(cluster_of(cell));
+        }
+        std::ranges::sort(touched);
+        touched.erase(std::unique(touched.begin(), touched.end()), touched.end());
+
+        smooth(middle);
+        cells = assemble(middle);
+        store_cached(start_key, goal_key, std::move(middle), std::move(touched));
+        if (cells.empty()) {
+            return std::nullopt;
+        }
+    }
+
+    auto waypoints = std::vector<Vector2>{};
+    waypoints.reserve(cells.size());
+    for (auto i = 1u; i + 1u < cells.size(); i++) {
+        waypoints.push_back(to_world(cells[i]));
+    }
+    waypoints.push_back(goal);
+
+    this->height_field = nullptr;
+    return waypoints;
+}
+
+void HierarchicalPathfinder::invalidate(const Vector2 min, const Vector2 max) {
+    const auto size = static_cast<float>(settings.cluster_cells) * settings.cell_size;
+    const auto first_x = static_cast<std::int64_t>(std::floor(min.x / size));
+    const auto first_z = static_cast<std::int64_t>(std::floor(min.y / size));
+    const auto last_x = static_cast<std::int64_t>(std::floor(max.x / size));
+    const auto last_z = static_cast<std::int64_t>(std::floor(max.y / size));
+
+    auto dropped = std::unordered_set<cluster_key>{};
+    for (auto z = first_z; z <= last_z; z++) {
+        for (auto x = first_x; x <= last_x; x++) {
+            const auto key = make_key(x, z);
+            if (clusters.erase(key) == 0u) {
+                continue;
+            }
+            dropped.insert(key);
+            invalidated.push_back(key);
+
+            // NOTE: The neighbours keep their costs, only their portals on the shared border may change
+            for (auto side = 0u; side < 4u; side++) {
+                if (const auto it = clusters.find(make_key(x + side_dx[side], z + side_dz[side]));
+                    it != clusters.end()) {
+                    it->second.has_portals = false;
+                    it->second.has_edges = false;
+                }
+            }
+        }
+    }
+
+    if (dropped.empty()) {
+        return;
+    }
+    for (auto it = cache.begin(); it != cache.end();) {
+        const auto crosses = std::ranges::any_of(it->second.clusters,
+                                                 [&](const cluster_key key) { return dropped.contains(key); });
+        if (crosses) {
+            lru.erase(it->second.lru_position);
+            it = cache.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void HierarchicalPathfinder::rebuild_invalidated(const TerrainHeightField *height_field) {
+    this->height_field = height_field;
+
+    for (auto i = 0u; i < settings.rebuilds_per_update && !invalidated.empty(); i++) {
+        const auto key = invalidated.back();
+        invalidated.pop_back();
+
+        const auto x = static_cast<std::int64_t>(static_cast<std::int32_t>(key >> 32u));
+        const auto z = static_cast<std::int64_t>(static_cast<std::int32_t>(key & 0xffffffffu));
+        ensure_edges(x, z);
+        for (auto side = 0u; side < 4u; side++) {
+            if (clusters.contains(make_key(x + side_dx[side], z + side_dz[side]))) {
+                ensure_edges(x + side_dx[side], z + side_dz[side]);
+            }
+        }
+    }
+
+    this->height_field = nullptr;
+}
+
+auto HierarchicalPathfinder::get_stats() const -> PathfinderStats {
+    return PathfinderStats{
+        .clusters = clusters.size(), .cache_hits = cache_hits, .cache_misses = cache_misses, .rebuilt = rebuilt};
+}
+
+void setup_pathfinding(entt::registry &registry, const PathfinderSettings settings) {
+    registry.ctx().emplace<HierarchicalPathfinder>(settings);
+
+    // NOTE: Costs near a chunk edge sample the neighbouring chunk, so the area grows by a cell on each side
+    constexpr auto invalidate_chunk = [](entt::registry &registry, const entt::entity entity) {
+        auto &pathfinder = registry.ctx().get<HierarchicalPathfinder>();
+        const auto &chunk = registry.get<const TerrainChunk>(entity);
+        const auto margin = pathfinder.get_settings().cell_size;
+        const auto min = Vector2{static_cast<float>(chunk.x) * chunk.size - margin,
+                                 static_cast<float>(chunk.y) * chunk.size - margin};
+        pathfinder.invalidate(min, Vector2Add(min, Vector2{chunk.size + 2.f * margin, chunk.size + 2.f * margin}));
+    };
+    registry.on_construct<TerrainChunk>().connect<invalidate_chunk>();
+    registry.on_destroy<TerrainChunk>().connect<invalidate_chunk>();
+}
+
+void update_pathfinding(entt::registry &registry) {
+    if (auto *pathfinder = registry.ctx().find<HierarchicalPathfinder>()) {
+        pathfinder->rebuild_invalidated(registry.ctx().find<const TerrainHeightField>());
+    }
+}
+
+} // namespace stratgame
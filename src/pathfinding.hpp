@@ -0,0 +1,172 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <entt.hpp>
+#include <list>
+#include <optional>
+#include <queue>
+#include <raylib.h>
+#include <span>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace stratgame {
+struct TerrainHeightField;
+
+struct PathfinderSettings {
+    float cell_size = 2.f; // same navigation grid as the flow fields
+    float max_slope = 1.f;
+    float slope_cost = 4.f;
+    std::uint32_t cluster_cells = 64u;      // per side, 64 cells of 2 units line up with the 128 unit terrain chunks
+    std::size_t cache_capacity = 256u;      // refined paths kept, keyed by (start cluster, goal cluster)
+    std::size_t max_expanded = 65'536u;     // abstract nodes a search may expand before it gives up
+    std::size_t rebuilds_per_update = 4u;   // invalidated clusters rebuilt eagerly by update_pathfinding
+};
+
+struct PathfinderStats {
+    std::size_t clusters = 0u;
+    std::size_t cache_hits = 0u;   // total since creation
+    std::size_t cache_misses = 0u; // total since creation
+    std::size_t rebuilt = 0u;      // clusters built, total since creation
+};
+
+// Hierarchical A* (HPA*) over the navigation grid. Clusters are square blocks of cells lined up with the terrain
+// chunks. Each keeps its cell costs, the portals on its four borders and the path costs between those portals.
+// Clusters are built on first use and rebuilt only when the terrain underneath them changes.
+// Lives in registry.ctx(), not thread safe.
+class HierarchicalPathfinder {
+  public:
+    explicit HierarchicalPathfinder(PathfinderSettings settings = {});
+
+    // Waypoints from start to goal with straight, passable segments in between, the last one is goal itself.
+    // nullopt when goal cannot be reached.
+    [[nodiscard]] auto find_path(const TerrainHeightField *height_field, Vector2 start, Vector2 goal)
+        -> std::optional<std::vector<Vector2>>;
+
+    // Drops every cluster overlapping the xz rectangle along with the cached paths through them
+    void invalidate(Vector2 min, Vector2 max);
+    // Builds up to rebuilds_per_update of the clusters dropped by invalidate before a search needs them
+    void rebuild_invalidated(const TerrainHeightField *height_field);
+
+    [[nodiscard]] auto get_stats() const -> PathfinderStats;
+    [[nodiscard]] auto get_settings() const -> const PathfinderSettings & { return settings; }
+
+  private:
+    using cluster_key = std::uint64_t;
+
+    struct Cell {
+        std::int64_t x;
+        std::int64_t z;
+
+        auto operator==(const Cell &) const -> bool = default;
+    };
+
+    struct Cluster {
+        std::int64_t x;
+        std::int64_t z;
+        std::vector<float> costs; // row major, infinity for impassable cells
+        bool uniform = false;     // every cell costs 1, paths inside are straight lines
+
+        // Positions along each border (+x, -x, +z, -z), the neighbour stores the same list for the shared border
+        bool has_portals = false;
+        std::array<std::vector<std::uint32_t>, 4> portals;
+        std::array<std::uint32_t, 5> portal_offsets{}; // local node index of the first portal on each side
+
+        bool has_edges = false;
+        std::vector<float> distances; // node count squared, path cost between two portals inside the cluster
+        std::vector<float> fields;    // per portal, cost from every cell to it, empty when uniform
+    };
+
+    struct Node {
+        cluster_key cluster;
+        std::uint32_t index;
+
+        auto operator==(const Node &) const -> bool = default;
+    };
+
+    struct NodeHash {
+        auto operator()(const Node &node) const -> std::size_t {
+            return std::hash<std::uint64_t>{}(node.cluster * 31u + node.index);
+        }
+    };
+
+    using path_key = std::pair<cluster_key, cluster_key>; // start cluster, goal cluster
+
+    struct PathKeyHash {
+        auto operator()(const path_key &key) const -> std::size_t {
+            return std::hash<std::uint64_t>{}(key.first * 0x9e3779b97f4a7c15u ^ key.second);
+        }
+    };
+
+    struct NodeRecord {
+        float cost;
+        Node parent;
+        bool closed;
+    };
+
+    // Middle part of a path between the first portal it leaves the start cluster through
+    // and the last portal it enters the goal cluster through, found again by cell since portals are renumbered
+    // whenever a neighbour is rebuilt
+    struct CachedPath {
+        std::vector<Cell> waypoints;
+        std::vector<cluster_key> clusters;
+        std::list<path_key>::iterator lru_position;
+    };
+
+    PathfinderSettings settings;
+    std::unordered_map<cluster_key, Cluster> clusters;
+    std::vector<cluster_key> invalidated;
+    const TerrainHeightField *height_field = nullptr; // only valid during find_path and rebuild_invalidated
+
+    std::unordered_map<path_key, CachedPath, PathKeyHash> cache;
+    std::list<path_key> lru; // front is the most recently used path
+    std::size_t cache_hits = 0u;
+    std::size_t cache_misses = 0u;
+    std::size_t rebuilt = 0u;
+
+    // scratch for the searches inside one cluster
+    std::vector<float> local_costs;
+    std::vector<std::uint32_t> local_parents;
+    std::vector<std::uint8_t> local_closed;
+    std::unordered_map<Node, NodeRecord, NodeHash> abstract_records;
+
+    [[nodiscard]] static auto make_key(std::int64_t x, std::int64_t z) -> cluster_key;
+    [[nodiscard]] auto cluster_of(const Cell &cell) const -> cluster_key;
+    [[nodiscard]] auto to_cell(Vector2 position) const -> Cell;
+    [[nodiscard]] auto to_world(const Cell &cell) const -> Vector2;
+    [[nodiscard]] auto local_index(const Cluster &cluster, const Cell &cell) const -> std::uint32_t;
+    [[nodiscard]] auto global_cell(const Cluster &cluster, std::uint32_t local) const -> Cell;
+    [[nodiscard]] auto portal_cell(const Cluster &cluster, std::uint32_t node) const -> std::uint32_t;
+    [[nodiscard]] auto find_portal(const Cluster &cluster, const Cell &cell) const -> std::optional<std::uint32_t>;
+    [[nodiscard]] auto portal_cost(const Cluster &cluster, std::uint32_t node, std::uint32_t local) const -> float;
+    [[nodiscard]] auto cell_cost(const Cell &cell) -> float;
+
+    auto ensure_costs(std::int64_t x, std::int64_t z) -> Cluster &;
+    auto ensure_portals(std::int64_t x, std::int64_t z) -> Cluster &;
+    auto ensure_edges(std::int64_t x, std::int64_t z) -> Cluster &;
+
+    // Costs from source to every cell of the cluster
+    void search_cluster(const Cluster &cluster, std::uint32_t source, std::span<float> out);
+    // Cells from one local cell to another without leaving the cluster, empty when there is no such path
+    [[nodiscard]] auto path_in_cluster(const Cluster &cluster, std::uint32_t from, std::uint32_t to)
+        -> std::vector<Cell>;
+    // Same as path_in_cluster towards a portal, follows the portal's field instead of searching
+    [[nodiscard]] auto path_to_portal(const Cluster &cluster, std::uint32_t from, std::uint32_t node) const
+        -> std::vector<Cell>;
+    [[nodiscard]] auto abstract_path(const Cell &start, const Cell &goal) -> std::optional<std::vector<Node>>;
+    [[nodiscard]] auto refine(const std::vector<Node> &nodes) -> std::vector<Cell>;
+    [[nodiscard]] auto line_of_sight(const Cell &from, const Cell &to) -> bool;
+    void smooth(std::vector<Cell> &cells);
+
+    [[nodiscard]] auto find_cached(cluster_key start, cluster_key goal) -> const CachedPath *;
+    void store_cached(cluster_key start, cluster_key goal, std::vector<Cell> waypoints,
+                      std::vector<cluster_key> touched);
+};
+
+void setup_pathfinding(entt::registry &registry, PathfinderSettings settings = {});
+// Rebuilds a few of the clusters whose terrain changed
+void update_pathfinding(entt::registry &registry);
+
+} // namespace stratgame
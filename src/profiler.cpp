@@ -0,0 +1,196 @@
+#include "profiler.hpp"
+#include <algorithm>
+#include <format>
+#include <fstream>
+
+namespace stratgame {
+
+static auto next_profiler_id = std::atomic<std::uint64_t>{1u};
+
+// The ring of the calling thread, valid while the profiler with the same id is alive
+struct ThreadRingCache {
+    std::uint64_t profiler_id = 0u;
+    void *ring = nullptr;
+};
+thread_local auto thread_ring_cache = ThreadRingCache{};
+
+Profiler::Profiler() : id{next_profiler_id.fetch_add(1u)} { static_cast<void>(get_thread_ring()); }
+
+Profiler::~Profiler() {
+    if (is_capturing()) {
+        finish_capture();
+    }
+}
+
+auto Profiler::get_thread_ring() -> ThreadRing & {
+    if (thread_ring_cache.profiler_id == id) {
+        return *static_cast<ThreadRing *>(thread_ring_cache.ring);
+    }
+
+    const auto lock = std::scoped_lock{rings_mutex};
+    auto &ring = rings.emplace_back(std::make_unique<ThreadRing>());
+    ring->thread = static_cast<std::uint32_t>(rings.size() - 1u);
+    thread_ring_cache = ThreadRingCache{.profiler_id = id, .ring = ring.get()};
+    return *ring;
+}
+
+void Profiler::record(const std::string_view name, const std::int64_t begin, const std::int64_t end) {
+    auto &ring = get_thread_ring();
+    const auto head = ring.head.load(std::memory_order_relaxed);
+    if (head - ring.tail.load(std::memory_order_acquire) == ring_capacity) {
+        ring.dropped.fetch_add(1u, std::memory_order_relaxed);
+        return;
+    }
+
+    ring.events[head % ring_capacity] = Event{.name = name, .thread = ring.thread, .begin = begin, .end = end};
+    ring.head.store(head + 1u, std::memory_order_release);
+}
+
+auto Profiler::get_dropped() const -> std::uint64_t {
+    const auto lock = std::scoped_lock{rings_mutex};
+    auto dropped = std::uint64_t{0u};
+    for (const auto &ring : rings) {
+        dropped += ring->dropped.load(std::memory_order_relaxed);
+    }
+    return dropped;
+}
+
+auto Profiler::get_zone(const std::string_view name) -> ZoneHistory & {
+    const auto [found, inserted] = zone_lookup.try_emplace(name, zones.size());
+    if (inserted) {
+        zones.push_back(ZoneHistory{.name = name});
+    }
+    return zones[found->second];
+}
+
+void Profiler::begin_frame() { frame_begin = now(); }
+
+void Profiler::end_frame() {
+    const auto frame_end = now();
+    const auto slot = frame % history_length;
+    frame_milliseconds[slot] = static_cast<float>(frame_end - frame_begin) * 1e-6f;
+
+    {
+        const auto lock = std::scoped_lock{rings_mutex};
+        for (auto &ring : rings) {
+            const auto tail = ring->tail.load(std::memory_order_relaxed);
+            const auto head = ring->head.load(std::memory_order_acquire);
+            for (auto i = tail; i != head; i++) {
+                const auto &event = ring->events[i % ring_capacity];
+                get_zone(event.name).current += static_cast<float>(event.end - event.begin) * 1e-6f;
+                if (is_capturing()) {
+                    captured_events.push_back(event);
+                }
+            }
+            ring->tail.store(head, std::memory_order_release);
+        }
+    }
+
+    for (auto &zone : zones) {
+        zone.milliseconds[slot] = zone.current;
+        zone.current = 0.f;
+    }
+    for (auto &counter : counters) {
+        counter.history[slot] = static_cast<float>(counter.value);
+        if (is_capturing()) {
+            captured_counters.push_back(CounterSample{.name = counter.name, .time = frame_end, .value = counter.value});
+        }
+    }
+
+    frame++;
+    if (is_capturing() && --capture_frames_left == 0u) {
+        finish_capture();
+    }
+}
+
+void Profiler::set_counter(const std::string_view name, const double value) {
+    const auto found = std::ranges::find(counters, name, &Counter::name);
+    if (found != counters.end()) {
+        found->value = value;
+        return;
+    }
+    counters.push_back(Counter{.name = name, .value = value});
+}
+
+void Profiler::capture(const std::size_t frames, std::filesystem::path path) {
+    captured_events.clear();
+    captured_counters.clear();
+    capture_frames_left = frames;
+    capture_path = std::move(path);
+    capture_status = std::format("Capturing {} frames", frames);
+}
+
+void Profiler::finish_capture() {
+    capture_frames_left = 0u;
+    const auto thread_count = [&] {
+        const auto lock = std::scoped_lock{rings_mutex};
+        return static_cast<std::uint32_t>(rings.size());
+    }();
+    const auto result = write_chrome_trace(capture_path, captured_events, captured_counters, thread_count);
+    capture_status = result ? std::format("Wrote {} zones to {}", captured_events.size(), capture_path.string())
+                            : result.error();
+
+    captured_events = {};
+    captured_counters = {};
+}
+
+// ===================================
+// Chrome trace
+// ===================================
+static void write_json_string(std::ofstream &file, const std::string_view text) {
+    file << '"';
+    for (const auto character : text) {
+        if (character == '"' || character == '\\') {
+            file << '\\';
+        }
+        file << character;
+    }
+    file << '"';
+}
+
+auto write_chrome_trace(const std::filesystem::path &path, const std::span<const Profiler::Event> events,
+                        const std::span<const Profiler::CounterSample> counters, const std::uint32_t thread_count)
+    -> Expected<void> {
+    if (path.has_parent_path()) {
+        auto error = std::error_code{};
+        std::filesystem::create_directories(path.parent_path(), error);
+    }
+
+    auto file = std::ofstream{path};
+    if (!file) {
+        return std::unexpected(std::string{"Could not open trace file: "} + path.string());
+    }
+
+    // NOTE: Timestamps are in microseconds, thread 0 is the one that created the profiler
+    file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    for (auto thread = 0u; thread < thread_count; thread++) {
+        const auto name = thread == 0u ? std::string{"main"} : std::format("worker {}", thread);
+        file << std::format(R"({{"name":"thread_name","ph":"M","pid":1,"tid":{},"args":{{"name":"{}"}}}},)", thread,
+                            name)
+             << '\n';
+    }
+    for (const auto &event : events) {
+        file << "{\"name\":";
+        write_json_string(file, event.name);
+        const auto begin = static_cast<double>(event.begin) * 1e-3;
+        const auto duration = static_cast<double>(event.end - event.begin) * 1e-3;
+        file << std::format(R"(,"ph":"X","pid":1,"tid":{},"ts":{:.3f},"dur":{:.3f}}},)", event.thread, begin, duration)
+             << '\n';
+    }
+    for (const auto &counter : counters) {
+        file << "{\"name\":";
+        write_json_string(file, counter.name);
+        file << std::format(R"(,"ph":"C","pid":1,"ts":{:.3f},"args":{{"value":{}}}}},)",
+                            static_cast<double>(counter.time) * 1e-3, counter.value)
+             << '\n';
+    }
+    // NOTE: Ends with the process name, so every event before it can end with a comma
+    file << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"stratgame\"}}\n]}\n";
+
+    if (!file) {
+        return std::unexpected(std::string{"Could not write trace file: "} + path.string());
+    }
+    return {};
+}
+
+} // namespace stratgame
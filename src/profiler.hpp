@@ -0,0 +1,157 @@
+#pragma once
+#include "error.hpp"
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace stratgame {
+
+// Timing zones and counters per frame, lives in registry.ctx(). Every thread writes its zones into its own lock free
+// ring, end_frame collects them on the main thread and keeps a history per zone for the overlay. The next N frames can
+// be captured and written as a Chrome trace_event file.
+// NOTE: Zone and counter names are not copied, they must outlive the profiler like string literals and system names
+class Profiler {
+  public:
+    constexpr static std::size_t ring_capacity = 4096u;  // zones a thread may record between two end_frame calls
+    constexpr static std::size_t history_length = 240u; // frames kept for the graphs
+
+    struct Event {
+        std::string_view name;
+        std::uint32_t thread;
+        std::int64_t begin; // nanoseconds since the profiler was created
+        std::int64_t end;
+    };
+
+    struct CounterSample {
+        std::string_view name;
+        std::int64_t time;
+        double value;
+    };
+
+    // Milliseconds spent in a zone per frame summed over every thread, oldest first starting at get_history_offset()
+    struct ZoneHistory {
+        std::string_view name;
+        std::array<float, history_length> milliseconds{};
+        float current = 0.f; // of the frame being recorded
+    };
+
+    struct Counter {
+        std::string_view name;
+        double value = 0.;
+        std::array<float, history_length> history{};
+    };
+
+    // NOTE: The constructing thread is taken as the main thread, it is thread 0 in traces
+    Profiler();
+    ~Profiler();
+
+    Profiler(const Profiler &) = delete;
+    Profiler(Profiler &&) = delete;
+    auto operator=(const Profiler &) -> Profiler & = delete;
+    auto operator=(Profiler &&) -> Profiler & = delete;
+
+    [[nodiscard]] auto now() const -> std::int64_t {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - origin).count();
+    }
+
+    // Called from any thread, dropped and counted when the ring of the calling thread is full
+    void record(std::string_view name, std::int64_t begin, std::int64_t end);
+
+    // Main thread only
+    void begin_frame();
+    void end_frame();
+    void set_counter(std::string_view name, double value);
+    // Records the next frames and writes them to path once done, the result ends up in get_capture_status()
+    void capture(std::size_t frames, std::filesystem::path path);
+
+    [[nodiscard]] auto get_zones() const -> std::span<const ZoneHistory> { return zones; }
+    [[nodiscard]] auto get_counters() const -> std::span<const Counter> { return counters; }
+    [[nodiscard]] auto get_frame_milliseconds() const -> const std::array<float, history_length> & {
+        return frame_milliseconds;
+    }
+    [[nodiscard]] auto get_frame() const -> std::size_t { return frame; }
+    [[nodiscard]] auto get_history_offset() const -> std::size_t { return frame % history_length; }
+    [[nodiscard]] auto get_last_frame() const -> std::size_t { return (frame + history_length - 1u) % history_length; }
+    [[nodiscard]] auto get_dropped() const -> std::uint64_t;
+    [[nodiscard]] auto is_capturing() const -> bool { return capture_frames_left > 0u; }
+    [[nodiscard]] auto get_capture_status() const -> const std::string & { return capture_status; }
+
+  private:
+    // Single producer single consumer, the owning thread pushes and end_frame pops
+    struct ThreadRing {
+        std::uint32_t thread;
+        std::array<Event, ring_capacity> events;
+        alignas(64) std::atomic<std::size_t> head = 0u; // written by the owning thread
+        alignas(64) std::atomic<std::size_t> tail = 0u; // written by end_frame
+        std::atomic<std::uint64_t> dropped = 0u;
+    };
+
+    [[nodiscard]] auto get_thread_ring() -> ThreadRing &;
+    [[nodiscard]] auto get_zone(std::string_view name) -> ZoneHistory &;
+    void finish_capture();
+
+    std::chrono::steady_clock::time_point origin = std::chrono::steady_clock::now();
+    std::uint64_t id; // tells apart profilers living at the same address one after another
+
+    mutable std::mutex rings_mutex; // only taken when a thread records its first zone and by end_frame
+    std::vector<std::unique_ptr<ThreadRing>> rings;
+
+    std::size_t frame = 0u;
+    std::int64_t frame_begin = 0;
+    std::array<float, history_length> frame_milliseconds{};
+    std::vector<ZoneHistory> zones;
+    std::unordered_map<std::string_view, std::size_t> zone_lookup;
+    std::vector<Counter> counters;
+
+    std::size_t capture_frames_left = 0u;
+    std::filesystem::path capture_path;
+    std::vector<Event> captured_events;
+    std::vector<CounterSample> captured_counters;
+    std::string capture_status;
+};
+
+// Records the time between construction and destruction, does nothing without a profiler
+class ProfileZone {
+  public:
+    ProfileZone(Profiler *profiler, const std::string_view name)
+        : profiler{profiler}, name{name}, begin{profiler != nullptr ? profiler->now() : 0} {}
+    ~ProfileZone() {
+        if (profiler != nullptr) {
+            profiler->record(name, begin, profiler->now());
+        }
+    }
+
+    ProfileZone(const ProfileZone &) = delete;
+    ProfileZone(ProfileZone &&) = delete;
+    auto operator=(const ProfileZone &) -> ProfileZone & = delete;
+    auto operator=(ProfileZone &&) -> ProfileZone & = delete;
+
+  private:
+    Profiler *profiler;
+    std::string_view name;
+    std::int64_t begin;
+};
+
+// Calls func inside a zone and returns what it returned
+template <typename Func> auto profile(Profiler *profiler, const std::string_view name, Func &&func) -> decltype(auto) {
+    const auto zone = ProfileZone{profiler, name};
+    return std::forward<Func>(func)();
+}
+
+// Writes events and counters in the Chrome trace_event format, loads in chrome://tracing and Perfetto
+[[nodiscard]] auto write_chrome_trace(const std::filesystem::path &path, std::span<const Profiler::Event> events,
+                                      std::span<const Profiler::CounterSample> counters, std::uint32_t thread_count)
+    -> Expected<void>;
+
+} // namespace stratgame
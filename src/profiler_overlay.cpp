@@ -0,0 +1,99 @@
+#include "profiler_overlay.hpp"
+#include "culling.hpp"
+#include "imgui.h"
+#include "minion.hpp"
+#include "terrain.hpp"
+#include <format>
+#include <numeric>
+#include <string>
+
+namespace stratgame {
+
+void ProfilerOverlay::draw(Profiler &profiler) {
+    ImGui::SetNextWindowPos(ImVec2{10.f, 140.f}, ImGuiCond_FirstUseEver);
+    ImGui::SetNextWindowBgAlpha(0.8f);
+    if (!ImGui::Begin("Profiler", nullptr, ImGuiWindowFlags_AlwaysAutoResize)) {
+        ImGui::End();
+        return;
+    }
+
+    constexpr auto history_length = static_cast<int>(Profiler::history_length);
+    const auto offset = static_cast<int>(profiler.get_history_offset());
+    const auto last = profiler.get_last_frame();
+
+    const auto &frames = profiler.get_frame_milliseconds();
+    const auto frame_label = std::format("frame {:.2f} ms", frames[last]);
+    ImGui::PlotLines("##frame", frames.data(), history_length, offset, frame_label.c_str(), 0.f, 33.3f,
+                     ImVec2{420.f, 60.f});
+
+    if (ImGui::BeginTable("zones", 4, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg)) {
+        ImGui::TableSetupColumn("zone");
+        ImGui::TableSetupColumn("ms");
+        ImGui::TableSetupColumn("avg ms");
+        ImGui::TableSetupColumn("history");
+        ImGui::TableHeadersRow();
+
+        for (const auto &zone : profiler.get_zones()) {
+            const auto average =
+                std::reduce(zone.milliseconds.begin(), zone.milliseconds.end(), 0.f) / Profiler::history_length;
+            const auto label = std::format("##{}", zone.name);
+
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn();
+            ImGui::TextUnformatted(zone.name.data(), zone.name.data() + zone.name.size());
+            ImGui::TableNextColumn();
+            ImGui::Text("%.3f", static_cast<double>(zone.milliseconds[last]));
+            ImGui::TableNextColumn();
+            ImGui::Text("%.3f", static_cast<double>(average));
+            ImGui::TableNextColumn();
+            ImGui::PlotLines(label.c_str(), zone.milliseconds.data(), history_length, offset, nullptr, 0.f,
+                             3.4e38f, ImVec2{120.f, 18.f});
+        }
+        ImGui::EndTable();
+    }
+
+    ImGui::Separator();
+    for (const auto &counter : profiler.get_counters()) {
+        const auto text = std::format("{}: {}", counter.name, counter.value);
+        ImGui::TextUnformatted(text.c_str());
+    }
+    if (const auto dropped = profiler.get_dropped(); dropped > 0u) {
+        const auto text = std::format("dropped zones: {}", dropped);
+        ImGui::TextUnformatted(text.c_str());
+    }
+
+    ImGui::Separator();
+    ImGui::SliderInt("frames", &capture_frames, 1, 600);
+    ImGui::SameLine();
+    if (ImGui::Button("Capture trace") && !profiler.is_capturing()) {
+        profiler.capture(static_cast<std::size_t>(capture_frames),
+                         std::format("profiles/frame_{}.json", profiler.get_frame()));
+    }
+    ImGui::TextUnformatted(profiler.get_capture_status().c_str());
+
+    ImGui::End();
+}
+
+void set_frame_counters(entt::registry &registry, Profiler &profiler, const DrawStats &draw_stats) {
+    profiler.set_counter("draw calls", draw_stats.draw_calls);
+    profiler.set_counter("instances", draw_stats.instances);
+    profiler.set_counter("terrain triangles", draw_stats.terrain_triangles);
+
+    const auto &culling = registry.ctx().get<const CullingSpheres>().stats;
+    profiler.set_counter("visible spheres", culling.visible);
+    profiler.set_counter("culled spheres", culling.culled);
+    profiler.set_counter("occluded spheres", culling.occluded);
+
+    auto visible_chunks = 0u;
+    const auto chunks = registry.view<const TerrainChunk, const ModelComponent>();
+    for (const auto &[entity, chunk, model] : chunks.each()) {
+        visible_chunks += model.visible ? 1u : 0u;
+    }
+    profiler.set_counter("visible chunks", visible_chunks);
+    profiler.set_counter("culled chunks", static_cast<double>(chunks.size_hint() - visible_chunks));
+
+    profiler.set_counter("entities", static_cast<double>(registry.storage<entt::entity>().free_list()));
+    profiler.set_counter("minions", static_cast<double>(registry.storage<Minion>().size()));
+}
+
+} // namespace stratgame
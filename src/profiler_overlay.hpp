@@ -0,0 +1,18 @@
+#pragma once
+#include "drawing.hpp"
+#include "profiler.hpp"
+#include <entt.hpp>
+
+namespace stratgame {
+
+// ImGui window with the zones of the last frame, their history and the counters, can start a trace capture
+struct ProfilerOverlay {
+    int capture_frames = 120;
+
+    void draw(Profiler &profiler);
+};
+
+// Draw calls, instances, culling results and entity counts of the frame about to end
+void set_frame_counters(entt::registry &registry, Profiler &profiler, const DrawStats &draw_stats);
+
+} // namespace stratgame
@@ -0,0 +1,437 @@
+#include "replay.hpp"
+#include "common_components.hpp"
+#include "height_field.hpp"
+#include "log.hpp"
+#include "tasks.hpp"
+#include <bit>
+#include <cstring>
+#include <format>
+#include <map>
+#include <type_traits>
+#include <utility>
+
+namespace stratgame {
+
+namespace {
+
+constexpr auto replay_magic = std::uint32_t{0x50524753u}; // "SGRP"
+
+struct ReplayFileHeader {
+    std::uint32_t magic;
+    std::uint32_t version;
+    float tick_rate;
+    float frequency;
+    float amplitude;
+    float lacunarity;
+    float persistence;
+    std::uint32_t octaves;
+    std::uint32_t chunk_size;
+    std::uint32_t chunk_subdivisions;
+    float height_scale;
+    std::uint32_t reserved;
+};
+static_assert(std::is_trivially_copyable_v<ReplayFileHeader>);
+static_assert(sizeof(ReplayFileHeader) == 48u, "the header is written as raw bytes and must not contain padding");
+
+// NOTE: Same order as the alternatives of Command, the others follow
+enum class RecordType : std::uint8_t {
+    SpawnMinion = 0u,
+    Select = 1u,
+    Move = 2u,
+    ChunkLoaded = 3u,
+    ChunkUnloaded = 4u,
+    StateHash = 5u,
+};
+static_assert(std::variant_size_v<Command> == 3u);
+
+struct ByteWriter {
+    std::vector<std::byte> bytes;
+
+    template <typename T> void raw(const T value) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        const auto offset = bytes.size();
+        bytes.resize(offset + sizeof(T));
+        std::memcpy(bytes.data() + offset, &value, sizeof(T));
+    }
+
+    // LEB128, seven bits per byte with the high bit set on every byte but the last
+    void varint(std::uint64_t value) {
+        while (value >= 0x80u) {
+            bytes.push_back(static_cast<std::byte>(value | 0x80u));
+            value >>= 7u;
+        }
+        bytes.push_back(static_cast<std::byte>(value));
+    }
+
+    void signed_varint(const std::int64_t value) {
+        varint((static_cast<std::uint64_t>(value) << 1u) ^ static_cast<std::uint64_t>(value >> 63));
+    }
+};
+
+// Reads past the end set ok to false and return zeros
+struct ByteReader {
+    std::span<const std::byte> bytes;
+    std::size_t offset;
+    bool ok = true;
+
+    template <typename T> auto raw() -> T {
+        auto value = T{};
+        if (offset + sizeof(T) > bytes.size()) {
+            ok = false;
+            return value;
+        }
+        std::memcpy(&value, bytes.data() + offset, sizeof(T));
+        offset += sizeof(T);
+        return value;
+    }
+
+    auto varint() -> std::uint64_t {
+        auto value = std::uint64_t{0};
+        for (auto shift = 0u; shift < 64u; shift += 7u) {
+            const auto byte = std::to_integer<std::uint64_t>(raw<std::byte>());
+            value |= (byte & 0x7fu) << shift;
+            if (!ok || (byte & 0x80u) == 0u) {
+                return value;
+            }
+        }
+        ok = false;
+        return value;
+    }
+
+    auto signed_varint() -> std::int64_t {
+        const auto value = varint();
+        return static_cast<std::int64_t>(value >> 1u) ^ -static_cast<std::int64_t>(value & 1u);
+    }
+};
+
+auto to_record_type(const ReplayRecord &record) -> RecordType {
+    return std::visit(
+        [](const auto &data) {
+            using data_type = std::decay_t<decltype(data)>;
+            if constexpr (std::is_same_v<data_type, Command>) {
+                return static_cast<RecordType>(data.index());
+            } else if constexpr (std::is_same_v<data_type, ChunkLoadedRecord>) {
+                return RecordType::ChunkLoaded;
+            } else if constexpr (std::is_same_v<data_type, ChunkUnloadedRecord>) {
+                return RecordType::ChunkUnloaded;
+            } else {
+                return RecordType::StateHash;
+            }
+        },
+        record.data);
+}
+
+void encode(ByteWriter &writer, const SpawnMinionCommand &command) {
+    writer.raw(command.position.x);
+    writer.raw(command.position.y);
+    writer.signed_varint(command.team_id);
+}
+
+void encode(ByteWriter &writer, const SelectCommand &command) {
+    writer.raw(static_cast<std::uint8_t>(command.add));
+    writer.varint(command.units.size());
+    for (const auto unit : command.units) {
+        writer.varint(unit);
+    }
+}
+
+void encode(ByteWriter &writer, const MoveCommand &command) {
+    writer.raw(command.target.x);
+    writer.raw(command.target.y);
+}
+
+void encode(ByteWriter &writer, const ChunkCoordinate &coordinate) {
+    writer.signed_varint(coordinate.x);
+    writer.signed_varint(coordinate.y);
+}
+
+auto decode_coordinate(ByteReader &reader) -> ChunkCoordinate {
+    const auto x = reader.signed_varint();
+    return ChunkCoordinate{.x = x, .y = reader.signed_varint()};
+}
+
+auto decode_position(ByteReader &reader) -> Vector2 {
+    const auto x = reader.raw<float>();
+    return Vector2{x, reader.raw<float>()};
+}
+
+// splitmix64 finalizer
+auto mix(std::uint64_t value) -> std::uint64_t {
+    value = (value ^ (value >> 30u)) * 0xbf58476d1ce4e5b9u;
+    value = (value ^ (value >> 27u)) * 0x94d049bb133111ebu;
+    return value ^ (value >> 31u);
+}
+
+} // namespace
+
+auto make_replay_header(const TerrainGenerator &generator, const float tick_rate) -> ReplayHeader {
+    return ReplayHeader{.tick_rate = tick_rate,
+                        .noise = generator.get_noise(),
+                        .chunk_size = generator.get_chunk_size(),
+                        .chunk_subdivisions = generator.get_chunk_subdivisions(),
+                        .height_scale = generator.get_height_scale()};
+}
+
+auto ReplayWriter::open(const std::filesystem::path &path, const ReplayHeader &header) -> Expected<ReplayWriter> {
+    auto error = std::error_code{};
+    if (path.has_parent_path()) {
+        std::filesystem::create_directories(path.parent_path(), error);
+    }
+
+    auto out = std::ofstream{path, std::ios::binary | std::ios::trunc};
+    const auto file_header = ReplayFileHeader{.magic = replay_magic,
+                                              .version = version,
+                                              .tick_rate = header.tick_rate,
+                                              .frequency = header.noise.frequency,
+                                              .amplitude = header.noise.amplitude,
+                                              .lacunarity = header.noise.lacunarity,
+                                              .persistence = header.noise.persistence,
+                                              .octaves = header.noise.octaves,
+                                              .chunk_size = header.chunk_size,
+                                              .chunk_subdivisions = header.chunk_subdivisions,
+                                              .height_scale = header.height_scale,
+                                              .reserved = 0u};
+    out.write(reinterpret_cast<const char *>(&file_header), sizeof(file_header));
+    if (!out) {
+        return std::unexpected(std::format("Could not write {}", path.string()));
+    }
+    return ReplayWriter{std::move(out), path};
+}
+
+void ReplayWriter::write(const ReplayRecord &record) {
+    auto writer = ByteWriter{};
+    writer.raw(to_record_type(record));
+    writer.varint(record.tick - last_tick);
+    last_tick = record.tick;
+
+    std::visit(
+        [&](const auto &data) {
+            using data_type = std::decay_t<decltype(data)>;
+            if constexpr (std::is_same_v<data_type, Command>) {
+                std::visit([&](const auto &command) { encode(writer, command); }, data);
+            } else if constexpr (std::is_same_v<data_type, StateHashRecord>) {
+                writer.raw(data.hash);
+            } else {
+                encode(writer, data.coordinate);
+            }
+        },
+        record.data);
+
+    out.write(reinterpret_cast<const char *>(writer.bytes.data()), static_cast<std::streamsize>(writer.bytes.size()));
+}
+
+auto ReplayWriter::flush() -> Expected<void> {
+    out.flush();
+    if (!out) {
+        return std::unexpected(std::format("Could not write {}", path.string()));
+    }
+    return {};
+}
+
+auto ReplayReader::open(const std::filesystem::path &path) -> Expected<ReplayReader> {
+    auto mapped = MappedFile::open(path);
+    if (!mapped) {
+        return std::unexpected(mapped.error());
+    }
+
+    const auto bytes = mapped->get_bytes();
+    auto file_header = ReplayFileHeader{};
+    if (bytes.size() < sizeof(file_header)) {
+        return std::unexpected(std::format("Truncated replay {}", path.string()));
+    }
+    std::memcpy(&file_header, bytes.data(), sizeof(file_header));
+    if (file_header.magic != replay_magic || file_header.version != ReplayWriter::version) {
+        return std::unexpected(std::format("{} is not a version {} replay", path.string(), ReplayWriter::version));
+    }
+
+    const auto header = ReplayHeader{.tick_rate = file_header.tick_rate,
+                                     .noise = NoiseParameters{.frequency = file_header.frequency,
+                                                              .amplitude = file_header.amplitude,
+                                                              .lacunarity = file_header.lacunarity,
+                                                              .persistence = file_header.persistence,
+                                                              .octaves = file_header.octaves},
+                                     .chunk_size = file_header.chunk_size,
+                                     .chunk_subdivisions = file_header.chunk_subdivisions,
+                                     .height_scale = file_header.height_scale};
+    return ReplayReader{std::move(*mapped), header, sizeof(file_header)};
+}
+
+auto ReplayReader::next() -> Expected<std::optional<ReplayRecord>> {
+    const auto bytes = file.get_bytes();
+    if (offset == bytes.size()) {
+        return std::nullopt;
+    }
+
+    auto reader = ByteReader{.bytes = bytes, .offset = offset};
+    const auto type = reader.raw<RecordType>();
+    auto record = ReplayRecord{.tick = last_tick + reader.varint(), .data = StateHashRecord{}};
+
+    switch (type) {
+    case RecordType::SpawnMinion: {
+        const auto position = decode_position(reader);
+        record.data = Command{SpawnMinionCommand{.position = position,
+                                                 .team_id = static_cast<int>(reader.signed_varint())}};
+        break;
+    }
+    case RecordType::Select: {
+        auto command = SelectCommand{.units = {}, .add = reader.raw<std::uint8_t>() != 0u};
+        const auto count = reader.varint();
+        // NOTE: Checked against the bytes left so a corrupt count cannot allocate gigabytes
+        if (count > bytes.size() - reader.offset) {
+            reader.ok = false;
+            break;
+        }
+        for (auto i = 0u; i < count; i++) {
+            command.units.push_back(static_cast<std::uint32_t>(reader.varint()));
+        }
+        record.data = Command{std::move(command)};
+        break;
+    }
+    case RecordType::Move:
+        record.data = Command{MoveCommand{.target = decode_position(reader)}};
+        break;
+    case RecordType::ChunkLoaded:
+        record.data = ChunkLoadedRecord{.coordinate = decode_coordinate(reader)};
+        break;
+    case RecordType::ChunkUnloaded:
+        record.data = ChunkUnloadedRecord{.coordinate = decode_coordinate(reader)};
+        break;
+    case RecordType::StateHash:
+        record.data = StateHashRecord{.hash = reader.raw<std::uint64_t>()};
+        break;
+    default:
+        reader.ok = false;
+        break;
+    }
+
+    if (!reader.ok) {
+        return std::unexpected(std::format("Corrupt replay record at byte {}", offset));
+    }
+    offset = reader.offset;
+    last_tick = record.tick;
+    return record;
+}
+
+auto hash_simulation_state(const entt::registry &registry) -> std::uint64_t {
+    const auto *pools = registry.ctx().find<const TaskPools>();
+    auto hash = mix(registry.ctx().get<const SimulationTime>().tick);
+
+    // NOTE: Summed so the order of the storages does not matter, only what is in them
+    for (const auto [entity, unit, transform] : registry.view<const UnitId, const Transform>().each()) {
+        auto unit_hash = mix(unit.value);
+        unit_hash = mix(unit_hash ^ std::bit_cast<std::uint32_t>(transform.position.x));
+        unit_hash = mix(unit_hash ^ std::bit_cast<std::uint32_t>(transform.position.y));
+        unit_hash = mix(unit_hash ^ std::bit_cast<std::uint32_t>(transform.position.z));
+        unit_hash = mix(unit_hash ^ static_cast<std::uint64_t>(pools != nullptr && pools->contains(entity)));
+        hash += unit_hash;
+    }
+    return hash;
+}
+
+void ReplayRecorder::record_tick(const entt::registry &registry) {
+    const auto tick = registry.ctx().get<const SimulationTime>().tick;
+    for (const auto &command : registry.ctx().get<const CommandQueue>().get_applied()) {
+        writer.write(ReplayRecord{.tick = tick, .data = command});
+    }
+    writer.write(ReplayRecord{.tick = tick, .data = StateHashRecord{.hash = hash_simulation_state(registry)}});
+
+    if (tick - last_flush >= flush_interval) {
+        last_flush = tick;
+        if (const auto flushed = writer.flush(); !flushed) {
+            log_error("{}", flushed.error());
+        }
+    }
+}
+
+auto start_recording(entt::registry &registry, const std::filesystem::path &path, const ReplayHeader &header)
+    -> Expected<void> {
+    if (registry.ctx().contains<ReplayRecorder>()) {
+        return std::unexpected(std::string{"Already recording"});
+    }
+
+    auto writer = ReplayWriter::open(path, header);
+    if (!writer) {
+        return std::unexpected(writer.error());
+    }
+    registry.ctx().emplace<ReplayRecorder>(std::move(*writer));
+
+    // NOTE: Chunks change between ticks, the replay applies them right before the coming one
+    registry.on_construct<TerrainChunk>().connect<[](entt::registry &registry, entt::entity entity) {
+        if (auto *recorder = registry.ctx().find<ReplayRecorder>()) {
+            const auto &chunk = registry.get<const TerrainChunk>(entity);
+            recorder->record(ReplayRecord{.tick = registry.ctx().get<const SimulationTime>().tick + 1u,
+                                          .data = ChunkLoadedRecord{.coordinate = {chunk.x, chunk.y}}});
+        }
+    }>();
+    registry.on_destroy<TerrainChunk>().connect<[](entt::registry &registry, entt::entity entity) {
+        if (auto *recorder = registry.ctx().find<ReplayRecorder>()) {
+            const auto &chunk = registry.get<const TerrainChunk>(entity);
+            recorder->record(ReplayRecord{.tick = registry.ctx().get<const SimulationTime>().tick + 1u,
+                                          .data = ChunkUnloadedRecord{.coordinate = {chunk.x, chunk.y}}});
+        }
+    }>();
+    return {};
+}
+
+auto play_replay(entt::registry &registry, ReplayReader &reader, const TerrainGenerator &generator,
+                 SystemTimings *timings) -> Expected<ReplayStats> {
+    auto stats = ReplayStats{};
+    auto chunks = std::map<std::pair<std::int64_t, std::int64_t>, entt::entity>{};
+    auto &queue = registry.ctx().get<CommandQueue>();
+
+    auto record = reader.next();
+    while (record && *record) {
+        const auto tick = registry.ctx().get<const SimulationTime>().tick + 1u;
+        if ((*record)->tick < tick) {
+            return std::unexpected(std::format("Replay record for tick {} found after tick {}", (*record)->tick,
+                                               tick - 1u));
+        }
+
+        // Everything stamped with the coming tick except its hash goes in before it runs
+        for (; record && *record && (*record)->tick == tick &&
+               !std::holds_alternative<StateHashRecord>((*record)->data);
+             record = reader.next()) {
+            std::visit(
+                [&](auto &data) {
+                    using data_type = std::decay_t<decltype(data)>;
+                    if constexpr (std::is_same_v<data_type, Command>) {
+                        queue.push(std::move(data));
+                        stats.commands++;
+                    } else if constexpr (std::is_same_v<data_type, ChunkLoadedRecord>) {
+                        const auto chunk = generator.generate_chunk_data(data.coordinate.x, data.coordinate.y);
+                        chunks[{data.coordinate.x, data.coordinate.y}] = generator.register_chunk(registry, chunk);
+                    } else if constexpr (std::is_same_v<data_type, ChunkUnloadedRecord>) {
+                        if (const auto it = chunks.find({data.coordinate.x, data.coordinate.y}); it != chunks.end()) {
+                            registry.ctx().get<TerrainHeightField>().remove_chunk(data.coordinate.x,
+                                                                                 data.coordinate.y);
+                            registry.destroy(it->second);
+                            chunks.erase(it);
+                        }
+                    }
+                },
+                (*record)->data);
+        }
+        // NOTE: The recording ends with the chunks unloaded on exit, there is no tick after them
+        if (!record || !*record) {
+            break;
+        }
+
+        tick_simulation(registry, timings);
+        stats.ticks++;
+
+        if ((*record)->tick == tick && std::holds_alternative<StateHashRecord>((*record)->data)) {
+            if (std::get<StateHashRecord>((*record)->data).hash != hash_simulation_state(registry)) {
+                stats.mismatches++;
+                stats.first_mismatch = stats.first_mismatch.value_or(tick);
+            }
+            record = reader.next();
+        }
+    }
+
+    if (!record) {
+        return std::unexpected(record.error());
+    }
+    return stats;
+}
+
+} // namespace stratgame
@@ -0,0 +1,124 @@
+#pragma once
+#include "commands.hpp"
+#include "error.hpp"
+#include "mapped_file.hpp"
+#include "noise.hpp"
+#include "simulation.hpp"
+#include "terrain.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <entt.hpp>
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <variant>
+#include <vector>
+
+namespace stratgame {
+
+// Everything a replay needs to rebuild the world the recording ran in
+struct ReplayHeader {
+    float tick_rate;
+    NoiseParameters noise;
+    std::uint32_t chunk_size;
+    std::uint32_t chunk_subdivisions;
+    float height_scale;
+};
+
+[[nodiscard]] auto make_replay_header(const TerrainGenerator &generator, float tick_rate) -> ReplayHeader;
+
+// NOTE: Navigation reads the resident terrain, so chunks coming and going are part of a recording
+struct ChunkLoadedRecord {
+    ChunkCoordinate coordinate;
+};
+
+struct ChunkUnloadedRecord {
+    ChunkCoordinate coordinate;
+};
+
+// hash_simulation_state after the tick ran
+struct StateHashRecord {
+    std::uint64_t hash;
+};
+
+// Commands and chunk records are stamped with the tick they are applied before, hashes with the tick they follow
+struct ReplayRecord {
+    std::uint64_t tick;
+    std::variant<Command, ChunkLoadedRecord, ChunkUnloadedRecord, StateHashRecord> data;
+};
+
+// Binary replay log: a fixed header followed by records of a type byte, the tick as a varint delta to the previous
+// record and a type specific payload. Numbers are in native byte order like the chunk cache.
+class ReplayWriter {
+  public:
+    constexpr static std::uint32_t version = 1u;
+
+    [[nodiscard]] static auto open(const std::filesystem::path &path, const ReplayHeader &header)
+        -> Expected<ReplayWriter>;
+
+    void write(const ReplayRecord &record);
+    // Pushes the records buffered by the stream to the file
+    auto flush() -> Expected<void>;
+
+  private:
+    ReplayWriter(std::ofstream out, std::filesystem::path path) : out(std::move(out)), path(std::move(path)) {}
+
+    std::ofstream out;
+    std::filesystem::path path;
+    std::uint64_t last_tick = 0u;
+};
+
+class ReplayReader {
+  public:
+    [[nodiscard]] static auto open(const std::filesystem::path &path) -> Expected<ReplayReader>;
+
+    [[nodiscard]] auto get_header() const -> const ReplayHeader & { return header; }
+    // nullopt at the end of the log
+    [[nodiscard]] auto next() -> Expected<std::optional<ReplayRecord>>;
+
+  private:
+    ReplayReader(MappedFile file, const ReplayHeader &header, std::size_t offset)
+        : file(std::move(file)), header(header), offset(offset) {}
+
+    MappedFile file;
+    ReplayHeader header;
+    std::size_t offset;
+    std::uint64_t last_tick = 0u;
+};
+
+// Order independent hash of the tick, every unit's position and whether it has a task
+[[nodiscard]] auto hash_simulation_state(const entt::registry &registry) -> std::uint64_t;
+
+// Records applied commands, chunk changes and a state hash per tick while it is in registry.ctx()
+class ReplayRecorder {
+  public:
+    explicit ReplayRecorder(ReplayWriter writer) : writer(std::move(writer)) {}
+
+    void record(const ReplayRecord &record) { writer.write(record); }
+    // Applied commands and the state hash of the tick that just ran
+    void record_tick(const entt::registry &registry);
+
+  private:
+    constexpr static std::uint64_t flush_interval = 60u; // ticks, a crash loses at most this much of the recording
+
+    ReplayWriter writer;
+    std::uint64_t last_flush = 0u;
+};
+
+// Starts recording into path, call before the first chunk is registered
+auto start_recording(entt::registry &registry, const std::filesystem::path &path, const ReplayHeader &header)
+    -> Expected<void>;
+
+struct ReplayStats {
+    std::uint64_t ticks = 0u;
+    std::uint64_t commands = 0u;
+    std::uint64_t mismatches = 0u;               // ticks whose state hash differs from the recording
+    std::optional<std::uint64_t> first_mismatch; // tick the simulation diverged at
+};
+
+// Feeds a recording into a registry prepared with setup_simulation(header.tick_rate) and ticks it as fast as
+// possible, chunks are generated on the CPU only
+[[nodiscard]] auto play_replay(entt::registry &registry, ReplayReader &reader, const TerrainGenerator &generator,
+                               SystemTimings *timings = nullptr) -> Expected<ReplayStats>;
+
+} // namespace stratgame
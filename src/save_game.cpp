@@ -0,0 +1,742 @@
+#include "save_game.hpp"
+#include "commands.hpp"
+#include "common_components.hpp"
+#include "flow_field.hpp"
+#include "height_field.hpp"
+#include "log.hpp"
+#include "mapped_file.hpp"
+#include "minion.hpp"
+#include "selection.hpp"
+#include "simulation.hpp"
+#include "spatial_grid.hpp"
+#include "thread_pool.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <format>
+#include <fstream>
+#include <functional>
+#include <span>
+#include <thread>
+#include <type_traits>
+
+#ifdef STRATGAME_LZ4
+#include <lz4.h>
+#endif
+
+namespace stratgame {
+
+namespace {
+
+constexpr auto save_magic = std::uint32_t{0x56534753u}; // "SGSV"
+constexpr auto save_version = std::uint32_t{1u};
+constexpr auto save_block_size = std::size_t{64u * 1024u};
+
+struct SaveFileHeader {
+    std::uint32_t magic;
+    std::uint32_t version;
+    float tick_rate;
+    float frequency;
+    float amplitude;
+    float lacunarity;
+    float persistence;
+    std::uint32_t octaves;
+    std::uint32_t chunk_size;
+    std::uint32_t chunk_subdivisions;
+    float height_scale;
+    SaveCompression compression;
+    std::uint64_t tick;
+    std::uint64_t payload_size; // before compression
+    std::uint32_t unit_ids;
+    std::uint32_t reserved;
+};
+static_assert(std::is_trivially_copyable_v<SaveFileHeader>);
+static_assert(sizeof(SaveFileHeader) == 72u, "the header is written as raw bytes and must not contain padding");
+
+// Precedes every block of the payload, stored_size equals size when the block is not compressed
+struct BlockHeader {
+    std::uint32_t size;
+    std::uint32_t stored_size;
+};
+static_assert(sizeof(BlockHeader) == 8u);
+
+// NOTE: Written and restored in this order. GridIndexed inserts into the SpatialGrid and needs Transform, Minion comes
+// after every other component so its hooks find them already there.
+using saved_pools = entt::type_list<Transform, Movement, BaseStats, Selectable, GridIndexed, UnitId, TaskQueue, Minion,
+                                    Selected, SavedTask>;
+
+template <typename... Type, typename Func> void for_each_pool(entt::type_list<Type...>, Func &&func) {
+    (func(std::type_identity<Type>{}), ...);
+}
+
+// Collects the payload and writes it out one block at a time, the whole payload is never in memory at once
+class BlockWriter {
+  public:
+    BlockWriter(std::ofstream &out, const SaveCompression compression) : out(out), compression(compression) {
+        block.reserve(save_block_size);
+    }
+
+    void write(const void *data, std::size_t size) {
+        const auto *bytes = static_cast<const std::byte *>(data);
+        written += size;
+        while (size > 0u) {
+            const auto count = std::min(size, save_block_size - block.size());
+            block.insert(block.end(), bytes, bytes + count);
+            bytes += count;
+            size -= count;
+            if (block.size() == save_block_size) {
+                flush();
+            }
+        }
+    }
+
+    template <typename T> void raw(const T &value) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        write(&value, sizeof(T));
+    }
+
+    // Writes out the block filled so far
+    void flush() {
+        if (block.empty()) {
+            return;
+        }
+
+        auto header = BlockHeader{.size = static_cast<std::uint32_t>(block.size()),
+                                  .stored_size = static_cast<std::uint32_t>(block.size())};
+        const auto *stored = reinterpret_cast<const char *>(block.data());
+#ifdef STRATGAME_LZ4
+        if (compression == SaveCompression::Lz4) {
+            const auto size = static_cast<int>(block.size());
+            compressed.resize(static_cast<std::size_t>(LZ4_compressBound(size)));
+            const auto compressed_size =
+                LZ4_compress_default(stored, compressed.data(), size, static_cast<int>(compressed.size()));
+            // NOTE: A block that does not shrink is stored as it is, 0 means compressing failed
+            if (compressed_size > 0 && compressed_size < size) {
+                header.stored_size = static_cast<std::uint32_t>(compressed_size);
+                stored = compressed.data();
+            }
+        }
+#endif
+        out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        out.write(stored, header.stored_size);
+        block.clear();
+    }
+
+    [[nodiscard]] auto get_written() const -> std::uint64_t { return written; }
+
+  private:
+    std::ofstream &out;
+    [[maybe_unused]] SaveCompression compression;
+    std::vector<std::byte> block;
+    std::vector<char> compressed;
+    std::uint64_t written = 0u;
+};
+
+// Reads the payload back one block at a time, reads past the end set ok to false
+class BlockReader {
+  public:
+    BlockReader(const std::span<const std::byte> bytes, const std::size_t offset, const std::uint64_t payload_size)
+        : bytes(bytes), offset(offset), remaining(payload_size) {}
+
+    void read(void *data, std::size_t size) {
+        auto *out = static_cast<std::byte *>(data);
+        if (size > remaining) {
+            ok = false;
+            return;
+        }
+        remaining -= size;
+        while (size > 0u) {
+            if (position == current.size() && !next_block()) {
+                ok = false;
+                return;
+            }
+            const auto count = std::min(size, current.size() - position);
+            std::memcpy(out, current.data() + position, count);
+            out += count;
+            size -= count;
+            position += count;
+        }
+    }
+
+    template <typename T> auto raw() -> T {
+        static_assert(std::is_trivially_copyable_v<T>);
+        auto value = T{};
+        read(&value, sizeof(T));
+        return value;
+    }
+
+    // Payload bytes not read yet
+    [[nodiscard]] auto get_remaining() const -> std::uint64_t { return remaining; }
+    // Whether every block of the file was read
+    [[nodiscard]] auto at_end() const -> bool { return offset == bytes.size() && position == current.size(); }
+
+    bool ok = true;
+
+  private:
+    std::span<const std::byte> bytes;
+    std::size_t offset;
+    std::uint64_t remaining;
+    std::span<const std::byte> current; // the block being read, points into the file unless it was compressed
+    std::size_t position = 0u;
+    std::vector<std::byte> decompressed;
+
+    auto next_block() -> bool {
+        auto header = BlockHeader{};
+        if (bytes.size() - offset < sizeof(header)) {
+            return false;
+        }
+        std::memcpy(&header, bytes.data() + offset, sizeof(header));
+        offset += sizeof(header);
+        if (header.size == 0u || header.size > save_block_size || header.stored_size > header.size ||
+            header.stored_size > bytes.size() - offset) {
+            return false;
+        }
+
+        const auto stored = bytes.subspan(offset, header.stored_size);
+        offset += header.stored_size;
+        position = 0u;
+        if (header.stored_size == header.size) {
+            current = stored;
+            return true;
+        }
+#ifdef STRATGAME_LZ4
+        decompressed.resize(header.size);
+        const auto size = LZ4_decompress_safe(reinterpret_cast<const char *>(stored.data()),
+                                              reinterpret_cast<char *>(decompressed.data()),
+                                              static_cast<int>(stored.size()), static_cast<int>(header.size));
+        current = decompressed;
+        return size == static_cast<int>(header.size);
+#else
+        return false;
+#endif
+    }
+};
+
+template <typename T>
+    requires std::is_trivially_copyable_v<T>
+void encode(BlockWriter &writer, const T &component) {
+    writer.raw(component);
+}
+
+// NOTE: The flow field is kept as a marker only, restoring asks the cache for a new one
+void encode(BlockWriter &writer, const WalkToTask &task) {
+    writer.raw(task.target);
+    writer.raw(task.speed);
+    writer.raw(task.flow_field);
+    writer.raw(task.next_waypoint);
+    writer.raw(task.arrive_radius);
+    writer.raw(static_cast<std::uint32_t>(task.waypoints.size()));
+    writer.write(task.waypoints.data(), task.waypoints.size() * sizeof(Vector2));
+}
+
+void encode(BlockWriter &writer, const Task &task) {
+    writer.raw(static_cast<std::uint8_t>(task.index()));
+    std::visit([&](const auto &alternative) { encode(writer, alternative); }, task);
+}
+
+void encode(BlockWriter &writer, const TaskQueue &queue) {
+    // NOTE: Queued tasks are only reachable through pop_task, a copy is drained
+    auto copy = queue;
+    writer.raw(static_cast<std::uint8_t>(copy.size()));
+    while (const auto task = copy.pop_task()) {
+        encode(writer, *task);
+    }
+}
+
+void encode(BlockWriter &writer, const SavedTask &saved) { encode(writer, saved.task); }
+
+template <typename T>
+    requires std::is_trivially_copyable_v<T>
+void decode(BlockReader &reader, T &component) {
+    component = reader.raw<T>();
+}
+
+void decode(BlockReader &reader, WalkToTask &task) {
+    task.target = reader.raw<Vector2>();
+    task.speed = reader.raw<float>();
+    task.flow_field = reader.raw<FlowFieldId>();
+    task.next_waypoint = reader.raw<std::uint32_t>();
+    task.arrive_radius = reader.raw<float>();
+    const auto count = reader.raw<std::uint32_t>();
+    // NOTE: Checked against the payload left so a corrupt count cannot allocate gigabytes
+    if (count > reader.get_remaining() / sizeof(Vector2)) {
+        reader.ok = false;
+        return;
+    }
+    task.waypoints.resize(count);
+    reader.read(task.waypoints.data(), count * sizeof(Vector2));
+}
+
+void decode(BlockReader &reader, Task &task) {
+    const auto index = reader.raw<std::uint8_t>();
+    if (index >= std::variant_size_v<Task>) {
+        reader.ok = false;
+        return;
+    }
+    [&]<std::size_t... I>(std::index_sequence<I...>) {
+        ((index == I ? decode(reader, task.emplace<I>()) : void()), ...);
+    }(std::make_index_sequence<std::variant_size_v<Task>>{});
+}
+
+void decode(BlockReader &reader, TaskQueue &queue) {
+    const auto count = reader.raw<std::uint8_t>();
+    if (count > TaskQueue::capacity) {
+        reader.ok = false;
+        return;
+    }
+    for (auto i = 0u; i < count && reader.ok; i++) {
+        auto task = Task{};
+        decode(reader, task);
+        static_cast<void>(queue.append_task(std::move(task)));
+    }
+}
+
+void decode(BlockReader &reader, SavedTask &saved) { decode(reader, saved.task); }
+
+// Archive entt::snapshot writes through
+struct OutputArchive {
+    BlockWriter &writer;
+
+    void operator()(const std::uint32_t count) { writer.raw(count); }
+    void operator()(const entt::entity entity) { writer.raw(entity); }
+    template <typename T> void operator()(const T &component) { encode(writer, component); }
+};
+
+// Reads a pool written by entt::snapshot::get and adds it to units with a single insert. entities maps the saved
+// entities to the ones in units.
+template <typename T>
+void read_pool(BlockReader &reader, entt::registry &units, const std::span<const entt::entity> entities) {
+    const auto count = reader.raw<std::uint32_t>();
+    if (count > entities.size()) {
+        reader.ok = false;
+        return;
+    }
+
+    auto owners = std::vector<entt::entity>(count);
+    auto values = std::vector<T>(std::is_empty_v<T> ? 0u : count);
+    auto seen = std::vector<std::uint8_t>(entities.size(), 0u);
+    for (auto i = 0u; i < count && reader.ok; i++) {
+        const auto index = static_cast<std::size_t>(entt::to_entity(reader.raw<entt::entity>()));
+        if (index >= entities.size() || entities[index] == entt::null || seen[index] != 0u) {
+            reader.ok = false;
+            return;
+        }
+        seen[index] = 1u;
+        owners[i] = entities[index];
+        if constexpr (!std::is_empty_v<T>) {
+            decode(reader, values[i]);
+        }
+    }
+    if (!reader.ok) {
+        return;
+    }
+
+    if constexpr (std::is_empty_v<T>) {
+        units.insert<T>(owners.begin(), owners.end());
+    } else {
+        units.insert<T>(owners.begin(), owners.end(), values.begin());
+    }
+}
+
+// Copies the T of every unit that has one, to_copy maps the index of a live entity to its snapshot entity.
+// NOTE: In packed order, systems like avoidance walk their storage in that order and a restored game has to as well
+template <typename T>
+void copy_pool(const entt::registry &registry, const std::span<const entt::entity> to_copy, entt::registry &snapshot) {
+    const auto *storage = registry.storage<T>();
+    if (storage == nullptr || storage->empty()) {
+        return;
+    }
+
+    auto &copy = snapshot.storage<T>();
+    const auto *entities = storage->data();
+    for (auto k = std::size_t{0}; k < storage->size(); k++) {
+        const auto index = static_cast<std::size_t>(entt::to_entity(entities[k]));
+        if (index >= to_copy.size() || to_copy[index] == entt::null) {
+            continue;
+        }
+        if constexpr (std::is_empty_v<T>) {
+            copy.emplace(to_copy[index]);
+        } else {
+            copy.emplace(to_copy[index], storage->get(entities[k]));
+        }
+    }
+}
+
+auto is_same_world(const ReplayHeader &a, const ReplayHeader &b) -> bool {
+    return a.tick_rate == b.tick_rate && a.noise.frequency == b.noise.frequency &&
+           a.noise.amplitude == b.noise.amplitude && a.noise.lacunarity == b.noise.lacunarity &&
+           a.noise.persistence == b.noise.persistence && a.noise.octaves == b.noise.octaves &&
+           a.chunk_size == b.chunk_size && a.chunk_subdivisions == b.chunk_subdivisions &&
+           a.height_scale == b.height_scale;
+}
+
+void restore_teams(entt::registry &registry, const std::vector<std::pair<int, Color>> &teams) {
+    const auto maps = registry.view<team_color_map>();
+    if (maps.empty() && teams.empty()) {
+        return;
+    }
+    auto &colors = maps.empty() ? registry.emplace<team_color_map>(registry.create())
+                                : registry.get<team_color_map>(maps.front());
+    colors = team_color_map(teams.begin(), teams.end());
+}
+
+void encode(BlockWriter &writer, const FlowFieldCacheState &state) {
+    writer.raw(static_cast<std::uint32_t>(state.slots.size()));
+    for (const auto &slot : state.slots) {
+        writer.raw(static_cast<std::uint8_t>(slot.window.has_value()));
+        if (slot.window) {
+            writer.raw(*slot.window);
+        }
+        writer.raw(slot.generation);
+        writer.raw(slot.last_used);
+    }
+    writer.raw(static_cast<std::uint32_t>(state.free_slots.size()));
+    writer.write(state.free_slots.data(), state.free_slots.size() * sizeof(std::uint32_t));
+}
+
+void decode(BlockReader &reader, FlowFieldCacheState &state) {
+    constexpr auto min_slot_size = sizeof(std::uint8_t) + sizeof(std::uint32_t) + sizeof(std::uint64_t);
+    const auto slot_count = reader.raw<std::uint32_t>();
+    if (slot_count > reader.get_remaining() / min_slot_size) {
+        reader.ok = false;
+        return;
+    }
+    state.slots.resize(slot_count);
+    for (auto &slot : state.slots) {
+        if (reader.raw<std::uint8_t>() != 0u) {
+            slot.window = reader.raw<FlowFieldWindow>();
+        }
+        slot.generation = reader.raw<std::uint32_t>();
+        slot.last_used = reader.raw<std::uint64_t>();
+    }
+
+    const auto free_count = reader.raw<std::uint32_t>();
+    if (free_count > slot_count) {
+        reader.ok = false;
+        return;
+    }
+    state.free_slots.resize(free_count);
+    reader.read(state.free_slots.data(), free_count * sizeof(std::uint32_t));
+    // NOTE: A slot handed out twice would give two orders the same field
+    auto is_free = std::vector<std::uint8_t>(slot_count, 0u);
+    for (const auto slot : state.free_slots) {
+        if (slot >= slot_count || state.slots[slot].window || is_free[slot] != 0u) {
+            reader.ok = false;
+            return;
+        }
+        is_free[slot] = 1u;
+    }
+}
+
+} // namespace
+
+auto take_world_snapshot(const entt::registry &registry, const ReplayHeader &world) -> WorldSnapshot {
+    auto snapshot = WorldSnapshot{.world = world,
+                                  .tick = registry.ctx().get<const SimulationTime>().tick,
+                                  .unit_ids = registry.ctx().get<const CommandQueue>().get_unit_count(),
+                                  .teams = {},
+                                  .flow_fields = {},
+                                  .units = {}};
+
+    if (const auto maps = registry.view<const team_color_map>(); !maps.empty()) {
+        const auto &colors = registry.get<const team_color_map>(maps.front());
+        snapshot.teams.assign(colors.begin(), colors.end());
+        std::ranges::sort(snapshot.teams, {}, &std::pair<int, Color>::first);
+    }
+
+    if (const auto *cache = registry.ctx().find<const FlowFieldCache>()) {
+        snapshot.flow_fields = cache->get_state();
+    }
+
+    const auto minions = registry.view<const Minion>();
+    const auto units = std::vector<entt::entity>(minions.begin(), minions.end());
+    auto copies = std::vector<entt::entity>(units.size());
+    snapshot.units.create(copies.begin(), copies.end());
+    auto to_copy = std::vector<entt::entity>(registry.storage<entt::entity>()->size(), entt::entity{entt::null});
+    for (auto i = 0u; i < units.size(); i++) {
+        to_copy[static_cast<std::size_t>(entt::to_entity(units[i]))] = copies[i];
+    }
+    for_each_pool(saved_pools{}, [&]<typename T>(std::type_identity<T>) {
+        if constexpr (!std::is_same_v<T, SavedTask>) {
+            copy_pool<T>(registry, to_copy, snapshot.units);
+        }
+    });
+
+    // NOTE: In slot order for the same reason as copy_pool, update_tasks runs the pools in blocks
+    if (const auto *pools = registry.ctx().find<const TaskPools>()) {
+        auto &tasks = snapshot.units.storage<SavedTask>();
+        pools->for_each_task([&](const entt::entity entity, Task task) {
+            const auto index = static_cast<std::size_t>(entt::to_entity(entity));
+            if (index < to_copy.size() && to_copy[index] != entt::null) {
+                tasks.emplace(to_copy[index], SavedTask{.task = std::move(task)});
+            }
+        });
+    }
+    return snapshot;
+}
+
+auto write_world_snapshot(const WorldSnapshot &snapshot, const std::filesystem::path &path,
+                          SaveCompression compression) -> Expected<void> {
+#ifndef STRATGAME_LZ4
+    // NOTE: Built without LZ4, every block is stored as it is
+    compression = SaveCompression::None;
+#endif
+    auto error = std::error_code{};
+    if (path.has_parent_path()) {
+        std::filesystem::create_directories(path.parent_path(), error);
+    }
+    auto temporary = path;
+    temporary += std::format(".{:x}.tmp", std::hash<std::thread::id>{}(std::this_thread::get_id()));
+
+    auto header = SaveFileHeader{.magic = save_magic,
+                                 .version = save_version,
+                                 .tick_rate = snapshot.world.tick_rate,
+                                 .frequency = snapshot.world.noise.frequency,
+                                 .amplitude = snapshot.world.noise.amplitude,
+                                 .lacunarity = snapshot.world.noise.lacunarity,
+                                 .persistence = snapshot.world.noise.persistence,
+                                 .octaves = snapshot.world.noise.octaves,
+                                 .chunk_size = snapshot.world.chunk_size,
+                                 .chunk_subdivisions = snapshot.world.chunk_subdivisions,
+                                 .height_scale = snapshot.world.height_scale,
+                                 .compression = compression,
+                                 .tick = snapshot.tick,
+                                 .payload_size = 0u,
+                                 .unit_ids = snapshot.unit_ids,
+                                 .reserved = 0u};
+
+    auto written = false;
+    {
+        auto out = std::ofstream{temporary, std::ios::binary | std::ios::trunc};
+        // NOTE: Written again once the payload size is known
+        out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+
+        auto writer = BlockWriter{out, compression};
+        writer.raw(static_cast<std::uint32_t>(snapshot.teams.size()));
+        for (const auto &[team, color] : snapshot.teams) {
+            writer.raw(team);
+            writer.raw(color);
+        }
+        encode(writer, snapshot.flow_fields);
+
+        auto archive = OutputArchive{.writer = writer};
+        const auto entity_snapshot = entt::snapshot{snapshot.units};
+        entity_snapshot.get<entt::entity>(archive);
+        for_each_pool(saved_pools{}, [&]<typename T>(std::type_identity<T>) { entity_snapshot.get<T>(archive); });
+        writer.flush();
+
+        header.payload_size = writer.get_written();
+        out.seekp(0);
+        out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        out.close();
+        written = static_cast<bool>(out);
+    }
+
+    if (written) {
+        std::filesystem::rename(temporary, path, error);
+    }
+    if (!written || error) {
+        std::filesystem::remove(temporary, error);
+        return std::unexpected(std::format("Could not write {}", path.string()));
+    }
+    return {};
+}
+
+auto read_world_snapshot(const std::filesystem::path &path) -> Expected<WorldSnapshot> {
+    const auto mapped = MappedFile::open(path);
+    if (!mapped) {
+        return std::unexpected(mapped.error());
+    }
+
+    const auto bytes = mapped->get_bytes();
+    auto header = SaveFileHeader{};
+    if (bytes.size() < sizeof(header)) {
+        return std::unexpected(std::format("Truncated save game {}", path.string()));
+    }
+    std::memcpy(&header, bytes.data(), sizeof(header));
+    if (header.magic != save_magic || header.version != save_version) {
+        return std::unexpected(std::format("{} is not a version {} save game", path.string(), save_version));
+    }
+#ifndef STRATGAME_LZ4
+    if (header.compression == SaveCompression::Lz4) {
+        return std::unexpected(
+            std::format("{} is compressed with LZ4, which this build does not support", path.string()));
+    }
+#endif
+
+    auto snapshot = WorldSnapshot{.world = ReplayHeader{.tick_rate = header.tick_rate,
+                                                        .noise = NoiseParameters{.frequency = header.frequency,
+                                                                                 .amplitude = header.amplitude,
+                                                                                 .lacunarity = header.lacunarity,
+                                                                                 .persistence = header.persistence,
+                                                                                 .octaves = header.octaves},
+                                                        .chunk_size = header.chunk_size,
+                                                        .chunk_subdivisions = header.chunk_subdivisions,
+                                                        .height_scale = header.height_scale},
+                                  .tick = header.tick,
+                                  .unit_ids = header.unit_ids,
+                                  .teams = {},
+                                  .flow_fields = {},
+                                  .units = {}};
+
+    auto reader = BlockReader{bytes, sizeof(header), header.payload_size};
+    const auto team_count = reader.raw<std::uint32_t>();
+    if (team_count > reader.get_remaining() / (sizeof(int) + sizeof(Color))) {
+        reader.ok = false;
+    }
+    for (auto i = 0u; i < team_count && reader.ok; i++) {
+        const auto team = reader.raw<int>();
+        snapshot.teams.emplace_back(team, reader.raw<Color>());
+    }
+    if (reader.ok) {
+        decode(reader, snapshot.flow_fields);
+    }
+
+    // Only the entities in use are created again, the table maps the saved ones to them
+    const auto size = reader.raw<std::uint32_t>();
+    const auto in_use = reader.raw<std::uint32_t>();
+    if (size > reader.get_remaining() / sizeof(entt::entity) || in_use > size) {
+        reader.ok = false;
+    }
+    auto entities = std::vector<entt::entity>{};
+    if (reader.ok) {
+        auto saved = std::vector<entt::entity>(size);
+        reader.read(saved.data(), saved.size() * sizeof(entt::entity));
+        auto created = std::vector<entt::entity>(in_use);
+        snapshot.units.create(created.begin(), created.end());
+        entities.resize(size, entt::entity{entt::null});
+        for (auto i = 0u; i < in_use; i++) {
+            const auto index = static_cast<std::size_t>(entt::to_entity(saved[i]));
+            if (index >= size) {
+                reader.ok = false;
+                break;
+            }
+            entities[index] = created[i];
+        }
+    }
+
+    for_each_pool(saved_pools{}, [&]<typename T>(std::type_identity<T>) {
+        if (reader.ok) {
+            read_pool<T>(reader, snapshot.units, entities);
+        }
+    });
+
+    if (!reader.ok || reader.get_remaining() != 0u || !reader.at_end()) {
+        return std::unexpected(std::format("Corrupt save game {}", path.string()));
+    }
+    return snapshot;
+}
+
+auto restore_world_snapshot(entt::registry &registry, const WorldSnapshot &snapshot, const ReplayHeader &world)
+    -> Expected<void> {
+    if (!is_same_world(snapshot.world, world)) {
+        return std::unexpected(std::string{"The save game was made on a different world"});
+    }
+
+    // NOTE: Their destroy hooks drop the tasks, grid entries and instances of the units being replaced
+    const auto minions = registry.view<const Minion>();
+    const auto replaced = std::vector<entt::entity>(minions.begin(), minions.end());
+    registry.destroy(replaced.begin(), replaced.end());
+
+    registry.ctx().get<SimulationTime>().tick = snapshot.tick;
+    registry.ctx().get<CommandQueue>().reset_units(snapshot.unit_ids);
+    restore_teams(registry, snapshot.teams);
+    // NOTE: Before the tasks, their FlowFieldIds point into the restored slots
+    registry.ctx().get<FlowFieldCache>().restore_state(registry.ctx().find<const TerrainHeightField>(),
+                                                       snapshot.flow_fields);
+
+    // The snapshot entities only index this table of new ones
+    const auto &saved = *snapshot.units.storage<entt::entity>();
+    auto created = std::vector<entt::entity>(saved.free_list());
+    registry.create(created.begin(), created.end());
+    auto to_live = std::vector<entt::entity>(saved.size(), entt::entity{entt::null});
+    auto next = created.begin();
+    for (const auto [entity] : saved.each()) {
+        to_live[static_cast<std::size_t>(entt::to_entity(entity))] = *next++;
+    }
+
+    auto entities = std::vector<entt::entity>{};
+    for_each_pool(saved_pools{}, [&]<typename T>(std::type_identity<T>) {
+        const auto *storage = snapshot.units.storage<T>();
+        if (storage == nullptr || storage->empty()) {
+            return;
+        }
+
+        // NOTE: In packed order like copy_pool, the reverse iterators of a storage walk its components that way
+        entities.clear();
+        const auto *saved_entities = storage->data();
+        for (auto k = std::size_t{0}; k < storage->size(); k++) {
+            entities.push_back(to_live[static_cast<std::size_t>(entt::to_entity(saved_entities[k]))]);
+        }
+
+        if constexpr (std::is_same_v<T, Selected>) {
+            // NOTE: Through the selection so the restored units are recoloured like after any other change
+            apply_selection(registry, entities, false);
+        } else if constexpr (std::is_same_v<T, SavedTask>) {
+            // NOTE: Tasks live in TaskPools rather than in a component pool
+            auto saved_task = storage->rbegin();
+            for (const auto entity : entities) {
+                add_task(registry, entity, (saved_task++)->task);
+            }
+        } else if constexpr (std::is_empty_v<T>) {
+            registry.insert<T>(entities.begin(), entities.end());
+        } else {
+            registry.insert<T>(entities.begin(), entities.end(), storage->rbegin());
+        }
+    });
+    return {};
+}
+
+auto SaveGameWriter::save(entt::registry &registry, const std::filesystem::path &path) -> bool {
+    if (pending.valid()) {
+        if (pending.wait_for(std::chrono::seconds{0}) != std::future_status::ready) {
+            return false;
+        }
+        report();
+    }
+
+    pending_path = path;
+    pending = registry.ctx().get<ThreadPool>().submit(
+        [snapshot = take_world_snapshot(registry, world), path, compression = compression] {
+            return write_world_snapshot(snapshot, path, compression);
+        });
+    return true;
+}
+
+void SaveGameWriter::update(entt::registry &registry) {
+    if (pending.valid() && pending.wait_for(std::chrono::seconds{0}) == std::future_status::ready) {
+        report();
+    }
+
+    // NOTE: Counted from the first update, a game that was just loaded is not saved again right away
+    const auto tick = registry.ctx().get<const SimulationTime>().tick;
+    if (!last_autosave || tick < *last_autosave) {
+        last_autosave = tick;
+    }
+    if (autosave_interval != 0u && tick - *last_autosave >= autosave_interval && save(registry, autosave_path)) {
+        last_autosave = tick;
+    }
+}
+
+void SaveGameWriter::wait() {
+    if (pending.valid()) {
+        pending.wait();
+        report();
+    }
+}
+
+void SaveGameWriter::report() {
+    if (const auto saved = pending.get(); !saved) {
+        log_error("{}", saved.error());
+    } else {
+        log_info("Saved {}", pending_path.string());
+    }
+}
+
+void update_save_games(entt::registry &registry) {
+    if (auto *writer = registry.ctx().find<SaveGameWriter>()) {
+        writer->update(registry);
+    }
+}
+
+} // namespace stratgame
@@ -0,0 +1,93 @@
+#pragma once
+#include "error.hpp"
+#include "flow_field.hpp"
+#include "replay.hpp"
+#include "tasks.hpp"
+#include <cstdint>
+#include <entt.hpp>
+#include <filesystem>
+#include <future>
+#include <optional>
+#include <raylib.h>
+#include <utility>
+#include <vector>
+
+namespace stratgame {
+
+enum class SaveCompression : std::uint32_t { None = 0u, Lz4 = 1u };
+
+// Current task of a unit in WorldSnapshot::units, the live registry keeps them in TaskPools instead
+struct SavedTask {
+    Task task;
+};
+
+// Copy of everything a save game holds, detached from the live registry so it can be encoded on another thread.
+// units has no hooks and only holds the saved components of the units, its entities are unrelated to the live ones.
+struct WorldSnapshot {
+    ReplayHeader world; // the terrain is generated again from this rather than saved
+    std::uint64_t tick = 0u;
+    std::uint32_t unit_ids = 0u; // UnitIds handed out so far, new units continue after them
+    std::vector<std::pair<int, Color>> teams;
+    FlowFieldCacheState flow_fields; // rebuilt on restore, the tasks keep their FlowFieldIds
+    entt::registry units;
+};
+
+// Copies the units, their tasks, the team colours and the flow field windows. Only plain copies, this is the part of a
+// save that has to run on the thread owning the registry.
+[[nodiscard]] auto take_world_snapshot(const entt::registry &registry, const ReplayHeader &world) -> WorldSnapshot;
+
+// Binary save game: a fixed header followed by the payload in blocks of at most save_block_size bytes, each one
+// compressed with LZ4 when that makes it smaller. The payload is the team colours and flow field windows followed by
+// an entt::snapshot of WorldSnapshot::units, numbers are in native byte order like the chunk cache.
+// Streamed through a temporary file so a crash never leaves a partial save behind, safe to call from any thread.
+[[nodiscard]] auto write_world_snapshot(const WorldSnapshot &snapshot, const std::filesystem::path &path,
+                                        SaveCompression compression) -> Expected<void>;
+[[nodiscard]] auto read_world_snapshot(const std::filesystem::path &path) -> Expected<WorldSnapshot>;
+
+// Replaces the units of a registry prepared with setup_simulation with the ones in snapshot. Every component pool is
+// added with one bulk insert, Minion last so its hooks find the rest already there. Fails without touching registry
+// when the snapshot was taken on a different world.
+auto restore_world_snapshot(entt::registry &registry, const WorldSnapshot &snapshot, const ReplayHeader &world)
+    -> Expected<void>;
+
+// Writes save games on the ThreadPool, lives in registry.ctx(). Only take_world_snapshot runs on the calling thread,
+// so saving does not hold up the frame.
+class SaveGameWriter {
+  public:
+    constexpr static std::uint64_t default_autosave_interval = 3600u; // ticks, a minute at the default tick rate
+
+    SaveGameWriter(const ReplayHeader &world, std::filesystem::path autosave_path,
+                   std::uint64_t autosave_interval = default_autosave_interval,
+                   SaveCompression compression = SaveCompression::Lz4)
+        : world(world), autosave_path(std::move(autosave_path)), autosave_interval(autosave_interval),
+          compression(compression) {}
+    SaveGameWriter(const SaveGameWriter &) = delete;
+    SaveGameWriter(SaveGameWriter &&) = default;
+    auto operator=(const SaveGameWriter &) -> SaveGameWriter & = delete;
+    auto operator=(SaveGameWriter &&) -> SaveGameWriter & = default;
+    ~SaveGameWriter() { wait(); }
+
+    // Starts writing a save to path, false while the previous one is still being written
+    auto save(entt::registry &registry, const std::filesystem::path &path) -> bool;
+    // Reports finished saves and starts an autosave once the interval passed, call once per frame
+    void update(entt::registry &registry);
+    // Blocks until the save being written is done
+    void wait();
+
+  private:
+    ReplayHeader world;
+    std::filesystem::path autosave_path;
+    std::uint64_t autosave_interval;
+    SaveCompression compression;
+    std::optional<std::uint64_t> last_autosave;
+
+    std::future<Expected<void>> pending;
+    std::filesystem::path pending_path;
+
+    void report();
+};
+
+// Calls SaveGameWriter::update
+void update_save_games(entt::registry &registry);
+
+} // namespace stratgame
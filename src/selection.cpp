@@ -0,0 +1,239 @@
+#include "selection.hpp"
+#include "camera.hpp"
+#include "commands.hpp"
+#include "common_components.hpp"
+#include "height_field.hpp"
+#include "minion.hpp"
+#include "spatial_grid.hpp"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+#include <raymath.h>
+
+namespace stratgame {
+constexpr static auto max_select_distance = 1000.f; // along the view direction, same as a click pick
+constexpr static auto unit_height_margin = 1.f;     // units stand on the terrain, their center is a bit above it
+constexpr static auto slab_tolerance = 0.01f;
+
+void setup_selection(entt::registry &registry) {
+    registry.ctx().emplace<SelectionState>();
+    static_cast<void>(registry.storage<Selected>());
+}
+
+static void grow_to(std::vector<std::uint8_t> &flags, const entt::entity entity) {
+    const auto index = static_cast<std::size_t>(entt::to_entity(entity));
+    if (index >= flags.size()) {
+        flags.resize(index + 1u, 0u);
+    }
+}
+
+static void mark_changed(SelectionState &state, const entt::entity entity) {
+    grow_to(state.is_changed, entity);
+    auto &is_changed = state.is_changed[static_cast<std::size_t>(entt::to_entity(entity))];
+    if (is_changed == 0u) {
+        is_changed = 1u;
+        state.changed.push_back(entity);
+    }
+}
+
+void apply_selection(entt::registry &registry, const std::span<const entt::entity> entities, const bool add) {
+    auto &state = registry.ctx().get<SelectionState>();
+    auto &selected = registry.storage<Selected>();
+    auto &requested = state.is_requested;
+    for (const auto entity : entities) {
+        grow_to(requested, entity);
+        requested[static_cast<std::size_t>(entt::to_entity(entity))] = 1u;
+    }
+    const auto is_requested = [&](const entt::entity entity) {
+        const auto index = static_cast<std::size_t>(entt::to_entity(entity));
+        return index < requested.size() && requested[index] != 0u;
+    };
+
+    // NOTE: Collected first, the storage must not change while it is iterated
+    state.scratch.clear();
+    if (!add) {
+        for (const auto entity : selected) {
+            if (!is_requested(entity)) {
+                state.scratch.push_back(entity);
+            }
+        }
+        registry.erase<Selected>(state.scratch.begin(), state.scratch.end());
+        for (const auto entity : state.scratch) {
+            mark_changed(state, entity);
+        }
+        state.scratch.clear();
+    }
+
+    for (const auto entity : entities) {
+        auto &flag = requested[static_cast<std::size_t>(entt::to_entity(entity))];
+        // NOTE: Cleared on the first visit, so an entity listed twice is only inserted once
+        if (flag != 0u && !selected.contains(entity)) {
+            state.scratch.push_back(entity);
+        }
+        flag = 0u;
+    }
+    registry.insert<Selected>(state.scratch.begin(), state.scratch.end());
+    for (const auto entity : state.scratch) {
+        mark_changed(state, entity);
+    }
+}
+
+void clear_selection_changes(entt::registry &registry) {
+    auto &state = registry.ctx().get<SelectionState>();
+    for (const auto entity : state.changed) {
+        state.is_changed[static_cast<std::size_t>(entt::to_entity(entity))] = 0u;
+    }
+    state.changed.clear();
+}
+
+auto find_units_in_rect(const entt::registry &registry, const Camera3D &camera, const Rectangle rect,
+                        const Vector2 screen_size) -> std::vector<std::uint32_t> {
+    const auto forward = Vector3Normalize(Vector3Subtract(camera.target, camera.position));
+    const auto right = Vector3Normalize(Vector3CrossProduct(forward, camera.up));
+    const auto up = Vector3CrossProduct(right, forward);
+
+    // The rect as slopes of the view space x and y over the depth, the same perspective raylib draws with
+    const auto tan_half_fovy = std::tan(camera.fovy * DEG2RAD * 0.5f);
+    const auto tan_half_fovx = tan_half_fovy * screen_size.x / screen_size.y;
+    const auto min_x = (2.f * rect.x / screen_size.x - 1.f) * tan_half_fovx;
+    const auto max_x = (2.f * (rect.x + rect.width) / screen_size.x - 1.f) * tan_half_fovx;
+    const auto min_y = (1.f - 2.f * (rect.y + rect.height) / screen_size.y) * tan_half_fovy;
+    const auto max_y = (1.f - 2.f * rect.y / screen_size.y) * tan_half_fovy;
+
+    // Corner rays of the rect, scaled to advance one unit of depth per unit of t
+    const auto corner = [&](const float x, const float y) {
+        return Vector3Add(forward, Vector3Add(Vector3Scale(right, x), Vector3Scale(up, y)));
+    };
+    const auto corners = std::array{corner(min_x, min_y), corner(max_x, min_y), corner(min_x, max_y),
+                                    corner(max_x, max_y)};
+
+    // Units are somewhere between the lowest and highest terrain, or at 0 without any
+    const auto *height_field = registry.ctx().find<const TerrainHeightField>();
+    const auto low =
+        std::min(height_field != nullptr ? height_field->get_min_height() : 0.f, 0.f) - unit_height_margin;
+    const auto high =
+        std::max(height_field != nullptr ? height_field->get_max_height() : 0.f, 0.f) + unit_height_margin;
+
+    // NOTE: The depths at which the cross section of the frustum overlaps the height slab form one interval, its ends
+    // are where a corner ray crosses one of the slab planes or the depth limits
+    const auto overlaps_slab = [&](const float depth) {
+        auto lowest = std::numeric_limits<float>::infinity();
+        auto highest = -std::numeric_limits<float>::infinity();
+        for (const auto &direction : corners) {
+            const auto y = camera.position.y + depth * direction.y;
+            lowest = std::min(lowest, y);
+            highest = std::max(highest, y);
+        }
+        // NOTE: The breakpoints lie exactly on a slab plane, the tolerance keeps rounding from rejecting them
+        return lowest <= high + slab_tolerance && highest >= low - slab_tolerance;
+    };
+    auto first_depth = std::numeric_limits<float>::infinity();
+    auto last_depth = -std::numeric_limits<float>::infinity();
+    const auto try_depth = [&](const float depth) {
+        if (depth >= 0.f && depth <= max_select_distance && overlaps_slab(depth)) {
+            first_depth = std::min(first_depth, depth);
+            last_depth = std::max(last_depth, depth);
+        }
+    };
+    try_depth(0.f);
+    try_depth(max_select_distance);
+    for (const auto &direction : corners) {
+        if (direction.y != 0.f) {
+            try_depth((low - camera.position.y) / direction.y);
+            try_depth((high - camera.position.y) / direction.y);
+        }
+    }
+    if (first_depth > last_depth) {
+        return {};
+    }
+
+    auto area_min = Vector2{std::numeric_limits<float>::infinity(), std::numeric_limits<float>::infinity()};
+    auto area_max = Vector2{-std::numeric_limits<float>::infinity(), -std::numeric_limits<float>::infinity()};
+    for (const auto depth : {first_depth, last_depth}) {
+        for (const auto &direction : corners) {
+            const auto point = Vector3Add(camera.position, Vector3Scale(direction, depth));
+            area_min = Vector2{std::min(area_min.x, point.x), std::min(area_min.y, point.z)};
+            area_max = Vector2{std::max(area_max.x, point.x), std::max(area_max.y, point.z)};
+        }
+    }
+
+    auto candidates = std::vector<entt::entity>{};
+    auto xs = std::vector<float>{};
+    auto ys = std::vector<float>{};
+    auto zs = std::vector<float>{};
+    registry.ctx().get<const SpatialGrid>().for_each_in_aabb(area_min, area_max, [&](const SpatialGridEntry &entry) {
+        candidates.push_back(entry.entity);
+        xs.push_back(entry.position.x - camera.position.x);
+        ys.push_back(entry.position.y - camera.position.y);
+        zs.push_back(entry.position.z - camera.position.z);
+    });
+
+    // NOTE: Branchless so the projection of every candidate vectorizes
+    auto inside = std::vector<std::uint8_t>(candidates.size());
+    for (auto i = 0u; i < candidates.size(); i++) {
+        const auto depth = xs[i] * forward.x + ys[i] * forward.y + zs[i] * forward.z;
+        const auto x = xs[i] * right.x + ys[i] * right.y + zs[i] * right.z;
+        const auto y = xs[i] * up.x + ys[i] * up.y + zs[i] * up.z;
+        inside[i] = static_cast<std::uint8_t>((depth > 0.f) & (x >= depth * min_x) & (x <= depth * max_x) &
+                                              (y >= depth * min_y) & (y <= depth * max_y));
+    }
+
+    auto units = std::vector<std::uint32_t>{};
+    for (auto i = 0u; i < candidates.size(); i++) {
+        if (inside[i] == 0u || !registry.all_of<Minion>(candidates[i])) {
+            continue;
+        }
+        if (const auto *unit = registry.try_get<const UnitId>(candidates[i])) {
+            units.push_back(unit->value);
+        }
+    }
+    return units;
+}
+
+[[nodiscard]] static auto make_rectangle(const Vector2 a, const Vector2 b) -> Rectangle {
+    return Rectangle{std::min(a.x, b.x), std::min(a.y, b.y), std::abs(a.x - b.x), std::abs(a.y - b.y)};
+}
+
+auto get_drag_rectangle(const entt::registry &registry) -> std::optional<Rectangle> {
+    const auto &state = registry.ctx().get<const SelectionState>();
+    const auto mouse = GetMousePosition();
+    if (!state.drag_start || !IsMouseButtonDown(MOUSE_LEFT_BUTTON) ||
+        Vector2Distance(*state.drag_start, mouse) < drag_threshold) {
+        return std::nullopt;
+    }
+    return make_rectangle(*state.drag_start, mouse);
+}
+
+void selection_from_input(entt::registry &registry) {
+    auto &state = registry.ctx().get<SelectionState>();
+    const auto mouse = GetMousePosition();
+    if (IsMouseButtonPressed(MOUSE_LEFT_BUTTON)) {
+        state.drag_start = mouse;
+    }
+    if (!state.drag_start || !IsMouseButtonReleased(MOUSE_LEFT_BUTTON)) {
+        return;
+    }
+
+    const auto start = *state.drag_start;
+    state.drag_start.reset();
+    const auto &camera = registry.get<const Camera>(registry.view<const Camera>().front()).camera3d;
+    const auto add = IsKeyDown(KEY_LEFT_SHIFT);
+    auto &commands = registry.ctx().get<CommandQueue>();
+
+    if (Vector2Distance(start, mouse) < drag_threshold) {
+        const auto hit =
+            registry.ctx().get<const SpatialGrid>().raycast(GetMouseRay(mouse, camera), max_select_distance);
+        if (hit && registry.all_of<Minion, UnitId>(hit->entity)) {
+            commands.push(SelectCommand{.units = {registry.get<const UnitId>(hit->entity).value}, .add = add});
+        }
+        return;
+    }
+
+    const auto screen_size = Vector2{static_cast<float>(GetScreenWidth()), static_cast<float>(GetScreenHeight())};
+    commands.push(
+        SelectCommand{.units = find_units_in_rect(registry, camera, make_rectangle(start, mouse), screen_size),
+                      .add = add});
+}
+
+} // namespace stratgame
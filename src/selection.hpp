@@ -0,0 +1,43 @@
+#pragma once
+#include <cstdint>
+#include <entt.hpp>
+#include <optional>
+#include <raylib.h>
+#include <span>
+#include <vector>
+
+namespace stratgame {
+
+// Lives in registry.ctx(). Selection changes are applied in bulk and only listed here, the game recolours the listed
+// units once per frame instead of reacting to every single Selected being added or removed.
+struct SelectionState {
+    std::vector<entt::entity> changed;      // Selected was added or removed since clear_selection_changes, once each
+    std::vector<std::uint8_t> is_changed;   // indexed by entt::to_entity
+    std::vector<std::uint8_t> is_requested; // scratch of apply_selection, indexed by entt::to_entity
+    std::vector<entt::entity> scratch;
+
+    std::optional<Vector2> drag_start; // screen position the left button went down at
+};
+
+// Screen space distance the mouse has to move before a left click turns into a drag box
+constexpr auto drag_threshold = 4.f;
+
+void setup_selection(entt::registry &registry);
+
+// Replaces the selection with entities, or adds them to it. Only the entities whose state changes are touched, the
+// Selected storage is updated with one bulk insert and erase.
+void apply_selection(entt::registry &registry, std::span<const entt::entity> entities, bool add);
+void clear_selection_changes(entt::registry &registry);
+
+// UnitId values of the minions whose position projects into rect. Candidates come from the SpatialGrid cells under
+// the part of the view frustum through rect that can hold units, then are projected in one pass.
+[[nodiscard]] auto find_units_in_rect(const entt::registry &registry, const Camera3D &camera, Rectangle rect,
+                                      Vector2 screen_size) -> std::vector<std::uint32_t>;
+
+// The box being dragged, nullopt unless the left button is held and has moved past drag_threshold
+[[nodiscard]] auto get_drag_rectangle(const entt::registry &registry) -> std::optional<Rectangle>;
+
+// Left click picks one minion, a left drag selects every minion inside the box. Pushes a SelectCommand either way.
+void selection_from_input(entt::registry &registry);
+
+} // namespace stratgame
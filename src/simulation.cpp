@@ -0,0 +1,186 @@
+#include "simulation.hpp"
+#include "avoidance.hpp"
+#include "commands.hpp"
+#include "common_components.hpp"
+#include "culling.hpp"
+#include "flow_field.hpp"
+#include "height_field.hpp"
+#include "minion.hpp"
+#include "pathfinding.hpp"
+#include "profiler.hpp"
+#include "replay.hpp"
+#include "selection.hpp"
+#include "spatial_grid.hpp"
+#include "systems.hpp"
+#include "tasks.hpp"
+#include "thread_pool.hpp"
+#include <algorithm>
+#include <cmath>
+
+namespace stratgame {
+
+auto FixedTimestep::consume(const float frame_time) -> int {
+    accumulator += frame_time;
+
+    const auto steps = static_cast<int>(std::floor(accumulator / step));
+    if (steps > max_steps_per_frame) {
+        accumulator = 0.f;
+        return max_steps_per_frame;
+    }
+
+    accumulator -= static_cast<float>(steps) * step;
+    return steps;
+}
+
+// NOTE: Order matters, of two systems touching the same data the earlier one runs first.
+// Tasks produce the velocities that avoidance adjusts and update_transform consumes in the same tick.
+constexpr static auto systems = std::array{
+    SimulationSystem{.name = "update_tasks",
+                     .update = &update_tasks,
+                     .declare_access = &system_access<TaskPools, TaskQueue, const Transform, Movement, FlowFieldCache,
+                                                      const SimulationTime>},
+    SimulationSystem{.name = "update_avoidance",
+                     .update = &update_avoidance,
+                     .declare_access = &system_access<AvoidanceGrid, Movement, const Transform, const GridIndexed,
+                                                      const TerrainHeightField, const SimulationTime>},
+    SimulationSystem{.name = "update_flow_fields",
+                     .update = &update_flow_fields,
+                     .declare_access = &system_access<FlowFieldCache, const SimulationTime>},
+    SimulationSystem{.name = "update_pathfinding",
+                     .update = &update_pathfinding,
+                     .declare_access = &system_access<HierarchicalPathfinder, const TerrainHeightField>},
+    SimulationSystem{.name = "update_transform",
+                     .update = &update_transform,
+                     .declare_access = &system_access<Movement, Transform, const TerrainHeightField>},
+    SimulationSystem{.name = "update_spatial_grid",
+                     .update = &update_spatial_grid,
+                     .declare_access =
+                         &system_access<SpatialGrid, const Movement, const Transform, const GridIndexed>},
+};
+static_assert(systems.size() <= max_simulation_systems);
+
+auto simulation_systems() -> std::span<const SimulationSystem> { return systems; }
+
+SystemGraph::SystemGraph(const std::span<const SimulationSystem> systems)
+    : systems(systems), dependents(systems.size()), dependency_counts(systems.size(), 0u),
+      waiting(std::make_unique<std::atomic<std::uint32_t>[]>(systems.size())) {
+    auto flow = entt::flow{};
+    for (auto i = 0u; i < systems.size(); i++) {
+        flow.bind(static_cast<entt::id_type>(i));
+        systems[i].declare_access(flow);
+    }
+
+    // NOTE: The graph is transitively reduced, a system only lists the ones that may start right after it
+    const auto graph = flow.graph();
+    for (const auto [from, to] : graph.edges()) {
+        dependents[from].push_back(to);
+        dependency_counts[to]++;
+    }
+}
+
+void SystemGraph::run(entt::registry &registry, ThreadPool &pool, SystemTimings *timings) {
+    profiler = registry.ctx().find<Profiler>();
+    remaining.store(systems.size());
+    auto first = systems.size();
+    for (auto i = 0u; i < systems.size(); i++) {
+        waiting[i].store(dependency_counts[i]);
+    }
+    for (auto i = 0u; i < systems.size(); i++) {
+        if (dependency_counts[i] != 0u) {
+            continue;
+        }
+        if (first == systems.size()) {
+            first = i;
+        } else {
+            pool.execute([this, i, &registry, &pool, timings] { run_from(i, registry, pool, timings); });
+        }
+    }
+    if (first != systems.size()) {
+        run_from(first, registry, pool, timings);
+    }
+
+    for (auto left = remaining.load(); left != 0u; left = remaining.load()) {
+        if (!pool.run_pending_task()) {
+            remaining.wait(left);
+        }
+    }
+}
+
+void SystemGraph::run_from(std::size_t system, entt::registry &registry, ThreadPool &pool, SystemTimings *timings) {
+    while (system != systems.size()) {
+        const auto start = std::chrono::steady_clock::now();
+        profile(profiler, systems[system].name, [&] { systems[system].update(registry); });
+        if (timings != nullptr) {
+            timings->elapsed[system] += std::chrono::steady_clock::now() - start;
+        }
+
+        // NOTE: The first dependent that becomes ready continues on this thread, the others go to the pool
+        auto next = systems.size();
+        for (const auto dependent : dependents[system]) {
+            if (waiting[dependent].fetch_sub(1u) != 1u) {
+                continue;
+            }
+            if (next == systems.size()) {
+                next = dependent;
+            } else {
+                pool.execute([this, dependent, &registry, &pool, timings] {
+                    run_from(dependent, registry, pool, timings);
+                });
+            }
+        }
+
+        if (remaining.fetch_sub(1u) == 1u) {
+            remaining.notify_all();
+        }
+        system = next;
+    }
+}
+
+void setup_simulation(entt::registry &registry, const float tick_rate) {
+    registry.ctx().emplace<SimulationTime>(SimulationTime{.delta_time = 1.f / tick_rate, .tick = 0u});
+    registry.ctx().emplace<ThreadPool>();
+    registry.ctx().emplace<SystemGraph>(systems);
+    // NOTE: Storages are created up front, systems running at the same time must not add one to the registry
+    static_cast<void>(registry.storage<Transform>());
+    static_cast<void>(registry.storage<Movement>());
+    static_cast<void>(registry.storage<TaskQueue>());
+    static_cast<void>(registry.storage<GridIndexed>());
+    registry.ctx().emplace<FlowFieldCache>();
+    setup_commands(registry);
+    setup_pathfinding(registry);
+    setup_tasks(registry);
+    setup_avoidance(registry);
+    setup_spatial_grid(registry);
+    setup_culling(registry);
+    setup_selection(registry);
+
+    // NOTE: Movement depends on Transform
+    registry.on_construct<stratgame::Movement>().connect<&entt::registry::get_or_emplace<stratgame::Transform>>();
+
+    // NOTE: Minions must have Transform, Movement, BaseStats, Selectable and GridIndexed. Units restored from a save
+    // game already have them when Minion is added.
+    registry.on_construct<stratgame::Minion>().connect<[](entt::registry &registry, entt::entity entity) {
+        static_cast<void>(registry.get_or_emplace<stratgame::Transform>(entity));
+        static_cast<void>(registry.get_or_emplace<stratgame::Movement>(entity));
+        static_cast<void>(registry.get_or_emplace<stratgame::BaseStats>(entity));
+        static_cast<void>(registry.get_or_emplace<stratgame::Selectable>(entity));
+        static_cast<void>(registry.get_or_emplace<stratgame::GridIndexed>(entity, 1.f));
+    }>();
+}
+
+void tick_simulation(entt::registry &registry, SystemTimings *timings) {
+    auto &time = registry.ctx().get<SimulationTime>();
+    time.tick++;
+
+    apply_commands(registry);
+    registry.ctx().get<SystemGraph>().run(registry, registry.ctx().get<ThreadPool>(), timings);
+    if (timings != nullptr) {
+        timings->ticks++;
+    }
+
+    if (auto *recorder = registry.ctx().find<ReplayRecorder>()) {
+        recorder->record_tick(registry);
+    }
+}
+
+} // namespace stratgame
@@ -0,0 +1,98 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <entt.hpp>
+#include <memory>
+#include <span>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+namespace stratgame {
+class Profiler;
+class ThreadPool;
+
+// ===================================
+// simulation clock
+// ===================================
+constexpr auto default_tick_rate = 60.f;
+
+// Lives in registry.ctx(); every simulation system reads its delta from here instead of GetFrameTime()
+struct SimulationTime {
+    float delta_time = 1.f / default_tick_rate;
+    std::uint64_t tick = 0u;
+};
+
+// Turns variable frame times into a whole number of fixed simulation ticks
+struct FixedTimestep {
+    float step = 1.f / default_tick_rate;
+    float accumulator = 0.f;
+    int max_steps_per_frame = 8; // drop time instead of spiralling when a frame takes too long
+
+    [[nodiscard]] auto consume(float frame_time) -> int;
+};
+
+// ===================================
+// systems
+// ===================================
+struct SimulationSystem {
+    std::string_view name;
+    void (*update)(entt::registry &registry);
+    void (*declare_access)(entt::flow &flow); // see system_access
+};
+
+// Declares the components and ctx variables a system touches, const types are only read
+template <typename... Type> void system_access(entt::flow &flow) {
+    ((std::is_const_v<Type> ? flow.ro(entt::type_hash<std::remove_const_t<Type>>::value())
+                            : flow.rw(entt::type_hash<Type>::value())),
+     ...);
+}
+
+[[nodiscard]] auto simulation_systems() -> std::span<const SimulationSystem>;
+
+constexpr auto max_simulation_systems = 16u;
+
+// Accumulated wall time per entry of simulation_systems()
+struct SystemTimings {
+    std::array<std::chrono::nanoseconds, max_simulation_systems> elapsed{};
+    std::uint64_t ticks = 0u;
+};
+
+// Dependency graph of a list of systems built from their declared accesses, lives in registry.ctx().
+// A system waits for the earlier systems writing what it touches, or reading what it writes; the rest run at the
+// same time on the ThreadPool.
+class SystemGraph {
+  public:
+    explicit SystemGraph(std::span<const SimulationSystem> systems);
+
+    // Runs every system once and returns when the last one finished, the calling thread helps out. Each system is a
+    // zone of the Profiler in registry.ctx() if there is one.
+    void run(entt::registry &registry, ThreadPool &pool, SystemTimings *timings = nullptr);
+
+    [[nodiscard]] auto get_dependents(std::size_t system) const -> std::span<const std::size_t> {
+        return dependents[system];
+    }
+
+  private:
+    std::span<const SimulationSystem> systems;
+    std::vector<std::vector<std::size_t>> dependents;
+    std::vector<std::uint32_t> dependency_counts;
+
+    // per run
+    std::unique_ptr<std::atomic<std::uint32_t>[]> waiting; // dependencies of each system that did not finish yet
+    std::atomic<std::size_t> remaining = 0u;
+    Profiler *profiler = nullptr;
+
+    void run_from(std::size_t system, entt::registry &registry, ThreadPool &pool, SystemTimings *timings);
+};
+
+// Connects the gameplay hooks that do not need a window or a GL context
+void setup_simulation(entt::registry &registry, float tick_rate = default_tick_rate);
+
+// Advances the simulation by exactly one SimulationTime::delta_time
+void tick_simulation(entt::registry &registry, SystemTimings *timings = nullptr);
+
+} // namespace stratgame
@@ -0,0 +1,220 @@
+#include "spatial_grid.hpp"
+#include "common_components.hpp"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <raymath.h>
+
+namespace stratgame {
+
+auto SpatialGrid::cell_coord(const float v) const -> std::int32_t {
+    return static_cast<std::int32_t>(std::floor(v * inv_cell_size));
+}
+
+auto SpatialGrid::make_key(const std::int32_t x, const std::int32_t z) -> cell_key {
+    return (static_cast<cell_key>(static_cast<std::uint32_t>(x)) << 32u) | static_cast<std::uint32_t>(z);
+}
+
+auto SpatialGrid::key_of(const Vector3 &position) const -> cell_key {
+    return make_key(cell_coord(position.x), cell_coord(position.z));
+}
+
+auto SpatialGrid::contains(const entt::entity entity) const -> bool {
+    const auto index = static_cast<std::size_t>(entt::to_entity(entity));
+    return index < entries.size() && entries[index].slot != invalid_slot;
+}
+
+void SpatialGrid::insert(const entt::entity entity, const Vector3 &position, const float radius) {
+    if (contains(entity)) {
+        remove(entity);
+    }
+
+    const auto index = static_cast<std::size_t>(entt::to_entity(entity));
+    if (index >= entries.size()) {
+        entries.resize(index + 1u, SpatialGridEntry{.entity = entt::null, .position = {}, .radius = 0.f, .cell = 0u,
+                                                    .slot = invalid_slot});
+    }
+
+    const auto key = key_of(position);
+    auto &bucket = cells[key];
+    bucket.push_back(entity);
+    entries[index] = SpatialGridEntry{.entity = entity,
+                                      .position = position,
+                                      .radius = radius,
+                                      .cell = key,
+                                      .slot = static_cast<std::uint32_t>(bucket.size() - 1u)};
+
+    max_radius = std::max(max_radius, radius);
+    count++;
+}
+
+void SpatialGrid::update(const entt::entity entity, const Vector3 &position) {
+    if (!contains(entity)) {
+        return;
+    }
+
+    auto &entry = entries[static_cast<std::size_t>(entt::to_entity(entity))];
+    entry.position = position;
+
+    const auto key = key_of(position);
+    if (key == entry.cell) {
+        return;
+    }
+
+    erase_from_cell(entry.cell, entry.slot);
+
+    auto &bucket = cells[key];
+    bucket.push_back(entity);
+    entry.cell = key;
+    entry.slot = static_cast<std::uint32_t>(bucket.size() - 1u);
+}
+
+void SpatialGrid::remove(const entt::entity entity) {
+    if (!contains(entity)) {
+        return;
+    }
+
+    auto &entry = entries[static_cast<std::size_t>(entt::to_entity(entity))];
+    erase_from_cell(entry.cell, entry.slot);
+    entry.slot = invalid_slot;
+    count--;
+}
+
+void SpatialGrid::clear() {
+    cells.clear();
+    entries.clear();
+    max_radius = 0.f;
+    count = 0u;
+}
+
+// swap-and-pop, the entity moved into the hole gets its slot patched
+void SpatialGrid::erase_from_cell(const cell_key key, const std::uint32_t slot) {
+    const auto it = cells.find(key);
+    auto &bucket = it->second;
+
+    if (slot + 1u != bucket.size()) {
+        bucket[slot] = bucket.back();
+        entries[static_cast<std::size_t>(entt::to_entity(bucket[slot]))].slot = slot;
+    }
+    bucket.pop_back();
+
+    if (bucket.empty()) {
+        cells.erase(it);
+    }
+}
+
+[[nodiscard]] static auto intersect_sphere(const Ray &ray, const Vector3 &center, const float radius)
+    -> std::optional<float> {
+    const auto to_center = Vector3Subtract(center, ray.position);
+    const auto b = Vector3DotProduct(to_center, ray.direction);
+    const auto c = Vector3DotProduct(to_center, to_center) - radius * radius;
+    const auto discriminant = b * b - c;
+    if (discriminant < 0.f) {
+        return std::nullopt;
+    }
+
+    const auto root = std::sqrt(discriminant);
+    const auto t = b - root >= 0.f ? b - root : b + root;
+    if (t < 0.f) {
+        return std::nullopt;
+    }
+    return t;
+}
+
+// 2D DDA over the xz projection of the ray. Spheres can overlap neighbouring cells, so every visited cell also checks
+// the ring of cells within max_radius. The walk stops once the next cell starts behind the closest hit found so far.
+auto SpatialGrid::raycast(const Ray &ray, const float max_distance) const -> std::optional<SpatialGridHit> {
+    if (count == 0u) {
+        return std::nullopt;
+    }
+
+    constexpr auto infinity = std::numeric_limits<float>::infinity();
+    const auto reach = static_cast<std::int32_t>(std::ceil(max_radius * inv_cell_size));
+
+    auto x = cell_coord(ray.position.x);
+    auto z = cell_coord(ray.position.z);
+
+    const auto step_x = ray.direction.x >= 0.f ? 1 : -1;
+    const auto step_z = ray.direction.z >= 0.f ? 1 : -1;
+    const auto t_delta_x = ray.direction.x != 0.f ? cell_size / std::abs(ray.direction.x) : infinity;
+    const auto t_delta_z = ray.direction.z != 0.f ? cell_size / std::abs(ray.direction.z) : infinity;
+
+    const auto boundary = [&](const std::int32_t cell, const int step, const float origin, const float dir) {
+        if (dir == 0.f) {
+            return infinity;
+        }
+        const auto edge = static_cast<float>(step > 0 ? cell + 1 : cell) * cell_size;
+        return (edge - origin) / dir;
+    };
+    auto t_max_x = boundary(x, step_x, ray.position.x, ray.direction.x);
+    auto t_max_z = boundary(z, step_z, ray.position.z, ray.direction.z);
+
+    auto best = std::optional<SpatialGridHit>{};
+    auto t = 0.f;
+
+    while (t <= max_distance && (!best || t <= best->distance)) {
+        for (auto cz = z - reach; cz <= z + reach; cz++) {
+            for (auto cx = x - reach; cx <= x + reach; cx++) {
+                const auto it = cells.find(make_key(cx, cz));
+                if (it == cells.end()) {
+                    continue;
+                }
+                for (const auto entity : it->second) {
+                    const auto &entry = entries[static_cast<std::size_t>(entt::to_entity(entity))];
+                    const auto distance = intersect_sphere(ray, entry.position, entry.radius);
+                    if (distance && *distance <= max_distance && (!best || *distance < best->distance)) {
+                        best = SpatialGridHit{.entity = entry.entity, .distance = *distance};
+                    }
+                }
+            }
+        }
+
+        if (t_max_x < t_max_z) {
+            t = t_max_x;
+            t_max_x += t_delta_x;
+            x += step_x;
+        } else {
+            t = t_max_z;
+            t_max_z += t_delta_z;
+            z += step_z;
+        }
+    }
+
+    return best;
+}
+
+void SpatialGrid::query_radius(const Vector2 &center, const float radius, std::vector<entt::entity> &out) const {
+    for_each_in_radius(center, radius, [&](const SpatialGridEntry &entry) { out.push_back(entry.entity); });
+}
+
+void SpatialGrid::query_aabb(const Vector2 &min, const Vector2 &max, std::vector<entt::entity> &out) const {
+    for_each_in_aabb(min, max, [&](const SpatialGridEntry &entry) { out.push_back(entry.entity); });
+}
+
+void setup_spatial_grid(entt::registry &registry, const float cell_size) {
+    registry.ctx().emplace<SpatialGrid>(cell_size);
+
+    // NOTE: GridIndexed requires Transform to already be present
+    registry.on_construct<GridIndexed>().connect<[](entt::registry &registry, entt::entity entity) {
+        const auto &[indexed, transform] = registry.get<const GridIndexed, const Transform>(entity);
+        registry.ctx().get<SpatialGrid>().insert(entity, transform.position, indexed.radius);
+    }>();
+
+    registry.on_destroy<GridIndexed>().connect<[](entt::registry &registry, entt::entity entity) {
+        registry.ctx().get<SpatialGrid>().remove(entity);
+    }>();
+
+    registry.on_update<Transform>().connect<[](entt::registry &registry, entt::entity entity) {
+        registry.ctx().get<SpatialGrid>().update(entity, registry.get<const Transform>(entity).position);
+    }>();
+}
+
+void update_spatial_grid(entt::registry &registry) {
+    auto &grid = registry.ctx().get<SpatialGrid>();
+    const auto view = registry.view<const Movement, const Transform, const GridIndexed>();
+    for (auto &&[entity, movement, transform, indexed] : view.each()) {
+        grid.update(entity, transform.position);
+    }
+}
+
+} // namespace stratgame
@@ -0,0 +1,114 @@
+#pragma once
+#include <cstdint>
+#include <entt.hpp>
+#include <optional>
+#include <raylib.h>
+#include <unordered_map>
+#include <vector>
+
+namespace stratgame {
+
+// Opt-in marker, entities with GridIndexed and Transform are kept in the SpatialGrid stored in registry.ctx()
+struct GridIndexed {
+    float radius{1.f};
+};
+
+struct SpatialGridEntry {
+    entt::entity entity;
+    Vector3 position;
+    float radius;
+    std::uint64_t cell;
+    std::uint32_t slot;
+};
+
+struct SpatialGridHit {
+    entt::entity entity;
+    float distance;
+};
+
+// Uniform grid over the xz plane, buckets are only allocated for occupied cells
+struct SpatialGrid {
+    using cell_key = std::uint64_t;
+
+    explicit SpatialGrid(float cell_size = 8.f) : cell_size(cell_size), inv_cell_size(1.f / cell_size) {}
+
+    void insert(entt::entity entity, const Vector3 &position, float radius);
+    void update(entt::entity entity, const Vector3 &position);
+    void remove(entt::entity entity);
+    void clear();
+
+    [[nodiscard]] auto contains(entt::entity entity) const -> bool;
+    [[nodiscard]] auto size() const -> std::size_t { return count; }
+
+    // Closest sphere hit along the ray
+    [[nodiscard]] auto raycast(const Ray &ray, float max_distance) const -> std::optional<SpatialGridHit>;
+    // Entities whose centers are within radius on the xz plane, appended to out
+    void query_radius(const Vector2 &center, float radius, std::vector<entt::entity> &out) const;
+    // Entities whose centers are inside the xz rectangle, appended to out
+    void query_aabb(const Vector2 &min, const Vector2 &max, std::vector<entt::entity> &out) const;
+
+    template <typename Func> void for_each_in_radius(const Vector2 &center, float radius, Func &&func) const {
+        for_each_cell(Vector2{center.x - radius, center.y - radius}, Vector2{center.x + radius, center.y + radius},
+                      [&](const SpatialGridEntry &entry) {
+                          const auto dx = entry.position.x - center.x;
+                          const auto dz = entry.position.z - center.y;
+                          if (dx * dx + dz * dz <= radius * radius) {
+                              func(entry);
+                          }
+                      });
+    }
+
+    template <typename Func> void for_each_in_aabb(const Vector2 &min, const Vector2 &max, Func &&func) const {
+        for_each_cell(min, max, [&](const SpatialGridEntry &entry) {
+            if (entry.position.x >= min.x && entry.position.x <= max.x && entry.position.z >= min.y &&
+                entry.position.z <= max.y) {
+                func(entry);
+            }
+        });
+    }
+
+    [[nodiscard]] auto get_cell_size() const -> float { return cell_size; }
+
+  private:
+    constexpr static auto invalid_slot = ~std::uint32_t{0};
+
+    float cell_size;
+    float inv_cell_size;
+    float max_radius = 0.f;
+    std::size_t count = 0u;
+
+    // NOTE: Buckets only hold entities, positions live in entries so same-cell moves never touch the hash map
+    std::unordered_map<cell_key, std::vector<entt::entity>> cells;
+    std::vector<SpatialGridEntry> entries; // indexed by entt::to_entity
+
+    [[nodiscard]] auto cell_coord(float v) const -> std::int32_t;
+    [[nodiscard]] static auto make_key(std::int32_t x, std::int32_t z) -> cell_key;
+    [[nodiscard]] auto key_of(const Vector3 &position) const -> cell_key;
+
+    void erase_from_cell(cell_key key, std::uint32_t slot);
+
+    template <typename Func> void for_each_cell(const Vector2 &min, const Vector2 &max, Func &&func) const {
+        const auto min_x = cell_coord(min.x);
+        const auto max_x = cell_coord(max.x);
+        const auto min_z = cell_coord(min.y);
+        const auto max_z = cell_coord(max.y);
+
+        for (auto z = min_z; z <= max_z; z++) {
+            for (auto x = min_x; x <= max_x; x++) {
+                const auto it = cells.find(make_key(x, z));
+                if (it == cells.end()) {
+                    continue;
+                }
+                for (const auto entity : it->second) {
+                    func(entries[static_cast<std::size_t>(entt::to_entity(entity))]);
+                }
+            }
+        }
+    }
+};
+
+void setup_spatial_grid(entt::registry &registry, float cell_size = 8.f);
+// Re-buckets moving entities, update_transform writes positions in place so it does not fire on_update<Transform>
+void update_spatial_grid(entt::registry &registry);
+
+} // namespace stratgame
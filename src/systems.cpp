@@ -2,27 +2,89 @@
 #include "camera.hpp"
 #include "common_components.hpp"
 #include "drawing.hpp"
+#include "height_field.hpp"
+#include "log.hpp"
 #include "minion.hpp"
+#include "selection.hpp"
 #include "tasks.hpp"
 #include "terrain.hpp"
-#include <print>
+#include "thread_pool.hpp"
+#include <array>
+#include <span>
 #include <raylib.h>
 #include <raymath.h>
 #include "common.hpp"
 
 namespace stratgame {
+constexpr static auto transform_chunk_size = std::size_t{4096};
+constexpr static auto ground_snap_block = std::size_t{256};
+
 void update_transform(entt::registry &registry) {
-    auto view = registry.view<Movement, Transform>();
-    for (auto&& [entity, movement, transform] : view.each()) {
-        transform.position = Vector3Add(transform.position, movement.velocity);
-        movement.velocity = {0.,0.,0.};
-    }
+    auto &movements = registry.storage<Movement>();
+    auto &transforms = registry.storage<Transform>();
+    const auto *height_field = registry.ctx().find<const TerrainHeightField>();
+
+    // NOTE: Chunks of the Movement storage run in parallel, each one only writes its own entities
+    registry.ctx().get<ThreadPool>().parallel_for_chunks(
+        movements.size(), transform_chunk_size, [&](const std::size_t begin, const std::size_t end) {
+            const auto *entities = movements.data();
+
+            // NOTE: Units that moved are put back on the ground with one batched height query per block
+            auto moved = std::array<Transform *, ground_snap_block>{};
+            auto xs = std::array<float, ground_snap_block>{};
+            auto zs = std::array<float, ground_snap_block>{};
+            auto heights = std::array<float, ground_snap_block>{};
+            auto moved_count = std::size_t{0};
+            const auto snap_to_ground = [&] {
+                for (auto i = 0u; i < moved_count; i++) {
+                    heights[i] = moved[i]->position.y - unit_ground_offset;
+                }
+                height_field->get_heights(std::span{xs.data(), moved_count}, std::span{zs.data(), moved_count},
+                                          std::span{heights.data(), moved_count});
+                for (auto i = 0u; i < moved_count; i++) {
+                    moved[i]->position.y = heights[i] + unit_ground_offset;
+                }
+                moved_count = 0u;
+            };
+
+            for (auto i = begin; i < end; i++) {
+                if (!transforms.contains(entities[i])) {
+                    continue;
+                }
+                auto &movement = movements.get(entities[i]);
+                auto &transform = transforms.get(entities[i]);
+                const auto is_moving = movement.velocity.x != 0.f || movement.velocity.z != 0.f;
+                transform.position = Vector3Add(transform.position, movement.velocity);
+                movement.velocity = {0., 0., 0.};
+
+                if (height_field != nullptr && is_moving) {
+                    moved[moved_count] = &transform;
+                    xs[moved_count] = transform.position.x;
+                    zs[moved_count] = transform.position.z;
+                    if (++moved_count == ground_snap_block) {
+                        snap_to_ground();
+                    }
+                }
+            }
+            if (moved_count != 0u) {
+                snap_to_ground();
+            }
+        });
 }
 
-void update_context(entt::registry &registry) {}
+void update_context(entt::registry &registry) {
+    if (!IsWindowReady()) {
+        return;
+    }
+
+    for (auto &&[entity, camera] : registry.view<Camera>().each()) {
+        camera.aspect_ratio = get_aspect_ratio();
+    }
+}
 
 void handle_input(entt::registry &registry) {
     handle_mouse_input(registry);
+    selection_from_input(registry);
     handle_camera_input(registry);
     tasks_from_input(registry);
 }
@@ -37,48 +99,13 @@ void handle_mouse_input(entt::registry &registry) {
     const auto terrain_entity = registry.view<TerrainClick>().begin()[0];
     const auto mouse_pos = GetMousePosition();
     const auto mouse_to_model_ray = GetMouseRay(mouse_pos, camera.camera3d);
-    const auto model_entities = registry.view<ModelComponent, Transform>();
-
-    for (auto &&[entity, model_component, transform] : model_entities.each()) {
-        if (!model_component.visible) {
-            continue;
-        }
-
-        const auto hit =
-            GetRayCollisionMesh(mouse_to_model_ray, model_component.model.meshes[0],
-                                MatrixTranslate(transform.position.x, transform.position.y, transform.position.z));
-        if (hit.hit) {
-            std::println("hit model at {}, {}, {}", hit.point.x, hit.point.y, hit.point.z);
-            registry.patch<TerrainClick>(
-                terrain_entity, [&](TerrainClick &click) { click.position = std::optional{to_vec2(hit.point)}; });
-            break;
-        }
-    }
-
-    const auto minions = registry.view<Minion, ModelComponent, Transform>();
-    for (auto minion : minions) {
-        const auto &transform = registry.get<Transform>(minion);
-
-        const auto minion_hit = GetRayCollisionSphere(mouse_to_model_ray, transform.position, 1.f);
-
-        if (minion_hit.hit) {
-            auto selected_minions = registry.view<Selected>();
-            if (!IsKeyDown(KEY_LEFT_SHIFT)) {
-                for (auto selected_minion : selected_minions) {
-                    registry.erase<Selected>(selected_minion);
-                }
-            }
-            registry.emplace_or_replace<Selected>(minion);
-            break;
-            // registry.patch<Selectable>(minion, [&](Selectable &selectable) {
-            //     selectable.selected = !selectable.selected;
 
-            //     registry.patch<SelectedState>(registry.view<SelectedState>().begin()[0],
-            //                                   [&](SelectedState &selected) {
-            //                                       selected.selected_entities_count += selectable.selected ? 1 :
-            //                                       -1;
-            //                                   });
-            // });
+    constexpr auto max_pick_distance = 1000.f;
+    if (const auto *height_field = registry.ctx().find<const TerrainHeightField>()) {
+        if (const auto hit = height_field->raycast(mouse_to_model_ray, max_pick_distance)) {
+            log_debug("hit terrain at {}, {}, {}", hit->x, hit->y, hit->z);
+            registry.patch<TerrainClick>(terrain_entity,
+                                         [&](TerrainClick &click) { click.position = std::optional{to_vec2(*hit)}; });
         }
     }
 }
@@ -2,6 +2,7 @@
 #include <entt.hpp>
 
 namespace stratgame {
+// Applies Movement::velocity, units that moved are snapped onto the TerrainHeightField when there is one
 void update_transform(entt::registry &registry);
 void update_context(entt::registry &registry);
 
@@ -1,85 +1,385 @@
 #include "tasks.hpp"
+#include "commands.hpp"
 #include "common.hpp"
 #include "common_components.hpp"
+#include "height_field.hpp"
 #include "minion.hpp"
+#include "pathfinding.hpp"
+#include "simulation.hpp"
 #include "terrain.hpp"
+#include "thread_pool.hpp"
 #include <raymath.h>
-#include <print>
+#include <algorithm>
+#include <cmath>
+#include <utility>
+#include <vector>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define STRATGAME_TASKS_SSE2
+#endif
 
 namespace stratgame {
 
-void add_task(entt::registry &registry, const entt::entity entity, const Task &task) {
+void TaskPool<WalkToTask>::push(const entt::entity entity, WalkToTask task) {
+    entities.push_back(entity);
+    target_x.push_back(task.target.x);
+    target_z.push_back(task.target.y);
+    speeds.push_back(task.speed);
+    arrive_radii.push_back(task.arrive_radius);
+    routes.push_back(!task.waypoints.empty()      ? Route::Waypoints
+                     : task.flow_field.is_valid() ? Route::FlowField
+                                                  : Route::Straight);
+    flow_fields.push_back(task.flow_field);
+    waypoints.push_back(std::move(task.waypoints));
+    next_waypoints.push_back(task.next_waypoint);
+}
+
+void TaskPool<WalkToTask>::swap_remove(const std::uint32_t slot) {
+    const auto last = entities.size() - 1u;
+    entities[slot] = entities[last];
+    target_x[slot] = target_x[last];
+    target_z[slot] = target_z[last];
+    speeds[slot] = speeds[last];
+    arrive_radii[slot] = arrive_radii[last];
+    routes[slot] = routes[last];
+    flow_fields[slot] = flow_fields[last];
+    waypoints[slot] = std::move(waypoints[last]);
+    next_waypoints[slot] = next_waypoints[last];
+
+    entities.pop_back();
+    target_x.pop_back();
+    target_z.pop_back();
+    speeds.pop_back();
+    arrive_radii.pop_back();
+    routes.pop_back();
+    flow_fields.pop_back();
+    waypoints.pop_back();
+    next_waypoints.pop_back();
+}
+
+auto TaskPool<WalkToTask>::get_task(const std::uint32_t slot) const -> WalkToTask {
+    return WalkToTask{.target = Vector2{target_x[slot], target_z[slot]},
+                      .speed = speeds[slot],
+                      .flow_field = flow_fields[slot],
+                      .waypoints = waypoints[slot],
+                      .next_waypoint = next_waypoints[slot],
+                      .arrive_radius = arrive_radii[slot]};
+}
+
+void TaskPools::assign(const entt::entity entity, Task task) {
+    const auto index = static_cast<std::size_t>(entt::to_entity(entity));
+    if (index >= locations.size()) {
+        locations.resize(index + 1u, Location{.type = 0u, .slot = invalid_slot});
+    }
+    remove(entity);
+
+    const auto type = static_cast<std::uint32_t>(task.index());
+    std::visit(
+        [&]<typename T>(T &&current) {
+            auto &pool = get_pool<std::remove_cvref_t<T>>();
+            locations[index] = Location{.type = type, .slot = static_cast<std::uint32_t>(pool.size())};
+            pool.push(entity, std::forward<T>(current));
+        },
+        std::move(task));
+}
+
+void TaskPools::remove(const entt::entity entity) {
+    if (!contains(entity)) {
+        return;
+    }
+
+    auto &location = locations[static_cast<std::size_t>(entt::to_entity(entity))];
+    const auto [type, slot] = location;
+    location.slot = invalid_slot;
+    [&]<std::size_t... I>(std::index_sequence<I...>) {
+        ((type == I ? remove_from(std::get<I>(pools), slot) : void()), ...);
+    }(std::make_index_sequence<std::tuple_size_v<decltype(pools)>>{});
+}
+
+template <typename T> void TaskPools::remove_from(TaskPool<T> &pool, const std::uint32_t slot) {
+    pool.swap_remove(slot);
+    if (slot < pool.size()) {
+        locations[static_cast<std::size_t>(entt::to_entity(pool.entities[slot]))].slot = slot;
+    }
+}
+
+auto TaskPools::contains(const entt::entity entity) const -> bool {
+    const auto index = static_cast<std::size_t>(entt::to_entity(entity));
+    return index < locations.size() && locations[index].slot != invalid_slot;
+}
+
+auto TaskPools::size() const -> std::size_t {
+    return std::apply([](const auto &...pool) { return (pool.size() + ...); }, pools);
+}
+
+void setup_tasks(entt::registry &registry) {
+    registry.ctx().emplace<TaskPools>();
+
+    registry.on_destroy<TaskQueue>().connect<[](entt::registry &registry, const entt::entity entity) {
+        registry.ctx().get<TaskPools>().remove(entity);
+    }>();
+}
+
+void add_task(entt::registry &registry, const entt::entity entity, Task task) {
     if (!registry.all_of<TaskQueue>(entity)) {
         registry.emplace<TaskQueue>(entity);
     }
 
-    std::println("Adding task to entity");
+    registry.ctx().get<TaskPools>().assign(entity, std::move(task));
+}
 
-    registry.patch<TaskQueue>(entity, [&](TaskQueue &task_queue) { task_queue.set_new_task(task); });
+auto queue_task(entt::registry &registry, const entt::entity entity, Task task) -> bool {
+    auto &pools = registry.ctx().get<TaskPools>();
+    if (!pools.contains(entity)) {
+        add_task(registry, entity, std::move(task));
+        return true;
+    }
+
+    return registry.get<TaskQueue>(entity).append_task(std::move(task));
 }
 
-auto handle_walk_to_task(entt::registry &registry, entt::entity entity, const WalkToTask &task) -> TaskStatus {
-    const auto target = to_vec3(task.target);
-    const auto delta = GetFrameTime();
+// Branch free so it vectorizes, the loops it guards only run for the few blocks that need them
+template <typename T> [[nodiscard]] static auto any_set(const T *values, const std::size_t count) -> bool {
+    auto any = std::uint8_t{0};
+    for (auto i = std::size_t{0}; i < count; i++) {
+        any |= static_cast<std::uint8_t>(values[i]);
+    }
+    return any != 0u;
+}
+
+// Steers one unit towards an aim point, a zero vector when already on it
+static void steer_one(WalkToBatch &batch, const std::size_t i, const Vector2 aim, const float step,
+                      const float arrive_radius) {
+    const auto dx = aim.x - batch.x[i];
+    const auto dz = aim.y - batch.z[i];
+    const auto length = std::sqrt(dx * dx + dz * dz);
+    const auto scale = length > 0.f ? step / length : 0.f;
+    batch.distance[i] = length;
+    batch.velocity_x[i] = dx * scale;
+    batch.velocity_z[i] = dz * scale;
+    batch.arrived[i] = static_cast<std::uint8_t>(length < std::max(step, arrive_radius));
+}
 
-    const auto &transform = registry.get<Transform>(entity);
-    auto &movement = registry.get<Movement>(entity);
+// Straight line steering of the count units starting at first towards their targets
+static void steer(const TaskPool<WalkToTask> &pool, WalkToBatch &batch, const std::size_t first,
+                  const std::size_t count, const float delta) {
+    const auto *target_x = pool.target_x.data() + first;
+    const auto *target_z = pool.target_z.data() + first;
+    const auto *speeds = pool.speeds.data() + first;
+    const auto *arrive_radii = pool.arrive_radii.data() + first;
+    auto i = std::size_t{0};
 
-    const auto diff_to_target = Vector3Subtract(target, transform.position);
-    const auto diff_to_target2d = to_vec2(diff_to_target);
-    const auto direction = Vector2Normalize(diff_to_target2d);
-    const auto movement_delta_scalar = task.speed * delta;
-    const auto movement_delta = Vector2Scale(direction, movement_delta_scalar);
+#if defined(__AVX__)
+    const auto zero = _mm256_setzero_ps();
+    const auto delta8 = _mm256_set1_ps(delta);
+    for (; i + 8u <= count; i += 8u) {
+        const auto dx = _mm256_sub_ps(_mm256_loadu_ps(target_x + i), _mm256_loadu_ps(batch.x.data() + i));
+        const auto dz = _mm256_sub_ps(_mm256_loadu_ps(target_z + i), _mm256_loadu_ps(batch.z.data() + i));
+        const auto length = _mm256_sqrt_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dz, dz)));
+        const auto step = _mm256_mul_ps(_mm256_loadu_ps(speeds + i), delta8);
 
-    if (Vector2Length(diff_to_target2d) < movement_delta_scalar) {
-        std::println("Reached target!");
-        return TaskStatus::Finished;
+        // NOTE: The division by a zero length is masked out rather than branched around
+        const auto moving = _mm256_cmp_ps(length, zero, _CMP_GT_OQ);
+        const auto scale = _mm256_and_ps(moving, _mm256_div_ps(step, length));
+        _mm256_storeu_ps(batch.distance.data() + i, length);
+        _mm256_storeu_ps(batch.velocity_x.data() + i, _mm256_mul_ps(dx, scale));
+        _mm256_storeu_ps(batch.velocity_z.data() + i, _mm256_mul_ps(dz, scale));
+
+        const auto arrive = _mm256_max_ps(step, _mm256_loadu_ps(arrive_radii + i));
+        const auto mask = static_cast<unsigned>(_mm256_movemask_ps(_mm256_cmp_ps(length, arrive, _CMP_LT_OQ)));
+        for (auto lane = 0u; lane < 8u; lane++) {
+            batch.arrived[i + lane] = static_cast<std::uint8_t>((mask >> lane) & 1u);
+        }
     }
+#elif defined(STRATGAME_TASKS_SSE2)
+    const auto zero = _mm_setzero_ps();
+    const auto delta4 = _mm_set1_ps(delta);
+    for (; i + 4u <= count; i += 4u) {
+        const auto dx = _mm_sub_ps(_mm_loadu_ps(target_x + i), _mm_loadu_ps(batch.x.data() + i));
+        const auto dz = _mm_sub_ps(_mm_loadu_ps(target_z + i), _mm_loadu_ps(batch.z.data() + i));
+        const auto length = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dz, dz)));
+        const auto step = _mm_mul_ps(_mm_loadu_ps(speeds + i), delta4);
 
-    movement.velocity = to_vec3(movement_delta);
+        // NOTE: The division by a zero length is masked out rather than branched around
+        const auto moving = _mm_cmpgt_ps(length, zero);
+        const auto scale = _mm_and_ps(moving, _mm_div_ps(step, length));
+        _mm_storeu_ps(batch.distance.data() + i, length);
+        _mm_storeu_ps(batch.velocity_x.data() + i, _mm_mul_ps(dx, scale));
+        _mm_storeu_ps(batch.velocity_z.data() + i, _mm_mul_ps(dz, scale));
 
-    return TaskStatus::InProgress;
+        const auto arrive = _mm_max_ps(step, _mm_loadu_ps(arrive_radii + i));
+        const auto mask = static_cast<unsigned>(_mm_movemask_ps(_mm_cmplt_ps(length, arrive)));
+        for (auto lane = 0u; lane < 4u; lane++) {
+            batch.arrived[i + lane] = static_cast<std::uint8_t>((mask >> lane) & 1u);
+        }
+    }
+#endif
+
+    for (; i < count; i++) {
+        steer_one(batch, i, Vector2{target_x[i], target_z[i]}, speeds[i] * delta, arrive_radii[i]);
+    }
 }
 
-void update_tasks(entt::registry &registry) {
-    const auto minions = registry.view<stratgame::Minion, stratgame::Transform, stratgame::TaskQueue>();
+// NOTE: Waypoints within one step are passed this tick, the target itself is the last one
+static void follow_waypoints(TaskPool<WalkToTask> &pool, WalkToBatch &batch, const std::size_t slot,
+                             const std::size_t i, const float delta) {
+    const auto &waypoints = pool.waypoints[slot];
+    auto &next = pool.next_waypoints[slot];
+    const auto position = Vector2{batch.x[i], batch.z[i]};
+    const auto step = pool.speeds[slot] * delta;
+    while (next + 1u < waypoints.size() && Vector2Distance(waypoints[next], position) < step) {
+        next++;
+    }
+    if (next + 1u < waypoints.size()) {
+        steer_one(batch, i, waypoints[next], step, 0.f);
+        batch.arrived[i] = 0u;
+    }
+}
+
+// NOTE: The last stretch inside the target's neighbourhood is walked straight, the field only has 8 directions
+static void follow_flow_field(FlowFieldCache &flow_fields, const TaskPool<WalkToTask> &pool, WalkToBatch &batch,
+                              const std::size_t slot, const std::size_t i, const float delta,
+                              const std::uint64_t tick) {
+    const auto *field = flow_fields.use(pool.flow_fields[slot], tick);
+    if (field == nullptr || batch.distance[i] <= 1.5f * field->cell_size) {
+        return;
+    }
+
+    const auto flow = field->sample(Vector2{batch.x[i], batch.z[i]});
+    if (flow.x != 0.f || flow.y != 0.f) {
+        const auto step = pool.speeds[slot] * delta;
+        batch.velocity_x[i] = flow.x * step;
+        batch.velocity_z[i] = flow.y * step;
+    }
+}
+
+// Runs the slots in [begin, end) and appends the entities whose task finished this tick to finished.
+// NOTE: Only touches its own slots and their entities' Movement, chunks run on several threads at once
+static void update_walk_to_tasks(entt::registry &registry, TaskPool<WalkToTask> &pool, const std::size_t begin,
+                                 const std::size_t end, const float delta, std::vector<entt::entity> &finished) {
+    using Route = TaskPool<WalkToTask>::Route;
 
-    const auto delta = GetFrameTime();
+    const auto &transforms = registry.storage<Transform>();
+    auto &movements = registry.storage<Movement>();
+    auto *flow_fields = registry.ctx().find<FlowFieldCache>();
+    const auto tick = registry.ctx().get<const SimulationTime>().tick;
 
-    for (auto minion : minions) {
-        auto &task_queue = registry.get<TaskQueue>(minion);
+    auto batch = WalkToBatch{};
+    for (auto first = begin; first < end; first += WalkToBatch::capacity) {
+        const auto count = std::min(WalkToBatch::capacity, end - first);
+        const auto *entities = pool.entities.data() + first;
 
-        if (task_queue.is_empty()) {
-            continue;
+        for (auto i = 0u; i < count; i++) {
+            const auto &position = transforms.get(entities[i]).position;
+            batch.x[i] = position.x;
+            batch.z[i] = position.z;
         }
 
-        const auto &task = task_queue.get_current_task();
+        steer(pool, batch, first, count, delta);
 
-        TaskStatus status = TaskStatus::InProgress;
-        std::visit(
-            overloaded{
-                [&](const WalkToTask &task) { status = handle_walk_to_task(registry, minion, task); },
-            },
-            task);
+        // NOTE: Only units with a route need more than the straight line, most blocks have none
+        if (any_set(pool.routes.data() + first, count)) {
+            for (auto i = 0u; i < count; i++) {
+                const auto slot = first + i;
+                if (pool.routes[slot] == Route::Waypoints) {
+                    follow_waypoints(pool, batch, slot, i, delta);
+                } else if (pool.routes[slot] == Route::FlowField && flow_fields != nullptr) {
+                    follow_flow_field(*flow_fields, pool, batch, slot, i, delta, tick);
+                }
+            }
+        }
 
-        if (status == TaskStatus::Finished) {
-            task_queue.remove_task();
+        // NOTE: Units that arrived keep a zero velocity, their task is replaced once every block is done
+        for (auto i = 0u; i < count; i++) {
+            const auto keep = batch.arrived[i] != 0u ? 0.f : 1.f;
+            movements.get(entities[i]).velocity = Vector3{batch.velocity_x[i] * keep, 0.f, batch.velocity_z[i] * keep};
+        }
+        if (any_set(batch.arrived.data(), count)) {
+            for (auto i = 0u; i < count; i++) {
+                if (batch.arrived[i] != 0u) {
+                    finished.push_back(entities[i]);
+                }
+            }
         }
     }
 }
 
-void tasks_from_input(entt::registry &registry) {
-    const auto terrain_entity = registry.view<const stratgame::TerrainClick>().begin()[0];
-    const auto &terrain_click = registry.get<const stratgame::TerrainClick>(terrain_entity);
-    if (terrain_click.position) {
-        if (IsMouseButtonPressed(MOUSE_RIGHT_BUTTON)) {
-            auto selected_minions = registry.view<const stratgame::Minion, const stratgame::Selected>();
+void update_tasks(entt::registry &registry) {
+    auto &pools = registry.ctx().get<TaskPools>();
+    const auto delta = registry.ctx().get<const SimulationTime>().delta_time;
+
+    auto &walk_to = pools.get_pool<WalkToTask>();
+    constexpr auto chunk_size = WalkToBatch::capacity * WalkToBatch::blocks_per_chunk;
+    auto &finished = pools.finished;
+    finished.resize(std::max(finished.size(), (walk_to.size() + chunk_size - 1u) / chunk_size));
+    for (auto &entities : finished) {
+        entities.clear();
+    }
+
+    registry.ctx().get<ThreadPool>().parallel_for_chunks(
+        walk_to.size(), chunk_size, [&](const std::size_t begin, const std::size_t end) {
+            update_walk_to_tasks(registry, walk_to, begin, end, delta, finished[begin / chunk_size]);
+        });
 
-            for (auto minion : selected_minions) {
-                add_task(registry, minion, stratgame::WalkToTask{*terrain_click.position, 5.f});
+    // NOTE: Done after the batches in chunk order, replacing a task moves others around inside the pools
+    for (const auto &entities : finished) {
+        for (const auto entity : entities) {
+            if (auto next = registry.get<TaskQueue>(entity).pop_task()) {
+                pools.assign(entity, std::move(*next));
+            } else {
+                pools.remove(entity);
             }
         }
     }
 }
 
+constexpr static auto group_spacing = 1.2f; // radius a unit of a group takes up around the target
+
+void order_walk_to(entt::registry &registry, const Vector2 target) {
+    auto selected_minions = registry.view<const stratgame::Minion, const stratgame::Selected>();
+    if (selected_minions.begin() == selected_minions.end()) {
+        return;
+    }
+
+    const auto *height_field = registry.ctx().find<const TerrainHeightField>();
+
+    // NOTE: A single unit follows its own path, a group shares one flow field
+    if (std::next(selected_minions.begin()) == selected_minions.end()) {
+        const auto minion = *selected_minions.begin();
+        const auto position = to_vec2(registry.get<const Transform>(minion).position);
+        auto path = registry.ctx().get<HierarchicalPathfinder>().find_path(height_field, position, target);
+        add_task(registry, minion,
+                 stratgame::WalkToTask{
+                     .target = target, .speed = 5.f, .waypoints = std::move(path).value_or(std::vector<Vector2>{})});
+        return;
+    }
+
+    // NOTE: One field for the whole order, every selected minion samples the same one
+    auto positions = std::vector<Vector2>{};
+    for (auto minion : selected_minions) {
+        positions.push_back(to_vec2(registry.get<const Transform>(minion).position));
+    }
+    const auto flow_field = registry.ctx().get<FlowFieldCache>().request(
+        height_field, target, positions, registry.ctx().get<const SimulationTime>().tick);
+
+    // NOTE: Avoidance keeps the group from standing on one point, the units stop once in the area it covers
+    const auto arrive_radius = group_spacing * std::sqrt(static_cast<float>(positions.size()));
+    for (auto minion : selected_minions) {
+        add_task(registry, minion,
+                 stratgame::WalkToTask{
+                     .target = target, .speed = 5.f, .flow_field = flow_field, .arrive_radius = arrive_radius});
+    }
+}
+
+void tasks_from_input(entt::registry &registry) {
+    const auto terrain_entity = registry.view<const stratgame::TerrainClick>().begin()[0];
+    const auto &terrain_click = registry.get<const stratgame::TerrainClick>(terrain_entity);
+    if (terrain_click.position && IsMouseButtonPressed(MOUSE_RIGHT_BUTTON)) {
+        registry.ctx().get<CommandQueue>().push(MoveCommand{.target = *terrain_click.position});
+    }
+}
+
 } // namespace stratgame
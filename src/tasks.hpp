@@ -1,46 +1,178 @@
 #pragma once
 
 #include "common_components.hpp"
-#include <deque>
+#include "flow_field.hpp"
+#include <array>
+#include <cstdint>
 #include <entt.hpp>
+#include <optional>
 #include <raylib.h>
+#include <tuple>
 #include <variant>
+#include <vector>
 
 namespace stratgame {
-enum class TaskStatus { InProgress, Finished };
-
 struct WalkToTask {
     Vector2 target;
     float speed;
+    FlowFieldId flow_field{}; // shared by the whole order, walks straight to the target without one
+
+    // Path of a single unit, followed instead of the flow field when set. The last waypoint is target.
+    std::vector<Vector2> waypoints{};
+    std::uint32_t next_waypoint = 0u;
+
+    float arrive_radius = 0.f; // done within this distance of target, a group spreads out around it
 };
 
 using Task = std::variant<WalkToTask>;
 
-[[nodiscard]] auto handle_walk_to_task(entt::registry &registry, entt::entity entity, const WalkToTask &task)
-    -> TaskStatus;
-
+// Tasks queued behind the current one, stored inline. The current task itself lives in TaskPools.
 struct TaskQueue {
-    void append_task(Task task) { m_tasks.push_front(task); }
-    void remove_task() { m_tasks.pop_front(); }
-    void clear_tasks() { m_tasks.clear(); }
-    void set_new_task(Task task) {
-        if (!m_tasks.empty()) {
-            m_tasks[0] = task;
-            return;
+    constexpr static std::uint32_t capacity = 4u;
+
+    // false when the queue is full
+    [[nodiscard]] auto append_task(Task task) -> bool {
+        if (m_count == capacity) {
+            return false;
+        }
+        m_tasks[(m_head + m_count) % capacity] = std::move(task);
+        m_count++;
+        return true;
+    }
+    [[nodiscard]] auto pop_task() -> std::optional<Task> {
+        if (m_count == 0u) {
+            return std::nullopt;
         }
-        m_tasks.push_front(task);
+        auto task = std::move(m_tasks[m_head]);
+        m_head = (m_head + 1u) % capacity;
+        m_count--;
+        return task;
+    }
+    void clear_tasks() {
+        m_head = 0u;
+        m_count = 0u;
+    }
+
+    [[nodiscard]] auto size() const -> std::uint32_t { return m_count; }
+    [[nodiscard]] auto is_empty() const -> bool { return m_count == 0u; }
+
+  private:
+    std::array<Task, capacity> m_tasks{};
+    std::uint8_t m_head = 0u;
+    std::uint8_t m_count = 0u;
+};
+
+// Current tasks of one type, packed. Entities are in the same order as tasks.
+template <typename T> struct TaskPool {
+    std::vector<entt::entity> entities;
+    std::vector<T> tasks;
+
+    [[nodiscard]] auto size() const -> std::size_t { return entities.size(); }
+    [[nodiscard]] auto get_task(std::uint32_t slot) const -> T { return tasks[slot]; }
+    void push(entt::entity entity, T task) {
+        entities.push_back(entity);
+        tasks.push_back(std::move(task));
+    }
+    // NOTE: The last task takes the free slot so the pool stays dense
+    void swap_remove(std::uint32_t slot) {
+        entities[slot] = entities.back();
+        tasks[slot] = std::move(tasks.back());
+        entities.pop_back();
+        tasks.pop_back();
     }
+};
+
+// WalkTo tasks split by how often each part is read: every tick needs the targets and speeds, only the tasks with a
+// route look at their flow field or waypoints
+template <> struct TaskPool<WalkToTask> {
+    enum class Route : std::uint8_t { Straight, FlowField, Waypoints };
+
+    std::vector<entt::entity> entities;
+    std::vector<float> target_x;
+    std::vector<float> target_z;
+    std::vector<float> speeds;
+    std::vector<float> arrive_radii;
+    std::vector<Route> routes;
+    std::vector<FlowFieldId> flow_fields;
+    std::vector<std::vector<Vector2>> waypoints;
+    std::vector<std::uint32_t> next_waypoints;
+
+    [[nodiscard]] auto size() const -> std::size_t { return entities.size(); }
+    void push(entt::entity entity, WalkToTask task);
+    void swap_remove(std::uint32_t slot);
+    [[nodiscard]] auto get_task(std::uint32_t slot) const -> WalkToTask;
+};
+
+// Working set of one block of WalkTo tasks, structure of arrays so the steering loop vectorizes.
+// NOTE: Small enough to stay in L1 while every pass runs over it
+struct WalkToBatch {
+    constexpr static std::size_t capacity = 256u;
+    constexpr static std::size_t blocks_per_chunk = 16u; // blocks handed to one thread at a time
+
+    std::array<float, capacity> x;
+    std::array<float, capacity> z;
+    std::array<float, capacity> distance; // to the current aim point
+    std::array<float, capacity> velocity_x;
+    std::array<float, capacity> velocity_z;
+    std::array<std::uint8_t, capacity> arrived;
+};
 
-    [[nodiscard]] auto get_tasks() const -> const std::deque<Task> & { return m_tasks; }
-    [[nodiscard]] auto get_current_task() const -> const Task & { return m_tasks[0]; }
-    [[nodiscard]] auto is_empty() const -> bool { return m_tasks.empty(); }
+// The current task of every entity with a TaskQueue, one dense pool per Task alternative so each type is run as one
+// batch. Lives in registry.ctx() and drops an entity when its TaskQueue is destroyed.
+class TaskPools {
+  public:
+    // Replaces the current task of entity
+    void assign(entt::entity entity, Task task);
+    void remove(entt::entity entity);
+
+    [[nodiscard]] auto contains(entt::entity entity) const -> bool;
+    [[nodiscard]] auto size() const -> std::size_t;
+    // Calls func(entity, task) with a copy of every current task, pool by pool in slot order
+    template <typename Func> void for_each_task(Func &&func) const {
+        std::apply(
+            [&](const auto &...pool) {
+                const auto visit = [&]<typename T>(const TaskPool<T> &tasks) {
+                    for (auto slot = 0u; slot < tasks.size(); slot++) {
+                        func(tasks.entities[slot], Task{std::in_place_type<T>, tasks.get_task(slot)});
+                    }
+                };
+                (visit(pool), ...);
+            },
+            pools);
+    }
+
+    template <typename T> [[nodiscard]] auto get_pool() -> TaskPool<T> & { return std::get<TaskPool<T>>(pools); }
+    template <typename T> [[nodiscard]] auto get_pool() const -> const TaskPool<T> & {
+        return std::get<TaskPool<T>>(pools);
+    }
+
+    // scratch for update_tasks, entities whose task finished per chunk of blocks
+    std::vector<std::vector<entt::entity>> finished;
 
   private:
-    std::deque<Task> m_tasks;
+    struct Location {
+        std::uint32_t type; // Task::index()
+        std::uint32_t slot;
+    };
+    constexpr static auto invalid_slot = ~std::uint32_t{0};
+
+    std::tuple<TaskPool<WalkToTask>> pools; // same order as the Task alternatives
+    std::vector<Location> locations;        // indexed by entt::to_entity
+
+    template <typename T> void remove_from(TaskPool<T> &pool, std::uint32_t slot);
 };
 
-void add_task(entt::registry &registry, const entt::entity entity, const Task &task);
+void setup_tasks(entt::registry &registry);
+
+// Replaces the current task of entity, the queued ones stay. Entities with tasks need Transform and Movement.
+void add_task(entt::registry &registry, entt::entity entity, Task task);
+// Queues task to run after the current one, starts it right away when there is none. false when the queue is full.
+auto queue_task(entt::registry &registry, entt::entity entity, Task task) -> bool;
+// Runs every pool as one batch split into chunks on the ThreadPool, finished tasks are replaced by the next queued one
 void update_tasks(entt::registry &registry);
+// Walks every selected minion to target, applied by MoveCommand
+void order_walk_to(entt::registry &registry, Vector2 target);
+// Turns a right click on the terrain into a MoveCommand
 void tasks_from_input(entt::registry &registry);
 
 } // namespace stratgame
@@ -1,19 +1,156 @@
 #include "terrain.hpp"
 #include "common_components.hpp"
+#include "culling.hpp"
 #include "drawing.hpp"
-#include <SimplexNoise.h>
+#include "height_field.hpp"
+#include "log.hpp"
+#include <algorithm>
 #include <numbers>
-#include <print>
 #include <raymath.h>
 
 namespace stratgame {
 auto TerrainGenerator::generate_chunk(const std::int64_t x, const std::int64_t y) const -> Chunk {
-    const auto transform = Vector3{static_cast<float>(x * chunk_size), 0.f, static_cast<float>(y * chunk_size)};
-    auto mesh = generate_flat_chunk_mesh();
+    auto chunk = generate_chunk_data(x, y);
+    upload_chunk(chunk);
+    return chunk;
+}
+
+auto TerrainGenerator::generate_chunk_data(const std::int64_t x, const std::int64_t y) const -> Chunk {
+    if (cache) {
+        if (const auto cached = cache->load(x, y)) {
+            return Chunk{.model = Model{},
+                         .transform = get_chunk_transform(x, y),
+                         .x = x,
+                         .y = y,
+                         .heights = std::vector<float>(cached->heights.begin(), cached->heights.end())};
+        }
+    }
+
+    auto heights = generate_chunk_heights(x, y);
+    if (cache) {
+        // NOTE: The cache is best effort, a chunk that could not be written is simply generated again next time
+        [[maybe_unused]] const auto stored = cache->store(x, y, heights);
+    }
+
+    return Chunk{.model = Model{},
+                 .transform = get_chunk_transform(x, y),
+                 .x = x,
+                 .y = y,
+                 .heights = std::move(heights)};
+}
+
+auto TerrainGenerator::generate_chunks(ThreadPool &pool, std::span<const ChunkCoordinate> coordinates) const
+    -> std::vector<Chunk> {
+    auto chunks = std::vector<Chunk>(coordinates.size());
+    pool.parallel_for(coordinates.size(), [&](const std::size_t i) {
+        chunks[i] = generate_chunk_data(coordinates[i].x, coordinates[i].y);
+    });
+    return chunks;
+}
+
+// Quads of a node grid side past this are split into further patches, so every patch fits 16 bit indices
+constexpr static auto max_patch_quads = 128u;
+
+// Flat patch of the node grid starting at quad (first_column, first_row). Vertex positions are node grid coordinates
+// on the xz plane, terrain.vs scales them to the node and reads the heights.
+[[nodiscard]] static auto generate_grid_patch(const std::uint32_t first_column, const std::uint32_t first_row,
+                                              const std::uint32_t columns, const std::uint32_t rows) -> Mesh {
+    auto mesh = Mesh{};
+    const auto vertices_per_row = columns + 1u;
+    mesh.vertexCount = static_cast<int>(vertices_per_row * (rows + 1u));
+    mesh.triangleCount = static_cast<int>(columns * rows * 2u);
+    mesh.vertices = static_cast<float *>(MemAlloc(static_cast<unsigned int>(mesh.vertexCount * 3) * sizeof(float)));
+    mesh.indices = static_cast<unsigned short *>(
+        MemAlloc(static_cast<unsigned int>(mesh.triangleCount * 3) * sizeof(unsigned short)));
 
-    Model model = LoadModelFromMesh(mesh);
+    for (auto i = 0u; i <= rows; i++) {
+        for (auto j = 0u; j <= columns; j++) {
+            const auto index = i * vertices_per_row + j;
+            mesh.vertices[index * 3] = static_cast<float>(first_column + j);
+            mesh.vertices[index * 3 + 1] = 0.f;
+            mesh.vertices[index * 3 + 2] = static_cast<float>(first_row + i);
+        }
+    }
+
+    auto k = 0u;
+    for (auto i = 0u; i < rows; i++) {
+        for (auto j = 0u; j < columns; j++) {
+            mesh.indices[k] = static_cast<unsigned short>(i * vertices_per_row + j);
+            mesh.indices[k + 1] = static_cast<unsigned short>((i + 1) * vertices_per_row + j);
+            mesh.indices[k + 2] = static_cast<unsigned short>((i + 1) * vertices_per_row + (j + 1));
+            mesh.indices[k + 3] = static_cast<unsigned short>(i * vertices_per_row + j);
+            mesh.indices[k + 4] = static_cast<unsigned short>((i + 1) * vertices_per_row + (j + 1));
+            mesh.indices[k + 5] = static_cast<unsigned short>(i * vertices_per_row + (j + 1));
+            k += 6; // next quad
+        }
+    }
 
-    return Chunk{.model = model, .transform = transform};
+    return mesh;
+}
+
+void TerrainGenerator::upload_grid() {
+    // NOTE: Patches are ordered by quadrant, so a node can draw single quadrants of the grid
+    const auto quads = lod.get_node_quads();
+    const auto half = quads / 2u;
+    for (auto quadrant = 0u; quadrant < 4u; quadrant++) {
+        const auto first_column = (quadrant & 1u) * half;
+        const auto first_row = (quadrant >> 1u) * half;
+        const auto last_column = (quadrant & 1u) != 0u ? quads : half;
+        const auto last_row = (quadrant >> 1u) != 0u ? quads : half;
+        for (auto row = first_row; row < last_row; row += max_patch_quads) {
+            for (auto column = first_column; column < last_column; column += max_patch_quads) {
+                auto patch = generate_grid_patch(column, row, std::min(max_patch_quads, last_column - column),
+                                                 std::min(max_patch_quads, last_row - row));
+                UploadMesh(&patch, false);
+                grid.push_back(patch);
+            }
+        }
+    }
+}
+
+void TerrainGenerator::unload_grid() {
+    for (const auto &patch : grid) {
+        UnloadMesh(patch);
+    }
+    grid.clear();
+}
+
+void TerrainGenerator::upload_chunk(Chunk &chunk) const {
+    // NOTE: One float per grid vertex, terrain.vs fetches exact texels so neither filtering nor mipmaps are needed
+    const auto side = static_cast<int>(chunk_subdivions + 1u);
+    const auto heightmap = LoadTextureFromImage(Image{.data = chunk.heights.data(),
+                                                      .width = side,
+                                                      .height = side,
+                                                      .mipmaps = 1,
+                                                      .format = PIXELFORMAT_UNCOMPRESSED_R32});
+
+    // NOTE: Built by hand instead of LoadModelFromMesh, the model only borrows the grid
+    auto model = Model{};
+    model.transform = MatrixIdentity();
+    model.meshCount = static_cast<int>(grid.size());
+    model.meshes = static_cast<Mesh *>(MemAlloc(static_cast<unsigned int>(grid.size() * sizeof(Mesh))));
+    std::ranges::copy(grid, model.meshes);
+    model.meshMaterial = static_cast<int *>(MemAlloc(static_cast<unsigned int>(grid.size() * sizeof(int))));
+    model.materialCount = 1;
+    model.materials = static_cast<Material *>(MemAlloc(sizeof(Material)));
+    model.materials[0] = LoadMaterialDefault();
+    model.materials[0].shader = shader;
+    model.materials[0].maps[MATERIAL_MAP_DIFFUSE].texture = heightmap;
+    chunk.model = model;
+}
+
+void TerrainGenerator::enable_cache(const std::filesystem::path &root) {
+    cache.emplace(root, noise, chunk_size, chunk_subdivions, height_scale);
+}
+
+void unload_chunk_model(Model &model) {
+    // NOTE: What UnloadModel would do, minus unloading the shared grid meshes and terrain shader
+    UnloadTexture(model.materials[0].maps[MATERIAL_MAP_DIFFUSE].texture);
+    MemFree(model.materials[0].maps);
+    MemFree(model.materials);
+    MemFree(model.meshes);
+    MemFree(model.meshMaterial);
+    model = Model{};
 }
 
 auto TerrainGenerator::register_chunk(entt::registry &registry, const Chunk &chunk) const -> entt::entity {
@@ -21,56 +158,39 @@ auto TerrainGenerator::register_chunk(entt::registry &registry, const Chunk &chu
 
     registry.emplace<stratgame::ModelComponent>(entity, chunk.model);
     registry.emplace<stratgame::Transform>(entity, chunk.transform);
-    registry.emplace<stratgame::ShaderComponent>(entity, shader);
-    registry.emplace<stratgame::DrawModelWireframeComponent>(entity);
 
     const auto radius = static_cast<float>(chunk_size) * std::numbers::sqrt2_v<float> / 2.f;
     const auto offset = Vector2{static_cast<float>(chunk_size) / 2.f, static_cast<float>(chunk_size) / 2.f};
     registry.emplace<stratgame::FrustumCullingComponent>(
         entity, stratgame::FrustumCullingComponent{.radius = radius, .offset = offset});
 
-    std::println("Registered chunk at ({}, {})", chunk.transform.x, chunk.transform.z);
+    auto &height_field = registry.ctx().emplace<TerrainHeightField>(chunk_size, chunk_subdivions);
+    height_field.set_chunk(chunk.x, chunk.y, chunk.heights);
+    registry.emplace<TerrainChunk>(entity, chunk.x, chunk.y, static_cast<float>(chunk_size));
+
+    log_debug("Registered chunk at ({}, {})", chunk.transform.x, chunk.transform.z);
 
     return entity;
 }
 
-auto TerrainGenerator::generate_flat_chunk_mesh() const -> Mesh {
-    Mesh mesh{};
+auto TerrainGenerator::generate_chunk_heights(const std::int64_t x, const std::int64_t y) const
+    -> std::vector<float> {
+    const auto num_vertices_per_side = static_cast<std::size_t>(chunk_subdivions + 1u);
+    auto heights = std::vector<float>(num_vertices_per_side * num_vertices_per_side);
 
-    const auto num_vertices_per_side = chunk_subdivions + 1u;
+    // NOTE: Sampled in world space so the edges of neighbouring chunks line up
+    const auto origin = get_chunk_transform(x, y);
+    fractal_grid(noise, Vector2{origin.x, origin.z}, dist_between_vertices(), num_vertices_per_side,
+                 num_vertices_per_side, heights);
 
-    mesh.triangleCount = static_cast<int>((num_vertices_per_side - 1u) * (num_vertices_per_side - 1u) * 2u);
-    mesh.vertexCount = static_cast<int>(num_vertices_per_side * num_vertices_per_side);
-    mesh.vertices = static_cast<float *>(MemAlloc(static_cast<unsigned int>(mesh.vertexCount * 3) * sizeof(float)));
-    mesh.indices = static_cast<unsigned short *>(
-        MemAlloc(static_cast<unsigned int>(mesh.triangleCount * 3) * sizeof(unsigned short)));
-
-    for (auto i = 0lu; i < num_vertices_per_side; i++) {
-        for (auto j = 0lu; j < num_vertices_per_side; j++) {
-            const auto index = i * num_vertices_per_side + j;
-            mesh.vertices[index * 3] = static_cast<float>(j) * dist_between_vertices();
-            mesh.vertices[index * 3 + 1] = 0.f;
-            mesh.vertices[index * 3 + 2] = static_cast<float>(i) * dist_between_vertices();
-        }
-    }
-
-    auto k = 0u;
-
-    for (auto i = 0u; i < num_vertices_per_side - 1; i++) {
-        for (auto j = 0u; j < num_vertices_per_side - 1; j++) {
-            mesh.indices[k] = static_cast<unsigned short>(i * num_vertices_per_side + j);
-            mesh.indices[k + 1] = static_cast<unsigned short>((i + 1) * num_vertices_per_side + j);
-            mesh.indices[k + 2] = static_cast<unsigned short>((i + 1) * num_vertices_per_side + (j + 1));
-            mesh.indices[k + 3] = static_cast<unsigned short>(i * num_vertices_per_side + j);
-            mesh.indices[k + 4] = static_cast<unsigned short>((i + 1) * num_vertices_per_side + (j + 1));
-            mesh.indices[k + 5] = static_cast<unsigned short>(i * num_vertices_per_side + (j + 1));
-            k += 6; // next quad
-        }
+    for (auto &height : heights) {
+        height *= height_scale;
     }
+    return heights;
+}
 
-    UploadMesh(&mesh, false);
-
-    return mesh;
+auto TerrainGenerator::get_chunk_transform(const std::int64_t x, const std::int64_t y) const -> Vector3 {
+    return Vector3{static_cast<float>(x * chunk_size), 0.f, static_cast<float>(y * chunk_size)};
 }
 
 auto generate_terrain_shader(const Shader &terrain_shader, const float height_scale) -> Shader {
@@ -85,18 +205,27 @@ auto generate_terrain_shader(const Shader &terrain_shader, const float height_sc
     return terrain_shader;
 }
 
-[[nodiscard]] auto generate_terrain(entt::registry& registry, const uint32_t size, const int32_t chunk_half_subdivisions, SimplexNoise noise, Shader terrain_shader) -> TerrainGenerator {
-    const auto subdivisions = static_cast<uint32_t>(chunk_half_subdivisions * 2);
-    const auto chunk_size = size / subdivisions;
-    const auto terrain_generator = TerrainGenerator(noise, subdivisions, chunk_size, terrain_shader);
-
-    for(auto x = -chunk_half_subdivisions; x < chunk_half_subdivisions; x++) {
-        for(auto y = -chunk_half_subdivisions; y < chunk_half_subdivisions; y++) {
-            auto chunk = terrain_generator.generate_chunk(x, y);
-            auto chunk_entity = terrain_generator.register_chunk(registry, chunk);
+[[nodiscard]] auto generate_terrain(entt::registry &registry, const uint32_t size, const int32_t half_chunks,
+                                    const uint32_t chunk_subdivisions, const NoiseParameters noise,
+                                    const Shader terrain_shader, const float height_scale) -> TerrainGenerator {
+    const auto chunk_size = size / static_cast<uint32_t>(half_chunks * 2);
+    auto terrain_generator = TerrainGenerator(noise, chunk_subdivisions, chunk_size, terrain_shader, height_scale);
+    terrain_generator.upload_grid();
+
+    auto coordinates = std::vector<ChunkCoordinate>{};
+    for (auto x = -half_chunks; x < half_chunks; x++) {
+        for (auto y = -half_chunks; y < half_chunks; y++) {
+            coordinates.push_back(ChunkCoordinate{.x = x, .y = y});
         }
     }
 
+    // NOTE: Heights are generated on the pool, only the upload has to happen on the GL thread
+    auto chunks = terrain_generator.generate_chunks(registry.ctx().get<ThreadPool>(), coordinates);
+    for (auto &chunk : chunks) {
+        terrain_generator.upload_chunk(chunk);
+        terrain_generator.register_chunk(registry, chunk);
+    }
+
     return terrain_generator;
 }
 
@@ -1,39 +1,91 @@
 #pragma once
 
-#include <SimplexNoise.h>
+#include "chunk_cache.hpp"
+#include "noise.hpp"
+#include "terrain_lod.hpp"
+#include "thread_pool.hpp"
 #include <cstdint>
 #include <entt.hpp>
+#include <filesystem>
 #include <optional>
 #include <raylib.h>
+#include <span>
+#include <vector>
 
 namespace stratgame {
 struct Chunk {
-    Model model;
+    Model model; // empty until upload_chunk ran, its meshes are the generator's shared node grid
     Vector3 transform;
+    std::int64_t x;
+    std::int64_t y;
+    std::vector<float> heights;
+};
+
+// Releases the heightmap and material upload_chunk created, the shared grid and shader stay loaded
+void unload_chunk_model(Model &model);
+
+struct ChunkCoordinate {
+    std::int64_t x;
+    std::int64_t y;
+};
+
+// Marks the entity of a registered chunk, lets systems react to chunks coming and going
+struct TerrainChunk {
+    std::int64_t x;
+    std::int64_t y;
+    float size; // world units per side
 };
 
 struct TerrainGenerator {
   public:
-    TerrainGenerator(SimplexNoise noise, uint32_t chunk_subdivisions, uint32_t chunk_size, const Shader &shader)
-        : noise(noise), shader(shader), chunk_size(chunk_size), chunk_subdivions(chunk_subdivisions) {}
+    TerrainGenerator(NoiseParameters noise, uint32_t chunk_subdivisions, uint32_t chunk_size, const Shader &shader,
+                     float height_scale = 5.f)
+        : noise(noise), shader(shader), height_scale(height_scale), chunk_size(chunk_size),
+          chunk_subdivions(chunk_subdivisions),
+          lod(chunk_subdivisions, static_cast<float>(chunk_size) / static_cast<float>(chunk_subdivisions),
+              height_scale) {}
 
     [[nodiscard]] auto generate_chunk(const std::int64_t x, const std::int64_t y) const -> Chunk;
     auto register_chunk(entt::registry &registry, const Chunk &chunk) const -> entt::entity;
 
-    [[nodiscard]] auto get_noise() const -> const SimplexNoise & { return noise; }
+    // CPU side only, does not touch the GL context so these can run on worker threads or headless
+    [[nodiscard]] auto generate_chunk_heights(const std::int64_t x, const std::int64_t y) const -> std::vector<float>;
+    [[nodiscard]] auto generate_chunk_data(const std::int64_t x, const std::int64_t y) const -> Chunk;
+    [[nodiscard]] auto generate_chunks(ThreadPool &pool, std::span<const ChunkCoordinate> coordinates) const
+        -> std::vector<Chunk>;
+    [[nodiscard]] auto get_chunk_transform(const std::int64_t x, const std::int64_t y) const -> Vector3;
+
+    // GL thread only. Every node picked by the TerrainLod draws the same flat node grid, terrain.vs displaces it by the
+    // heightmap texture upload_chunk makes from the chunk heights. The grid is shared with every copy of the generator,
+    // so it has to be uploaded before the generator is copied and unloaded after the last chunk.
+    void upload_grid();
+    void unload_grid();
+    void upload_chunk(Chunk &chunk) const;
+
+    // Makes generate_chunk_data read chunks from and write them to a ChunkCache under root
+    void enable_cache(const std::filesystem::path &root);
+
+    [[nodiscard]] auto get_noise() const -> const NoiseParameters & { return noise; }
+    [[nodiscard]] auto get_height_scale() const -> float { return height_scale; }
+    [[nodiscard]] auto get_chunk_size() const -> uint32_t { return chunk_size; }
+    [[nodiscard]] auto get_chunk_subdivisions() const -> uint32_t { return chunk_subdivions; }
+    [[nodiscard]] auto get_lod() const -> const TerrainLod & { return lod; }
 
   private:
-    SimplexNoise noise;
+    NoiseParameters noise;
     Shader shader;
+    float height_scale; /// world units the [-1, 1] noise output is scaled to
 
     uint32_t chunk_size;       /// size of the chunk in world units
     uint32_t chunk_subdivions;
 
+    TerrainLod lod;
+    std::optional<ChunkCache> cache;
+    std::vector<Mesh> grid; // patches of the node grid ordered by quadrant, empty until upload_grid
+
     [[nodiscard]] constexpr auto dist_between_vertices() const -> float {
         return static_cast<float>(chunk_size) / static_cast<float>(chunk_subdivions);
     }
-
-    [[nodiscard]] auto generate_flat_chunk_mesh() const -> Mesh;
 };
 
 struct TerrainClick {
@@ -42,6 +94,10 @@ struct TerrainClick {
 
 [[nodiscard]] auto generate_terrain_shader(const Shader &terrain_shader, float height_scale) -> Shader;
 
-[[nodiscard]] auto generate_terrain(entt::registry& registry, const uint32_t size, const int32_t half_subdivisions, SimplexNoise noise, Shader terrain_shader) -> TerrainGenerator;
+// Generates (2 * half_chunks)^2 chunks of size / (2 * half_chunks) world units on the registry's ThreadPool, the
+// returned generator owns the uploaded grid
+[[nodiscard]] auto generate_terrain(entt::registry &registry, uint32_t size, int32_t half_chunks,
+                                    uint32_t chunk_subdivisions, NoiseParameters noise, Shader terrain_shader,
+                                    float height_scale) -> TerrainGenerator;
 
 }; // namespace stratgame
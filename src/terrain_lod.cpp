@@ -0,0 +1,92 @@
+#include "terrain_lod.hpp"
+#include "culling.hpp"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <raymath.h>
+
+namespace stratgame {
+
+TerrainLod::TerrainLod(const std::uint32_t chunk_subdivisions, const float vertex_spacing, const float height_scale,
+                       const float lod_distance)
+    : node_quads(chunk_subdivisions), levels(1u), vertex_spacing(vertex_spacing), min_height(-height_scale),
+      max_height(height_scale) {
+    // NOTE: Only halved while the result stays even, the quadrants of a node must line up with the texels
+    while (node_quads % 4u == 0u && node_quads / 2u >= min_node_quads) {
+        node_quads /= 2u;
+        levels++;
+    }
+
+    // NOTE: A node reaches at most its diagonal past the range it was picked in, its neighbours one level up must not
+    // have started morphing there yet. Ranges double per level and diagonals at most do, so checking level 0 is enough.
+    const auto node_size = static_cast<float>(node_quads) * vertex_spacing;
+    const auto height = max_height - min_height;
+    const auto diagonal = std::sqrt(2.f * node_size * node_size + height * height);
+    auto range = std::max(lod_distance, diagonal / (1.f - 2.f * morph_fraction));
+    for (auto level = 0u; level + 1u < levels; level++) {
+        ranges.push_back(range);
+        range *= 2.f;
+    }
+    ranges.push_back(std::numeric_limits<float>::infinity()); // the root is always drawn
+}
+
+auto TerrainLod::get_morph_range(const std::uint32_t level) const -> Vector2 {
+    if (level + 1u >= levels) {
+        // NOTE: Finite so the shader never divides by zero, but far enough that it never morphs
+        constexpr auto never = std::numeric_limits<float>::max() / 2.f;
+        return Vector2{never, 2.f * never};
+    }
+    return Vector2{ranges[level] * (1.f - morph_fraction), ranges[level]};
+}
+
+[[nodiscard]] static auto in_range(const Vector3 &min, const Vector3 &max, const Vector3 &position, const float range)
+    -> bool {
+    const auto closest = Vector3Clamp(position, min, max);
+    return Vector3DistanceSqr(closest, position) <= range * range;
+}
+
+void TerrainLod::select(const Vector3 chunk_origin, const Vector3 camera_position, const CullingFrustum &frustum,
+                        std::vector<TerrainNode> &nodes) const {
+    static_cast<void>(select_node(0u, 0u, levels - 1u, chunk_origin, camera_position, frustum, nodes));
+}
+
+// Returns false when the node is out of range of its level, its parent covers that quadrant itself then
+auto TerrainLod::select_node(const std::uint32_t x, const std::uint32_t y, const std::uint32_t level,
+                             const Vector3 chunk_origin, const Vector3 camera_position, const CullingFrustum &frustum,
+                             std::vector<TerrainNode> &nodes) const -> bool {
+    const auto texels = node_quads << level;
+    const auto min = Vector3{chunk_origin.x + static_cast<float>(x) * vertex_spacing, min_height,
+                             chunk_origin.z + static_cast<float>(y) * vertex_spacing};
+    const auto size = static_cast<float>(texels) * vertex_spacing;
+    const auto max = Vector3{min.x + size, max_height, min.z + size};
+
+    if (!in_range(min, max, camera_position, ranges[level])) {
+        return false;
+    }
+    const auto center = Vector3Scale(Vector3Add(min, max), 0.5f);
+    if (test_sphere(frustum, center, Vector3Distance(min, max) * 0.5f) == CullingResult::Outside) {
+        return true;
+    }
+
+    constexpr auto all_quadrants = std::uint8_t{0b1111u};
+    if (level == 0u || !in_range(min, max, camera_position, ranges[level - 1u])) {
+        nodes.push_back(TerrainNode{.x = x, .y = y, .level = level, .quadrants = all_quadrants});
+        return true;
+    }
+
+    const auto half = texels / 2u;
+    auto quadrants = std::uint8_t{0u};
+    for (auto quadrant = 0u; quadrant < 4u; quadrant++) {
+        const auto child_x = x + (quadrant & 1u) * half;
+        const auto child_y = y + (quadrant >> 1u) * half;
+        if (!select_node(child_x, child_y, level - 1u, chunk_origin, camera_position, frustum, nodes)) {
+            quadrants |= static_cast<std::uint8_t>(1u << quadrant);
+        }
+    }
+    if (quadrants != 0u) {
+        nodes.push_back(TerrainNode{.x = x, .y = y, .level = level, .quadrants = quadrants});
+    }
+    return true;
+}
+
+} // namespace stratgame
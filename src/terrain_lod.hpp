@@ -0,0 +1,54 @@
+#pragma once
+#include <cstdint>
+#include <raylib.h>
+#include <vector>
+
+namespace stratgame {
+struct CullingFrustum;
+
+// A part of a chunk picked by TerrainLod::select. Coordinates are in texels of the full resolution chunk heightmap.
+struct TerrainNode {
+    std::uint32_t x;
+    std::uint32_t y;
+    std::uint32_t level;    // 0 is full resolution, the node grid has a quad every 2^level texels
+    std::uint8_t quadrants; // bit x + 2y set when that quadrant of the node grid is drawn at this level
+};
+
+// CDLOD style level of detail. Each chunk is the root of a quadtree whose nodes are all drawn with the same node grid,
+// a level further down covers a quarter of the area with the same number of quads. A node is split while its children
+// are in range of their level, so the triangle count on screen depends on the distance ranges rather than on how far
+// the camera can see. Inside the last morph_fraction of its range a node morphs into its parent level in terrain.vs,
+// so switching levels does not pop.
+class TerrainLod {
+  public:
+    constexpr static auto min_node_quads = 16u;
+    constexpr static auto morph_fraction = 0.3f;
+
+    // lod_distance is the range of the full resolution level, 0 picks one that keeps neighbouring levels crack free
+    TerrainLod(std::uint32_t chunk_subdivisions, float vertex_spacing, float height_scale, float lod_distance = 0.f);
+
+    // Appends the nodes of the chunk at chunk_origin that are needed for camera_position, skipping the ones outside
+    // the frustum
+    void select(Vector3 chunk_origin, Vector3 camera_position, const CullingFrustum &frustum,
+                std::vector<TerrainNode> &nodes) const;
+
+    [[nodiscard]] auto get_levels() const -> std::uint32_t { return levels; }
+    [[nodiscard]] auto get_node_quads() const -> std::uint32_t { return node_quads; }
+    [[nodiscard]] auto get_vertex_spacing() const -> float { return vertex_spacing; }
+    // Camera distance at which nodes of level start and finish morphing into the level above, never for the root
+    [[nodiscard]] auto get_morph_range(std::uint32_t level) const -> Vector2;
+
+  private:
+    std::uint32_t node_quads; // quads per side of the node grid, even unless there is a single level
+    std::uint32_t levels;
+    float vertex_spacing;
+    float min_height;
+    float max_height;
+    std::vector<float> ranges; // per level, a node is only drawn at its level when it is closer than this
+
+    auto select_node(std::uint32_t x, std::uint32_t y, std::uint32_t level, Vector3 chunk_origin,
+                     Vector3 camera_position, const CullingFrustum &frustum, std::vector<TerrainNode> &nodes) const
+        -> bool;
+};
+
+} // namespace stratgame
@@ -0,0 +1,190 @@
+#include "terrain_streamer.hpp"
+#include "camera.hpp"
+#include "drawing.hpp"
+#include "height_field.hpp"
+#include "thread_pool.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <ranges>
+
+namespace stratgame {
+
+TerrainStreamer::TerrainStreamer(TerrainGenerator generator, TerrainStreamingSettings settings)
+    : generator(std::move(generator)), settings(settings) {
+    // NOTE: The LRU must at least hold every chunk in the load radius, otherwise wanted chunks would thrash
+    const auto reach = static_cast<std::size_t>(
+        std::ceil(settings.load_radius / static_cast<float>(this->generator.get_chunk_size())));
+    this->settings.max_resident_chunks = std::max(settings.max_resident_chunks, (2u * reach + 1u) * (2u * reach + 1u));
+}
+
+auto TerrainStreamer::make_key(const std::int64_t x, const std::int64_t y) -> chunk_key {
+    return (static_cast<std::uint64_t>(static_cast<std::uint32_t>(x)) << 32u) | static_cast<std::uint32_t>(y);
+}
+
+// Every chunk whose center lies within the load radius, nearest first
+void TerrainStreamer::collect_wanted(const Vector2 center) {
+    const auto size = static_cast<float>(generator.get_chunk_size());
+    const auto radius = settings.load_radius;
+
+    const auto min_x = static_cast<std::int64_t>(std::floor((center.x - radius) / size));
+    const auto max_x = static_cast<std::int64_t>(std::floor((center.x + radius) / size));
+    const auto min_y = static_cast<std::int64_t>(std::floor((center.y - radius) / size));
+    const auto max_y = static_cast<std::int64_t>(std::floor((center.y + radius) / size));
+
+    const auto distance_squared = [&](const ChunkCoordinate &coordinate) {
+        const auto dx = (static_cast<float>(coordinate.x) + 0.5f) * size - center.x;
+        const auto dy = (static_cast<float>(coordinate.y) + 0.5f) * size - center.y;
+        return dx * dx + dy * dy;
+    };
+
+    wanted.clear();
+    for (auto y = min_y; y <= max_y; y++) {
+        for (auto x = min_x; x <= max_x; x++) {
+            const auto coordinate = ChunkCoordinate{.x = x, .y = y};
+            if (distance_squared(coordinate) <= radius * radius) {
+                wanted.push_back(coordinate);
+            }
+        }
+    }
+
+    std::ranges::sort(wanted, {}, distance_squared);
+}
+
+void TerrainStreamer::request(entt::registry &registry) {
+    auto &pool = registry.ctx().get<ThreadPool>();
+
+    for (const auto &coordinate : wanted) {
+        if (pending.size() >= settings.max_in_flight) {
+            return;
+        }
+
+        const auto key = make_key(coordinate.x, coordinate.y);
+        if (resident.contains(key) || pending.contains(key)) {
+            continue;
+        }
+
+        // NOTE: The task gets its own copy of the generator, so it stays valid even if the streamer goes away
+        auto chunk = pool.submit([generator = generator, coordinate] {
+            return generator.generate_chunk_data(coordinate.x, coordinate.y);
+        });
+        pending.emplace(key, PendingChunk{.coordinate = coordinate, .chunk = std::move(chunk)});
+    }
+}
+
+void TerrainStreamer::receive(entt::registry &registry, std::size_t budget) {
+    for (auto it = pending.begin(); it != pending.end() && budget > 0u;) {
+        auto &[key, pending_chunk] = *it;
+        if (pending_chunk.chunk.wait_for(std::chrono::seconds{0}) != std::future_status::ready) {
+            ++it;
+            continue;
+        }
+
+        auto chunk = pending_chunk.chunk.get();
+        const auto still_wanted = std::ranges::any_of(wanted, [&](const ChunkCoordinate &coordinate) {
+            return coordinate.x == pending_chunk.coordinate.x && coordinate.y == pending_chunk.coordinate.y;
+        });
+
+        if (still_wanted) {
+            finish(registry, pending_chunk.coordinate, std::move(chunk));
+            budget--;
+        }
+        it = pending.erase(it);
+    }
+}
+
+void TerrainStreamer::finish(entt::registry &registry, const ChunkCoordinate &coordinate, Chunk chunk) {
+    if (settings.upload_chunks) {
+        generator.upload_chunk(chunk);
+    }
+
+    const auto key = make_key(coordinate.x, coordinate.y);
+    const auto entity = generator.register_chunk(registry, chunk);
+
+    lru.push_front(key);
+    resident.emplace(key, ResidentChunk{.entity = entity, .coordinate = coordinate, .lru_position = lru.begin()});
+    loaded++;
+}
+
+void TerrainStreamer::evict(entt::registry &registry) {
+    while (resident.size() > settings.max_resident_chunks) {
+        unload(registry, lru.back());
+    }
+}
+
+void TerrainStreamer::unload(entt::registry &registry, const chunk_key key) {
+    const auto it = resident.find(key);
+    const auto &chunk = it->second;
+
+    if (settings.upload_chunks) {
+        unload_chunk_model(registry.get<ModelComponent>(chunk.entity).model);
+    }
+    registry.ctx().get<TerrainHeightField>().remove_chunk(chunk.coordinate.x, chunk.coordinate.y);
+    registry.destroy(chunk.entity);
+
+    lru.erase(chunk.lru_position);
+    resident.erase(it);
+    evicted++;
+}
+
+void TerrainStreamer::update(entt::registry &registry, const Vector2 center) {
+    collect_wanted(center);
+
+    // NOTE: Wanted chunks move to the front, whatever has not been wanted for longest sits at the back
+    for (const auto &coordinate : wanted | std::views::reverse) {
+        if (const auto it = resident.find(make_key(coordinate.x, coordinate.y)); it != resident.end()) {
+            lru.splice(lru.begin(), lru, it->second.lru_position);
+        }
+    }
+
+    receive(registry, settings.max_uploads_per_frame);
+    request(registry);
+    evict(registry);
+}
+
+void TerrainStreamer::load_blocking(entt::registry &registry, const Vector2 center) {
+    collect_wanted(center);
+
+    // NOTE: Whatever is already in flight is waited on instead of being generated twice
+    for (auto &[key, pending_chunk] : pending) {
+        pending_chunk.chunk.wait();
+    }
+    receive(registry, pending.size());
+
+    auto missing = std::vector<ChunkCoordinate>{};
+    for (const auto &coordinate : wanted) {
+        if (!resident.contains(make_key(coordinate.x, coordinate.y))) {
+            missing.push_back(coordinate);
+        }
+    }
+
+    auto chunks = generator.generate_chunks(registry.ctx().get<ThreadPool>(), missing);
+    for (auto i = 0u; i < chunks.size(); i++) {
+        finish(registry, missing[i], std::move(chunks[i]));
+    }
+    evict(registry);
+}
+
+void TerrainStreamer::unload_all(entt::registry &registry) {
+    while (!lru.empty()) {
+        unload(registry, lru.back());
+    }
+}
+
+auto TerrainStreamer::get_stats() const -> TerrainStreamingStats {
+    return TerrainStreamingStats{
+        .resident = resident.size(), .in_flight = pending.size(), .loaded = loaded, .evicted = evicted};
+}
+
+void update_terrain_streaming(entt::registry &registry) {
+    auto *streamer = registry.ctx().find<TerrainStreamer>();
+    const auto cameras = registry.view<const Camera>();
+    if (streamer == nullptr || cameras.empty()) {
+        return;
+    }
+
+    const auto &camera = cameras.get<const Camera>(cameras.front());
+    streamer->update(registry, camera.target_position);
+}
+
+} // namespace stratgame
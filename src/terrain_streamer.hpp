@@ -0,0 +1,85 @@
+#pragma once
+#include "terrain.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <entt.hpp>
+#include <future>
+#include <list>
+#include <raylib.h>
+#include <unordered_map>
+#include <vector>
+
+namespace stratgame {
+
+struct TerrainStreamingSettings {
+    float load_radius = 384.f;              // chunks whose center is closer than this to the camera target are wanted
+    std::size_t max_resident_chunks = 96u;  // LRU capacity, raised to cover the load radius if needed
+    std::size_t max_uploads_per_frame = 2u; // generated chunks uploaded and registered per update
+    std::size_t max_in_flight = 8u;         // chunks generated on the ThreadPool at the same time
+    bool upload_chunks = true;              // false for headless runs without a GL context
+};
+
+struct TerrainStreamingStats {
+    std::size_t resident = 0u;
+    std::size_t in_flight = 0u;
+    std::size_t loaded = 0u;  // total since creation
+    std::size_t evicted = 0u; // total since creation
+};
+
+// Keeps the chunks around the camera target loaded, lives in registry.ctx().
+// Chunks are generated on the ThreadPool, uploaded within a per-frame budget and evicted least recently wanted first,
+// so the number of resident chunks stays bounded no matter how large the world is.
+class TerrainStreamer {
+  public:
+    TerrainStreamer(TerrainGenerator generator, TerrainStreamingSettings settings);
+    TerrainStreamer(const TerrainStreamer &) = delete;
+    TerrainStreamer(TerrainStreamer &&) = default;
+    auto operator=(const TerrainStreamer &) -> TerrainStreamer & = delete;
+    auto operator=(TerrainStreamer &&) -> TerrainStreamer & = default;
+
+    void update(entt::registry &registry, Vector2 center);
+    // Loads every chunk within the load radius before returning, for startup
+    void load_blocking(entt::registry &registry, Vector2 center);
+    void unload_all(entt::registry &registry);
+
+    [[nodiscard]] auto get_stats() const -> TerrainStreamingStats;
+    [[nodiscard]] auto get_generator() const -> const TerrainGenerator & { return generator; }
+    [[nodiscard]] auto get_settings() const -> const TerrainStreamingSettings & { return settings; }
+
+  private:
+    using chunk_key = std::uint64_t;
+
+    struct ResidentChunk {
+        entt::entity entity;
+        ChunkCoordinate coordinate;
+        std::list<chunk_key>::iterator lru_position;
+    };
+
+    struct PendingChunk {
+        ChunkCoordinate coordinate;
+        std::future<Chunk> chunk;
+    };
+
+    TerrainGenerator generator;
+    TerrainStreamingSettings settings;
+
+    std::unordered_map<chunk_key, ResidentChunk> resident;
+    std::unordered_map<chunk_key, PendingChunk> pending;
+    std::list<chunk_key> lru; // front is the most recently wanted chunk
+    std::vector<ChunkCoordinate> wanted;
+    std::size_t loaded = 0u;
+    std::size_t evicted = 0u;
+
+    [[nodiscard]] static auto make_key(std::int64_t x, std::int64_t y) -> chunk_key;
+    void collect_wanted(Vector2 center);
+    void request(entt::registry &registry);
+    void receive(entt::registry &registry, std::size_t budget);
+    void finish(entt::registry &registry, const ChunkCoordinate &coordinate, Chunk chunk);
+    void evict(entt::registry &registry);
+    void unload(entt::registry &registry, chunk_key key);
+};
+
+// Streams around the first Camera's target, no-op without a TerrainStreamer in registry.ctx()
+void update_terrain_streaming(entt::registry &registry);
+
+} // namespace stratgame
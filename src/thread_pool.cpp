@@ -0,0 +1,114 @@
+#include "thread_pool.hpp"
+
+namespace stratgame {
+
+// Index of the calling thread's queue in the pool it works for, so tasks it spawns stay local
+static thread_local const ThreadPool *current_pool = nullptr;
+static thread_local std::size_t current_queue = 0u;
+
+ThreadPool::ThreadPool(const std::size_t thread_count) {
+    queues.reserve(thread_count);
+    for (auto i = 0u; i < thread_count; i++) {
+        queues.push_back(std::make_unique<WorkerQueue>());
+    }
+
+    workers.reserve(thread_count);
+    for (auto i = 0u; i < thread_count; i++) {
+        workers.emplace_back([this, i] { worker_loop(i); });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        const auto lock = std::scoped_lock{sleep_mutex};
+        stopping = true;
+    }
+    wake.notify_all();
+
+    // NOTE: Joined here rather than by member destruction, the workers still need the mutex and the queues.
+    // Tasks that are already queued are drained first.
+    workers.clear();
+}
+
+auto ThreadPool::default_thread_count() -> std::size_t {
+    const auto hardware = static_cast<std::size_t>(std::thread::hardware_concurrency());
+    return std::max<std::size_t>(hardware, 2u) - 1u;
+}
+
+void ThreadPool::execute(std::function<void()> func) { enqueue(std::move(func)); }
+
+void ThreadPool::enqueue(std::function<void()> task) {
+    if (queues.empty()) {
+        task();
+        return;
+    }
+
+    // NOTE: Counted before it is queued, pending never drops below the number of tasks in the queues
+    {
+        const auto lock = std::scoped_lock{sleep_mutex};
+        pending++;
+    }
+    const auto index = current_pool == this ? current_queue : next_queue.fetch_add(1u) % queues.size();
+    {
+        const auto lock = std::scoped_lock{queues[index]->mutex};
+        queues[index]->tasks.push_back(std::move(task));
+    }
+    wake.notify_one();
+}
+
+auto ThreadPool::take_task(const std::size_t first_queue) -> std::function<void()> {
+    auto task = std::function<void()>{};
+    for (auto offset = 0u; offset < queues.size() && !task; offset++) {
+        const auto index = (first_queue + offset) % queues.size();
+        auto &queue = *queues[index];
+        const auto lock = std::scoped_lock{queue.mutex};
+        if (queue.tasks.empty()) {
+            continue;
+        }
+
+        // NOTE: Newest first from the own queue while it is still warm in cache, oldest first when stealing
+        const auto own = current_pool == this && index == current_queue;
+        if (own) {
+            task = std::move(queue.tasks.back());
+            queue.tasks.pop_back();
+        } else {
+            task = std::move(queue.tasks.front());
+            queue.tasks.pop_front();
+        }
+    }
+
+    if (task) {
+        const auto lock = std::scoped_lock{sleep_mutex};
+        pending--;
+    }
+    return task;
+}
+
+auto ThreadPool::run_pending_task() -> bool {
+    auto task = take_task(current_pool == this ? current_queue : 0u);
+    if (!task) {
+        return false;
+    }
+    task();
+    return true;
+}
+
+void ThreadPool::worker_loop(const std::size_t index) {
+    current_pool = this;
+    current_queue = index;
+
+    while (true) {
+        if (auto task = take_task(index)) {
+            task();
+            continue;
+        }
+
+        auto lock = std::unique_lock{sleep_mutex};
+        wake.wait(lock, [this] { return stopping || pending > 0u; });
+        if (stopping && pending == 0u) {
+            return;
+        }
+    }
+}
+
+} // namespace stratgame
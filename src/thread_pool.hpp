@@ -0,0 +1,117 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <future>
+#include <latch>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace stratgame {
+
+// Work stealing pool, every worker owns a queue and takes from the others once its own runs dry. Lives in
+// registry.ctx(). Any thread may submit, waiting threads run queued tasks so nested parallel_for calls cannot deadlock.
+class ThreadPool {
+  public:
+    // NOTE: Defaults to one thread less than the hardware has, the calling thread helps out in parallel_for
+    explicit ThreadPool(std::size_t thread_count = default_thread_count());
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool(ThreadPool &&) = delete;
+    auto operator=(const ThreadPool &) -> ThreadPool & = delete;
+    auto operator=(ThreadPool &&) -> ThreadPool & = delete;
+
+    template <typename Func> auto submit(Func &&func) -> std::future<std::invoke_result_t<Func>>;
+
+    // Fire and forget, func must not throw
+    void execute(std::function<void()> func);
+
+    // Calls func(i) for every i in [0, count) and blocks until all calls returned, func must not throw
+    template <typename Func> void parallel_for(std::size_t count, Func &&func);
+
+    // Calls func(begin, end) for consecutive ranges of at most chunk_size covering [0, count), func must not throw
+    template <typename Func> void parallel_for_chunks(std::size_t count, std::size_t chunk_size, Func &&func);
+
+    // Runs one queued task on the calling thread, false when every queue was empty
+    auto run_pending_task() -> bool;
+
+    [[nodiscard]] auto get_thread_count() const -> std::size_t { return workers.size(); }
+    [[nodiscard]] static auto default_thread_count() -> std::size_t;
+
+  private:
+    struct WorkerQueue {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks; // the owner works from the back, thieves take from the front
+    };
+
+    std::vector<std::unique_ptr<WorkerQueue>> queues; // one per worker
+    std::vector<std::jthread> workers;
+    std::atomic<std::size_t> next_queue = 0u; // round robin for tasks submitted from outside the pool
+
+    std::mutex sleep_mutex;
+    std::condition_variable wake;
+    std::size_t pending = 0u; // queued tasks, guarded by sleep_mutex
+    bool stopping = false;
+
+    void enqueue(std::function<void()> task);
+    [[nodiscard]] auto take_task(std::size_t first_queue) -> std::function<void()>;
+    void worker_loop(std::size_t index);
+};
+
+template <typename Func> auto ThreadPool::submit(Func &&func) -> std::future<std::invoke_result_t<Func>> {
+    using result_type = std::invoke_result_t<Func>;
+
+    // NOTE: std::function needs a copyable callable, so the packaged_task is shared
+    auto task = std::make_shared<std::packaged_task<result_type()>>(std::forward<Func>(func));
+    auto future = task->get_future();
+    enqueue([task] { (*task)(); });
+    return future;
+}
+
+template <typename Func> void ThreadPool::parallel_for(const std::size_t count, Func &&func) {
+    if (count == 0u) {
+        return;
+    }
+
+    auto next = std::atomic<std::size_t>{0u};
+    const auto run = [&] {
+        for (auto i = next.fetch_add(1u); i < count; i = next.fetch_add(1u)) {
+            func(i);
+        }
+    };
+
+    const auto helpers = std::min(workers.size(), count - 1u);
+    auto done = std::latch{static_cast<std::ptrdiff_t>(helpers)};
+    for (auto i = 0u; i < helpers; i++) {
+        enqueue([&] {
+            run();
+            done.count_down();
+        });
+    }
+
+    run();
+    // NOTE: Helpers still queued may sit behind this thread's own queue, once every queue is empty they have all
+    // started and blocking is safe
+    while (!done.try_wait()) {
+        if (!run_pending_task()) {
+            done.wait();
+        }
+    }
+}
+
+template <typename Func>
+void ThreadPool::parallel_for_chunks(const std::size_t count, const std::size_t chunk_size, Func &&func) {
+    const auto chunk = std::max<std::size_t>(chunk_size, 1u);
+    parallel_for((count + chunk - 1u) / chunk, [&](const std::size_t i) {
+        func(i * chunk, std::min(count, (i + 1u) * chunk));
+    });
+}
+
+} // namespace stratgame